@@ -2,11 +2,63 @@
 #include "FindTextHelper.h"
 #include "utils/cregexp.h"
 #include "utils/string_util.h"
+#include <string>
+#include <type_traits>
+
+#if defined(_UNICODE) && (defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__))
+#define FINDTEXT_SIMD 1
+#include <emmintrin.h>
+#endif
+
+#ifdef FINDTEXT_SIMD
+/**
+ * @brief Bit mask of the chars equal to @p ch among the 8 UTF-16 chars at @p p.
+ * Each char has two bits in the mask, as returned by _mm_movemask_epi8().
+ */
+static inline unsigned match_mask(const tchar_t *p, __m128i ch)
+{
+  const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+  return static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi16(v, ch)));
+}
+
+static inline unsigned bit_scan_forward(unsigned mask)
+{
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return index;
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+#endif
 
 static const tchar_t *memstr(const tchar_t *str1, size_t str1len, const tchar_t *str2, size_t str2len)
 {
   ASSERT(str1 && str2 && str2len > 0);
-  for (const tchar_t *p = str1; p < str1 + str1len; ++p)
+  if (str2len > str1len)
+    return nullptr;
+  const tchar_t *last = str1 + str1len - str2len;
+  const tchar_t *p = str1;
+#ifdef FINDTEXT_SIMD
+  static_assert(sizeof(tchar_t) == 2, "UTF-16 chars expected");
+  // Compare the first and the last char of str2 with 8 positions at once,
+  // and only compare the whole string where both match
+  const __m128i first = _mm_set1_epi16(static_cast<short>(str2[0]));
+  const __m128i lastch = _mm_set1_epi16(static_cast<short>(str2[str2len - 1]));
+  for (; p + 8 <= last + 1; p += 8)
+    {
+      unsigned mask = match_mask(p, first) & match_mask(p + str2len - 1, lastch);
+      while (mask != 0)
+        {
+          const unsigned i = bit_scan_forward(mask) / 2;
+          if (memcmp(p + i + 1, str2 + 1, (str2len - 1) * sizeof(tchar_t)) == 0)
+            return p + i;
+          mask &= ~(3U << (i * 2));
+        }
+    }
+#endif
+  for (; p <= last; ++p)
     {
       if (*p == *str2)
         {
@@ -19,26 +71,60 @@ static const tchar_t *memstr(const tchar_t *str1, size_t str1len, const tchar_t
 
 inline tchar_t mytoupper(tchar_t ch)
 {
-    return static_cast<tchar_t>(reinterpret_cast<uintptr_t>(CharUpper(reinterpret_cast<LPTSTR>(ch))));
+  // CharUpper() maps ASCII chars the same way, without the call
+  if (static_cast<std::make_unsigned_t<tchar_t>>(ch) < 0x80)
+    return (ch >= 'a' && ch <= 'z') ? static_cast<tchar_t>(ch - ('a' - 'A')) : ch;
+  return static_cast<tchar_t>(reinterpret_cast<uintptr_t>(CharUpper(reinterpret_cast<LPTSTR>(static_cast<uintptr_t>(ch)))));
 }
 
 static const tchar_t *memistr(const tchar_t *str1, size_t str1len, const tchar_t *str2, size_t str2len)
 {
   ASSERT(str1 && str2 && str2len > 0);
-  for (const tchar_t *p = str1; p < str1 + str1len; ++p)
+  if (str2len > str1len)
+    return nullptr;
+  std::basic_string<tchar_t> upper(str2, str2len);
+  for (auto& ch : upper)
+    ch = mytoupper(ch);
+  const tchar_t *last = str1 + str1len - str2len;
+  const tchar_t *p = str1;
+  auto matches = [&upper, str2len](const tchar_t *p)
     {
-      if (mytoupper(*p) == mytoupper(*str2))
+      for (size_t i = 0; i < str2len; ++i)
         {
-          size_t i;
-          for (i = 0; i < str2len; ++i)
-            {
-              if (mytoupper(p[i]) != mytoupper(str2[i]))
-                break;
-            }
-          if (i == str2len)
-            return p;
+          if (mytoupper(p[i]) != upper[i])
+            return false;
+        }
+      return true;
+    };
+#ifdef FINDTEXT_SIMD
+  // Skip 8 chars at once while none of them can be the first char of str2.
+  // A non-ASCII char may be uppercased to anything, so it is always checked.
+  const tchar_t up = upper[0];
+  const tchar_t lo = (up >= 'A' && up <= 'Z') ? static_cast<tchar_t>(up + ('a' - 'A')) : up;
+  const __m128i upch = _mm_set1_epi16(static_cast<short>(up));
+  const __m128i loch = _mm_set1_epi16(static_cast<short>(lo));
+  const __m128i nonascii = _mm_set1_epi16(static_cast<short>(0xff80));
+  const __m128i zero = _mm_setzero_si128();
+  for (; p + 8 <= last + 1; p += 8)
+    {
+      const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+      const __m128i ascii = _mm_cmpeq_epi16(_mm_and_si128(v, nonascii), zero);
+      const __m128i candidates = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(v, upch), _mm_cmpeq_epi16(v, loch)), _mm_andnot_si128(ascii, _mm_cmpeq_epi16(zero, zero)));
+      unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(candidates));
+      while (mask != 0)
+        {
+          const unsigned i = bit_scan_forward(mask) / 2;
+          if (matches(p + i))
+            return p + i;
+          mask &= ~(3U << (i * 2));
         }
     }
+#endif
+  for (; p <= last; ++p)
+    {
+      if (matches(p))
+        return p;
+    }
   return nullptr;
 }
 
@@ -49,12 +135,15 @@ FindStringHelper (const tchar_t* pszLineBegin, size_t nLineLength, const tchar_t
     {
       ptrdiff_t pos = -1;
 
-      if (rxnode)
-        RxFree (rxnode);
-      rxnode = nullptr;
+      // Searches call this for each line, compile the expression only once
+      const unsigned int rxopt = (dwFlags & FIND_MATCH_CASE) != 0 ? RX_CASE : 0;
+      if (!RxIsCompiledFrom (rxnode, pszFindWhat, rxopt))
+        {
+          RxFree (rxnode);
+          rxnode = RxCompile (pszFindWhat, rxopt);
+        }
       if (pszFindWhat[0] == '^' && pszLineBegin != pszFindWhere)
         return pos;
-      rxnode = RxCompile (pszFindWhat, (dwFlags & FIND_MATCH_CASE) != 0 ? RX_CASE : 0);
       if (rxnode && RxExec (rxnode, pszLineBegin, nLineLength, pszFindWhere, rxmatch))
         {
           pos = rxmatch->Open[0];
@@ -93,7 +182,7 @@ FindStringHelper (const tchar_t* pszLineBegin, size_t nLineLength, const tchar_t
               pszFindWhere = pszPos + 1;
               continue;
             }
-          if (xisalnum (pszPos[nLength]))
+          if (pszPos + nLength < pszLineBegin + nLineLength && xisalnum (pszPos[nLength]))
             {
               nCur += (int) (pszPos - pszFindWhere + 1);
               pszFindWhere = pszPos + 1;
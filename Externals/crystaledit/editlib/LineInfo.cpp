@@ -9,80 +9,148 @@
 #include <cassert>
 #include <utility>
 
+/** @brief # of characters in an arena chunk. */
+static const size_t ARENA_CHUNK_SIZE = 256 * 1024;
+
+LineArena::LineArena()
+: m_pcNext(nullptr)
+, m_nFree(0)
+{
+}
+
+/**
+ * @brief Allocate space for line data.
+ * @param [in] nLength # of characters to allocate.
+ * @return Allocated space, valid until Clear() is called.
+ */
+tchar_t* LineArena::Allocate(size_t nLength)
+{
+  if (nLength > m_nFree)
+    {
+      // Long lines get a chunk of their own so the current chunk is not wasted
+      if (nLength > ARENA_CHUNK_SIZE / 4)
+        {
+          m_aChunks.emplace_back(new tchar_t[nLength]);
+          return m_aChunks.back().get();
+        }
+      m_aChunks.emplace_back(new tchar_t[ARENA_CHUNK_SIZE]);
+      m_pcNext = m_aChunks.back().get();
+      m_nFree = ARENA_CHUNK_SIZE;
+    }
+  tchar_t *pcLine = m_pcNext;
+  m_pcNext += nLength;
+  m_nFree -= nLength;
+  return pcLine;
+}
+
+/**
+ * @brief Free all line data allocated from the arena.
+ */
+void LineArena::Clear()
+{
+  m_aChunks.clear();
+  m_aChunks.shrink_to_fit();
+  m_pcNext = nullptr;
+  m_nFree = 0;
+}
+
 /**
  @brief Constructor.
  */
 LineInfo::LineInfo()
-: m_pcLine(nullptr)
-, m_nLength(0)
+: m_dwFlags(0)
+, m_dwRevisionNumber(0)
+, m_pcLine(nullptr)
 , m_nMax(0)
+, m_nLength(0)
 , m_nEolChars(0)
-, m_dwFlags(0)
-, m_dwRevisionNumber(0)
+, m_bInArena(false)
 {
 }
 
 LineInfo::LineInfo(const tchar_t* pszLine, size_t nLength)
-: m_pcLine(nullptr)
-, m_nLength(0)
-, m_nMax(0)
-, m_nEolChars(0)
-, m_dwFlags(0)
-, m_dwRevisionNumber(0)
+: LineInfo()
 {
   Create(pszLine, nLength);
 }
 
+LineInfo::LineInfo(const tchar_t* pszLine, size_t nLength, LineArena& arena)
+: LineInfo()
+{
+  Create(pszLine, nLength, arena);
+}
+
 LineInfo::LineInfo(const LineInfo& li)
-: m_pcLine(new tchar_t[li.m_nMax])
+: m_dwFlags(li.m_dwFlags)
+, m_dwRevisionNumber(li.m_dwRevisionNumber)
+, m_pcLine(li.m_pcLine != nullptr ? new tchar_t[li.m_nMax] : nullptr)
+, m_nMax(li.m_pcLine != nullptr ? li.m_nMax : 0)
 , m_nLength(li.m_nLength)
-, m_nMax(li.m_nMax)
 , m_nEolChars(li.m_nEolChars)
-, m_dwFlags(li.m_dwFlags)
-, m_dwRevisionNumber(li.m_dwRevisionNumber)
+, m_bInArena(false)
 {
-  memcpy (m_pcLine, li.m_pcLine, sizeof (tchar_t) * m_nMax);
+  if (m_pcLine != nullptr)
+    memcpy (m_pcLine, li.m_pcLine, sizeof (tchar_t) * m_nMax);
 }
 
 LineInfo::LineInfo(LineInfo&& li) noexcept
-: m_pcLine(nullptr)
-, m_nLength(0)
+: LineInfo()
 {
   *this = std::move(li);
 }
 
 LineInfo::~LineInfo()
 {
-  delete[] m_pcLine;
+  ReleaseBuffer();
 }
 
 LineInfo& LineInfo::operator=(const LineInfo& li)
 {
-  delete[] m_pcLine;
-  m_pcLine = new tchar_t[li.m_nMax];
+  tchar_t *pcNewBuf = nullptr;
+  if (li.m_pcLine != nullptr)
+    {
+      pcNewBuf = new tchar_t[li.m_nMax];
+      memcpy (pcNewBuf, li.m_pcLine, sizeof (tchar_t) * li.m_nMax);
+    }
+  ReleaseBuffer();
+  m_pcLine = pcNewBuf;
   m_nLength = li.m_nLength;
-  m_nMax = li.m_nMax;
+  m_nMax = li.m_pcLine != nullptr ? li.m_nMax : 0;
   m_nEolChars = li.m_nEolChars;
   m_dwFlags = li.m_dwFlags;
   m_dwRevisionNumber = li.m_dwRevisionNumber;
-  memcpy (m_pcLine, li.m_pcLine, sizeof (tchar_t) * m_nMax);
   return *this;
 }
 
 LineInfo& LineInfo::operator=(LineInfo&& li) noexcept
 {
-  delete[] m_pcLine;
+  ReleaseBuffer();
   m_pcLine = li.m_pcLine;
   m_nLength = li.m_nLength;
   m_nMax = li.m_nMax;
   m_nEolChars = li.m_nEolChars;
+  m_bInArena = li.m_bInArena;
   m_dwFlags = li.m_dwFlags;
   m_dwRevisionNumber = li.m_dwRevisionNumber;
   li.m_pcLine = nullptr;
   li.m_nLength = 0;
+  li.m_nMax = 0;
+  li.m_nEolChars = 0;
+  li.m_bInArena = false;
   return *this;
 }
 
+/**
+ * @brief Free line data, unless it is stored in an arena.
+ */
+void LineInfo::ReleaseBuffer()
+{
+  if (!m_bInArena)
+    delete[] m_pcLine;
+  m_pcLine = nullptr;
+  m_bInArena = false;
+}
+
 /**
  * @brief Clear item.
  * Frees buffer, sets members to initial values.
@@ -91,8 +159,7 @@ void LineInfo::Clear()
 {
   if (m_pcLine != nullptr)
     {
-      delete[] m_pcLine;
-      m_pcLine = nullptr;
+      ReleaseBuffer();
       m_nLength = 0;
       m_nMax = 0;
       m_nEolChars = 0;
@@ -109,8 +176,7 @@ void LineInfo::FreeBuffer()
 {
   if (m_pcLine != nullptr)
     {
-      delete[] m_pcLine;
-      m_pcLine = nullptr;
+      ReleaseBuffer();
       m_nLength = 0;
       m_nMax = 0;
       m_nEolChars = 0;
@@ -131,24 +197,53 @@ void LineInfo::Create(const tchar_t* pszLine, size_t nLength)
     }
 
   assert (nLength <= INT_MAX);		// assert "positive int"
-  m_nLength = nLength;
-  m_nMax = ALIGN_BUF_SIZE (m_nLength + 1);
-  assert (m_nMax < INT_MAX);
-  assert (m_nMax >= m_nLength + 1);
-  if (m_pcLine != nullptr)
-    delete[] m_pcLine;
-  m_pcLine = new tchar_t[m_nMax];
-  memset(m_pcLine, 0, m_nMax * sizeof(tchar_t));
-  const size_t dwLen = sizeof (tchar_t) * m_nLength;
-  memcpy (m_pcLine, pszLine, dwLen);
+  const size_t nMax = ALIGN_BUF_SIZE (nLength + 1);
+  assert (nMax < INT_MAX);
+  assert (nMax >= nLength + 1);
+  ReleaseBuffer();
+  m_pcLine = new tchar_t[nMax];
+  m_nMax = static_cast<uint32_t>(nMax);
+  memset(m_pcLine, 0, nMax * sizeof(tchar_t));
+  memcpy (m_pcLine, pszLine, sizeof (tchar_t) * nLength);
+  m_nLength = static_cast<uint32_t>(nLength);
+  DetectEol();
+}
+
+/**
+ * @brief Create a line with its data stored in an arena.
+ * The line data is not padded for appending, as loaded lines are
+ * rarely edited.
+ * @param [in] pszLine Line data.
+ * @param [in] nLength Line length.
+ * @param [in] arena Arena to store the line data in.
+ */
+void LineInfo::Create(const tchar_t* pszLine, size_t nLength, LineArena& arena)
+{
+  assert (nLength < INT_MAX);		// assert "positive int"
+  ReleaseBuffer();
+  m_pcLine = arena.Allocate(nLength + 1);
+  m_nMax = static_cast<uint32_t>(nLength + 1);
+  m_bInArena = true;
+  if (nLength > 0)
+    memcpy (m_pcLine, pszLine, sizeof (tchar_t) * nLength);
+  m_nLength = static_cast<uint32_t>(nLength);
+  DetectEol();
+}
+
+/**
+ * @brief Split the EOL bytes off a newly created line.
+ * Expects the line data (with EOL bytes) to be m_nLength characters.
+ */
+void LineInfo::DetectEol()
+{
   m_pcLine[m_nLength] = '\0';
 
-  int nEols = 0;
-  if (nLength > 1 && IsDosEol(&pszLine[nLength - 2]))
+  uint8_t nEols = 0;
+  if (m_nLength > 1 && IsDosEol(&m_pcLine[m_nLength - 2]))
     nEols = 2;
-  else if (IsEol(pszLine[nLength - 1]))
+  else if (m_nLength > 0 && IsEol(m_pcLine[m_nLength - 1]))
     nEols = 1;
-  assert (static_cast<size_t>(nEols) <= m_nLength);
+  assert (nEols <= m_nLength);
   m_nLength -= nEols;
   m_nEolChars = nEols;
 }
@@ -160,8 +255,8 @@ void LineInfo::CreateEmpty()
 {
   m_nLength = 0;
   m_nEolChars = 0;
-  m_nMax = ALIGN_BUF_SIZE (m_nLength + 1);
-  delete [] m_pcLine;
+  m_nMax = static_cast<uint32_t>(ALIGN_BUF_SIZE (m_nLength + 1));
+  ReleaseBuffer();
   m_pcLine = new tchar_t[m_nMax];
   memset (m_pcLine, 0, m_nMax * sizeof(tchar_t));
 }
@@ -177,18 +272,19 @@ void LineInfo::Append(const tchar_t* pszChars, size_t nLength, bool bDetectEol)
   size_t nBufNeeded = m_nLength + m_nEolChars + nLength + 1;
   if (nBufNeeded > m_nMax)
     {
-      m_nMax = ALIGN_BUF_SIZE (nBufNeeded);
-      assert (m_nMax < INT_MAX);
-      assert (m_nMax >= m_nLength + nLength);
-      tchar_t *pcNewBuf = new tchar_t[m_nMax];
+      const size_t nMax = ALIGN_BUF_SIZE (nBufNeeded);
+      assert (nMax < INT_MAX);
+      assert (nMax >= m_nLength + nLength);
+      tchar_t *pcNewBuf = new tchar_t[nMax];
       if (FullLength() > 0)
         memcpy (pcNewBuf, m_pcLine, sizeof (tchar_t) * (FullLength() + 1));
-      delete[] m_pcLine;
+      ReleaseBuffer();
       m_pcLine = pcNewBuf;
+      m_nMax = static_cast<uint32_t>(nMax);
     }
 
   memcpy (m_pcLine + m_nLength + m_nEolChars, pszChars, sizeof (tchar_t) * nLength);
-  m_nLength += nLength + m_nEolChars;
+  m_nLength += static_cast<uint32_t>(nLength) + m_nEolChars;
   m_pcLine[m_nLength] = '\0';
 
   if (!bDetectEol)
@@ -199,7 +295,7 @@ void LineInfo::Append(const tchar_t* pszChars, size_t nLength, bool bDetectEol)
      {
        m_nEolChars = 2;
      }
-   else if (LineInfo::IsEol(m_pcLine[m_nLength - 1]))
+   else if (m_nLength > 0 && LineInfo::IsEol(m_pcLine[m_nLength - 1]))
       {
        m_nEolChars = 1;
       }
@@ -227,7 +323,7 @@ const tchar_t* LineInfo::GetEol() const
  */
 bool LineInfo::ChangeEol(const tchar_t* lpEOL)
 {
-  const int nNewEolChars = (int) tc::tcslen(lpEOL);
+  const uint8_t nNewEolChars = static_cast<uint8_t>(tc::tcslen(lpEOL));
 
   // Check if we really are changing EOL.
   if (nNewEolChars == m_nEolChars)
@@ -238,13 +334,14 @@ bool LineInfo::ChangeEol(const tchar_t* lpEOL)
   assert (nBufNeeded < INT_MAX);
   if (nBufNeeded > m_nMax)
     {
-      m_nMax = ALIGN_BUF_SIZE (nBufNeeded);
-      assert (m_nMax >= nBufNeeded);
-      tchar_t *pcNewBuf = new tchar_t[m_nMax];
+      const size_t nMax = ALIGN_BUF_SIZE (nBufNeeded);
+      assert (nMax >= nBufNeeded);
+      tchar_t *pcNewBuf = new tchar_t[nMax];
       if (FullLength() > 0)
         memcpy (pcNewBuf, m_pcLine, sizeof (tchar_t) * (FullLength() + 1));
-      delete[] m_pcLine;
+      ReleaseBuffer();
       m_pcLine = pcNewBuf;
+      m_nMax = static_cast<uint32_t>(nMax);
     }
   
   // copy also the 0 to zero-terminate the line
@@ -263,20 +360,20 @@ void LineInfo::Delete(size_t nStartChar, size_t nEndChar)
   if (nEndChar < Length() || m_nEolChars)
     {
       // preserve characters after deleted range by shifting up
-      memcpy (m_pcLine + nStartChar, m_pcLine + nEndChar,
+      memmove (m_pcLine + nStartChar, m_pcLine + nEndChar,
               sizeof (tchar_t) * (FullLength() - nEndChar));
     }
   size_t nDelete = (nEndChar - nStartChar);
   if (nDelete <= m_nLength)
     {
-      m_nLength -= nDelete;
+      m_nLength -= static_cast<uint32_t>(nDelete);
     }
   else
     {
       assert( (m_nLength + m_nEolChars) <= nDelete );
       nDelete -= m_nLength;
       m_nLength = 0;
-      m_nEolChars -= static_cast<int>(nDelete);
+      m_nEolChars -= static_cast<uint8_t>(nDelete);
     }
   assert (m_nLength <= INT_MAX);		// assert "positive int"
   if (m_pcLine != nullptr)
@@ -289,8 +386,8 @@ void LineInfo::Delete(size_t nStartChar, size_t nEndChar)
  */
 void LineInfo::DeleteEnd(size_t nStartChar)
 {
-  m_nLength = nStartChar;
-  assert (m_nLength <= INT_MAX);		// assert "positive int"
+  assert (nStartChar <= INT_MAX);		// assert "positive int"
+  m_nLength = static_cast<uint32_t>(nStartChar);
   if (m_pcLine != nullptr)
     m_pcLine[nStartChar] = 0;
   m_nEolChars = 0;
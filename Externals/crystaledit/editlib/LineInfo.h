@@ -9,6 +9,8 @@
 
 #include "utils/ctchar.h"
 #include <cstdint>
+#include <memory>
+#include <vector>
 
 //  Line allocation granularity
 constexpr size_t CHAR_ALIGN = 16;
@@ -28,9 +30,32 @@ enum LINEFLAGS: lineflags_t
 
 #define LF_BOOKMARK(id)     (LF_BOOKMARK_FIRST << id)
 
+/**
+ * @brief Storage for the text of loaded lines.
+ * Lines are carved out of large chunks instead of being allocated one by
+ * one. Memory is only released by Clear(), so lines using the arena must
+ * not be accessed after it.
+ */
+class LineArena
+  {
+public:
+    LineArena();
+    LineArena(const LineArena&) = delete;
+    LineArena& operator=(const LineArena&) = delete;
+    tchar_t* Allocate(size_t nLength);
+    void Clear();
+
+private:
+    std::vector<std::unique_ptr<tchar_t[]>> m_aChunks; /**< Allocated chunks. */
+    tchar_t *m_pcNext; /**< Free space in the current chunk. */
+    size_t m_nFree; /**< # of free characters in the current chunk. */
+  };
+
 /**
  * @brief Line information.
- * This class presents one line in the editor.
+ * This class presents one line in the editor. Line data is either owned
+ * by the line or stored in a LineArena. Lines only grow out of an arena
+ * into a buffer of their own when edited.
  */
 class LineInfo
   {
@@ -40,6 +65,7 @@ public:
 
     LineInfo();
     LineInfo(const tchar_t* pszLine, size_t nLength);
+    LineInfo(const tchar_t* pszLine, size_t nLength, LineArena& arena);
     LineInfo(const LineInfo& li);
     LineInfo(LineInfo&& li) noexcept;
     LineInfo& operator=(const LineInfo& li);
@@ -48,6 +74,7 @@ public:
     void Clear();
     void FreeBuffer();
     void Create(const tchar_t* pszLine, size_t nLength);
+    void Create(const tchar_t* pszLine, size_t nLength, LineArena& arena);
     void CreateEmpty();
     void Append(const tchar_t* pszChars, size_t nLength, bool bDetectEol = true);
     void Delete(size_t nStartChar, size_t nEndChar);
@@ -76,10 +103,14 @@ public:
     };
 
 private:
+    void ReleaseBuffer();
+    void DetectEol();
+
     tchar_t *m_pcLine; /**< Line data. */
-    size_t m_nMax; /**< Allocated space for line data. */
-    size_t m_nLength; /**< Line length (without EOL bytes). */
-    int m_nEolChars; /**< # of EOL bytes. */
+    uint32_t m_nMax; /**< Allocated space for line data. */
+    uint32_t m_nLength; /**< Line length (without EOL bytes). */
+    uint8_t m_nEolChars; /**< # of EOL bytes. */
+    bool m_bInArena; /**< Is line data stored in a LineArena? */
   };
 
 /**
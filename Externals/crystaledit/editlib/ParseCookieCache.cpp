@@ -0,0 +1,116 @@
+/**
+ * @file  ParseCookieCache.cpp
+ *
+ * @brief Implementation of ParseCookieCache class.
+ */
+
+#include "pch.h"
+#include "ParseCookieCache.h"
+#include <algorithm>
+#include <cassert>
+
+ParseCookieCache::ParseCookieCache()
+: m_nValidCount(0)
+, m_nCheckpointEnd(0)
+, m_nConvergeLine(0)
+{
+}
+
+/**
+ * @brief Forget all cookies.
+ */
+void ParseCookieCache::clear()
+{
+  std::vector<uint32_t>().swap(m_aCookies);
+  m_nValidCount = 0;
+  m_nCheckpointEnd = 0;
+  m_nConvergeLine = 0;
+}
+
+/**
+ * @brief Make room for the cookies of all lines, none of them valid.
+ * @param [in] nLineCount # of lines in the buffer.
+ */
+void ParseCookieCache::Reset(int nLineCount)
+{
+  m_aCookies.assign(nLineCount, INVALID_COOKIE);
+  m_nValidCount = 0;
+  m_nCheckpointEnd = 0;
+  m_nConvergeLine = 0;
+}
+
+/**
+ * @brief Get the cookie of a line.
+ * @param [in] nLineIndex Index of a line with a valid cookie, or -1 for the
+ * cookie before the first line.
+ */
+uint32_t ParseCookieCache::GetCookie(int nLineIndex) const
+{
+  if (nLineIndex < 0)
+    return 0;
+  assert(nLineIndex < m_nValidCount);
+  return m_aCookies[nLineIndex];
+}
+
+/**
+ * @brief Store the cookie of a line parsed from the cookie of the previous line.
+ * When the cookie matches the checkpoint of the line, the checkpoints below
+ * are valid again.
+ * @param [in] nLineIndex Index of the line, at most GetValidCount().
+ * @param [in] dwCookie Cookie at the end of the line.
+ */
+void ParseCookieCache::SetCookie(int nLineIndex, uint32_t dwCookie)
+{
+  assert(nLineIndex >= 0 && nLineIndex <= m_nValidCount && nLineIndex < static_cast<int>(m_aCookies.size()));
+  if (nLineIndex < m_nValidCount)
+    {
+      m_aCookies[nLineIndex] = dwCookie;
+      return;
+    }
+  if (nLineIndex >= m_nConvergeLine && nLineIndex < m_nCheckpointEnd && m_aCookies[nLineIndex] == dwCookie)
+    {
+      m_nValidCount = m_nCheckpointEnd;
+      return;
+    }
+  m_aCookies[nLineIndex] = dwCookie;
+  m_nValidCount = nLineIndex + 1;
+}
+
+/**
+ * @brief Invalidate the cookies after an edit.
+ * The cookies of the lines below the edit are moved with their lines and
+ * kept as checkpoints.
+ * @param [in] nLineIndex First changed line, lines are inserted or deleted
+ * from it.
+ * @param [in] nLastChangedLine Last changed line after the edit. Lines below
+ * it must have the same text as before. Less than @p nLineIndex when no
+ * text changed.
+ * @param [in] nLineCount # of lines after the edit.
+ */
+void ParseCookieCache::Invalidate(int nLineIndex, int nLastChangedLine, int nLineCount)
+{
+  if (m_aCookies.empty())
+    return;
+  nLineIndex = (std::max)(nLineIndex, 0);
+  const int nOldCount = static_cast<int>(m_aCookies.size());
+  const int nDelta = nLineCount - nOldCount;
+  // The end of the last changed line is the end of the line that was at
+  // nLineIndex before an insert, or at nLineIndex - nDelta before a delete
+  const int nMoveFrom = (std::min)(nLineIndex, (std::min)(nOldCount, nLineCount));
+  if (nDelta > 0)
+    m_aCookies.insert(m_aCookies.begin() + nMoveFrom, nDelta, INVALID_COOKIE);
+  else if (nDelta < 0)
+    m_aCookies.erase(m_aCookies.begin() + nMoveFrom, m_aCookies.begin() + nMoveFrom - nDelta);
+  auto moveLine = [nMoveFrom, nDelta](int nLine) {
+    return nLine >= nMoveFrom ? (std::max)(nLine + nDelta, nMoveFrom) : nLine;
+  };
+
+  // Checkpoints of an earlier edit not parsed again yet stay usable below
+  // both edits only, and after the lines already parsed again
+  if (m_nValidCount < m_nCheckpointEnd)
+    m_nConvergeLine = (std::max)((std::max)(moveLine(m_nConvergeLine), moveLine(m_nValidCount)), nLastChangedLine);
+  else
+    m_nConvergeLine = nLastChangedLine;
+  m_nCheckpointEnd = (std::min)(moveLine((std::max)(m_nValidCount, m_nCheckpointEnd)), nLineCount);
+  m_nValidCount = (std::min)(m_nValidCount, nLineIndex);
+}
@@ -0,0 +1,50 @@
+/**
+ * @file ParseCookieCache.h
+ *
+ * @brief Declaration for ParseCookieCache class.
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Parse cookies of the lines of a view.
+ *
+ * The cookie of a line is the parser state at its end, it depends on the
+ * cookie of the previous line. Cookies are valid from the top of the file
+ * down to GetValidCount().
+ *
+ * An edit invalidates the cookies from the changed line, but the cookies
+ * of the previous parse are kept below it as checkpoints. When the cookie
+ * computed again for a line below the changed lines matches its
+ * checkpoint, the following checkpoints are valid again and parsing
+ * stops there.
+ */
+class ParseCookieCache
+{
+public:
+  /** @brief Cookie value of a line not parsed yet. */
+  static constexpr uint32_t INVALID_COOKIE = static_cast<uint32_t>(-1);
+
+  ParseCookieCache();
+
+  bool empty() const { return m_aCookies.empty(); }
+  size_t size() const { return m_aCookies.size(); }
+  void clear();
+  void Reset(int nLineCount);
+
+  /** @brief Get # of lines from the top with a valid cookie. */
+  int GetValidCount() const { return m_nValidCount; }
+  uint32_t GetCookie(int nLineIndex) const;
+  void SetCookie(int nLineIndex, uint32_t dwCookie);
+  void Invalidate(int nLineIndex, int nLastChangedLine, int nLineCount);
+
+private:
+  std::vector<uint32_t> m_aCookies; /**< Cookie of each line. */
+  int m_nValidCount; /**< # of lines from the top with a valid cookie. */
+  int m_nCheckpointEnd; /**< Cookies from m_nValidCount up to this line are checkpoints. */
+  int m_nConvergeLine; /**< First line whose checkpoint can match a new cookie. */
+};
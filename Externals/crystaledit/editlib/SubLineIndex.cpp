@@ -0,0 +1,223 @@
+/**
+ * @file  SubLineIndex.cpp
+ *
+ * @brief Implementation of SubLineIndex class.
+ */
+
+#include "pch.h"
+#include "SubLineIndex.h"
+#include <algorithm>
+#include <cassert>
+
+static inline int LowBit(int n)
+{
+  return n & -n;
+}
+
+SubLineIndex::SubLineIndex()
+: m_nValidEnd(0)
+{
+}
+
+/**
+ * @brief Forget all lines.
+ */
+void SubLineIndex::clear()
+{
+  std::vector<int>().swap(m_aCounts);
+  std::vector<int>().swap(m_aTree);
+  m_aInvalidLines.clear();
+  m_nValidEnd = 0;
+}
+
+/**
+ * @brief Make room for the counts of all lines, none of them valid.
+ * @param [in] nLineCount # of lines in the buffer.
+ */
+void SubLineIndex::Reset(int nLineCount)
+{
+  m_aCounts.assign(nLineCount, 0);
+  m_aTree.assign(nLineCount + 1, 0);
+  m_aInvalidLines.clear();
+  m_nValidEnd = 0;
+}
+
+/**
+ * @brief Get the first line whose count must be set before an index below
+ * it can be read, size() when all counts are valid.
+ */
+int SubLineIndex::GetFirstInvalidLine() const
+{
+  return m_aInvalidLines.empty() ? m_nValidEnd : *m_aInvalidLines.begin();
+}
+
+/**
+ * @brief Set the # of sub lines of an invalid line.
+ * @param [in] nLineIndex Index of an invalid line before GetFirstInvalidLine()
+ * is reached, or GetFirstInvalidLine() itself.
+ * @param [in] nSubLines # of sub lines of the line.
+ */
+void SubLineIndex::SetSubLines(int nLineIndex, int nSubLines)
+{
+  assert(nLineIndex >= 0 && nLineIndex < static_cast<int>(m_aCounts.size()));
+  if (nLineIndex == m_nValidEnd)
+    {
+      // The tree nodes before this line are valid, the node of this line
+      // sums its own count and the nodes it covers
+      const int k = nLineIndex + 1;
+      int nSum = nSubLines;
+      for (int j = k - 1; j > k - LowBit(k); j -= LowBit(j))
+        nSum += m_aTree[j];
+      m_aTree[k] = nSum;
+      m_aCounts[nLineIndex] = nSubLines;
+      ++m_nValidEnd;
+      return;
+    }
+  assert(m_aInvalidLines.count(nLineIndex) != 0);
+  m_aInvalidLines.erase(nLineIndex);
+  const int nDelta = nSubLines - m_aCounts[nLineIndex];
+  m_aCounts[nLineIndex] = nSubLines;
+  if (nDelta != 0)
+    {
+      const int nSize = static_cast<int>(m_aCounts.size());
+      for (int k = nLineIndex + 1; k <= nSize; k += LowBit(k))
+        m_aTree[k] += nDelta;
+    }
+}
+
+/**
+ * @brief Get the index of the first sub line of a line.
+ * @param [in] nLineIndex Index of the line, at most GetFirstInvalidLine().
+ */
+int SubLineIndex::GetSubLineIndex(int nLineIndex) const
+{
+  assert(nLineIndex >= 0 && nLineIndex <= GetFirstInvalidLine());
+  int nSum = 0;
+  for (int k = nLineIndex; k > 0; k -= LowBit(k))
+    nSum += m_aTree[k];
+  return nSum;
+}
+
+/**
+ * @brief Get the line of a sub line, all counts must be valid.
+ * @param [in] nSubLineIndex Index of the sub line.
+ * @param [out] nSubLine Index of the sub line in the line.
+ * @return Index of the line, the last line for a sub line after the end.
+ */
+int SubLineIndex::GetLineBySubLine(int nSubLineIndex, int& nSubLine) const
+{
+  const int nSize = static_cast<int>(m_aCounts.size());
+  assert(GetFirstInvalidLine() == nSize);
+  if (nSize == 0)
+    {
+      nSubLine = nSubLineIndex;
+      return 0;
+    }
+  // Find the most lines whose sub lines are all before nSubLineIndex
+  int nLine = 0;
+  int nRest = nSubLineIndex;
+  int nStep = 1;
+  while (nStep * 2 <= nSize)
+    nStep *= 2;
+  for (; nStep > 0; nStep /= 2)
+    {
+      if (nLine + nStep <= nSize && m_aTree[nLine + nStep] <= nRest)
+        {
+          nLine += nStep;
+          nRest -= m_aTree[nLine];
+        }
+    }
+  if (nLine >= nSize)
+    {
+      nLine = nSize - 1;
+      nRest = nSubLineIndex - GetSubLineIndex(nLine);
+    }
+  nSubLine = nRest;
+  return nLine;
+}
+
+/**
+ * @brief Invalidate the counts of some lines.
+ * @param [in] nLineIndex1 The index of the first line to invalidate.
+ * @param [in] nLineIndex2 The index of the last line to invalidate, -1 for
+ * all lines to the end.
+ */
+void SubLineIndex::Invalidate(int nLineIndex1, int nLineIndex2)
+{
+  if (m_aCounts.empty())
+    return;
+  if (nLineIndex2 >= 0 && nLineIndex1 > nLineIndex2)
+    std::swap(nLineIndex1, nLineIndex2);
+  nLineIndex1 = (std::max)(nLineIndex1, 0);
+  if (nLineIndex2 < 0 || nLineIndex2 >= m_nValidEnd - 1)
+    {
+      if (nLineIndex1 < m_nValidEnd)
+        {
+          m_nValidEnd = nLineIndex1;
+          m_aInvalidLines.erase(m_aInvalidLines.lower_bound(nLineIndex1), m_aInvalidLines.end());
+        }
+      return;
+    }
+  for (int i = nLineIndex1; i <= nLineIndex2; ++i)
+    m_aInvalidLines.insert(i);
+}
+
+/**
+ * @brief Move the counts of the lines below an insert or delete with their
+ * lines. The inserted lines are invalid.
+ *
+ * The tree nodes before the moved lines are kept, and only the nodes from
+ * there to the end of the valid lines are built again. Moving the counts
+ * themselves is still a linear memmove.
+ * @param [in] nLineIndex Index of the line the lines are inserted or deleted at.
+ * @param [in] nLineDelta # of lines inserted, negative for deleted lines.
+ */
+void SubLineIndex::MoveLines(int nLineIndex, int nLineDelta)
+{
+  if (m_aCounts.empty() || nLineDelta == 0)
+    return;
+  const int nOldSize = static_cast<int>(m_aCounts.size());
+  nLineIndex = (std::min)((std::max)(nLineIndex, 0), nOldSize);
+  if (nLineDelta > 0)
+    m_aCounts.insert(m_aCounts.begin() + nLineIndex, nLineDelta, 0);
+  else
+    {
+      nLineDelta = (std::max)(nLineDelta, nLineIndex - nOldSize);
+      m_aCounts.erase(m_aCounts.begin() + nLineIndex, m_aCounts.begin() + nLineIndex - nLineDelta);
+    }
+  m_aTree.resize(m_aCounts.size() + 1);
+  auto moveLine = [nLineIndex, nLineDelta](int nLine) {
+    return nLine >= nLineIndex ? (std::max)(nLine + nLineDelta, nLineIndex) : nLine;
+  };
+
+  m_nValidEnd = moveLine(m_nValidEnd);
+  auto it = m_aInvalidLines.lower_bound(nLineIndex);
+  std::vector<int> aMovedLines;
+  for (auto itMoved = it; itMoved != m_aInvalidLines.end(); ++itMoved)
+    {
+      if (moveLine(*itMoved) < m_nValidEnd)
+        aMovedLines.push_back(moveLine(*itMoved));
+    }
+  m_aInvalidLines.erase(it, m_aInvalidLines.end());
+  for (int nLine : aMovedLines)
+    m_aInvalidLines.insert(m_aInvalidLines.end(), nLine);
+  for (int i = nLineIndex; i < nLineIndex + nLineDelta && i < m_nValidEnd; ++i)
+    m_aInvalidLines.insert(i);
+  Rebuild(nLineIndex);
+}
+
+/**
+ * @brief Build the tree nodes of the valid lines from a line on, the nodes
+ * before it must be valid.
+ * @param [in] nLineIndex Index of the first line whose node is built.
+ */
+void SubLineIndex::Rebuild(int nLineIndex)
+{
+  for (int k = nLineIndex + 1; k <= m_nValidEnd; ++k)
+    {
+      int nSum = m_aCounts[k - 1];
+      for (int j = k - 1; j > k - LowBit(k); j -= LowBit(j))
+        nSum += m_aTree[j];
+      m_aTree[k] = nSum;
+    }
+}
@@ -0,0 +1,50 @@
+/**
+ * @file SubLineIndex.h
+ *
+ * @brief Declaration for SubLineIndex class.
+ *
+ */
+
+#pragma once
+
+#include <set>
+#include <vector>
+
+/**
+ * @brief Sub line index of the lines of a view.
+ *
+ * Keeps the # of sub lines of each line in a Fenwick tree, so the index of
+ * the first sub line of a line, and the line of a sub line, are found in
+ * O(log n). Counts are computed by the view on demand, from the top of the
+ * file down to the lines it needs.
+ *
+ * Invalidating a few lines only marks them, their counts are computed again
+ * and updated in the tree the next time an index below them is needed.
+ * Invalidating to the end drops the counts from that line.
+ */
+class SubLineIndex
+{
+public:
+  SubLineIndex();
+
+  bool empty() const { return m_aCounts.empty(); }
+  size_t size() const { return m_aCounts.size(); }
+  void clear();
+  void Reset(int nLineCount);
+
+  int GetFirstInvalidLine() const;
+  void SetSubLines(int nLineIndex, int nSubLines);
+  int GetSubLineIndex(int nLineIndex) const;
+  int GetLineBySubLine(int nSubLineIndex, int& nSubLine) const;
+
+  void Invalidate(int nLineIndex1, int nLineIndex2);
+  void MoveLines(int nLineIndex, int nLineDelta);
+
+private:
+  void Rebuild(int nLineIndex);
+
+  std::vector<int> m_aCounts; /**< # of sub lines of each line. */
+  std::vector<int> m_aTree; /**< Fenwick tree of m_aCounts, one based. */
+  std::set<int> m_aInvalidLines; /**< Invalid lines before m_nValidEnd. */
+  int m_nValidEnd; /**< Lines from here to the end are invalid. */
+};
@@ -0,0 +1,396 @@
+/**
+ * @file  UndoJournal.cpp
+ *
+ * @brief Implementation of UndoJournal class.
+ */
+
+#include "pch.h"
+#include "UndoJournal.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <string>
+#if __has_include(<Poco/DeflatingStream.h>)
+#include <sstream>
+#include <Poco/DeflatingStream.h>
+#include <Poco/InflatingStream.h>
+#include <Poco/Exception.h>
+#endif
+
+/** @brief Size of a data chunk in bytes. */
+static const size_t CHUNK_SIZE = 1024 * 1024;
+/** @brief Texts of at least this many bytes are compressed once they are not recent. */
+static const size_t COMPRESS_MIN_SIZE = 64 * 1024;
+/** @brief # of newest records which are not compressed, as they are likely to be undone. */
+static const size_t RECENT_RECORDS = 256;
+/** @brief Size of the buffer a compressed text is read back into. */
+static const size_t VERIFY_BUFFER_SIZE = 64 * 1024;
+
+/**
+ * @brief Compress a text.
+ * @return true if the compressed text is smaller.
+ */
+static bool Compress(const tchar_t* pszText, size_t cchText, std::string& compressed)
+{
+#if __has_include(<Poco/DeflatingStream.h>)
+  try
+    {
+      std::ostringstream ostr;
+      Poco::DeflatingOutputStream deflater(ostr, Poco::DeflatingStreamBuf::STREAM_ZLIB, 1);
+      deflater.write(reinterpret_cast<const char *>(pszText), cchText * sizeof(tchar_t));
+      deflater.close();
+      compressed = ostr.str();
+      return compressed.size() < cchText * sizeof(tchar_t);
+    }
+  catch (Poco::Exception&)
+    {
+    }
+#endif
+  return false;
+}
+
+/**
+ * @brief Decompress a text compressed with Compress().
+ */
+static bool Decompress(const uint8_t* pData, size_t nBytes, std::basic_string<tchar_t>& text)
+{
+#if __has_include(<Poco/DeflatingStream.h>)
+  try
+    {
+      std::istringstream istr(std::string(reinterpret_cast<const char *>(pData), nBytes));
+      Poco::InflatingInputStream inflater(istr, Poco::InflatingStreamBuf::STREAM_ZLIB);
+      inflater.read(reinterpret_cast<char *>(&text[0]), text.length() * sizeof(tchar_t));
+      return static_cast<size_t>(inflater.gcount()) == text.length() * sizeof(tchar_t);
+    }
+  catch (Poco::Exception&)
+    {
+    }
+#endif
+  return false;
+}
+
+/**
+ * @brief Does a compressed text decompress to the original?
+ * The text is read back in pieces, without making a copy of it.
+ */
+static bool DecompressesTo(const std::string& compressed, const uint8_t* pOriginal, size_t nBytes)
+{
+#if __has_include(<Poco/DeflatingStream.h>)
+  try
+    {
+      std::istringstream istr(compressed);
+      Poco::InflatingInputStream inflater(istr, Poco::InflatingStreamBuf::STREAM_ZLIB);
+      std::vector<char> buffer(VERIFY_BUFFER_SIZE);
+      size_t nRead = 0;
+      while (nRead < nBytes)
+        {
+          inflater.read(buffer.data(), (std::min)(buffer.size(), nBytes - nRead));
+          const size_t nCount = static_cast<size_t>(inflater.gcount());
+          if (nCount == 0 || memcmp(buffer.data(), pOriginal + nRead, nCount) != 0)
+            return false;
+          nRead += nCount;
+        }
+      return true;
+    }
+  catch (Poco::Exception&)
+    {
+    }
+#endif
+  return false;
+}
+
+/**
+ * @brief Append a revision number delta as a variable length integer.
+ * Small positive and negative deltas take one byte.
+ */
+static void AppendDelta(std::vector<uint8_t>& data, uint32_t nValue, uint32_t nPrevious)
+{
+  const int32_t nDelta = static_cast<int32_t>(nValue - nPrevious);
+  uint32_t nZigZag = (static_cast<uint32_t>(nDelta) << 1) ^ static_cast<uint32_t>(nDelta >> 31);
+  while (nZigZag >= 0x80)
+    {
+      data.push_back(static_cast<uint8_t>(nZigZag | 0x80));
+      nZigZag >>= 7;
+    }
+  data.push_back(static_cast<uint8_t>(nZigZag));
+}
+
+static uint32_t ReadDelta(const uint8_t*& p, uint32_t nPrevious)
+{
+  uint32_t nZigZag = 0;
+  for (int nShift = 0; ; nShift += 7)
+    {
+      const uint8_t b = *p++;
+      nZigZag |= static_cast<uint32_t>(b & 0x7f) << nShift;
+      if ((b & 0x80) == 0)
+        break;
+    }
+  const int32_t nDelta = static_cast<int32_t>(nZigZag >> 1) ^ -static_cast<int32_t>(nZigZag & 1);
+  return nPrevious + static_cast<uint32_t>(nDelta);
+}
+
+UndoJournal::UndoJournal()
+: m_nFirstChunk(0)
+, m_nChunkMemory(0)
+, m_nMaxMemory(0)
+, m_nNextTrimUsage(0)
+, m_nNextCompress(0)
+{
+}
+
+/**
+ * @brief Remove all records and free their memory.
+ */
+void UndoJournal::clear()
+{
+  std::vector<Entry>().swap(m_aEntries);
+  m_aChunks.clear();
+  m_nFirstChunk = 0;
+  m_nChunkMemory = 0;
+  m_nNextTrimUsage = 0;
+  m_nNextCompress = 0;
+}
+
+/**
+ * @brief Remove the records after the given number of records.
+ * @param [in] nSize # of records to keep, records are never added.
+ */
+void UndoJournal::resize(size_t nSize)
+{
+  if (nSize >= m_aEntries.size())
+    return;
+  if (nSize == 0)
+    {
+      clear();
+      return;
+    }
+  const Entry& entry = m_aEntries[nSize];
+  const size_t nChunk = entry.m_nChunk - m_nFirstChunk;
+  while (m_aChunks.size() > nChunk + 1 || (m_aChunks.size() == nChunk + 1 && entry.m_nOffset == 0))
+    {
+      m_nChunkMemory -= m_aChunks.back().capacity();
+      m_aChunks.pop_back();
+    }
+  if (m_aChunks.size() == nChunk + 1)
+    m_aChunks.back().resize(entry.m_nOffset);
+  m_aEntries.resize(nSize);
+  m_nNextTrimUsage = 0;
+  m_nNextCompress = (std::min)(m_nNextCompress, nSize);
+}
+
+/**
+ * @brief Get a chunk with space for record data.
+ * Large records get a chunk of their own.
+ */
+std::vector<uint8_t>& UndoJournal::AllocateChunkSpace(size_t nBytes)
+{
+  if (!m_aChunks.empty())
+    {
+      // Keep texts aligned
+      std::vector<uint8_t>& chunk = m_aChunks.back();
+      const size_t nOffset = (chunk.size() + sizeof(tchar_t) - 1) / sizeof(tchar_t) * sizeof(tchar_t);
+      if (nOffset + nBytes <= chunk.capacity())
+        {
+          chunk.resize(nOffset);
+          return chunk;
+        }
+    }
+  m_aChunks.emplace_back();
+  m_aChunks.back().reserve(nBytes > CHUNK_SIZE / 4 ? nBytes : CHUNK_SIZE);
+  m_nChunkMemory += m_aChunks.back().capacity();
+  return m_aChunks.back();
+}
+
+/**
+ * @brief Compress the text of a large record.
+ * The text is only replaced when it decompresses to the original. It is
+ * compressed in place: the data after it in its chunk is moved down, and
+ * a chunk of its own is shrunk.
+ * @param [in] nIndex Index of the record.
+ */
+void UndoJournal::CompressRecord(size_t nIndex)
+{
+  Entry& entry = m_aEntries[nIndex];
+  if (entry.m_nTextBytes < COMPRESS_MIN_SIZE || entry.m_nTextBytes != entry.m_nTextLength * sizeof(tchar_t))
+    return;
+  std::vector<uint8_t>& chunk = m_aChunks[entry.m_nChunk - m_nFirstChunk];
+  uint8_t* pText = chunk.data() + entry.m_nOffset;
+  std::string compressed;
+  if (!Compress(reinterpret_cast<const tchar_t*>(pText), entry.m_nTextLength, compressed))
+    return;
+  // GetRecord() cannot fail, so keep the text as is unless it is read back intact
+  if (!DecompressesTo(compressed, pText, entry.m_nTextBytes))
+    return;
+
+  // The revision numbers follow the text, the next record starts at an
+  // aligned offset, so it is moved by a multiple of the alignment
+  const bool bLastInChunk = (nIndex + 1 == m_aEntries.size() || m_aEntries[nIndex + 1].m_nChunk != entry.m_nChunk);
+  const size_t nRecordEnd = bLastInChunk ? chunk.size() : m_aEntries[nIndex + 1].m_nOffset;
+  const size_t nSaved = entry.m_nTextBytes - compressed.size();
+  const size_t nShift = nSaved / sizeof(tchar_t) * sizeof(tchar_t);
+  const size_t nTextEnd = entry.m_nOffset + entry.m_nTextBytes;
+  memcpy(pText, compressed.data(), compressed.size());
+  memmove(pText + compressed.size(), chunk.data() + nTextEnd, nRecordEnd - nTextEnd);
+  memmove(chunk.data() + nRecordEnd - nShift, chunk.data() + nRecordEnd, chunk.size() - nRecordEnd);
+  chunk.resize(chunk.size() - nShift);
+  for (size_t i = nIndex + 1; i < m_aEntries.size() && m_aEntries[i].m_nChunk == entry.m_nChunk; ++i)
+    m_aEntries[i].m_nOffset -= static_cast<uint32_t>(nShift);
+  entry.m_nTextBytes = static_cast<uint32_t>(compressed.size());
+
+  if (entry.m_nOffset == 0 && bLastInChunk && chunk.capacity() > CHUNK_SIZE / 4)
+    {
+      m_nChunkMemory -= chunk.capacity();
+      chunk.shrink_to_fit();
+      m_nChunkMemory += chunk.capacity();
+    }
+}
+
+/**
+ * @brief Compress the large records which are no longer recent.
+ * All but the newest record are compressed when the memory usage nears
+ * the limit.
+ */
+void UndoJournal::CompressOldRecords()
+{
+  const size_t nRecent = (m_nMaxMemory != 0 && GetMemoryUsage() > m_nMaxMemory / 2) ? 1 : RECENT_RECORDS;
+  for (; m_nNextCompress + nRecent < m_aEntries.size(); ++m_nNextCompress)
+    CompressRecord(m_nNextCompress);
+}
+
+/**
+ * @brief Add a record at the end of the journal.
+ * @param [in] dwFlags Undo flags.
+ * @param [in] nAction Action type.
+ * @param [in] ptStartPos Start of the text.
+ * @param [in] ptEndPos End of the text.
+ * @param [in] pszText Inserted or deleted text.
+ * @param [in] cchText Length of the text.
+ * @param [in] paSavedRevisionNumbers Revision numbers to restore on undo, may be nullptr.
+ */
+void UndoJournal::Append(undoflags_t dwFlags, int nAction, const CEPoint& ptStartPos, const CEPoint& ptEndPos,
+                         const tchar_t* pszText, size_t cchText, const std::vector<uint32_t>* paSavedRevisionNumbers)
+{
+  assert (cchText < INT_MAX);
+  CompressOldRecords();
+
+  std::vector<uint8_t> revisions;
+  const size_t nRevisionCount = paSavedRevisionNumbers ? paSavedRevisionNumbers->size() : 0;
+  uint32_t nPrevious = 0;
+  for (size_t i = 0; i < nRevisionCount; ++i)
+    {
+      AppendDelta(revisions, (*paSavedRevisionNumbers)[i], nPrevious);
+      nPrevious = (*paSavedRevisionNumbers)[i];
+    }
+
+  const uint8_t* pText = reinterpret_cast<const uint8_t*>(pszText);
+  const size_t nTextBytes = cchText * sizeof(tchar_t);
+  std::vector<uint8_t>& chunk = AllocateChunkSpace(nTextBytes + revisions.size());
+  Entry entry;
+  entry.m_dwFlags = dwFlags;
+  entry.m_ptStartPos = ptStartPos;
+  entry.m_ptEndPos = ptEndPos;
+  entry.m_nAction = nAction;
+  entry.m_nChunk = static_cast<uint32_t>(m_nFirstChunk + m_aChunks.size() - 1);
+  entry.m_nOffset = static_cast<uint32_t>(chunk.size());
+  entry.m_nTextLength = static_cast<uint32_t>(cchText);
+  entry.m_nTextBytes = static_cast<uint32_t>(nTextBytes);
+  entry.m_nRevisionCount = static_cast<uint32_t>(nRevisionCount);
+  chunk.insert(chunk.end(), pText, pText + nTextBytes);
+  chunk.insert(chunk.end(), revisions.begin(), revisions.end());
+  m_aEntries.push_back(entry);
+}
+
+/**
+ * @brief Make an undo record from the journal.
+ * @param [in] nIndex Index of the record.
+ */
+UndoRecord UndoJournal::GetRecord(size_t nIndex) const
+{
+  const Entry& entry = m_aEntries[nIndex];
+  UndoRecord ur;
+  ur.m_dwFlags = entry.m_dwFlags;
+  ur.m_ptStartPos = entry.m_ptStartPos;
+  ur.m_ptEndPos = entry.m_ptEndPos;
+  ur.m_nAction = entry.m_nAction;
+
+  const uint8_t* p = m_aChunks[entry.m_nChunk - m_nFirstChunk].data() + entry.m_nOffset;
+  if (entry.m_nTextBytes == entry.m_nTextLength * sizeof(tchar_t))
+    ur.SetText(reinterpret_cast<const tchar_t*>(p), entry.m_nTextLength);
+  else
+    {
+      std::basic_string<tchar_t> text(entry.m_nTextLength, '\0');
+      // Cannot fail, CompressRecord() has read the text back already
+      if (!Decompress(p, entry.m_nTextBytes, text))
+        assert (false);
+      ur.SetText(text.c_str(), text.length());
+    }
+  p += entry.m_nTextBytes;
+
+  ur.m_paSavedRevisionNumbers = new std::vector<uint32_t>(entry.m_nRevisionCount);
+  uint32_t nPrevious = 0;
+  for (uint32_t i = 0; i < entry.m_nRevisionCount; ++i)
+    {
+      nPrevious = ReadDelta(p, nPrevious);
+      (*ur.m_paSavedRevisionNumbers)[i] = nPrevious;
+    }
+  return ur;
+}
+
+/**
+ * @brief Get the memory used by the records.
+ */
+size_t UndoJournal::GetMemoryUsage() const
+{
+  return m_nChunkMemory + m_aEntries.size() * sizeof(Entry);
+}
+
+/**
+ * @brief Discard the oldest undo groups when over the memory limit.
+ * Groups are discarded until the memory usage is a quarter below the
+ * limit. The newest group is always kept.
+ * @param [out] nGroups # of discarded groups.
+ * @return # of discarded records.
+ */
+size_t UndoJournal::Trim(int& nGroups)
+{
+  nGroups = 0;
+  const size_t nUsage = GetMemoryUsage();
+  if (m_nMaxMemory == 0 || nUsage <= m_nMaxMemory || nUsage < m_nNextTrimUsage)
+    return 0;
+  // Don't look again for every record added when the newest group is too
+  // large to get under the limit
+  m_nNextTrimUsage = nUsage + m_nMaxMemory / 8;
+
+  size_t nLastGroup = m_aEntries.size() - 1;
+  while (nLastGroup > 0 && (m_aEntries[nLastGroup].m_dwFlags & UNDO_BEGINGROUP) == 0)
+    --nLastGroup;
+
+  const size_t nTarget = m_nMaxMemory / 4 * 3;
+  size_t nKeep = 0;
+  size_t nFreed = 0;
+  size_t nChunk = 0;
+  for (size_t i = 1; i <= nLastGroup; ++i)
+    {
+      if ((m_aEntries[i].m_dwFlags & UNDO_BEGINGROUP) == 0)
+        continue;
+      ++nGroups;
+      nKeep = i;
+      for (; nChunk < m_aEntries[i].m_nChunk - m_nFirstChunk; ++nChunk)
+        nFreed += m_aChunks[nChunk].capacity();
+      if (nUsage - nFreed - i * sizeof(Entry) <= nTarget)
+        break;
+    }
+  if (nKeep == 0)
+    return 0;
+
+  while (m_nFirstChunk < m_aEntries[nKeep].m_nChunk)
+    {
+      m_nChunkMemory -= m_aChunks.front().capacity();
+      m_aChunks.pop_front();
+      ++m_nFirstChunk;
+    }
+  m_aEntries.erase(m_aEntries.begin(), m_aEntries.begin() + nKeep);
+  m_nNextCompress -= (std::min)(m_nNextCompress, nKeep);
+  m_nNextTrimUsage = GetMemoryUsage() + m_nMaxMemory / 8;
+  return nKeep;
+}
@@ -0,0 +1,75 @@
+/**
+ * @file UndoJournal.h
+ *
+ * @brief Declaration for UndoJournal class.
+ *
+ */
+
+#pragma once
+
+#include "UndoRecord.h"
+#include <deque>
+#include <vector>
+
+/**
+ * @brief Compact storage for the undo records of a text buffer.
+ *
+ * Record headers are kept in a vector, their text and saved revision
+ * numbers are appended to shared byte chunks. Revision numbers are delta
+ * encoded, as neighbouring lines mostly have the same revision. Large texts
+ * of records older than the recent ones are compressed when Poco is
+ * available, they are only read back on undo/redo. UndoRecord objects are made from the
+ * journal on demand.
+ *
+ * When a memory limit is set, Trim() discards the oldest undo groups to
+ * stay under it.
+ */
+class UndoJournal
+{
+public:
+  /** @brief Header of a record, see UndoRecord. */
+  struct Entry
+  {
+    undoflags_t m_dwFlags;
+    CEPoint m_ptStartPos, m_ptEndPos;
+    int m_nAction;
+
+  private:
+    friend class UndoJournal;
+    uint32_t m_nChunk; /**< Chunk of the record data, counted from the first chunk ever added. */
+    uint32_t m_nOffset; /**< Offset of the record data in the chunk. */
+    uint32_t m_nTextLength; /**< # of characters in the text. */
+    uint32_t m_nTextBytes; /**< # of bytes stored for the text. */
+    uint32_t m_nRevisionCount; /**< # of saved revision numbers. */
+  };
+
+  UndoJournal();
+
+  size_t size() const { return m_aEntries.size(); }
+  bool empty() const { return m_aEntries.empty(); }
+  const Entry& operator[](size_t nIndex) const { return m_aEntries[nIndex]; }
+  void clear();
+  void resize(size_t nSize);
+
+  void Append(undoflags_t dwFlags, int nAction, const CEPoint& ptStartPos, const CEPoint& ptEndPos,
+              const tchar_t* pszText, size_t cchText, const std::vector<uint32_t>* paSavedRevisionNumbers);
+  UndoRecord GetRecord(size_t nIndex) const;
+
+  void SetMaxMemory(size_t nMaxMemory) { m_nMaxMemory = nMaxMemory; }
+  size_t GetMaxMemory() const { return m_nMaxMemory; }
+  size_t GetMemoryUsage() const;
+  size_t Trim(int& nGroups);
+
+private:
+  std::vector<uint8_t>& AllocateChunkSpace(size_t nBytes);
+  void CompressRecord(size_t nIndex);
+  void CompressOldRecords();
+
+  std::vector<Entry> m_aEntries; /**< Record headers. */
+  std::deque<std::vector<uint8_t>> m_aChunks; /**< Record data. */
+  size_t m_nFirstChunk; /**< # of chunks discarded from the front. */
+  size_t m_nChunkMemory; /**< Allocated size of the chunks. */
+  size_t m_nMaxMemory; /**< Memory limit, 0 for no limit. */
+  size_t m_nNextTrimUsage; /**< Memory usage at which Trim() looks for groups to discard again. */
+  size_t m_nNextCompress; /**< Index of the first record not yet considered for compression. */
+};
@@ -183,20 +183,18 @@ void CCrystalTextBuffer::InsertLine (const tchar_t* pszLine, size_t nLength,
 {
   ASSERT(nLength != -1);
 
-  LineInfo line{ pszLine, nLength };
-
   // nPosition not defined ? Insert at end of array
   if (nPosition == -1)
     nPosition = (int) m_aLines.size();
 
-  // insert all lines in one pass
+  // insert all lines in one pass, empty lines have no text data to copy
   std::vector<LineInfo>::iterator iter = m_aLines.begin() + nPosition;
-  m_aLines.insert(iter, nCount, line);
+  m_aLines.insert(iter, nCount, LineInfo());
 
-  // create text data for lines after the first one
-  for (int ic = 1; ic < nCount; ic++)
+  // create text data for each line
+  for (int ic = 0; ic < nCount; ic++)
     {
-      m_aLines[nPosition + ic] = std::move(LineInfo{ pszLine, nLength });
+      m_aLines[nPosition + ic].Create(pszLine, nLength);
     }
 
 #ifdef _DEBUG
@@ -282,6 +280,7 @@ FreeAll ()
       ++iter;
     }
   m_aLines.clear();
+  m_lineArena.Clear();
 
   // Undo buffer will be cleared by its destructor
 
@@ -452,12 +451,12 @@ LoadFromFile (const tchar_t* pszFileName, CRLFSTYLE nCrlfStyle /*= CRLFSTYLE::AU
               int len = MultiByteToWideChar(CP_UTF8, 0, pcLineBuf, nCurrentLength, buf, nCurrentLength);
               if (m_nSourceEncoding >= 0)
                 iconvert(buf, m_nSourceEncoding, 1, m_nSourceEncoding == 15);
-              InsertLine(buf, len);
+              m_aLines.emplace_back(buf, len, m_lineArena);
               delete[] buf;
 #else
               if (m_nSourceEncoding >= 0)
                 iconvert (pcLineBuf, m_nSourceEncoding, 1, m_nSourceEncoding == 15);
-              InsertLine (pcLineBuf, nCurrentLength);
+              m_aLines.emplace_back(pcLineBuf, nCurrentLength, m_lineArena);
 #endif
               nCurrentLength = 0;
             }
@@ -467,10 +466,10 @@ LoadFromFile (const tchar_t* pszFileName, CRLFSTYLE nCrlfStyle /*= CRLFSTYLE::AU
 #ifdef _UNICODE
       wchar_t *buf = new wchar_t[nCurrentLength];
       int len = MultiByteToWideChar(CP_UTF8, 0, pcLineBuf, nCurrentLength, buf, nCurrentLength);
-      InsertLine(buf, len);
+      m_aLines.emplace_back(buf, len, m_lineArena);
       delete[] buf;
 #else
-      InsertLine (&pcLineBuf[0], nCurrentLength);
+      m_aLines.emplace_back(&pcLineBuf[0], nCurrentLength, m_lineArena);
 #endif
 
       ASSERT (m_aLines.size() > 0);   //  At least one empty line must present
@@ -1315,15 +1314,11 @@ GetUndoActionCode (int & nAction, size_t pos /*= 0*/ ) const
 
   //  Advance to next undo group
   nPosition--;
-  std::vector<UndoRecord>::const_iterator iter = m_aUndoBuf.begin () + nPosition;
-  while (((*iter).m_dwFlags & UNDO_BEGINGROUP) == 0)
-    {
-      --iter;
-      --nPosition;
-    }
+  while ((m_aUndoBuf[nPosition].m_dwFlags & UNDO_BEGINGROUP) == 0)
+    --nPosition;
 
   //  Get description
-  nAction = (*iter).m_nAction;
+  nAction = m_aUndoBuf[nPosition].m_nAction;
 
   //  Now, if we stop at zero position, this will be the last action,
   //  since we return (size_t) nPosition
@@ -1356,15 +1351,9 @@ GetRedoActionCode (int & nAction, size_t pos /*= 0*/ ) const
 
   //  Advance to next undo group
   nPosition++;
-  if (nPosition < static_cast<intptr_t>(m_aUndoBuf.size ()))
-    {
-      std::vector<UndoRecord>::const_iterator iter = m_aUndoBuf.begin () + nPosition;
-      while (iter != m_aUndoBuf.end () && ((*iter).m_dwFlags & UNDO_BEGINGROUP) == 0)
-        {
-          ++iter;
-          ++nPosition;
-        }
-    }
+  while (nPosition < static_cast<intptr_t>(m_aUndoBuf.size ()) &&
+         (m_aUndoBuf[nPosition].m_dwFlags & UNDO_BEGINGROUP) == 0)
+    ++nPosition;
   if (nPosition >= static_cast<intptr_t>(m_aUndoBuf.size ()))
     return 0;                //  No more redo actions!
 
@@ -1571,30 +1560,24 @@ AddUndoRecord (bool bInsert, const CEPoint & ptStartPos,
     }
 
   //  Add new record
-  UndoRecord ur;
-  ur.m_dwFlags = bInsert ? UNDO_INSERT : 0;
-  ur.m_nAction = nActionType;
+  undoflags_t dwFlags = bInsert ? UNDO_INSERT : 0;
   if (m_bUndoBeginGroup)
     {
-      ur.m_dwFlags |= UNDO_BEGINGROUP;
+      dwFlags |= UNDO_BEGINGROUP;
       m_bUndoBeginGroup = false;
     }
-  ur.m_ptStartPos = ptStartPos;
-  ur.m_ptEndPos = ptEndPos;
-  ur.SetText (pszText, cchText);
-  ur.m_paSavedRevisionNumbers = paSavedRevisionNumbers;
+  m_aUndoBuf.Append (dwFlags, nActionType, ptStartPos, ptEndPos, pszText, cchText, paSavedRevisionNumbers);
+  delete paSavedRevisionNumbers;
 
-  // Optimize memory allocation
-  if (m_aUndoBuf.capacity() == m_aUndoBuf.size())
+  //  Discard the oldest undo groups when over the memory limit
+  int nDiscardedGroups = 0;
+  const int nDiscarded = static_cast<int>(m_aUndoBuf.Trim (nDiscardedGroups));
+  if (nDiscarded > 0)
     {
-      if (m_aUndoBuf.size() == 0)
-        m_aUndoBuf.reserve(16);
-      else if (m_aUndoBuf.size() < 1025)
-        m_aUndoBuf.reserve(m_aUndoBuf.size() * 2);
-      else
-        m_aUndoBuf.reserve(m_aUndoBuf.size() + 1024);
+      // The unmodified state may not be reachable any more
+      m_nSyncPosition = m_nSyncPosition >= nDiscarded ? m_nSyncPosition - nDiscarded : -1;
+      OnUndoGroupsDiscarded (nDiscardedGroups);
     }
-  m_aUndoBuf.push_back (ur);
   m_nUndoPosition = (int) m_aUndoBuf.size ();
 }
 
@@ -1891,7 +1874,8 @@ FlushUndoGroup (CCrystalTextView * pSource)
       ASSERT (static_cast<size_t>(m_nUndoPosition) <= m_aUndoBuf.size());
       if (m_nUndoPosition > 0)
         {
-          pSource->OnEditOperation (m_aUndoBuf[m_nUndoPosition - 1].m_nAction, m_aUndoBuf[m_nUndoPosition - 1].GetText (), m_aUndoBuf[m_nUndoPosition - 1].GetTextLength ());
+          const UndoRecord ur = m_aUndoBuf.GetRecord (m_nUndoPosition - 1);
+          pSource->OnEditOperation (ur.m_nAction, ur.GetText (), ur.GetTextLength ());
         }
     }
   m_bUndoGroup = false;
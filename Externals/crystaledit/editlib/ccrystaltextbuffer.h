@@ -33,7 +33,7 @@
 
 #include "parsers/crystallineparser.h"
 #include "LineInfo.h"
-#include "UndoRecord.h"
+#include "UndoJournal.h"
 #include "cepoint.h"
 #include <memory>
 #include <vector>
@@ -128,9 +128,10 @@ public :
 
     //  Lines of text
     std::vector<LineInfo> m_aLines; /**< Text lines. */
+    LineArena m_lineArena; /**< Storage for the text of loaded lines. */
 
     //  Undo
-    std::vector<UndoRecord> m_aUndoBuf; /**< Undo records. */
+    UndoJournal m_aUndoBuf; /**< Undo records. */
     int m_nUndoPosition;
     int m_nSyncPosition;
     bool m_bUndoGroup, m_bUndoBeginGroup;
@@ -169,7 +170,8 @@ public :
     //  [JRT] Support For Descriptions On Undo/Redo Actions
     virtual void AddUndoRecord (bool bInsert, const CEPoint & ptStartPos, const CEPoint & ptEndPos,
                                 const tchar_t* pszText, size_t cchText, int nActionType = CE_ACTION_UNKNOWN, std::vector<uint32_t> *paSavedRevisionNumbers = nullptr);
-    virtual UndoRecord GetUndoRecord (int nUndoPos) const { return m_aUndoBuf[nUndoPos]; }
+    virtual UndoRecord GetUndoRecord (int nUndoPos) const { return m_aUndoBuf.GetRecord (nUndoPos); }
+    virtual void OnUndoGroupsDiscarded (int nGroups) {}
 
     virtual std::vector<uint32_t> *CopyRevisionNumbers(int nStartLine, int nEndLine) const;
     virtual void RestoreRevisionNumbers(int nStartLine, std::vector<uint32_t> *psaSavedRevisionNumbers);
@@ -254,6 +256,10 @@ public :
     virtual void BeginUndoGroup (bool bMergeWithPrevious = false);
     virtual void FlushUndoGroup (CCrystalTextView * pSource);
 
+    //  Undo memory
+    void SetMaxUndoMemory (size_t nMaxBytes) { m_aUndoBuf.SetMaxMemory (nMaxBytes); }
+    size_t GetUndoMemoryUsage () const { return m_aUndoBuf.GetMemoryUsage (); }
+
     //BEGIN SW
     /**
     Returns the position where the last changes where made.
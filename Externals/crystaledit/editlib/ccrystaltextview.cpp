@@ -92,6 +92,8 @@
 #include "ccrystaltextbuffer.h"
 #include "ccrystaltextmarkers.h"
 #include "ViewableWhitespace.h"
+#include "ParseCookieCache.h"
+#include "SubLineIndex.h"
 #include "SyntaxColors.h"
 #include "renderers/ccrystalrendererdirectwrite.h"
 #include "renderers/ccrystalrenderergdi.h"
@@ -279,6 +281,8 @@ DoSetTextType (CrystalLineParser::TextDefinition *def)
 {
   m_CurSourceDef = def;
   SetFlags (def->flags);
+  m_ParseCookies->clear ();
+  StartBackgroundParse ();
 
 // Do not set these
 // EOL is determined from file, tabsize and viewtabs are
@@ -364,7 +368,6 @@ CCrystalTextView::CCrystalTextView ()
 , m_bBookmarkExist(false)
 , m_bSingle(false) // needed to be set in descendat classes
 , m_pColors(nullptr)
-, m_nLastLineIndexCalculatedSubLineIndex(-1)
 , m_hAccel(nullptr)
 , m_pTextBuffer(nullptr)
 , m_pCacheBitmap(nullptr)
@@ -381,10 +384,10 @@ CCrystalTextView::CCrystalTextView ()
 , m_nScreenLines(0)
 , m_pMarkers(nullptr)
 , m_panSubLines(new std::vector<int>())
-, m_panSubLineIndexCache(new std::vector<int>())
+, m_pSubLineIndex(new SubLineIndex)
 , m_pstrIncrementalSearchString(new CString)
 , m_pstrIncrementalSearchStringOld(new CString)
-, m_ParseCookies(new vector<uint32_t>)
+, m_ParseCookies(new ParseCookieCache)
 , m_pnActualLineLength(new vector<int>)
 , m_nIdealCharPos(0)
 , m_bFocused(false)
@@ -439,8 +442,6 @@ CCrystalTextView::CCrystalTextView ()
 
   m_panSubLines->reserve(4096);
   m_panSubLines->resize(0);
-  m_panSubLineIndexCache->reserve (4096);
-  m_panSubLineIndexCache->resize ( 0);
 
   //END SW
   CCrystalTextView::ResetView ();
@@ -468,8 +469,8 @@ CCrystalTextView::~CCrystalTextView ()
   delete m_panSubLines;
   m_panSubLines = nullptr;
 
-  delete m_panSubLineIndexCache;
-  m_panSubLineIndexCache = nullptr;
+  delete m_pSubLineIndex;
+  m_pSubLineIndex = nullptr;
 
   delete m_pstrIncrementalSearchString;
   m_pstrIncrementalSearchString = nullptr;
@@ -1432,36 +1433,37 @@ GetLineColors (int nLineIndex, CEColor & crBkgnd,
 DWORD CCrystalTextView::
 GetParseCookie (int nLineIndex)
 {
-  const int nLineCount = GetLineCount ();
-  if (m_ParseCookies->size() == 0)
-    {
-      // must be initialized to invalid value (DWORD) -1
-      m_ParseCookies->assign(nLineCount, static_cast<uint32_t>(-1));
-    }
+  if (m_ParseCookies->empty ())
+    m_ParseCookies->Reset (GetLineCount ());
 
   if (nLineIndex < 0)
     return 0;
-  if ((*m_ParseCookies)[nLineIndex] != - 1)
-    return (*m_ParseCookies)[nLineIndex];
-
-  int L = nLineIndex;
-  while (L >= 0 && (*m_ParseCookies)[L] == - 1)
-    L--;
-  L++;
+  ParseLinesUpTo (nLineIndex, 0);
+  return m_ParseCookies->GetCookie (nLineIndex);
+}
 
+/**
+ * @brief Compute the parse cookies down to a line.
+ * @param [in] nLineIndex Last line to parse.
+ * @param [in] dwTimeLimit Milliseconds after which parsing stops, 0 for no limit.
+ * @return true if the cookies are valid down to the line.
+ */
+bool CCrystalTextView::
+ParseLinesUpTo (int nLineIndex, DWORD dwTimeLimit)
+{
+  const ULONGLONG ullStart = dwTimeLimit > 0 ? GetTickCount64 () : 0;
   int nBlocks = 0;
-  while (L <= nLineIndex)
+  int nParsed = 0;
+  for (int L = m_ParseCookies->GetValidCount (); L <= nLineIndex; L = m_ParseCookies->GetValidCount ())
     {
-      unsigned dwCookie = 0;
-      if (L > 0)
-        dwCookie = (*m_ParseCookies)[L - 1];
+      const unsigned dwCookie = m_ParseCookies->GetCookie (L - 1);
       ASSERT (dwCookie != - 1);
-      (*m_ParseCookies)[L] = ParseLine (dwCookie, GetLineChars(L), GetLineLength(L), nullptr, nBlocks);
-      ASSERT ((*m_ParseCookies)[L] != - 1);
-      L++;
+      m_ParseCookies->SetCookie (L, ParseLine (dwCookie, GetLineChars(L), GetLineLength(L), nullptr, nBlocks));
+      ASSERT (m_ParseCookies->GetCookie (L) != - 1);
+      if (dwTimeLimit > 0 && (++nParsed % 256) == 0 && GetTickCount64 () - ullStart >= dwTimeLimit)
+        return m_ParseCookies->GetValidCount () > nLineIndex;
     }
-
-  return (*m_ParseCookies)[nLineIndex];
+  return true;
 }
 
 std::vector<TEXTBLOCK> CCrystalTextView::
@@ -1521,7 +1523,7 @@ void CCrystalTextView::WrapLineCached(
 void CCrystalTextView::InvalidateLineCache( int nLineIndex1, int nLineIndex2 /*= -1*/ )
 {
   // invalidate cached sub line index
-  InvalidateSubLineIndexCache( nLineIndex1 );
+  InvalidateSubLineIndexCache( nLineIndex1, nLineIndex2 );
 
   // invalidate cached sub line count
 
@@ -1550,13 +1552,33 @@ void CCrystalTextView::InvalidateLineCache( int nLineIndex1, int nLineIndex2 /*=
 }
 
 /**
- * @brief Invalidate sub line index cache from the specified index to the end of file.
- * @param [in] nLineIndex Index of the first line to invalidate 
+ * @brief Invalidate the sub line counts of the specified lines in the sub line index cache.
+ * @param [in] nLineIndex1 Index of the first line to invalidate
+ * @param [in] nLineIndex2 Index of the last line to invalidate, -1 for the end of file
  */
-void CCrystalTextView::InvalidateSubLineIndexCache( int nLineIndex )
+void CCrystalTextView::InvalidateSubLineIndexCache( int nLineIndex1, int nLineIndex2 )
 {
-  if (m_nLastLineIndexCalculatedSubLineIndex > nLineIndex)
-    m_nLastLineIndexCalculatedSubLineIndex = nLineIndex - 1;
+  m_pSubLineIndex->Invalidate (nLineIndex1, nLineIndex2);
+}
+
+/**
+ * @brief Move the cached sub line counts of the lines below an insert or delete
+ * with their lines, so they are not wrapped again.
+ * @param [in] nLineIndex Index of the line the lines are inserted or deleted at
+ * @param [in] nLineDelta # of lines inserted, negative for deleted lines
+ */
+void CCrystalTextView::MoveLineCache( int nLineIndex, int nLineDelta )
+{
+  const int nSize = static_cast<int>(m_panSubLines->size ());
+  if (nLineIndex < nSize)
+    {
+      if (nLineDelta > 0)
+        m_panSubLines->insert (m_panSubLines->begin () + nLineIndex, nLineDelta, -1);
+      else if (nLineDelta < 0)
+        m_panSubLines->erase (m_panSubLines->begin () + nLineIndex,
+            m_panSubLines->begin () + (std::min) (nLineIndex - nLineDelta, nSize));
+    }
+  m_pSubLineIndex->MoveLines (nLineIndex, nLineDelta);
 }
 
 /**
@@ -1936,8 +1958,8 @@ CCrystalTextView::GetTextBlocks(int nLineIndex)
   blocks[0].m_nColorIndex = COLORINDEX_NORMALTEXT;
   blocks[0].m_nBgColorIndex = COLORINDEX_BKGND;
   nBlocks++;
-  (*m_ParseCookies)[nLineIndex] = ParseLine(dwCookie, GetLineChars(nLineIndex), GetLineLength(nLineIndex), blocks.data(), nBlocks);
-  ASSERT((*m_ParseCookies)[nLineIndex] != -1);
+  m_ParseCookies->SetCookie(nLineIndex, ParseLine(dwCookie, GetLineChars(nLineIndex), GetLineLength(nLineIndex), blocks.data(), nBlocks));
+  ASSERT(m_ParseCookies->GetCookie(nLineIndex) != -1);
   blocks.resize(nBlocks);
 
   std::vector<TEXTBLOCK> additionalBlocks = GetAdditionalTextBlocks(nLineIndex);
@@ -2708,7 +2730,7 @@ OnDraw (CDC * pdc)
 
   // if the private arrays (m_ParseCookies and m_pnActualLineLength) 
   // are defined, check they are in phase with the text buffer
-  if (m_ParseCookies->size())
+  if (!m_ParseCookies->empty())
     ASSERT(m_ParseCookies->size() == static_cast<size_t>(nLineCount));
   if (m_pnActualLineLength->size())
     ASSERT(m_pnActualLineLength->size() == static_cast<size_t>(nLineCount));
@@ -2816,6 +2838,7 @@ ResetView ()
   m_ptAnchor.y = 0;
   InvalidateLineCache( 0, -1 );
   m_ParseCookies->clear();
+  StartBackgroundParse ();
   m_pnActualLineLength->clear();
   m_ptCursorPos.x = 0;
   m_ptCursorPos.y = 0;
@@ -3698,7 +3721,8 @@ int CCrystalTextView::GetSubLineCount()
   // calculate number of sub lines
   if (nLineCount <= 0)
     return 0;
-  return CCrystalTextView::GetSubLineIndex( nLineCount - 1 ) + GetSubLines( nLineCount - 1 );
+  UpdateSubLineIndex( nLineCount );
+  return m_pSubLineIndex->GetSubLineIndex( nLineCount );
 }
 
 int CCrystalTextView::GetSubLineIndex( int nLineIndex )
@@ -3708,40 +3732,30 @@ int CCrystalTextView::GetSubLineIndex( int nLineIndex )
     return nLineIndex;
 
   // calculate subline index of the line
-  int	nSubLineCount = 0;
   int nLineCount = GetLineCount();
 
   if( nLineIndex >= nLineCount )
     nLineIndex = nLineCount - 1;
 
-  // return cached subline index of the line if it is already cached.
-  if (nLineIndex <= m_nLastLineIndexCalculatedSubLineIndex)
-    return (*m_panSubLineIndexCache)[nLineIndex];
-
-  // calculate subline index of the line and cache it.
-  if (m_nLastLineIndexCalculatedSubLineIndex >= 0)
-    nSubLineCount = (*m_panSubLineIndexCache)[m_nLastLineIndexCalculatedSubLineIndex];
-  else
-    {
-      m_nLastLineIndexCalculatedSubLineIndex = 0;
-      m_panSubLineIndexCache->resize (1);
-      (*m_panSubLineIndexCache)[0] = 0;
-    }
+  if( nLineIndex < 0 )
+    return 0;
 
-// TODO: Rethink this, it is very time consuming
-  for( int i = m_nLastLineIndexCalculatedSubLineIndex; i < nLineIndex; i++ )
-    {
-      if (m_panSubLineIndexCache->size () >= i)
-        m_panSubLineIndexCache->resize (i + 1);
-      (*m_panSubLineIndexCache)[i] = nSubLineCount;
-      nSubLineCount+= GetSubLines( i );
-    }
-  if (m_panSubLineIndexCache->size () >= nLineIndex)
-    m_panSubLineIndexCache->resize (nLineIndex + 1);
-  (*m_panSubLineIndexCache)[nLineIndex] = nSubLineCount;
-  m_nLastLineIndexCalculatedSubLineIndex = nLineIndex;
+  UpdateSubLineIndex( nLineIndex );
+  return m_pSubLineIndex->GetSubLineIndex( nLineIndex );
+}
 
-  return nSubLineCount;
+/**
+ * @brief Compute the sub line counts of the invalid lines before the given line.
+ * Only lines invalidated since the last call, and lines not reached yet, are counted.
+ * @param [in] nLineIndex Index of the line, up to the line count
+ */
+void CCrystalTextView::UpdateSubLineIndex( int nLineIndex )
+{
+  const int nLineCount = GetLineCount();
+  if (m_pSubLineIndex->size () != static_cast<size_t>(nLineCount))
+    m_pSubLineIndex->Reset (nLineCount);
+  for (int i = m_pSubLineIndex->GetFirstInvalidLine (); i < nLineIndex; i = m_pSubLineIndex->GetFirstInvalidLine ())
+    m_pSubLineIndex->SetSubLines (i, GetSubLines (i));
 }
 
 // See comment in the header file
@@ -3765,26 +3779,9 @@ void CCrystalTextView::GetLineBySubLine(int nSubLineIndex, int &nLine, int &nSub
     }
 
   // compute result
-  const int nLineCount = GetLineCount();
-
-  // binary search
-  int base = 0, i = 0, nSubLineIndex2 = 0;
-  for (int lim = nLineCount; lim != 0; lim >>= 1)
-    {
-      i = base + (lim >> 1);
-      nSubLineIndex2 = GetSubLineIndex(i);
-      if (nSubLineIndex >= nSubLineIndex2 && nSubLineIndex < nSubLineIndex2 + GetSubLines(i))
-        break;
-      else if (nSubLineIndex2 <= nSubLineIndex)	/* key > p: move right */
-        {
-          base = i + 1;
-          lim--;
-        } /* else move left */
-    }
-
-  ASSERT(i < nLineCount);
-  nLine = i;
-  nSubLine = nSubLineIndex - nSubLineIndex2;
+  UpdateSubLineIndex(GetLineCount());
+  nLine = m_pSubLineIndex->GetLineBySubLine(nSubLineIndex, nSubLine);
+  ASSERT(nLine < GetLineCount());
 }
 
 int CCrystalTextView::
@@ -5042,17 +5039,24 @@ UpdateView (CCrystalTextView * pSource, CUpdateContext * pContext,
   int nLineCount = GetLineCount ();
   ASSERT (nLineCount > 0);
   ASSERT (nLineIndex >= -1 && nLineIndex < nLineCount);
+
+  //  Last line whose text changed: an insert changes the line at nLineIndex
+  //  and the inserted lines, a delete only the line at nLineIndex
+  int nLastChangedLine = nLineCount - 1;
+  if ((dwFlags & UPDATE_FLAGSONLY) != 0)
+    nLastChangedLine = nLineIndex - 1;
+  else if (pContext != nullptr && nLineIndex >= 0)
+    nLastChangedLine = nLineIndex + (std::max) (nLineCount - static_cast<int>(m_ParseCookies->size ()), 0);
+
   if ((dwFlags & UPDATE_SINGLELINE) != 0)
     {
       ASSERT (nLineIndex != -1);
       //  All text below this line should be reparsed
-      const int cookiesSize = (int) m_ParseCookies->size();
-      if (cookiesSize > 0)
+      if (!m_ParseCookies->empty ())
         {
-          ASSERT (cookiesSize == nLineCount);
-          // must be reinitialized to invalid value (DWORD) - 1
-          for (int i = nLineIndex; i < cookiesSize; ++i)
-            (*m_ParseCookies)[i] = static_cast<uint32_t>(-1);
+          ASSERT (m_ParseCookies->size () == static_cast<size_t>(nLineCount));
+          m_ParseCookies->Invalidate (nLineIndex, nLastChangedLine, nLineCount);
+          StartBackgroundParse ();
         }
       //  This line'th actual length must be recalculated
       if (m_pnActualLineLength->size())
@@ -5069,6 +5073,10 @@ UpdateView (CCrystalTextView * pSource, CUpdateContext * pContext,
     }
   else
     {
+      //  Lines below an edit only move, their sub line counts stay valid
+      const bool bMoveLineCache = pContext != nullptr && nLineIndex >= 0 && (dwFlags & UPDATE_FLAGSONLY) == 0
+          && !m_bViewLineNumbers && !m_pSubLineIndex->empty ();
+
       if (m_bViewLineNumbers)
         // if enabling linenumber, we must invalidate all line-cache in visible area because selection margin width changes dynamically.
         nLineIndex = m_nTopLine < nLineIndex ? m_nTopLine : nLineIndex;
@@ -5077,20 +5085,10 @@ UpdateView (CCrystalTextView * pSource, CUpdateContext * pContext,
         nLineIndex = 0;         //  Refresh all text
 
       //  All text below this line should be reparsed
-      if (m_ParseCookies->size())
+      if (!m_ParseCookies->empty ())
         {
-          size_t arrSize = m_ParseCookies->size();
-          if (arrSize != static_cast<size_t>(nLineCount))
-            {
-              size_t oldsize = arrSize; 
-              m_ParseCookies->resize(nLineCount);
-              arrSize = nLineCount;
-              // must be initialized to invalid value (DWORD) - 1
-              for (size_t i = oldsize; i < arrSize; ++i)
-                (*m_ParseCookies)[i] = static_cast<uint32_t>(-1);
-            }
-          for (size_t i = nLineIndex; i < arrSize; ++i)
-            (*m_ParseCookies)[i] = static_cast<uint32_t>(-1);
+          m_ParseCookies->Invalidate (nLineIndex, nLastChangedLine, nLineCount);
+          StartBackgroundParse ();
         }
 
       //  Recalculate actual length for all lines below this
@@ -5111,7 +5109,14 @@ UpdateView (CCrystalTextView * pSource, CUpdateContext * pContext,
             (*m_pnActualLineLength)[i] = -1;
         }
       //BEGIN SW
-      InvalidateLineCache( nLineIndex, -1 );
+      if (bMoveLineCache)
+        {
+          const int nLineDelta = nLineCount - static_cast<int>(m_pSubLineIndex->size ());
+          MoveLineCache( nLineIndex, nLineDelta );
+          InvalidateLineCache( nLineIndex, nLineIndex + (std::max) (nLineDelta, 0) );
+        }
+      else
+        InvalidateLineCache( nLineIndex, -1 );
       //END SW
       //  Repaint the lines
       InvalidateLines (nLineIndex, -1, true);
@@ -5709,6 +5714,7 @@ FindTextInBlock (const tchar_t* pszText, const CEPoint & ptStartPosition,
             {
               int nLineLength;
               CString line;
+              const tchar_t* pszLine;
               if (dwFlags & FIND_REGEXP)
                 {
                   int nLines = m_pTextBuffer->GetLineCount ();
@@ -5727,6 +5733,7 @@ FindTextInBlock (const tchar_t* pszText, const CEPoint & ptStartPosition,
                         }
                     }
                   nLineLength = line.GetLength ();
+                  pszLine = line;
                 }
               else
                 {
@@ -5738,13 +5745,17 @@ FindTextInBlock (const tchar_t* pszText, const CEPoint & ptStartPosition,
                       continue;
                     }
 
-                  line.SetString(GetLineChars(ptCurrentPos.y), GetLineLength(ptCurrentPos.y));
+                  //  Search the buffer line itself, it is copied only if the text is found
+                  nLineLength = GetLineLength (ptCurrentPos.y);
+                  pszLine = GetLineChars (ptCurrentPos.y);
                 }
 
               //  Perform search in the line
-              size_t nPos = ::FindStringHelper (line, line.GetLength (), static_cast<const tchar_t*>(line) + ptCurrentPos.x, what, dwFlags, m_nLastFindWhatLen, m_rxnode, &m_rxmatch);
+              size_t nPos = ::FindStringHelper (pszLine, nLineLength, pszLine + ptCurrentPos.x, what, dwFlags, m_nLastFindWhatLen, m_rxnode, &m_rxmatch);
               if (nPos != -1)
                 {
+                  if ((dwFlags & FIND_REGEXP) == 0)
+                    line.SetString (pszLine, nLineLength);
                   if (m_pszMatched != nullptr)
                     free(m_pszMatched);
                   m_pszMatched = tc::tcsdup (line);
@@ -47,6 +47,8 @@
 
 class CCrystalTextBuffer;
 class CUpdateContext;
+class ParseCookieCache;
+class SubLineIndex;
 struct ViewableWhitespaceChars;
 class SyntaxColors;
 class CFindTextDlg;
@@ -128,8 +130,8 @@ private :
     initialize the member objects. This would destroy a CArray object.
     */
     std::vector<int> *m_panSubLines;
-    std::vector<int> *m_panSubLineIndexCache;
-    int m_nLastLineIndexCalculatedSubLineIndex;
+    /** Index of the first subline of each line, computed on demand. */
+    SubLineIndex *m_pSubLineIndex;
     //END SW
 
     int m_nIdealCharPos;
@@ -144,19 +146,22 @@ private:
     //  Parsing stuff
 
     /**  
-    This array must be initialized to (DWORD) - 1, code for invalid values (not yet computed).
-    We prefer to limit the recomputing delay to the moment when we need to read
-    a parseCookie value for drawing.
+    Parse cookies, valid from the top of the file down to some line.
     GetParseCookie must always be used to read the m_ParseCookies value of a line.
-    If the actual value is invalid code, GetParseCookie computes the value, 
-    stores it in m_ParseCookies, and returns the new valid value.
+    If the actual value is not computed yet, GetParseCookie parses the lines
+    down to it, stores their cookies in m_ParseCookies, and returns the new valid value.
     When we edit the text, the parse cookies value may change for the modified line
     and all the lines below (As m_ParseCookies[line i] depends on m_ParseCookies[line (i-1)])
-    It would be a loss of time to recompute all these values after each action.
-    So we just set all these values to invalid code (DWORD) - 1.
+    The old values below the edit are kept as checkpoints: parsing again stops
+    at the first line whose cookie is unchanged.
+    The lines below the view are parsed in the background, in short slices of
+    a timer.
     */
-    std::vector<uint32_t> *m_ParseCookies;
+    ParseCookieCache *m_ParseCookies;
     DWORD GetParseCookie (int nLineIndex);
+    bool ParseLinesUpTo (int nLineIndex, DWORD dwTimeLimit);
+    void StartBackgroundParse ();
+    void OnBackgroundParseTimer ();
 
     /**
     Pre-calculated line lengths (in characters)
@@ -456,6 +461,8 @@ protected :
      */
     virtual void GetLineBySubLine(int nSubLineIndex, int &nLine, int &nSubLine);
 
+    void UpdateSubLineIndex( int nLineIndex );
+
 public:
     virtual int GetLineLength (int nLineIndex) const;
     virtual int GetFullLineLength (int nLineIndex) const;
@@ -603,7 +610,8 @@ protected:
     -1 (default) all lines from nLineIndex1 to the end are invalidated.
     */
     virtual void InvalidateLineCache( int nLineIndex1, int nLineIndex2 );
-    virtual void InvalidateSubLineIndexCache( int nLineIndex1 );
+    virtual void InvalidateSubLineIndexCache( int nLineIndex1, int nLineIndex2 );
+    virtual void MoveLineCache( int nLineIndex, int nLineDelta );
     void InvalidateScreenRect(bool bInvalidateView = true);
     void InvalidateVertScrollBar();
     void InvalidateHorzScrollBar();
@@ -45,6 +45,7 @@
 #include "StdAfx.h"
 #include "ccrystaltextview.h"
 #include "ccrystaltextbuffer.h"
+#include "ParseCookieCache.h"
 #include "ccrystaltextmarkers.h"
 #include "editcmd.h"
 #include "SyntaxColors.h"
@@ -64,6 +65,10 @@
 static const UINT_PTR CRYSTAL_TIMER_DRAGSEL = 1001;
 static const UINT_PTR CRYSTAL_RECALC_VSCROLLBAR = 1002;
 static const UINT_PTR CRYSTAL_RECALC_HSCROLLBAR = 1003;
+static const UINT_PTR CRYSTAL_TIMER_PARSE = 1004;
+
+/** @brief Milliseconds of background parsing per timer message. */
+static const DWORD BACKGROUND_PARSE_TIME_SLICE = 20;
 
 /////////////////////////////////////////////////////////////////////////////
 // CCrystalTextView
@@ -959,6 +964,10 @@ OnTimer (UINT_PTR nIDEvent)
       KillTimer (CRYSTAL_RECALC_HSCROLLBAR);
       RecalcHorzScrollBar ();
     }
+  else if (nIDEvent == CRYSTAL_TIMER_PARSE)
+    {
+      OnBackgroundParseTimer ();
+    }
 }
 
 /** 
@@ -1189,3 +1198,30 @@ InvalidateHorzScrollBar ()
 {
   SetTimer(CRYSTAL_RECALC_HSCROLLBAR, 1, nullptr);
 }
+
+/**
+ * @brief Parse the lines without a valid parse cookie in the background.
+ * Timer messages only come when the message queue is empty, so the lines
+ * are parsed when the user does nothing, and jumping far down the file
+ * does not parse all lines in between at once.
+ */
+void CCrystalTextView::
+StartBackgroundParse ()
+{
+  if (::IsWindow (m_hWnd) && m_CurSourceDef != nullptr && m_CurSourceDef->type != CrystalLineParser::SRC_PLAIN)
+    SetTimer (CRYSTAL_TIMER_PARSE, 1, nullptr);
+}
+
+void CCrystalTextView::
+OnBackgroundParseTimer ()
+{
+  if (m_pTextBuffer == nullptr || !IsWindowVisible ())
+    {
+      KillTimer (CRYSTAL_TIMER_PARSE);
+      return;
+    }
+  if (m_ParseCookies->empty ())
+    m_ParseCookies->Reset (GetLineCount ());
+  if (ParseLinesUpTo (static_cast<int>(m_ParseCookies->size ()) - 1, BACKGROUND_PARSE_TIME_SLICE))
+    KillTimer (CRYSTAL_TIMER_PARSE);
+}
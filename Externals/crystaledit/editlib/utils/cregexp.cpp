@@ -620,6 +620,11 @@ RxNode *RxCompile(const tchar_t* Regexp, unsigned int RxOpt) {
     return n;
 }
 
+bool RxIsCompiledFrom(const RxNode * /*Regexp*/, const tchar_t* /*Pattern*/, unsigned int /*RxOpt*/) {
+    // The nodes do not keep the pattern, so they are always compiled again
+    return false;
+}
+
 void RxFree(RxNode *n) {
     while (n) {
         RxNode *p = n;
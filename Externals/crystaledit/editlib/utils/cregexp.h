@@ -102,6 +102,7 @@ typedef struct {
 } RxMatchRes;
 
 RxNode EDITPADC_CLASS *RxCompile(const tchar_t* Regexp, unsigned int RxOpt = RX_CASE);
+bool EDITPADC_CLASS RxIsCompiledFrom(const RxNode *Regexp, const tchar_t* Pattern, unsigned int RxOpt = RX_CASE);
 int EDITPADC_CLASS RxExec(RxNode *Regexp, const tchar_t* Data, size_t Len, const tchar_t* Start, RxMatchRes *Match);
 int EDITPADC_CLASS RxReplace(const tchar_t* rep, const tchar_t* Src, int len, RxMatchRes match, tchar_t* *Dest, int *Dlen);
 void EDITPADC_CLASS RxFree(RxNode *Node);
@@ -32,8 +32,65 @@ using Poco::UnicodeConverter;
 
 struct _RxNode {
 	std::unique_ptr<RegularExpression> regexp;
+	std::basic_string<tchar_t> pattern;   // compiled pattern, to reuse the node
+	unsigned int options = 0;
+	std::basic_string<tchar_t> subject;   // last subject and its UTF-8 form, so that
+	std::string subjectUtf8;              // searching the same line again does not convert it
+	RegularExpression::MatchVec ovector;
 };
 
+#ifdef UNICODE
+static bool IsHighSurrogate(tchar_t ch) { return ch >= 0xd800 && ch < 0xdc00; }
+static bool IsLowSurrogate(tchar_t ch) { return ch >= 0xdc00 && ch < 0xe000; }
+
+/**
+ * Convert UTF-16 to UTF-8. Unpaired surrogates become U+FFFD, so that
+ * each UTF-16 code unit or surrogate pair maps to one UTF-8 sequence.
+ */
+static void ToUtf8(const tchar_t* Data, size_t Len, std::string& Dest) {
+	Dest.resize(Len * 3);
+	unsigned char *p = reinterpret_cast<unsigned char *>(&Dest[0]);
+	for (size_t i = 0; i < Len; i++) {
+		unsigned ch = Data[i];
+		if (IsHighSurrogate(Data[i]) && i + 1 < Len && IsLowSurrogate(Data[i + 1])) {
+			ch = ((ch & 0x3ff) << 10) + (Data[i + 1] & 0x3ff) + 0x10000;
+			i++;
+		} else if (IsHighSurrogate(Data[i]) || IsLowSurrogate(Data[i])) {
+			ch = 0xfffd;
+		}
+		p += ucr::Ucs4_to_Utf8(ch, p);
+	}
+	Dest.resize(p - reinterpret_cast<unsigned char *>(&Dest[0]));
+}
+
+/** UTF-8 length of the first Len UTF-16 code units, as converted by ToUtf8(). */
+static size_t Utf8Length(const tchar_t* Data, size_t Len) {
+	size_t len = 0;
+	for (size_t i = 0; i < Len; i++) {
+		if (Data[i] < 0x80)
+			len += 1;
+		else if (Data[i] < 0x800)
+			len += 2;
+		else if (IsHighSurrogate(Data[i]) && i + 1 < Len && IsLowSurrogate(Data[i + 1]))
+			len += 4, i++;
+		else
+			len += 3;
+	}
+	return len;
+}
+
+/** UTF-16 length of the UTF-8 string, which must be valid. */
+static size_t Utf16Length(const char* Data, size_t Len) {
+	size_t len = 0;
+	for (size_t i = 0; i < Len; i++) {
+		const unsigned char ch = Data[i];
+		if ((ch & 0xc0) != 0x80)
+			len += ch >= 0xf0 ? 2 : 1;
+	}
+	return len;
+}
+#endif
+
 RxNode *RxCompile(const tchar_t* Regexp, unsigned int RxOpt) {
     RxNode *n = nullptr;
     if (Regexp == nullptr) return nullptr;
@@ -61,12 +118,19 @@ RxNode *RxCompile(const tchar_t* Regexp, unsigned int RxOpt) {
 	}
 	catch (...)
 	{
+		delete n;
 		return nullptr;
 	}
+	n->pattern = Regexp;
+	n->options = RxOpt;
 
     return n;
 }
 
+bool RxIsCompiledFrom(const RxNode *Regexp, const tchar_t* Pattern, unsigned int RxOpt) {
+    return Regexp != nullptr && Pattern != nullptr && Regexp->options == RxOpt && Regexp->pattern == Pattern;
+}
+
 void RxFree(RxNode *n) {
 	if (n)
 	{
@@ -80,11 +144,15 @@ int RxExec(RxNode *Regexp, const tchar_t* Data, size_t Len, const tchar_t* Start
 	int i;
     for (i = 0; i < NSEXPS; i++) Match->Open[i] = Match->Close[i] = -1;
 
-	RegularExpression::MatchVec ovector;
-	std::string compString;
+	RegularExpression::MatchVec& ovector = Regexp->ovector;
+	std::string& compString = Regexp->subjectUtf8;
 #ifdef UNICODE
-	size_t startoffset = ucr::Utf8len_of_string(Data, Start - Data);
-	UnicodeConverter::toUTF8(Data, Len, compString);
+	if (Regexp->subject.length() != Len || Regexp->subject.compare(0, Len, Data, Len) != 0)
+	{
+		Regexp->subject.assign(Data, Len);
+		ToUtf8(Data, Len, compString);
+	}
+	size_t startoffset = Utf8Length(Data, Start - Data);
 #else
 	int startoffset = Start - Data;
 	compString = Data;
@@ -101,13 +169,14 @@ int RxExec(RxNode *Regexp, const tchar_t* Data, size_t Len, const tchar_t* Start
 		for (i = 0; i < result; i++)
 		{
 #ifdef UNICODE
-			std::wstring utf16str;
             if (ovector[i].offset != -1)
             {
-                UnicodeConverter::toUTF16(std::string(compString.c_str(), ovector[i].offset), utf16str);
-                Match->Open[i] = utf16str.length();
-                UnicodeConverter::toUTF16(std::string(compString.c_str() + ovector[i].offset, ovector[i].length), utf16str);
-                Match->Close[i] = Match->Open[i] + utf16str.length();
+                // Count from the start offset for groups after it, which is all of them most of the time
+                if (ovector[i].offset >= startoffset)
+                    Match->Open[i] = (Start - Data) + Utf16Length(compString.c_str() + startoffset, ovector[i].offset - startoffset);
+                else
+                    Match->Open[i] = Utf16Length(compString.c_str(), ovector[i].offset);
+                Match->Close[i] = Match->Open[i] + Utf16Length(compString.c_str() + ovector[i].offset, ovector[i].length);
             }
             else
             {
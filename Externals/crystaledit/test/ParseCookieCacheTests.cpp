@@ -0,0 +1,79 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "../editlib/ParseCookieCache.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace test
+{
+	TEST_CLASS(ParseCookieCacheTests)
+	{
+	public:
+		// A line with 1 opens a comment, a line with 2 closes it
+		static uint32_t Parse(uint32_t dwCookie, int nLine)
+		{
+			return nLine == 1 ? 1 : (nLine == 2 ? 0 : dwCookie);
+		}
+		static int ParseAll(ParseCookieCache& cache, const std::vector<int>& lines)
+		{
+			int nParsed = 0;
+			for (int i = cache.GetValidCount(); i < static_cast<int>(lines.size()); i = cache.GetValidCount(), ++nParsed)
+				cache.SetCookie(i, Parse(cache.GetCookie(i - 1), lines[i]));
+			uint32_t dwCookie = 0;
+			for (size_t i = 0; i < lines.size(); ++i)
+			{
+				dwCookie = Parse(dwCookie, lines[i]);
+				Assert::AreEqual(dwCookie, cache.GetCookie(static_cast<int>(i)));
+			}
+			return nParsed;
+		}
+		TEST_METHOD(Converge)
+		{
+			std::vector<int> lines(1000, 0);
+			lines[10] = 1;
+			lines[20] = 2;
+			ParseCookieCache cache;
+			cache.Reset(static_cast<int>(lines.size()));
+			Assert::AreEqual(1000, ParseAll(cache, lines));
+
+			// Editing a line inside the comment changes no cookie
+			lines[15] = 3;
+			cache.Invalidate(15, 15, 1000);
+			Assert::AreEqual(1, ParseAll(cache, lines));
+
+			// Removing the end of the comment changes all cookies below
+			lines[20] = 0;
+			cache.Invalidate(20, 20, 1000);
+			Assert::AreEqual(980, ParseAll(cache, lines));
+
+			// Flags only
+			cache.Invalidate(500, 499, 1000);
+			Assert::AreEqual(1, ParseAll(cache, lines));
+		}
+		TEST_METHOD(InsertAndDelete)
+		{
+			std::vector<int> lines(100, 0);
+			lines[50] = 1;
+			ParseCookieCache cache;
+			cache.Reset(static_cast<int>(lines.size()));
+			ParseAll(cache, lines);
+
+			// Split line 5 into 3 lines
+			lines.insert(lines.begin() + 6, 2, 0);
+			cache.Invalidate(5, 7, 102);
+			Assert::AreEqual(3, ParseAll(cache, lines));
+
+			// Join lines 60 to 62
+			lines.erase(lines.begin() + 61, lines.begin() + 63);
+			cache.Invalidate(60, 60, 100);
+			Assert::AreEqual(1, ParseAll(cache, lines));
+
+			// Two edits before parsing again
+			lines.insert(lines.begin() + 80, 0);
+			cache.Invalidate(80, 81, 101);
+			lines.erase(lines.begin() + 3);
+			cache.Invalidate(2, 2, 100);
+			Assert::AreEqual(79, ParseAll(cache, lines));
+		}
+	};
+}
@@ -0,0 +1,94 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "../editlib/SubLineIndex.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace test
+{
+	TEST_CLASS(SubLineIndexTests)
+	{
+	public:
+		// Set the invalid counts up to nLineIndex and check the index of each line
+		static int Check(SubLineIndex& index, const std::vector<int>& counts, int nLineIndex)
+		{
+			int nComputed = 0;
+			for (int i = index.GetFirstInvalidLine(); i < nLineIndex; i = index.GetFirstInvalidLine(), ++nComputed)
+				index.SetSubLines(i, counts[i]);
+			int nSubLineIndex = 0;
+			for (int i = 0; i < nLineIndex; ++i)
+			{
+				Assert::AreEqual(nSubLineIndex, index.GetSubLineIndex(i));
+				nSubLineIndex += counts[i];
+			}
+			Assert::AreEqual(nSubLineIndex, index.GetSubLineIndex(nLineIndex));
+			return nComputed;
+		}
+		TEST_METHOD(SubLineIndexAndLine)
+		{
+			std::vector<int> counts(1000);
+			for (size_t i = 0; i < counts.size(); ++i)
+				counts[i] = (i % 7 == 3) ? 0 : static_cast<int>(i % 5) + 1;
+			SubLineIndex index;
+			index.Reset(static_cast<int>(counts.size()));
+			Assert::AreEqual(100, Check(index, counts, 100));
+			Assert::AreEqual(900, Check(index, counts, 1000));
+
+			int nSubLineIndex = 0;
+			for (int i = 0; i < static_cast<int>(counts.size()); ++i)
+			{
+				for (int j = 0; j < counts[i]; ++j)
+				{
+					int nSubLine = -1;
+					Assert::AreEqual(i, index.GetLineBySubLine(nSubLineIndex + j, nSubLine));
+					Assert::AreEqual(j, nSubLine);
+				}
+				nSubLineIndex += counts[i];
+			}
+		}
+		TEST_METHOD(Invalidate)
+		{
+			std::vector<int> counts(1000, 1);
+			SubLineIndex index;
+			index.Reset(static_cast<int>(counts.size()));
+			Check(index, counts, 1000);
+
+			// Only the invalidated lines are computed again
+			counts[10] = 3;
+			counts[500] = 2;
+			index.Invalidate(10, 10);
+			index.Invalidate(500, 501);
+			Assert::AreEqual(3, Check(index, counts, 1000));
+
+			index.Invalidate(900, -1);
+			Assert::AreEqual(0, Check(index, counts, 800));
+			Assert::AreEqual(100, Check(index, counts, 1000));
+		}
+		TEST_METHOD(MoveLines)
+		{
+			std::vector<int> counts(1000, 2);
+			SubLineIndex index;
+			index.Reset(static_cast<int>(counts.size()));
+			Check(index, counts, 1000);
+
+			// Split line 5 into 3 lines
+			counts.insert(counts.begin() + 5, 2, 1);
+			index.MoveLines(5, 2);
+			index.Invalidate(5, 7);
+			Assert::AreEqual(3, Check(index, counts, 1002));
+
+			// Join lines 60 to 62
+			counts.erase(counts.begin() + 61, counts.begin() + 63);
+			counts[60] = 4;
+			index.MoveLines(60, -2);
+			index.Invalidate(60, 60);
+			Assert::AreEqual(1, Check(index, counts, 1000));
+
+			// Delete lines below the valid counts
+			index.Invalidate(800, -1);
+			counts.erase(counts.begin() + 900, counts.begin() + 950);
+			index.MoveLines(900, -50);
+			Assert::AreEqual(150, Check(index, counts, 950));
+		}
+	};
+}
@@ -0,0 +1,99 @@
+#include "pch.h"
+#include "CppUnitTest.h"
+#include "../editlib/UndoJournal.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace test
+{
+	TEST_CLASS(UndoJournalTests)
+	{
+	public:
+		TEST_METHOD(AppendAndGet)
+		{
+			UndoJournal journal;
+			std::vector<uint32_t> revisions = { 5, 5, 6, 1, 0xffffffff, 7 };
+			journal.Append(UNDO_BEGINGROUP | UNDO_INSERT, 1, CEPoint(0, 0), CEPoint(4, 0), _T("Test"), 4, &revisions);
+			journal.Append(0, 2, CEPoint(1, 2), CEPoint(3, 4), _T(""), 0, nullptr);
+			Assert::AreEqual(static_cast<size_t>(2), journal.size());
+			Assert::AreEqual(2, journal[1].m_nAction);
+
+			UndoRecord ur = journal.GetRecord(0);
+			Assert::IsTrue(ur.m_dwFlags == (UNDO_BEGINGROUP | UNDO_INSERT));
+			Assert::AreEqual(4, ur.m_ptEndPos.x);
+			Assert::AreEqual(std::basic_string<tchar_t>(_T("Test")), std::basic_string<tchar_t>(ur.GetText(), ur.GetTextLength()));
+			Assert::IsTrue(*ur.m_paSavedRevisionNumbers == revisions);
+
+			UndoRecord ur2 = journal.GetRecord(1);
+			Assert::AreEqual(static_cast<size_t>(0), ur2.GetTextLength());
+			Assert::IsTrue(ur2.m_paSavedRevisionNumbers->empty());
+		}
+		TEST_METHOD(LargeText)
+		{
+			UndoJournal journal;
+			std::basic_string<tchar_t> text;
+			for (int i = 0; i < 100000; ++i)
+				text += _T("line\n");
+			std::vector<uint32_t> revisions(100000, 3);
+			journal.Append(UNDO_BEGINGROUP, 1, CEPoint(0, 0), CEPoint(0, 100000), text.c_str(), text.length(), &revisions);
+			journal.Append(UNDO_BEGINGROUP, 1, CEPoint(0, 0), CEPoint(1, 0), _T("a"), 1, nullptr);
+			// The first text may be compressed now
+			UndoRecord ur = journal.GetRecord(0);
+			Assert::IsTrue(text == std::basic_string<tchar_t>(ur.GetText(), ur.GetTextLength()));
+			Assert::IsTrue(*ur.m_paSavedRevisionNumbers == revisions);
+		}
+		TEST_METHOD(CompressOldRecords)
+		{
+			UndoJournal journal;
+			// Texts of this size share a chunk with the records after them
+			std::basic_string<tchar_t> text;
+			for (int i = 0; i < 20000; ++i)
+				text += _T("line\n");
+			std::vector<uint32_t> revisions(20000, 3);
+			std::vector<std::basic_string<tchar_t>> texts;
+			for (int i = 0; i < 1000; ++i)
+			{
+				texts.push_back((i % 100 == 0) ? text : std::basic_string<tchar_t>(i % 7 + 1, 'a' + i % 26));
+				journal.Append(UNDO_BEGINGROUP, 1, CEPoint(0, 0), CEPoint(0, 1), texts.back().c_str(), texts.back().length(), &revisions);
+			}
+			// Old records may be compressed now, the data after them has moved
+			for (size_t i = 0; i < texts.size(); ++i)
+			{
+				UndoRecord ur = journal.GetRecord(i);
+				Assert::IsTrue(texts[i] == std::basic_string<tchar_t>(ur.GetText(), ur.GetTextLength()));
+				Assert::IsTrue(*ur.m_paSavedRevisionNumbers == revisions);
+			}
+		}
+		TEST_METHOD(Resize)
+		{
+			UndoJournal journal;
+			journal.Append(UNDO_BEGINGROUP, 1, CEPoint(0, 0), CEPoint(1, 0), _T("a"), 1, nullptr);
+			journal.Append(UNDO_BEGINGROUP, 1, CEPoint(0, 0), CEPoint(1, 0), _T("b"), 1, nullptr);
+			journal.resize(1);
+			journal.Append(UNDO_BEGINGROUP, 1, CEPoint(0, 0), CEPoint(1, 0), _T("c"), 1, nullptr);
+			Assert::AreEqual(static_cast<size_t>(2), journal.size());
+			UndoRecord ur = journal.GetRecord(1);
+			Assert::AreEqual(std::basic_string<tchar_t>(_T("c")), std::basic_string<tchar_t>(ur.GetText(), ur.GetTextLength()));
+		}
+		TEST_METHOD(Trim)
+		{
+			UndoJournal journal;
+			journal.SetMaxMemory(4 * 1024 * 1024);
+			std::basic_string<tchar_t> text(300000, 'x');
+			size_t nDiscarded = 0;
+			int nDiscardedGroups = 0;
+			for (int i = 0; i < 100; ++i)
+			{
+				journal.Append(UNDO_BEGINGROUP, 1, CEPoint(0, 0), CEPoint(0, 1), text.c_str(), text.length(), nullptr);
+				journal.Append(0, 1, CEPoint(0, 0), CEPoint(0, 1), _T("a"), 1, nullptr);
+				int nGroups = 0;
+				nDiscarded += journal.Trim(nGroups);
+				nDiscardedGroups += nGroups;
+			}
+			Assert::IsTrue(journal.GetMemoryUsage() <= journal.GetMaxMemory());
+			Assert::AreEqual(static_cast<size_t>(200), journal.size() + nDiscarded);
+			Assert::AreEqual(static_cast<size_t>(nDiscardedGroups * 2), nDiscarded);
+			Assert::IsTrue((journal[0].m_dwFlags & UNDO_BEGINGROUP) != 0);
+		}
+	};
+}
@@ -33,18 +33,34 @@ THE SOFTWARE.
 #include <cstdio>
 #include <cassert>
 #include <memory>
+#include <vector>
 #include <Poco/SharedMemory.h>
 #include <Poco/Exception.h>
+#include <Poco/Environment.h>
 #include "UnicodeString.h"
 #include "unicoder.h"
 #include "paths.h" // paths::GetLongbPath()
 #include "TFile.h"
 #include "cio.h"
+#include "WorkStealingPool.h"
 #include <windows.h>
 
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define USE_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
 using Poco::SharedMemory;
 using Poco::Exception;
 
+/** @brief Size of the blocks UniMemFile::ReadLines() transcodes at once. */
+static const size_t READLINES_BLOCK_SIZE = 256 * 1024;
+/** @brief Files smaller than this are read by UniMemFile::ReadLines() in the calling thread. */
+static const int64_t PARALLEL_READLINES_MIN_SIZE = 4 * 1024 * 1024;
+
 static void Append(String &strBuffer, const tchar_t *pchTail, size_t cchTail,
 		size_t cchBufferMin = 1024);
 
@@ -645,6 +661,298 @@ bool UniMemFile::ReadString(String & line, String & eol, bool * lossy)
 	return true;
 }
 
+#ifdef USE_SSE2
+static inline unsigned CountTrailingZeros(unsigned mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return static_cast<unsigned>(index);
+#else
+	return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+#endif
+
+/**
+ * @brief Find the first CR, LF or zero character.
+ * @param [in] p Characters to search.
+ * @param [in] len Number of characters.
+ * @return Index of the character found, @p len if there is none.
+ */
+static size_t FindEolOrZero(const tchar_t *p, size_t len)
+{
+	size_t i = 0;
+#ifdef USE_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	if constexpr (sizeof(tchar_t) == 2)
+	{
+		const __m128i cr = _mm_set1_epi16('\r');
+		const __m128i lf = _mm_set1_epi16('\n');
+		for (; i + 8 <= len; i += 8)
+		{
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+			const __m128i found = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(v, cr), _mm_cmpeq_epi16(v, lf)), _mm_cmpeq_epi16(v, zero));
+			const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(found));
+			if (mask != 0)
+				return i + CountTrailingZeros(mask) / 2;
+		}
+	}
+	else
+	{
+		const __m128i cr = _mm_set1_epi8('\r');
+		const __m128i lf = _mm_set1_epi8('\n');
+		for (; i + 16 <= len; i += 16)
+		{
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+			const __m128i found = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf)), _mm_cmpeq_epi8(v, zero));
+			const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(found));
+			if (mask != 0)
+				return i + CountTrailingZeros(mask);
+		}
+	}
+#endif
+	for (; i < len; ++i)
+	{
+		if (p[i] == '\r' || p[i] == '\n' || p[i] == 0)
+			break;
+	}
+	return i;
+}
+
+namespace
+{
+
+/** @brief A block of a file read by UniMemFile::ReadLines(). */
+struct LineBlock
+{
+	const unsigned char *begin = nullptr; /**< Start of the block in the file. */
+	const unsigned char *end = nullptr; /**< End of the block, after an EOL or at the end of file. */
+	String text; /**< Transcoded text, unused for UCS-2LE which is read in place. */
+	const tchar_t *pchText = nullptr; /**< Text of the lines with their EOLs. */
+	size_t cchText = 0; /**< Number of characters in pchText. */
+	std::vector<size_t> lineEnds; /**< End of each line with an EOL in pchText. */
+	UniFile::txtstats stats; /**< EOL and zero counts of the block. */
+	bool lossy = false; /**< Was the transcoding lossy? The block is read again with ReadString(). */
+};
+
+}
+
+/**
+ * @brief Transcode a block and split it into lines, counting EOLs and zeros.
+ * @param [in, out] block Block to read, begin and end must be set.
+ * @param [in] codepage Codepage of 8-bit and UTF-8 text.
+ * @param [in] charsize 2 if the block is UCS-2LE text, 1 otherwise.
+ */
+static void ReadLineBlock(LineBlock & block, int codepage, int charsize)
+{
+	block.lineEnds.clear();
+	block.stats.clear();
+	block.lossy = false;
+	if (charsize == 2)
+	{
+		block.pchText = reinterpret_cast<const tchar_t *>(block.begin);
+		block.cchText = (block.end - block.begin) / 2;
+	}
+	else
+	{
+		if (!ucr::maketstring(block.text, reinterpret_cast<const char *>(block.begin), block.end - block.begin, codepage, &block.lossy))
+			block.lossy = true;
+		if (block.lossy)
+			return;
+		block.pchText = block.text.c_str();
+		block.cchText = block.text.length();
+	}
+
+	const tchar_t *pchText = block.pchText;
+	const size_t cchText = block.cchText;
+	size_t i = 0;
+	for (;;)
+	{
+		i += FindEolOrZero(pchText + i, cchText - i);
+		if (i >= cchText)
+			break;
+		const tchar_t ch = pchText[i++];
+		if (ch == '\n')
+		{
+			++block.stats.nlfs;
+		}
+		else if (ch == '\r')
+		{
+			// Blocks never end between CR and LF
+			if (i < cchText && pchText[i] == '\n')
+			{
+				++i;
+				++block.stats.ncrlfs;
+			}
+			else
+			{
+				++block.stats.ncrs;
+			}
+		}
+		else
+		{
+			RecordZero(block.stats, i - 1);
+			continue;
+		}
+		block.lineEnds.push_back(i);
+	}
+}
+
+/**
+ * @brief Read all remaining lines at once.
+ * The file is transcoded and split into lines in large blocks, on several
+ * threads for large files, and the text stats are counted in the same pass.
+ * Blocks which cannot be transcoded losslessly are read again with
+ * ReadString(), so the lines are the same as when read one by one.
+ * @param [in] addLine Called for each line in order, with its EOL chars.
+ * @return false if the encoding of the file is not handled, nothing is read then.
+ */
+bool UniMemFile::ReadLines(const std::function<void(const tchar_t *pchLine, size_t cchLine)>& addLine)
+{
+	int codepage = m_codepage;
+	int charsize = 1;
+#ifdef _UNICODE
+	if (m_unicoding == ucr::UCS2LE)
+		charsize = 2;
+	else
+#endif
+	if (m_unicoding == ucr::UTF8)
+		codepage = ucr::CP_UTF_8;
+	else if (m_unicoding != ucr::NONE)
+		return false;
+	else
+	{
+		if (codepage == -1)
+			codepage = ucr::getDefaultCodepage();
+		// Other codepages need a converter which is not used from other threads
+		if (codepage != CP_ACP && !IsValidCodePage(codepage))
+			return false;
+		// Blocks are cut at CR and LF bytes, which are not EOLs in EBCDIC codepages
+		String eol;
+		bool lossy = false;
+		if (!ucr::maketstring(eol, "\r\n", 2, codepage, &lossy) || lossy || eol != _T("\r\n"))
+			return false;
+	}
+
+	const unsigned char *end = m_base + m_filesize;
+	// ReadString() ignores an odd byte at the end of UCS-2 files
+	end -= (end - m_current) % charsize;
+
+	// Blocks are split after an EOL, so that they hold whole lines
+	const unsigned char *next = m_current;
+	auto findBlockEnd = [end, charsize](const unsigned char *p) -> const unsigned char *
+	{
+		for (; p + charsize <= end; p += charsize)
+		{
+			const unsigned ch = (charsize == 2) ? (p[0] | (p[1] << 8)) : p[0];
+			if (ch == '\n')
+				return p + charsize;
+			if (ch == '\r')
+			{
+				const unsigned char *q = p + charsize;
+				if (q + charsize <= end && q[0] == '\n' && (charsize == 1 || q[1] == 0))
+					return q + charsize;
+				return q;
+			}
+		}
+		return end;
+	};
+
+	const int nThreads = static_cast<int>(Poco::Environment::processorCount());
+	const bool bParallel = (end - m_current >= PARALLEL_READLINES_MIN_SIZE && nThreads >= 2);
+
+	// A batch of blocks is transcoded while the previous one is passed to addLine
+	const size_t nBatchBlocks = bParallel ? 2 * nThreads : 1;
+	std::vector<LineBlock> batches[2] = { std::vector<LineBlock>(nBatchBlocks), std::vector<LineBlock>(nBatchBlocks) };
+	// Declared after the batches, so that the pool is destroyed, and its
+	// tasks finished, before the blocks they write to
+	std::unique_ptr<WorkStealingPool> pPool;
+	if (bParallel)
+		pPool.reset(new WorkStealingPool(nThreads));
+	auto startBatch = [&](std::vector<LineBlock>& batch) -> size_t
+	{
+		size_t nBlocks = 0;
+		for (; nBlocks < batch.size() && next < end; ++nBlocks)
+		{
+			LineBlock& block = batch[nBlocks];
+			block.begin = next;
+			block.end = (end - next > READLINES_BLOCK_SIZE) ? findBlockEnd(next + READLINES_BLOCK_SIZE) : end;
+			next = block.end;
+			auto task = [&block, codepage, charsize]() { ReadLineBlock(block, codepage, charsize); };
+			if (pPool)
+				pPool->Submit(task);
+			else
+				task();
+		}
+		return nBlocks;
+	};
+	// ReadString() handles lossy text line by line, as it did before
+	auto readLines = [&](const unsigned char *stop)
+	{
+		String line, eol;
+		while (m_current < stop)
+		{
+			const unsigned char *current = m_current;
+			bool lossy = false;
+			const bool more = ReadString(line, eol, &lossy);
+			line += eol;
+			if (!line.empty())
+				addLine(line.c_str(), line.length());
+			if (!more || m_current == current)
+				break;
+		}
+	};
+	auto addBlockLines = [&](LineBlock& block)
+	{
+		if (block.lossy)
+		{
+			m_current = const_cast<unsigned char *>(block.begin);
+			readLines(block.end);
+			return;
+		}
+		size_t nLineStart = 0;
+		for (size_t nLineEnd : block.lineEnds)
+		{
+			addLine(block.pchText + nLineStart, nLineEnd - nLineStart);
+			nLineStart = nLineEnd;
+		}
+		if (nLineStart < block.cchText)
+			addLine(block.pchText + nLineStart, block.cchText - nLineStart);
+		m_current = const_cast<unsigned char *>(block.end);
+		m_lineno += static_cast<int>(block.lineEnds.size());
+		m_txtstats.ncrs += block.stats.ncrs;
+		m_txtstats.nlfs += block.stats.nlfs;
+		m_txtstats.ncrlfs += block.stats.ncrlfs;
+		m_txtstats.nzeros += block.stats.nzeros;
+	};
+
+	int current = 0;
+	size_t nBlocks = startBatch(batches[current]);
+	if (pPool)
+		pPool->Wait();
+	bool inSync = true;
+	while (nBlocks > 0)
+	{
+		const size_t nNextBlocks = startBatch(batches[1 - current]);
+		for (size_t i = 0; i < nBlocks && inSync; ++i)
+		{
+			addBlockLines(batches[current][i]);
+			// A bad UTF-8 sequence may have swallowed the EOL ending the block
+			inSync = (m_current == batches[current][i].end);
+		}
+		if (pPool)
+			pPool->Wait();
+		if (!inSync)
+			break;
+		current = 1 - current;
+		nBlocks = nNextBlocks;
+	}
+	if (!inSync)
+		readLines(end);
+	return true;
+}
+
 /**
  * @brief Write one line (doing any needed conversions)
  */
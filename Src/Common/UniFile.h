@@ -10,6 +10,7 @@
 
 #include "unicoder.h"
 #include <cstdio>
+#include <functional>
 
 namespace Poco { class SharedMemory; }
 
@@ -195,6 +196,7 @@ public:
 	virtual bool ReadString(String & line, bool * lossy) override;
 	virtual bool ReadString(String & line, String & eol, bool * lossy) override;
 	virtual bool ReadStringAll(String & line) override;
+	bool ReadLines(const std::function<void(const tchar_t *pchLine, size_t cchLine)>& addLine);
 	virtual int64_t GetPosition() const override { return m_current - m_base; }
 	virtual bool WriteString(const String & line) override;
 	unsigned char* GetBase() const { return m_base; }
@@ -24,10 +24,12 @@ namespace cio
 	ssize_t read(int fd, void* buf, size_t size);
 	ssize_t write(int fd, const void* buf, size_t size);
 	constexpr auto close = ::_close;
+	constexpr auto lseek = ::_lseeki64;
 	constexpr auto fstat = ::myfstat;
 	constexpr auto pipe = ::_pipe;
 #else
 #define O_BINARY (0)
+#define O_SEQUENTIAL (0)
 #define _SH_DENYNO (0)
 #define _S_IREAD  (S_IRUSR | S_IRGRP | S_IROTH)
 #define _S_IWRITE (S_IWUSR | S_IWGRP | S_IWOTH)
@@ -37,6 +39,7 @@ namespace cio
 	constexpr auto read = ::read;
 	constexpr auto write = ::write;
 	constexpr auto close = ::close;
+	constexpr auto lseek = ::lseek;
 	constexpr auto fstat = ::fstat;
 	constexpr auto pipe = ::pipe;
 #endif
@@ -6,10 +6,12 @@
 
 #include "pch.h"
 #include "BinaryCompare.h"
+#include <memory>
 #include "DiffItem.h"
 #include "PathContext.h"
 #include "IAbortable.h"
 #include "cio.h"
+#include "MappedFile.h"
 
 namespace CompareEngines
 {
@@ -29,16 +31,47 @@ void BinaryCompare::SetAbortable(const IAbortable * piAbortable)
 	m_piAbortable = const_cast<IAbortable*>(piAbortable);
 }
 
-static int compare_files(const String& file1, const String& file2, IAbortable *piAbortable)
+/**
+ * @brief Compare two memory-mapped files of the same size.
+ */
+static int compare_mapped_files(const MappedFile& file1, const MappedFile& file2, IAbortable *piAbortable)
 {
+	const int64_t windowsize = 1024 * 1024 * 8;
+	const char *p1 = file1.begin();
+	const char *p2 = file2.begin();
+	while (p1 < file1.end())
+	{
+		if (piAbortable && piAbortable->ShouldAbort())
+			return DIFFCODE::CMPABORT;
+		const size_t size = static_cast<size_t>((std::min)(file1.end() - p1, windowsize));
+		if (memcmp(p1, p2, size) != 0)
+			return DIFFCODE::DIFF;
+		p1 += size;
+		p2 += size;
+	}
+	return DIFFCODE::SAME;
+}
+
+static int compare_files(const String& file1, const String& file2, int64_t size1, int64_t size2, IAbortable *piAbortable)
+{
+	if (size1 == size2)
+	{
+		MappedFile mapped1, mapped2;
+		if (mapped1.Open(file1, size1) && mapped2.Open(file2, size2))
+			return compare_mapped_files(mapped1, mapped2, piAbortable);
+	}
+
 	const size_t bufsize = 1024 * 256;
 	int code;
 	int fd1 = -1, fd2 = -1;
 	
-	cio::tsopen_s(&fd1, file1, O_BINARY | O_RDONLY, _SH_DENYNO, _S_IREAD);
-	cio::tsopen_s(&fd2, file2, O_BINARY | O_RDONLY, _SH_DENYNO, _S_IREAD);
+	cio::tsopen_s(&fd1, file1, O_BINARY | O_RDONLY | O_SEQUENTIAL, _SH_DENYNO, _S_IREAD);
+	cio::tsopen_s(&fd2, file2, O_BINARY | O_RDONLY | O_SEQUENTIAL, _SH_DENYNO, _S_IREAD);
 	if (fd1 != -1 && fd2 != -1)
 	{
+		// Too large for the stack of the compare threads
+		std::unique_ptr<char[]> buf1(new char[bufsize]);
+		std::unique_ptr<char[]> buf2(new char[bufsize]);
 		for (;;)
 		{
 			if (piAbortable && piAbortable->ShouldAbort())
@@ -46,10 +79,8 @@ static int compare_files(const String& file1, const String& file2, IAbortable *p
 				code = DIFFCODE::CMPABORT;
 				break;
 			}
-			char buf1[bufsize];
-			char buf2[bufsize];
-			int size1 = cio::read_i(fd1, buf1, sizeof(buf1));
-			int size2 = cio::read_i(fd2, buf2, sizeof(buf2));
+			int size1 = cio::read_i(fd1, buf1.get(), bufsize);
+			int size2 = cio::read_i(fd2, buf2.get(), bufsize);
 			if (size1 <= 0 || size2 <= 0)
 			{
 				if (size1 < 0 || size2 < 0)
@@ -60,7 +91,7 @@ static int compare_files(const String& file1, const String& file2, IAbortable *p
 					code = DIFFCODE::DIFF;
 				break;
 			}
-			if (size1 != size2 || memcmp(buf1, buf2, size1) != 0)
+			if (size1 != size2 || memcmp(buf1.get(), buf2.get(), size1) != 0)
 			{
 				code = DIFFCODE::DIFF;
 				break;
@@ -97,7 +128,7 @@ int BinaryCompare::CompareFiles(const PathContext& files, const DIFFITEM &di) co
 			(di.diffFileInfo[p1].size != di.diffFileInfo[p2].size &&
 			 di.diffFileInfo[p1].size != 0 && di.diffFileInfo[p2].size != 0))
 			return DIFFCODE::DIFF;
-		return compare_files(files[p1], files[p2], m_piAbortable);
+		return compare_files(files[p1], files[p2], di.diffFileInfo[p1].size, di.diffFileInfo[p2].size, m_piAbortable);
 	};
 	switch (files.GetSize())
 	{
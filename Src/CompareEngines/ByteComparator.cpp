@@ -7,10 +7,23 @@
 #include "pch.h"
 #include "ByteComparator.h"
 #include <cassert>
+#include <algorithm>
 #include "UnicodeString.h"
 #include "FileTextStats.h"
 #include "CompareOptions.h"
 
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define BYTECOMPARATOR_SIMD 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#include <cpuid.h>
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
 /**
  * @brief Returns if given char is EOL byte.
  * @param [in] ch Char to test.
@@ -32,6 +45,201 @@ static inline bool iswsch(tchar_t ch)
 	return ch == ' ' || ch == '\t';
 }
 
+namespace
+{
+
+/** @brief Indexes of the byte counts computed by the CountBytes kernels. */
+enum
+{
+	COUNT_CR, /**< CR bytes */
+	COUNT_LF, /**< LF bytes */
+	COUNT_CRLF, /**< CR bytes followed by a LF byte */
+	COUNT_ZERO, /**< Zero bytes */
+	COUNT_MAX
+};
+
+/**
+ * @brief Buffer scanning kernels, selected once for the running CPU.
+ */
+struct Kernels
+{
+	/** Return the number of leading bytes that are equal in both buffers. */
+	size_t (*FindMismatch)(const char *p0, const char *p1, size_t len);
+	/** Add the counts of EOL and zero bytes in a buffer to counts[COUNT_MAX]. */
+	void (*CountBytes)(const char *p, size_t len, size_t counts[]);
+};
+
+size_t FindMismatchScalar(const char *p0, const char *p1, size_t len)
+{
+	return std::mismatch(p0, p0 + len, p1).first - p0;
+}
+
+void CountBytesScalar(const char *p, size_t len, size_t counts[])
+{
+	for (size_t i = 0; i < len; ++i)
+	{
+		const char ch = p[i];
+		if (ch == 0)
+			++counts[COUNT_ZERO];
+		else if (ch == '\r')
+		{
+			++counts[COUNT_CR];
+			if (i + 1 < len && p[i + 1] == '\n')
+				++counts[COUNT_CRLF];
+		}
+		else if (ch == '\n')
+			++counts[COUNT_LF];
+	}
+}
+
+#ifdef BYTECOMPARATOR_SIMD
+
+inline unsigned CountTrailingZeros(unsigned mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+size_t FindMismatchSSE2(const char *p0, const char *p1, size_t len)
+{
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16)
+	{
+		const __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p0 + i));
+		const __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p1 + i));
+		const unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v0, v1));
+		if (mask != 0xFFFF)
+			return i + CountTrailingZeros(~mask);
+	}
+	return i + FindMismatchScalar(p0 + i, p1 + i, len - i);
+}
+
+inline size_t SumBytes(__m128i v)
+{
+	const __m128i sums = _mm_sad_epu8(v, _mm_setzero_si128());
+	return _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+}
+
+void CountBytesSSE2(const char *p, size_t len, size_t counts[])
+{
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i lf = _mm_set1_epi8('\n');
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+	// A block also looks at the first byte of the next block for CR/LF pairs
+	while (i + 16 < len)
+	{
+		// Byte counters overflow after 255 blocks
+		__m128i ncr = zero, nlf = zero, ncrlf = zero, nzero = zero;
+		for (int j = 0; j < 255 && i + 16 < len; ++j, i += 16)
+		{
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+			const __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i + 1));
+			const __m128i iscr = _mm_cmpeq_epi8(v, cr);
+			ncr = _mm_sub_epi8(ncr, iscr);
+			nlf = _mm_sub_epi8(nlf, _mm_cmpeq_epi8(v, lf));
+			ncrlf = _mm_sub_epi8(ncrlf, _mm_and_si128(iscr, _mm_cmpeq_epi8(next, lf)));
+			nzero = _mm_sub_epi8(nzero, _mm_cmpeq_epi8(v, zero));
+		}
+		counts[COUNT_CR] += SumBytes(ncr);
+		counts[COUNT_LF] += SumBytes(nlf);
+		counts[COUNT_CRLF] += SumBytes(ncrlf);
+		counts[COUNT_ZERO] += SumBytes(nzero);
+	}
+	CountBytesScalar(p + i, len - i, counts);
+}
+
+TARGET_AVX2 size_t FindMismatchAVX2(const char *p0, const char *p1, size_t len)
+{
+	size_t i = 0;
+	for (; i + 32 <= len; i += 32)
+	{
+		const __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p0 + i));
+		const __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p1 + i));
+		const unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v0, v1)));
+		if (mask != 0xFFFFFFFF)
+			return i + CountTrailingZeros(~mask);
+	}
+	return i + FindMismatchSSE2(p0 + i, p1 + i, len - i);
+}
+
+TARGET_AVX2 inline size_t SumBytes(__m256i v)
+{
+	const __m256i sums = _mm256_sad_epu8(v, _mm256_setzero_si256());
+	const __m128i sum = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+	return _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+}
+
+TARGET_AVX2 void CountBytesAVX2(const char *p, size_t len, size_t counts[])
+{
+	const __m256i cr = _mm256_set1_epi8('\r');
+	const __m256i lf = _mm256_set1_epi8('\n');
+	const __m256i zero = _mm256_setzero_si256();
+	size_t i = 0;
+	while (i + 32 < len)
+	{
+		__m256i ncr = zero, nlf = zero, ncrlf = zero, nzero = zero;
+		for (int j = 0; j < 255 && i + 32 < len; ++j, i += 32)
+		{
+			const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+			const __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i + 1));
+			const __m256i iscr = _mm256_cmpeq_epi8(v, cr);
+			ncr = _mm256_sub_epi8(ncr, iscr);
+			nlf = _mm256_sub_epi8(nlf, _mm256_cmpeq_epi8(v, lf));
+			ncrlf = _mm256_sub_epi8(ncrlf, _mm256_and_si256(iscr, _mm256_cmpeq_epi8(next, lf)));
+			nzero = _mm256_sub_epi8(nzero, _mm256_cmpeq_epi8(v, zero));
+		}
+		counts[COUNT_CR] += SumBytes(ncr);
+		counts[COUNT_LF] += SumBytes(nlf);
+		counts[COUNT_CRLF] += SumBytes(ncrlf);
+		counts[COUNT_ZERO] += SumBytes(nzero);
+	}
+	CountBytesSSE2(p + i, len - i, counts);
+}
+
+/**
+ * @brief Check if the CPU and the OS support AVX2 instructions.
+ */
+bool IsAVX2Supported()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	__cpuid(info, 1);
+	// OSXSAVE and AVX, and YMM state saved by the OS
+	if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // BYTECOMPARATOR_SIMD
+
+const Kernels& GetKernels()
+{
+#ifdef BYTECOMPARATOR_SIMD
+	// SSE2 is the baseline of all x86 and x64 targets
+	static const Kernels kernels = IsAVX2Supported() ?
+		Kernels{ FindMismatchAVX2, CountBytesAVX2 } : Kernels{ FindMismatchSSE2, CountBytesSSE2 };
+#else
+	static const Kernels kernels = { FindMismatchScalar, CountBytesScalar };
+#endif
+	return kernels;
+}
+
+}
+
 /**
  * @brief Calculates statistics from given buffer.
  * This function calculates EOL byte and zero-byte statistics from given
@@ -59,43 +267,21 @@ static void TextScan(FileTextStats & stats, const char *ptr, const char *end, bo
 			++stats.ncrs;
 		}
 	}
-	for (; ptr < end; ++ptr)
-	{
-		char ch = *ptr;
-		if (ch == 0)
-		{
-			++stats.nzeros;
-		}
-		else if (ch == '\r')
-		{
-			if (ptr + 1 < end)
-			{
-				if (ptr[1] == '\n')
-				{
-					++stats.ncrlfs;
-					++ptr;
-				}
-				else
-				{
-					++stats.ncrs;
-				}
-			}
-			else if (eof)
-			{
-				++stats.ncrs;
-			}
-			else
-			{
-				// else last byte of buffer
-				// leave alone, the CompareBuffers loop will set the appropriate m_cr flag
-				// and we'll handle it next time we're called
-			}
-		}
-		else if (ch == '\n')
-		{
-			++stats.nlfs;
-		}
-	}
+	if (ptr >= end)
+		return;
+
+	size_t counts[COUNT_MAX] = {};
+	GetKernels().CountBytes(ptr, end - ptr, counts);
+	size_t ncrs = counts[COUNT_CR] - counts[COUNT_CRLF];
+	// A CR at the end of the buffer may be the first half of a CR/LF pair.
+	// Leave it alone, the CompareBuffers loop will set the appropriate m_cr
+	// flag and we'll handle it next time we're called
+	if (end[-1] == '\r' && !eof)
+		--ncrs;
+	stats.ncrs += static_cast<int>(ncrs);
+	stats.nlfs += static_cast<int>(counts[COUNT_LF] - counts[COUNT_CRLF]);
+	stats.ncrlfs += static_cast<int>(counts[COUNT_CRLF]);
+	stats.nzeros += static_cast<int>(counts[COUNT_ZERO]);
 }
 
 namespace CompareEngines
@@ -129,6 +315,9 @@ ByteComparator::ByteComparator(const QuickCompareOptions * options)
 		m_ignore_all_space = true;
 	else
 		m_ignore_all_space = false;
+
+	m_compare_bytes = !m_ignore_case && !m_ignore_space_change && !m_ignore_all_space &&
+		!m_ignore_eol_diff && !m_ignore_blank_lines;
 }
 
 static const char* SkipBlankLines(const char* p, const char* end)
@@ -182,6 +371,20 @@ ByteComparator::COMP_RESULT ByteComparator::CompareBuffers(
 	const char *orig0 = ptr0;
 	const char *orig1 = ptr1;
 
+	if (m_compare_bytes)
+	{
+		// Without ignore options the loop below only compares bytes, so skip
+		// the equal bytes at once
+		const size_t len = GetKernels().FindMismatch(ptr0, ptr1, (std::min)(end0 - ptr0, end1 - ptr1));
+		ptr0 += len;
+		ptr1 += len;
+		if (ptr0 < end0 && ptr1 < end1)
+		{
+			result = RESULT_DIFF;
+			goto exit;
+		}
+	}
+
 	// cycle through buffer data performing actual comparison
 	while (true)
 	{
@@ -16,6 +16,7 @@
 #include "diff.h"
 #include "ByteComparator.h"
 #include "DiffFileData.h"
+#include "MappedFile.h"
 
 namespace CompareEngines
 {
@@ -25,6 +26,23 @@ static const int KILO = 1024; // Kilo(byte)
 /** @brief Quick contents compare's file buffer size. */
 static const int WMCMPBUFF = 32 * KILO;
 
+/** @brief Amount of mapped file data compared between checks for abort. */
+static const int64_t MAPPEDWINDOW = 8 * KILO * KILO;
+
+/**
+ * @brief Check if the remaining difference is only a missing EOL at the end
+ * of one of the files.
+ */
+static bool IsMissingTrailingEol(const char* ptr0, const char* end0, const char* ptr1, const char* end1,
+		const bool eof[2], const std::string lasteol[2])
+{
+	return ((eof[0] || eof[1]) &&
+		((end0 - ptr0 <= 1 && (lasteol[0] == "\r" || lasteol[0] == "\n" || lasteol[0] == "\r\n") && (end1 == ptr1))) ||
+		((end0 - ptr0 == 2 && (lasteol[0] == "\r\n") && (end1 == ptr1))) ||
+		((end1 - ptr1 <= 1 && (lasteol[1] == "\r" || lasteol[1] == "\n" || lasteol[1] == "\r\n") && (end0 == ptr0))) ||
+		((end1 - ptr1 == 2 && (lasteol[1] == "\r\n") && (end0 == ptr0))));
+}
+
 /**
  * @brief Default constructor.
  */
@@ -75,6 +93,12 @@ int ByteCompare::CompareFiles(DiffFileData* diffData)
 	diffData->m_textStats[0].clear();
 	diffData->m_textStats[1].clear();
 
+	MappedFile mapped[2];
+	if (mapped[0].Open(diffData->m_FileLocation[0].filepath, diffData->m_inf[0].stat.st_size) &&
+		mapped[1].Open(diffData->m_FileLocation[1].filepath, diffData->m_inf[1].stat.st_size))
+		return CompareMappedFiles(diffData, mapped);
+	mapped[0].Close();
+
 	// TODO
 	// Right now, we assume files are in 8-bit encoding
 	// because transform code converted any UCS-2 files to UTF-8
@@ -180,13 +204,7 @@ int ByteCompare::CompareFiles(DiffFileData* diffData)
 			{
 				if (m_pOptions->m_bIgnoreMissingTrailingEol)
 				{
-					if ((eof[0] || eof[1]) &&
-						((end0 - ptr0 <= 1 && (lasteol[0] == "\r" || lasteol[0] == "\n" || lasteol[0] == "\r\n") && (end1 == ptr1))) ||
-						((end0 - ptr0 == 2 && (lasteol[0] == "\r\n") && (end1 == ptr1))) ||
-						((end1 - ptr1 <= 1 && (lasteol[1] == "\r" || lasteol[1] == "\n" || lasteol[1] == "\r\n") && (end0 == ptr0))) ||
-						((end1 - ptr1 == 2 && (lasteol[1] == "\r\n") && (end0 == ptr0))))
-						;
-					else
+					if (!IsMissingTrailingEol(ptr0, end0, ptr1, end1, eof, lasteol))
 						diffcode |= DIFFCODE::DIFF;
 				}
 				else
@@ -259,32 +277,103 @@ int ByteCompare::CompareFiles(DiffFileData* diffData)
 		}
 
 		// Did we finish both files?
-		// We set the text/binary status only for fully compared files. Only
-		// then the result is reliable.
 		if (eof[0] && eof[1])
+			return GetResultCode(diffData, diffcode, ptr0 == end0 && ptr1 == end1);
+	}
+	return diffcode;
+}
+
+/**
+ * @brief Compare two memory-mapped files.
+ * The comparator sees the files as contiguous buffers, so the data it could
+ * not compare yet is simply handed to it again with the next window.
+ * @return DIFFCODE
+ */
+int ByteCompare::CompareMappedFiles(DiffFileData* diffData, const MappedFile mapped[2])
+{
+	std::string lasteol[2];
+	unsigned diffcode = 0;
+	int i;
+
+	if (m_pOptions->m_bIgnoreMissingTrailingEol)
+	{
+		for (i = 0; i < 2; ++i)
 		{
-			bool bBin0 = (diffData->m_textStats[0].nzeros > 0);
-			bool bBin1 = (diffData->m_textStats[1].nzeros > 0);
-
-			if (bBin0 && bBin1)
-				diffcode |= DIFFCODE::BIN | DIFFCODE::BINSIDE1 | DIFFCODE::BINSIDE2;
-			else if (bBin0)
-				diffcode |= DIFFCODE::BIN | DIFFCODE::BINSIDE1;
-			else if (bBin1)
-				diffcode |= DIFFCODE::BIN | DIFFCODE::BINSIDE2;
-			else
-				diffcode |= DIFFCODE::TEXT;
+			for (const char* p = mapped[i].end() - 4; p < mapped[i].end(); ++p)
+			{
+				if (*p == '\r' || *p == '\n')
+					lasteol[i].push_back(*p);
+				else
+					lasteol[i].clear();
+			}
+		}
+	}
+
+	ByteComparator comparator(m_pOptions.get());
+
+	const char* ptr0 = mapped[0].begin();
+	const char* ptr1 = mapped[1].begin();
+	for (;;)
+	{
+		if (m_piAbortable != nullptr && m_piAbortable->ShouldAbort())
+			return DIFFCODE::CMPABORT;
 
-			// If either unfinished, they differ
-			if (ptr0 != end0 || ptr1 != end1)
-				diffcode = (diffcode & DIFFCODE::DIFF);
-			if (diffcode & DIFFCODE::DIFF)
+		const char* end0 = ptr0 + (std::min)(mapped[0].end() - ptr0, MAPPEDWINDOW);
+		const char* end1 = ptr1 + (std::min)(mapped[1].end() - ptr1, MAPPEDWINDOW);
+		const bool eof[2] = { end0 == mapped[0].end(), end1 == mapped[1].end() };
+
+		int64_t offset0 = (ptr0 - mapped[0].begin());
+		int64_t offset1 = (ptr1 - mapped[1].begin());
+
+		// NEED_MORE_* results leave ptr0 and ptr1 at the data not compared yet
+		int result = comparator.CompareBuffers(diffData->m_textStats[0], diffData->m_textStats[1],
+				ptr0, ptr1, end0, end1, eof[0], eof[1], offset0, offset1);
+		if (result == ByteComparator::RESULT_DIFF)
+		{
+			if (m_pOptions->m_bStopAfterFirstDiff)
 				return diffcode | DIFFCODE::DIFF;
-			else
-				return diffcode | DIFFCODE::SAME;
+			if (!m_pOptions->m_bIgnoreMissingTrailingEol ||
+				!IsMissingTrailingEol(ptr0, end0, ptr1, end1, eof, lasteol))
+				diffcode |= DIFFCODE::DIFF;
+			ptr0 = end0;
+			ptr1 = end1;
 		}
+
+		if (eof[0] && eof[1])
+			return GetResultCode(diffData, diffcode, ptr0 == end0 && ptr1 == end1);
 	}
-	return diffcode;
+}
+
+/**
+ * @brief Get the result of a compare that reached the end of both files.
+ * We set the text/binary status only for fully compared files. Only
+ * then the result is reliable.
+ * @param [in] diffData Text statistics of the files.
+ * @param [in] diffcode DIFFCODE::DIFF if a difference was found.
+ * @param [in] bFinished Were both files compared to the end?
+ * @return DIFFCODE
+ */
+unsigned ByteCompare::GetResultCode(const DiffFileData* diffData, unsigned diffcode, bool bFinished) const
+{
+	bool bBin0 = (diffData->m_textStats[0].nzeros > 0);
+	bool bBin1 = (diffData->m_textStats[1].nzeros > 0);
+
+	if (bBin0 && bBin1)
+		diffcode |= DIFFCODE::BIN | DIFFCODE::BINSIDE1 | DIFFCODE::BINSIDE2;
+	else if (bBin0)
+		diffcode |= DIFFCODE::BIN | DIFFCODE::BINSIDE1;
+	else if (bBin1)
+		diffcode |= DIFFCODE::BIN | DIFFCODE::BINSIDE2;
+	else
+		diffcode |= DIFFCODE::TEXT;
+
+	// If either unfinished, they differ
+	if (!bFinished)
+		diffcode = (diffcode & DIFFCODE::DIFF);
+	if (diffcode & DIFFCODE::DIFF)
+		return diffcode | DIFFCODE::DIFF;
+	else
+		return diffcode | DIFFCODE::SAME;
 }
 
 } // namespace CompareEngines
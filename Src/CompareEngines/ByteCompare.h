@@ -16,10 +16,13 @@ struct DiffFileData;
 namespace CompareEngines
 {
 
+class MappedFile;
+
 /**
  * @brief A quick compare -compare method implementation class.
  * This compare method compares files in small blocks. Code assumes block size
- * is in range of 32-bit int-type.
+ * is in range of 32-bit int-type. Large files are memory-mapped and compared
+ * in place instead.
  */
 class ByteCompare
 {
@@ -34,6 +37,9 @@ public:
 	int CompareFiles(DiffFileData* diffData);
 
 private:
+	int CompareMappedFiles(DiffFileData* diffData, const MappedFile mapped[2]);
+	unsigned GetResultCode(const DiffFileData* diffData, unsigned diffcode, bool bFinished) const;
+
 	std::unique_ptr<QuickCompareOptions> m_pOptions; /**< Compare options for diffutils. */
 	IAbortable * m_piAbortable;
 };
@@ -0,0 +1,79 @@
+/**
+ * @file  MappedFile.cpp
+ *
+ * @brief Implementation file for MappedFile
+ */
+
+#include "pch.h"
+#include "MappedFile.h"
+#include <Poco/SharedMemory.h>
+#include <Poco/Exception.h>
+#include "TFile.h"
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+using Poco::SharedMemory;
+
+namespace CompareEngines
+{
+
+/**
+ * @brief Largest file mapped at once.
+ * A 32-bit process cannot map files of several gigabytes, and large
+ * mappings would fragment its address space.
+ */
+static const int64_t MAX_SIZE = sizeof(void *) > 4 ? INT64_MAX : 256 * 1024 * 1024;
+
+MappedFile::MappedFile()
+: m_pBegin(nullptr)
+, m_pEnd(nullptr)
+{
+}
+
+MappedFile::~MappedFile() = default;
+
+/**
+ * @brief Map a file into memory.
+ * @param [in] filepath Path of the file to map.
+ * @param [in] size Expected size of the file.
+ * @return true if the whole file is mapped, false if it must be read instead.
+ */
+bool MappedFile::Open(const String& filepath, int64_t size)
+{
+	Close();
+	if (size < MIN_SIZE || size > MAX_SIZE)
+		return false;
+	try
+	{
+		m_pSharedMemory.reset(new SharedMemory(TFile(filepath), SharedMemory::AM_READ));
+	}
+	catch (Poco::Exception&)
+	{
+		return false;
+	}
+	m_pBegin = m_pSharedMemory->begin();
+	m_pEnd = m_pSharedMemory->end();
+	// The file may have changed since its size was read
+	if (m_pBegin == nullptr || m_pEnd - m_pBegin != size)
+	{
+		Close();
+		return false;
+	}
+#ifndef _WIN32
+	// Windows reads ahead on mapped files by itself
+	posix_madvise(const_cast<char *>(m_pBegin), m_pEnd - m_pBegin, POSIX_MADV_SEQUENTIAL);
+#endif
+	return true;
+}
+
+/**
+ * @brief Unmap the file.
+ */
+void MappedFile::Close()
+{
+	m_pSharedMemory.reset();
+	m_pBegin = m_pEnd = nullptr;
+}
+
+} // namespace CompareEngines
@@ -0,0 +1,45 @@
+/**
+ * @file  MappedFile.h
+ *
+ * @brief Declaration file for MappedFile
+ */
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include "UnicodeString.h"
+
+namespace Poco { class SharedMemory; }
+
+namespace CompareEngines
+{
+
+/**
+ * @brief Read-only memory mapping of a whole file.
+ * Compare engines use the mapping to see a large file as one contiguous
+ * buffer instead of reading it in small blocks. Mapping is only worth it
+ * for large files, and it may fail (e.g. address space is exhausted on
+ * 32-bit builds), so callers must be able to fall back to reading the file.
+ */
+class MappedFile
+{
+public:
+	/** @brief Files smaller than this are cheaper to read than to map. */
+	static const int64_t MIN_SIZE = 1024 * 1024;
+
+	MappedFile();
+	~MappedFile();
+
+	bool Open(const String& filepath, int64_t size);
+	void Close();
+	bool IsOpen() const { return m_pSharedMemory != nullptr; }
+	const char *begin() const { return m_pBegin; }
+	const char *end() const { return m_pEnd; }
+
+private:
+	std::unique_ptr<Poco::SharedMemory> m_pSharedMemory;
+	const char *m_pBegin; /**< First byte of the mapped file */
+	const char *m_pEnd; /**< Past-the-end of the mapped file */
+};
+
+} // namespace CompareEngines
@@ -239,6 +239,16 @@ bool DiffUtils::Diff2Files(struct change ** diffs, DiffFileData *diffData,
 	return m_pDiffWrapper->Diff2Files(diffs, diffData, bin_status, bin_file);
 }
 
+/**
+ * @brief Compare several file pairs, concurrently if the files are large.
+ * @sa CDiffWrapper::DiffFilePairs()
+ */
+bool DiffUtils::DiffFilePairs(int nPairs, struct change ** diffs[], DiffFileData * diffData[],
+		int * bin_status[], int nMaxThreads/* = 0*/) const
+{
+	return m_pDiffWrapper->DiffFilePairs(nPairs, diffs, diffData, bin_status, nMaxThreads);
+}
+
 /**
  * @brief Return diff counts for last compare.
  * @param [out] diffs Count of real differences.
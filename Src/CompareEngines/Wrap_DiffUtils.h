@@ -41,6 +41,8 @@ public:
 	int CompareFiles(DiffFileData* diffData);
 	bool Diff2Files(struct change ** diffs, DiffFileData *diffData,
 			int * bin_status, int * bin_file) const;
+	bool DiffFilePairs(int nPairs, struct change ** diffs[], DiffFileData * diffData[],
+			int * bin_status[], int nMaxThreads = 0) const;
 
 	void GetDiffCounts(int & diffs, int & trivialDiffs) const;
 
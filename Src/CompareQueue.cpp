@@ -0,0 +1,219 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  CompareQueue.cpp
+ *
+ * @brief Implementation file for CompareQueue
+ */
+
+#include "pch.h"
+#include "CompareQueue.h"
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include "DebugNew.h"
+
+/**
+ * @brief Constructor.
+ * @param [in] nCapacity Maximum number of queued items, rounded up to a
+ * power of two.
+ */
+CompareQueue::CompareQueue(size_t nCapacity)
+: m_nPushPos(0)
+, m_nPopPos(0)
+, m_nPushed(0)
+, m_nDone(0)
+, m_nPushWaiting(0)
+, m_nPopWaiting(0)
+, m_bClosed(false)
+, m_slotFreed(0, INT_MAX)
+, m_itemAdded(0, INT_MAX)
+{
+	size_t nSize = 2;
+	while (nSize < nCapacity)
+		nSize <<= 1;
+	m_nMask = nSize - 1;
+	m_cells.reset(new Cell[nSize]);
+	for (size_t i = 0; i < nSize; ++i)
+	{
+		m_cells[i].m_sequence.store(i, std::memory_order_relaxed);
+		m_cells[i].m_di = nullptr;
+	}
+}
+
+/**
+ * @brief Append an item, waiting while the queue is full.
+ * @param [in] di Item to compare.
+ */
+void CompareQueue::Push(DIFFITEM *di)
+{
+	assert(!m_bClosed);
+	while (!TryPush(di))
+	{
+		++m_nPushWaiting;
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (TryPush(di))
+		{
+			--m_nPushWaiting;
+			break;
+		}
+		m_slotFreed.wait();
+		--m_nPushWaiting;
+	}
+	++m_nPushed;
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (m_nPopWaiting > 0)
+		m_itemAdded.set();
+}
+
+/**
+ * @brief Take a batch of the oldest items, waiting while the queue is empty.
+ * The batch is limited to a quarter of the queued items, so that the last
+ * items are spread over all compare threads.
+ * @param [out] items Array receiving the items.
+ * @param [in] nMax Size of @p items.
+ * @return Number of items taken, 0 if the queue is closed and empty.
+ */
+size_t CompareQueue::Pop(DIFFITEM *items[], size_t nMax)
+{
+	assert(nMax > 0);
+	for (;;)
+	{
+		size_t nItems = TryPop(items, std::clamp<size_t>(GetCount() / 4, 1, nMax));
+		if (nItems == 0)
+		{
+			++m_nPopWaiting;
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			nItems = TryPop(items, 1);
+			if (nItems == 0)
+			{
+				if (m_bClosed)
+				{
+					--m_nPopWaiting;
+					// Items pushed before Close() are visible by now
+					nItems = TryPop(items, 1);
+					if (nItems == 0)
+						return 0;
+				}
+				else
+				{
+					m_itemAdded.wait();
+					--m_nPopWaiting;
+					continue;
+				}
+			}
+			else
+				--m_nPopWaiting;
+		}
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_nPushWaiting > 0)
+			m_slotFreed.set();
+		return nItems;
+	}
+}
+
+/**
+ * @brief Report that compare threads have finished items taken by Pop().
+ * @param [in] nItems Number of finished items.
+ */
+void CompareQueue::Done(size_t nItems)
+{
+	m_nDone += nItems;
+	if (IsDone())
+		m_done.set();
+}
+
+/**
+ * @brief Mark the end of the collect and wake up all waiting compare threads.
+ */
+void CompareQueue::Close()
+{
+	m_bClosed = true;
+	for (int i = m_nPopWaiting; i > 0; --i)
+		m_itemAdded.set();
+	if (IsDone())
+		m_done.set();
+}
+
+/**
+ * @brief Wait until the queue is closed and all pushed items are done.
+ * @param [in] milliseconds Maximum time to wait.
+ * @return true if all items are done, false on timeout.
+ */
+bool CompareQueue::WaitUntilDone(long milliseconds)
+{
+	if (!IsDone())
+		m_done.tryWait(milliseconds);
+	return IsDone();
+}
+
+/**
+ * @brief Return the number of queued items.
+ */
+size_t CompareQueue::GetCount() const
+{
+	const size_t nPopPos = m_nPopPos.load(std::memory_order_relaxed);
+	const size_t nPushPos = m_nPushPos.load(std::memory_order_relaxed);
+	return nPushPos > nPopPos ? nPushPos - nPopPos : 0;
+}
+
+bool CompareQueue::TryPush(DIFFITEM *di)
+{
+	size_t pos = m_nPushPos.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		Cell& cell = m_cells[pos & m_nMask];
+		const size_t seq = cell.m_sequence.load(std::memory_order_acquire);
+		const intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+		if (dif == 0)
+		{
+			if (m_nPushPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				cell.m_di = di;
+				cell.m_sequence.store(pos + 1, std::memory_order_release);
+				return true;
+			}
+		}
+		else if (dif < 0)
+			return false; // full
+		else
+			pos = m_nPushPos.load(std::memory_order_relaxed);
+	}
+}
+
+/**
+ * @brief Claim up to @p nMax consecutive filled cells with a single CAS.
+ */
+size_t CompareQueue::TryPop(DIFFITEM *items[], size_t nMax)
+{
+	size_t pos = m_nPopPos.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		size_t nItems = 0;
+		while (nItems < nMax &&
+			m_cells[(pos + nItems) & m_nMask].m_sequence.load(std::memory_order_acquire) == pos + nItems + 1)
+			++nItems;
+		if (nItems == 0)
+		{
+			const size_t seq = m_cells[pos & m_nMask].m_sequence.load(std::memory_order_acquire);
+			if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1) < 0)
+				return 0; // empty
+			pos = m_nPopPos.load(std::memory_order_relaxed);
+			continue;
+		}
+		if (m_nPopPos.compare_exchange_weak(pos, pos + nItems, std::memory_order_relaxed))
+		{
+			for (size_t i = 0; i < nItems; ++i)
+			{
+				Cell& cell = m_cells[(pos + i) & m_nMask];
+				items[i] = cell.m_di;
+				cell.m_sequence.store(pos + i + m_nMask + 1, std::memory_order_release);
+			}
+			return nItems;
+		}
+	}
+}
+
+bool CompareQueue::IsDone() const
+{
+	return m_bClosed && m_nDone == m_nPushed;
+}
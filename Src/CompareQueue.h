@@ -0,0 +1,67 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  CompareQueue.h
+ *
+ * @brief Declaration file for CompareQueue
+ */
+#pragma once
+
+#include <atomic>
+#include <memory>
+#define POCO_NO_UNWINDOWS 1
+#include <Poco/Event.h>
+#include <Poco/Semaphore.h>
+
+class DIFFITEM;
+
+/**
+ * @brief Bounded queue handing collected items over to the compare threads.
+ *
+ * The collect thread pushes every file item as soon as it has been added to
+ * the item tree, and the compare threads pop them in batches. When the
+ * queue is full, Push() blocks until a compare thread has taken items, so a
+ * fast collect cannot run arbitrarily far ahead of the compare. Close()
+ * marks the end of the collect; Pop() then returns the remaining items
+ * followed by an empty batch.
+ *
+ * The queue itself is lock-free (a bounded multi-producer multi-consumer
+ * ring of sequenced cells). Threads only block on a semaphore when the
+ * queue is full or empty, and only signal one when somebody is waiting.
+ * Compare threads report finished items with Done(), which lets the owner
+ * wait for the whole compare in WaitUntilDone().
+ */
+class CompareQueue
+{
+public:
+	explicit CompareQueue(size_t nCapacity = 8192);
+	void Push(DIFFITEM *di);
+	size_t Pop(DIFFITEM *items[], size_t nMax);
+	void Done(size_t nItems);
+	void Close();
+	bool WaitUntilDone(long milliseconds);
+	size_t GetCount() const;
+
+private:
+	struct Cell
+	{
+		std::atomic_size_t m_sequence;
+		DIFFITEM *m_di;
+	};
+
+	bool TryPush(DIFFITEM *di);
+	size_t TryPop(DIFFITEM *items[], size_t nMax);
+	bool IsDone() const;
+
+	std::unique_ptr<Cell[]> m_cells;
+	size_t m_nMask; /**< Capacity - 1, capacity is a power of two */
+	alignas(64) std::atomic_size_t m_nPushPos;
+	alignas(64) std::atomic_size_t m_nPopPos;
+	alignas(64) std::atomic_size_t m_nPushed; /**< Number of items pushed */
+	std::atomic_size_t m_nDone; /**< Number of items reported done */
+	std::atomic_int m_nPushWaiting; /**< Number of threads waiting in Push() */
+	std::atomic_int m_nPopWaiting; /**< Number of threads waiting in Pop() */
+	std::atomic_bool m_bClosed; /**< Has the collect finished? */
+	Poco::Semaphore m_slotFreed;
+	Poco::Semaphore m_itemAdded;
+	Poco::Event m_done;
+};
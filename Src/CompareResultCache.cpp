@@ -0,0 +1,224 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  CompareResultCache.cpp
+ *
+ * @brief Implementation file for CompareResultCache
+ */
+
+#include "pch.h"
+#include "CompareResultCache.h"
+#include <cstdio>
+#include <cstring>
+#include "cio.h"
+#include "paths.h"
+#include "TFile.h"
+#include "unicoder.h"
+#include "DebugNew.h"
+
+/** @brief Identifies the cache file and its format version. */
+static const char CACHE_SIGNATURE[8] = { 'W', 'M', 'C', 'R', 'C', '0', '0', '2' };
+
+/** @brief Entries not used for this many seconds are dropped when loading. */
+static const int64_t CACHE_EXPIRY = 30 * 24 * 60 * 60;
+
+/** @brief Number of 32-bit fields stored for a result. */
+static const int RESULT_FIELDS = 3 + 3 * 4 + 3 * 3;
+
+static void PackResult(const CompareResultCache::Result& result, int32_t fields[RESULT_FIELDS])
+{
+	int n = 0;
+	fields[n++] = static_cast<int32_t>(result.code);
+	fields[n++] = result.ndiffs;
+	fields[n++] = result.ntrivialdiffs;
+	for (int i = 0; i < 3; ++i)
+	{
+		fields[n++] = result.textStats[i].ncrs;
+		fields[n++] = result.textStats[i].nlfs;
+		fields[n++] = result.textStats[i].ncrlfs;
+		fields[n++] = result.textStats[i].nzeros;
+	}
+	for (int i = 0; i < 3; ++i)
+	{
+		fields[n++] = result.encoding[i].m_codepage;
+		fields[n++] = result.encoding[i].m_unicoding;
+		fields[n++] = result.encoding[i].m_bom;
+	}
+}
+
+static void UnpackResult(const int32_t fields[RESULT_FIELDS], CompareResultCache::Result& result)
+{
+	int n = 0;
+	result.code = static_cast<unsigned>(fields[n++]);
+	result.ndiffs = fields[n++];
+	result.ntrivialdiffs = fields[n++];
+	for (int i = 0; i < 3; ++i)
+	{
+		result.textStats[i].ncrs = fields[n++];
+		result.textStats[i].nlfs = fields[n++];
+		result.textStats[i].ncrlfs = fields[n++];
+		result.textStats[i].nzeros = fields[n++];
+	}
+	for (int i = 0; i < 3; ++i)
+	{
+		result.encoding[i].m_codepage = fields[n++];
+		result.encoding[i].m_unicoding = static_cast<ucr::UNICODESET>(fields[n++]);
+		result.encoding[i].m_bom = fields[n++] != 0;
+	}
+}
+
+/**
+ * @brief Constructor.
+ * @param [in] filepath Path of the cache file.
+ */
+CompareResultCache::CompareResultCache(const String& filepath)
+: m_filepath(filepath)
+, m_bLoaded(false)
+, m_bModified(false)
+{
+}
+
+/**
+ * @brief Read the cache file, dropping expired entries.
+ * Does nothing if the file has already been read.
+ * @return true if the file was read, false if it is missing or invalid.
+ */
+bool CompareResultCache::Load()
+{
+	Poco::FastMutex::ScopedLock lock(m_mutex);
+	if (m_bLoaded)
+		return true;
+	m_bLoaded = true;
+	const int64_t now = time(nullptr);
+
+	FILE *fp = nullptr;
+	if (cio::tfopen_s(&fp, m_filepath, _T("rb")) != 0 || fp == nullptr)
+		return false;
+	bool bResult = false;
+	char signature[sizeof(CACHE_SIGNATURE)];
+	uint32_t nEntries = 0;
+	if (fread(signature, sizeof(signature), 1, fp) == 1 &&
+		memcmp(signature, CACHE_SIGNATURE, sizeof(signature)) == 0 &&
+		fread(&nEntries, sizeof(nEntries), 1, fp) == 1)
+	{
+		m_entries.reserve(nEntries);
+		std::string key;
+		uint32_t i;
+		for (i = 0; i < nEntries; ++i)
+		{
+			uint32_t cbKey = 0;
+			int32_t fields[RESULT_FIELDS];
+			int64_t lastUsed = 0;
+			if (fread(&cbKey, sizeof(cbKey), 1, fp) != 1 || cbKey > 0x10000)
+				break;
+			key.resize(cbKey);
+			if ((cbKey > 0 && fread(&key[0], cbKey, 1, fp) != 1) ||
+				fread(fields, sizeof(fields), 1, fp) != 1 ||
+				fread(&lastUsed, sizeof(lastUsed), 1, fp) != 1)
+				break;
+			if (now - lastUsed > CACHE_EXPIRY)
+			{
+				m_bModified = true;
+				continue;
+			}
+			Entry& entry = m_entries[ucr::toTString(key)];
+			UnpackResult(fields, entry.result);
+			entry.lastUsed = lastUsed;
+		}
+		bResult = (i == nEntries);
+	}
+	fclose(fp);
+	if (!bResult)
+	{
+		// Throw away a damaged cache
+		m_entries.clear();
+		m_bModified = true;
+	}
+	return bResult;
+}
+
+/**
+ * @brief Write the cache file if entries have been added or used.
+ * The file is written to a temporary file first, so that an interrupted
+ * save cannot leave a truncated cache behind.
+ * @return true if the file is up to date.
+ */
+bool CompareResultCache::Save()
+{
+	Poco::FastMutex::ScopedLock lock(m_mutex);
+	if (!m_bModified)
+		return true;
+
+	paths::CreateIfNeeded(paths::GetParentPath(m_filepath));
+	const String tmpPath = m_filepath + _T(".tmp");
+	FILE *fp = nullptr;
+	if (cio::tfopen_s(&fp, tmpPath, _T("wb")) != 0 || fp == nullptr)
+		return false;
+	const uint32_t nEntries = static_cast<uint32_t>(m_entries.size());
+	bool bResult = fwrite(CACHE_SIGNATURE, sizeof(CACHE_SIGNATURE), 1, fp) == 1 &&
+		fwrite(&nEntries, sizeof(nEntries), 1, fp) == 1;
+	std::string key;
+	for (auto it = m_entries.begin(); bResult && it != m_entries.end(); ++it)
+	{
+		ucr::toUTF8(it->first, key);
+		const uint32_t cbKey = static_cast<uint32_t>(key.length());
+		int32_t fields[RESULT_FIELDS];
+		PackResult(it->second.result, fields);
+		bResult = fwrite(&cbKey, sizeof(cbKey), 1, fp) == 1 &&
+			(cbKey == 0 || fwrite(key.data(), cbKey, 1, fp) == 1) &&
+			fwrite(fields, sizeof(fields), 1, fp) == 1 &&
+			fwrite(&it->second.lastUsed, sizeof(it->second.lastUsed), 1, fp) == 1;
+	}
+	if (fclose(fp) != 0)
+		bResult = false;
+	try
+	{
+		if (bResult)
+			TFile(tmpPath).renameTo(m_filepath);
+		else
+			TFile(tmpPath).remove();
+	}
+	catch (...)
+	{
+		bResult = false;
+	}
+	if (bResult)
+		m_bModified = false;
+	return bResult;
+}
+
+/**
+ * @brief Find a cached compare result.
+ * @param [in] key Key made of file identities and compare options.
+ * @param [out] result Cached result, if found.
+ * @return true if the result was found.
+ */
+bool CompareResultCache::Lookup(const String& key, Result& result)
+{
+	Poco::FastMutex::ScopedLock lock(m_mutex);
+	auto it = m_entries.find(key);
+	if (it == m_entries.end())
+		return false;
+	result = it->second.result;
+	// Entries expire in days, so the time of use needs no finer update
+	const int64_t now = time(nullptr);
+	if (now - it->second.lastUsed >= 60 * 60)
+	{
+		it->second.lastUsed = now;
+		m_bModified = true;
+	}
+	return true;
+}
+
+/**
+ * @brief Add or replace a compare result.
+ * @param [in] key Key made of file identities and compare options.
+ * @param [in] result Compare result.
+ */
+void CompareResultCache::Store(const String& key, const Result& result)
+{
+	Poco::FastMutex::ScopedLock lock(m_mutex);
+	Entry& entry = m_entries[key];
+	entry.result = result;
+	entry.lastUsed = time(nullptr);
+	m_bModified = true;
+}
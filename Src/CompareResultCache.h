@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  CompareResultCache.h
+ *
+ * @brief Declaration file for CompareResultCache
+ */
+#pragma once
+
+#include <ctime>
+#include <unordered_map>
+#define POCO_NO_UNWINDOWS 1
+#include <Poco/Mutex.h>
+#include "UnicodeString.h"
+#include "FileTextStats.h"
+#include "FileTextEncoding.h"
+
+/**
+ * @brief On-disk cache of file compare results.
+ *
+ * Repeated folder compares of the same trees can reuse the result of an
+ * earlier content compare instead of reading the files again. An entry is
+ * keyed by the paths, sizes and modification times of the compared files and
+ * by a fingerprint of the compare options, so a change of any of these makes
+ * the old entry unreachable. Unreachable entries are dropped from the cache
+ * file when they have not been used for a while.
+ *
+ * One cache may be shared by several folder compares, and all methods may be
+ * called from several compare threads at once.
+ */
+class CompareResultCache
+{
+public:
+	/**
+	 * @brief Cached compare result.
+	 */
+	struct Result
+	{
+		unsigned code; /**< DIFFCODE compare and text flags */
+		int ndiffs; /**< Number of significant diffs */
+		int ntrivialdiffs; /**< Number of ignored diffs */
+		FileTextStats textStats[3];
+		FileTextEncoding encoding[3]; /**< Guessed encodings, shown in the Encoding column */
+	};
+
+	explicit CompareResultCache(const String& filepath);
+	bool Load();
+	bool Save();
+	bool Lookup(const String& key, Result& result);
+	void Store(const String& key, const Result& result);
+
+private:
+	struct Entry
+	{
+		Result result;
+		int64_t lastUsed; /**< Time of last lookup or store */
+	};
+
+	String m_filepath; /**< Path of the cache file */
+	bool m_bLoaded; /**< Has the cache file been read? */
+	bool m_bModified; /**< Have entries been added or used since saving? */
+	std::unordered_map<String, Entry> m_entries;
+	Poco::FastMutex m_mutex;
+};
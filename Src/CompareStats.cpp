@@ -15,6 +15,8 @@
 CompareStats::CompareStats(int nDirs)
 : m_nTotalItems(0)
 , m_nComparedItems(0)
+, m_nCacheHits(0)
+, m_nCacheMisses(0)
 , m_state(STATE_IDLE)
 , m_bCompareDone(false)
 , m_nDirs(nDirs)
@@ -28,6 +30,33 @@ CompareStats::CompareStats(int nDirs)
  */
 CompareStats::~CompareStats() = default;
 
+/**
+ * @brief Set the number of compare threads that pause after their current
+ * items, and wake up threads that may continue.
+ * @param [in] nIdleCompareThreadCount Number of paused compare threads.
+ */
+void CompareStats::SetIdleCompareThreadCount(unsigned nIdleCompareThreadCount)
+{
+	assert(nIdleCompareThreadCount < m_rgThreadState.size());
+	Poco::FastMutex::ScopedLock lock(m_idleMutex);
+	m_nIdleCompareThreadCount = nIdleCompareThreadCount;
+	m_idleChanged.broadcast();
+}
+
+/**
+ * @brief Block a paused compare thread until it may continue.
+ * @param [in] iCompareThread Index of the compare thread.
+ * @param [in] milliseconds Maximum time to wait.
+ * @return true if the thread is still paused.
+ */
+bool CompareStats::WaitWhileIdleCompareThread(unsigned iCompareThread, long milliseconds)
+{
+	Poco::FastMutex::ScopedLock lock(m_idleMutex);
+	if (IsIdleCompareThread(iCompareThread))
+		m_idleChanged.tryWait(m_idleMutex, milliseconds);
+	return IsIdleCompareThread(iCompareThread);
+}
+
 /** 
  * @brief Add compared item.
  * @param [in] code Resultcode to add.
@@ -79,6 +108,8 @@ void CompareStats::Reset()
 	SetCompareState(STATE_IDLE);
 	m_nTotalItems = 0;
 	m_nComparedItems = 0;
+	m_nCacheHits = 0;
+	m_nCacheMisses = 0;
 	m_bCompareDone = false;
 }
 
@@ -8,6 +8,9 @@
 #include <atomic>
 #include <vector>
 #include <array>
+#define POCO_NO_UNWINDOWS 1
+#include <Poco/Condition.h>
+#include <Poco/Mutex.h>
 
 class DIFFITEM;
 
@@ -82,11 +85,8 @@ public:
 	{
 		return m_nIdleCompareThreadCount;
 	}
-	void SetIdleCompareThreadCount(unsigned nIdleCompareThreadCount)
-	{
-		assert(nIdleCompareThreadCount < m_rgThreadState.size());
-		m_nIdleCompareThreadCount = nIdleCompareThreadCount;
-	}
+	void SetIdleCompareThreadCount(unsigned nIdleCompareThreadCount);
+	bool WaitWhileIdleCompareThread(unsigned iCompareThread, long milliseconds);
 	bool IsIdleCompareThread(unsigned iCompareThread) const
 	{
 		return iCompareThread >= (m_rgThreadState.size() - m_nIdleCompareThreadCount);
@@ -102,6 +102,9 @@ public:
 	int GetCount(CompareStats::RESULT result) const;
 	int GetTotalItems() const;
 	int GetComparedItems() const { return m_nComparedItems; }
+	void AddCacheLookup(bool bHit) { ++(bHit ? m_nCacheHits : m_nCacheMisses); }
+	int GetCacheHits() const { return m_nCacheHits; }
+	int GetCacheMisses() const { return m_nCacheMisses; }
 	const DIFFITEM *GetCurDiffItem();
 	void Reset();
 	void SetCompareState(CompareStats::CMP_STATE state);
@@ -115,6 +118,8 @@ private:
 	std::array<std::atomic_int, RESULT_COUNT> m_counts; /**< Table storing result counts */
 	std::atomic_int m_nTotalItems; /**< Total items found to compare */
 	std::atomic_int m_nComparedItems; /**< Compared items so far */
+	std::atomic_int m_nCacheHits; /**< Results taken from the compare result cache */
+	std::atomic_int m_nCacheMisses; /**< Cacheable items not found in the cache */
 	CMP_STATE m_state; /**< State for compare (idle, collect, compare,..) */
 	bool m_bCompareDone; /**< Have we finished last compare? */
 	int m_nDirs; /**< number of directories to compare */
@@ -126,7 +131,9 @@ private:
 		const DIFFITEM *m_pDiffItem;
 	};
 	std::vector<ThreadState> m_rgThreadState;
-	unsigned m_nIdleCompareThreadCount;
+	std::atomic_uint m_nIdleCompareThreadCount;
+	Poco::FastMutex m_idleMutex;
+	Poco::Condition m_idleChanged; /**< Signaled when the idle thread count changes */
 };
 
 /** 
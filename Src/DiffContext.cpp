@@ -41,6 +41,7 @@ CDiffContext::CDiffContext(const PathContext & paths, int compareMethod)
 , m_pCompareStats(nullptr)
 , m_piAbortable(nullptr)
 , m_bStopAfterFirstDiff(false)
+, m_bFastReject(false)
 , m_pFilterList(nullptr)
 , m_pSubstitutionList(nullptr)
 , m_pContentCompareOptions(nullptr)
@@ -21,6 +21,7 @@ class CompareStats;
 class IAbortable;
 class CDiffWrapper;
 class CompareOptions;
+class CompareResultCache;
 struct DIFFOPTIONS;
 
 /** Interface to a provider of plugin info */
@@ -181,6 +182,14 @@ public:
 	 */
 	bool m_bStopAfterFirstDiff;
 
+	/**
+	 * Decide content compare results from file sizes and file ends.
+	 * When compare options are binary equivalent, files of different sizes
+	 * or with different first or last blocks are marked different without
+	 * reading them fully. Text statistics of such files stay empty.
+	 */
+	bool m_bFastReject;
+
 	/**
 	 * Threshold size for switching to quick compare.
 	 * When diffutils compare is selected, files bigger (in bytes) than this
@@ -211,6 +220,7 @@ public:
 	std::shared_ptr<FilterList> m_pFilterList; /**< Filter list for line filters */
 	std::shared_ptr<SubstitutionList> m_pSubstitutionList; /// list for Substitution Filters
 	std::unique_ptr<PropertySystem> m_pPropertySystem; /**< pointer to Property System */
+	std::shared_ptr<CompareResultCache> m_pCompareResultCache; /**< Results of earlier compares, or nullptr */
 	std::vector<std::map<std::vector<uint8_t>, DuplicateInfo>> m_duplicateValues; /**< Number of duplicate hash values */
 	std::vector<String> m_vCurrentlyHiddenItems; /**< The list of currently hidden items */
 
@@ -15,6 +15,9 @@
 #include "unicoder.h"
 #include "DebugNew.h"
 
+/** @brief Dummy descriptor of texts given with OpenBuffers(). */
+static const int PRELOADED_DESC = INT_MAX;
+
 /**
  * @brief Simple initialization of DiffFileData
  * @note Diffcounts are initialized to invalid values, not zeros.
@@ -44,6 +47,43 @@ bool DiffFileData::OpenFiles(const String& szFilepath1, const String& szFilepath
 	return b;
 }
 
+/**
+ * @brief Give diffutils texts which are already in memory instead of files.
+ * The texts are copied, as diffutils modifies and frees its buffers.
+ * Display paths must be set before, they are the only names diffutils sees.
+ * @param [in] data1 Text of the first file.
+ * @param [in] data2 Text of the second file.
+ * @return false if memory could not be allocated.
+ */
+bool DiffFileData::OpenBuffers(const std::string& data1, const std::string& data2)
+{
+	Reset();
+	m_used = true;
+
+	const std::string *data[2] = { &data1, &data2 };
+	for (int i = 0; i < 2; ++i)
+	{
+		m_inf[i].name = strdup(ucr::toSystemCP(m_sDisplayFilepath[i]).c_str());
+		// Leave room for the newline and sentinel diffutils appends
+		m_inf[i].buffer = static_cast<char *>(malloc(data[i]->length() + sizeof(unsigned) + 1));
+		if (m_inf[i].name == nullptr || m_inf[i].buffer == nullptr)
+		{
+			Reset();
+			return false;
+		}
+		memcpy(m_inf[i].buffer, data[i]->data(), data[i]->length());
+		m_inf[i].bufsize = data[i]->length() + sizeof(unsigned) + 1;
+		m_inf[i].buffered_chars = data[i]->length();
+		m_inf[i].preloaded = 1;
+		// diffutils compares descriptors to detect comparing a file with itself,
+		// so give each buffer a distinct descriptor which is never read nor closed
+		m_inf[i].desc = PRELOADED_DESC - i;
+		m_inf[i].stat.st_mode = S_IFREG;
+		m_inf[i].stat.st_size = data[i]->length();
+	}
+	return true;
+}
+
 /** @brief stash away true names for display, before opening files */
 void DiffFileData::SetDisplayFilepaths(const String& szTrueFilepath1, const String& szTrueFilepath2)
 {
@@ -113,7 +153,7 @@ void DiffFileData::Reset()
 	{
 		free((void *)m_inf[i].name);
 
-		if (m_inf[i].desc > 0)
+		if (m_inf[i].desc > 0 && !m_inf[i].preloaded)
 		{
 			cio::close(m_inf[i].desc);
 		}
@@ -84,6 +84,9 @@ CDiffTextBuffer::CDiffTextBuffer(CMergeDoc * pDoc, int pane)
 : m_pOwnerDoc(pDoc)
 , m_nThisPane(pane)
 , m_bMixedEOL(false)
+, m_dwRevisionNumberOnRescan(0)
+, m_nRealLinesOnRescan(-1)
+, m_bRevisionsRestored(false)
 {
 }
 
@@ -132,6 +135,31 @@ AddUndoRecord(bool bInsert, const CEPoint & ptStartPos,
 	}
 }
 
+/**
+ * @brief Forget the oldest undo groups of this pane in the document.
+ * @param [in] nGroups Number of undo groups discarded from the buffer.
+ */
+void CDiffTextBuffer::			/* virtual override */
+OnUndoGroupsDiscarded(int nGroups)
+{
+	std::vector<int>& undoTgt = m_pOwnerDoc->undoTgt;
+	ptrdiff_t nCurUndo = m_pOwnerDoc->curUndo - undoTgt.begin();
+	auto it = undoTgt.begin();
+	while (nGroups > 0 && it != undoTgt.end())
+	{
+		if (*it == m_nThisPane)
+		{
+			if (it - undoTgt.begin() < nCurUndo)
+				--nCurUndo;
+			it = undoTgt.erase(it);
+			--nGroups;
+		}
+		else
+			++it;
+	}
+	m_pOwnerDoc->curUndo = undoTgt.begin() + nCurUndo;
+}
+
 /**
  * @brief Checks if a flag is set for line.
  * @param [in] line Index (0-based) for line.
@@ -159,6 +187,48 @@ void CDiffTextBuffer::prepareForRescan()
 			LF_INVISIBLE | LF_DIFF | LF_TRIVIAL | LF_MOVED | LF_SNP,
 			false, false, false);
 	}
+	// Remember the state of the compared text to find later edits
+	m_dwRevisionNumberOnRescan = m_dwCurrentRevisionNumber;
+	m_nRealLinesOnRescan = GetLineCount();
+	m_bRevisionsRestored = false;
+}
+
+/**
+ * @brief Find the real lines edited since the buffer was last compared.
+ * Lines are found from their revision numbers. Removed lines leave the
+ * revision number of the line where they were removed, and removed
+ * ghost lines count for the next real line.
+ * @param [out] nFirstRealLine First edited real line, -1 if no line was edited.
+ * @param [out] nLastRealLine Last edited real line.
+ * @param [out] nRealLineCount Real line count of the buffer.
+ * @return false if the edited lines cannot be known, e.g. after undo.
+ */
+bool CDiffTextBuffer::GetLinesEditedAfterRescan(int &nFirstRealLine, int &nLastRealLine, int &nRealLineCount) const
+{
+	if (m_nRealLinesOnRescan < 0 || m_bRevisionsRestored)
+		return false;
+	int nFirstLine = -1, nLastLine = -1;
+	nRealLineCount = 0;
+	const int nLineCount = GetLineCount();
+	for (int nLine = 0; nLine < nLineCount; ++nLine)
+	{
+		if (m_aLines[nLine].m_dwRevisionNumber > m_dwRevisionNumberOnRescan)
+		{
+			if (nFirstLine < 0)
+				nFirstLine = nLine;
+			nLastLine = nLine;
+		}
+		if ((m_aLines[nLine].m_dwFlags & LF_GHOST) == 0)
+			++nRealLineCount;
+	}
+	if (nFirstLine < 0)
+	{
+		nFirstRealLine = nLastRealLine = -1;
+		return true;
+	}
+	nFirstRealLine = ComputeRealLine(nFirstLine);
+	nLastRealLine = (std::min)(ComputeRealLine(nLastLine), nRealLineCount - 1);
+	return true;
 }
 
 /** 
@@ -179,6 +249,18 @@ OnNotifyLineHasBeenEdited(int nLine)
 	CGhostTextBuffer::OnNotifyLineHasBeenEdited(nLine);
 }
 
+/**
+ * @brief Restore line revision numbers when undoing.
+ * The restored revision numbers are older than the last compare although
+ * the lines changed after it, so edited lines cannot be found any more.
+ */
+void CDiffTextBuffer::			/* virtual override */
+RestoreRevisionNumbers(int nStartLine, std::vector<uint32_t> *paSavedRevisionNumbers)
+{
+	CGhostTextBuffer::RestoreRevisionNumbers(nStartLine, paSavedRevisionNumbers);
+	m_bRevisionsRestored = true;
+}
+
 /**
  * @brief Load file from disk into buffer
  *
@@ -224,7 +306,7 @@ int CDiffTextBuffer::LoadFromFile(const tchar_t* pszFileNameInit,
 	if (def && def->encoding != -1)
 		m_nSourceEncoding = def->encoding;
 	
-	UniFile *pufile = new UniMemFile;
+	UniMemFile *pufile = new UniMemFile;
 
 	// Now we only use the UniFile interface
 	// which is something we could implement for HTTP and/or FTP files
@@ -261,26 +343,13 @@ int CDiffTextBuffer::LoadFromFile(const tchar_t* pszFileNameInit,
 				pufile->SetCodepage(encoding.m_codepage);
 		}
 		unsigned lineno = 0;
-		String eol, preveol;
-		String sline;
-		bool done = false;
 
 		// Manually grow line array exponentially
 		size_t arraysize = 500;
 		m_aLines.resize(arraysize);
-		
-		// preveol must be initialized for empty files
-		preveol = _T("\n");
-		
-		do {
-			bool lossy = false;
-			done = !pufile->ReadString(sline, eol, &lossy);
-
-			// if last line had no eol, we can quit
-			if (done && preveol.empty())
-				break;
-			// but if last line had eol, we add an extra (empty) line to buffer
 
+		auto addLine = [&](const tchar_t *pchLine, size_t cchLine)
+		{
 			// Grow line array
 			if (lineno == arraysize)
 			{
@@ -293,17 +362,50 @@ int CDiffTextBuffer::LoadFromFile(const tchar_t* pszFileNameInit,
 					arraysize += 100 * 1024;
 				m_aLines.resize(arraysize);
 			}
-
-			sline += eol; // TODO: opportunity for optimization, as CString append is terrible
-			if (lossy)
-			{
-				// TODO: Should record lossy status of line
-			}
-			AppendLine(lineno, sline.c_str(), static_cast<int>(sline.length()));
+			m_aLines[lineno].Create(pchLine, cchLine, m_lineArena);
 			++lineno;
-			preveol = eol;
+		};
 
-		} while (!done);
+		// Read the whole file at once when its encoding allows it
+		bool bEol = true;
+		if (pufile->ReadLines([&](const tchar_t *pchLine, size_t cchLine)
+			{
+				addLine(pchLine, cchLine);
+				bEol = (pchLine[cchLine - 1] == '\r' || pchLine[cchLine - 1] == '\n');
+			}))
+		{
+			// if last line had eol, we add an extra (empty) line to buffer
+			if (bEol)
+				addLine(_T(""), 0);
+		}
+		else
+		{
+			String eol, preveol;
+			String sline;
+			bool done = false;
+
+			// preveol must be initialized for empty files
+			preveol = _T("\n");
+
+			do {
+				bool lossy = false;
+				done = !pufile->ReadString(sline, eol, &lossy);
+
+				// if last line had no eol, we can quit
+				if (done && preveol.empty())
+					break;
+				// but if last line had eol, we add an extra (empty) line to buffer
+
+				sline += eol; // TODO: opportunity for optimization, as CString append is terrible
+				if (lossy)
+				{
+					// TODO: Should record lossy status of line
+				}
+				addLine(sline.c_str(), sline.length());
+				preveol = eol;
+
+			} while (!done);
+		}
 
 		// fix array size (due to our manual exponential growth
 		m_aLines.resize(lineno);
@@ -372,6 +474,88 @@ int CDiffTextBuffer::LoadFromFile(const tchar_t* pszFileNameInit,
 	return nRetVal;
 }
 
+/**
+ * @brief Pass the real lines of a range to a writer, with their EOLs.
+ * Ghost lines are skipped.
+ * @param [in] bTempFile true if the lines are written for the diff engine.
+ * @param [in] nCrlfStyle EOL style to write.
+ * @param [in] nStartLine First line to write.
+ * @param [in] nLines Number of lines to write.
+ * @param [in] writeLine Called for each line to write.
+ */
+void CDiffTextBuffer::WriteLines(bool bTempFile, CRLFSTYLE nCrlfStyle,
+		int nStartLine, int nLines, const std::function<void(const String&)>& writeLine)
+{
+	if (nCrlfStyle == CRLFSTYLE::AUTOMATIC &&
+		!GetOptionsMgr()->GetBool(OPT_ALLOW_MIXED_EOL))
+	{
+			// get the default nCrlfStyle of the CDiffTextBuffer
+		nCrlfStyle = GetCRLFMode();
+		ASSERT(nCrlfStyle != CRLFSTYLE::AUTOMATIC);
+	}
+
+	// line loop : get each real line and write it
+	String sLine;
+	String sEol = GetStringEol(nCrlfStyle);
+	int lastRealLine = ApparentLastRealLine();
+	for (int line = nStartLine; line < nStartLine + nLines; ++line)
+	{
+		if (GetLineFlags(line) & LF_GHOST)
+			continue;
+
+		// get the characters of the line (excluding EOL)
+		if (GetLineLength(line) > 0)
+		{
+			int nLineLength = GetLineLength(line);
+			sLine.resize(0);
+			sLine.reserve(nLineLength + 4);
+			sLine.append(GetLineChars(line), nLineLength);
+		}
+		else
+			sLine.clear();
+
+		if (bTempFile && m_bTableEditing && m_bAllowNewlinesInQuotes)
+		{
+			strutils::replace(sLine, _T("\x1b"), _T("\x1b\x1b"));
+			strutils::replace(sLine, _T("\r"), _T("\x1br"));
+			strutils::replace(sLine, _T("\n"), _T("\x1bn"));
+		}
+
+		// last real line ?
+		if (line == lastRealLine || lastRealLine == -1 )
+		{
+			// If original last line had no EOL, then we are done
+			if( !m_aLines[line].HasEol() )
+			{
+				writeLine(sLine);
+				break;
+			}
+			// Otherwise, add the appropriate EOL to the last line ...
+		}
+
+		// normal line : append an EOL
+		if (nCrlfStyle == CRLFSTYLE::AUTOMATIC || nCrlfStyle == CRLFSTYLE::MIXED)
+		{
+			// either the EOL of the line (when preserve original EOL chars is on)
+			sLine += GetLineEol(line);
+		}
+		else
+		{
+			// or the default EOL for this file
+			sLine += sEol;
+		}
+
+		// write this line; the writer converts it to the output encoding
+		writeLine(sLine);
+
+		if (line == lastRealLine || lastRealLine == -1)
+		{
+			// Last line, so now done
+			break;
+		}
+	}
+}
+
 /**
  * @brief Saves file from buffer to disk
  *
@@ -396,14 +580,6 @@ int CDiffTextBuffer::SaveToFile (const String& pszFileName,
 	if (pszFileName.empty())
 		return SAVE_FAILED;	// No filename, cannot save...
 
-	if (nCrlfStyle == CRLFSTYLE::AUTOMATIC &&
-		!GetOptionsMgr()->GetBool(OPT_ALLOW_MIXED_EOL))
-	{
-			// get the default nCrlfStyle of the CDiffTextBuffer
-		nCrlfStyle = GetCRLFMode();
-		ASSERT(nCrlfStyle != CRLFSTYLE::AUTOMATIC);
-	}
-
 	bool bOpenSuccess = true;
 	bool bSaveSuccess = false;
 
@@ -449,66 +625,8 @@ int CDiffTextBuffer::SaveToFile (const String& pszFileName,
 	file.SetVBuf(_IOFBF, StdioBufSize);
 	file.WriteBom();
 
-	// line loop : get each real line and write it in the file
-	String sLine;
-	String sEol = GetStringEol(nCrlfStyle);
-	int lastRealLine = ApparentLastRealLine();
-	for (int line = nStartLine; line < nStartLine + nLines; ++line)
-	{
-		if (GetLineFlags(line) & LF_GHOST)
-			continue;
-
-		// get the characters of the line (excluding EOL)
-		if (GetLineLength(line) > 0)
-		{
-			int nLineLength = GetLineLength(line);
-			sLine.resize(0);
-			sLine.reserve(nLineLength + 4);
-			sLine.append(GetLineChars(line), nLineLength);
-		}
-		else
-			sLine.clear();
-
-		if (bTempFile && m_bTableEditing && m_bAllowNewlinesInQuotes)
-		{
-			strutils::replace(sLine, _T("\x1b"), _T("\x1b\x1b"));
-			strutils::replace(sLine, _T("\r"), _T("\x1br"));
-			strutils::replace(sLine, _T("\n"), _T("\x1bn"));
-		}
-
-		// last real line ?
-		if (line == lastRealLine || lastRealLine == -1 )
-		{
-			// If original last line had no EOL, then we are done
-			if( !m_aLines[line].HasEol() )
-			{
-				file.WriteString(sLine);
-				break;
-			}
-			// Otherwise, add the appropriate EOL to the last line ...
-		}
-
-		// normal line : append an EOL
-		if (nCrlfStyle == CRLFSTYLE::AUTOMATIC || nCrlfStyle == CRLFSTYLE::MIXED)
-		{
-			// either the EOL of the line (when preserve original EOL chars is on)
-			sLine += GetLineEol(line);
-		}
-		else
-		{
-			// or the default EOL for this file
-			sLine += sEol;
-		}
-
-		// write this line to the file (codeset or unicode conversions are done there
-		file.WriteString(sLine);
-
-		if (line == lastRealLine || lastRealLine == -1)
-		{
-			// Last line, so now done
-			break;
-		}
-	}
+	WriteLines(bTempFile, nCrlfStyle, nStartLine, nLines,
+		[&file](const String& sLine) { file.WriteString(sLine); });
 	file.Close();
 
 	if (!bTempFile)
@@ -561,6 +679,28 @@ int CDiffTextBuffer::SaveToFile (const String& pszFileName,
 		return SAVE_FAILED;
 }
 
+/**
+ * @brief Get the text of a range of lines as it is saved for the diff engine.
+ * The text is the same as SaveToFile() writes to a temp file: UTF-8 with
+ * a BOM, without ghost lines. This lets the diff engine compare the buffer
+ * without writing and reading back a file.
+ * @param [out] data Text of the lines.
+ * @param [in] nStartLine First line to get.
+ * @param [in] nLines Number of lines to get, -1 for all lines to the end.
+ */
+void CDiffTextBuffer::SaveToMemory(std::string& data, int nStartLine /*= 0*/, int nLines /*= -1*/)
+{
+	ASSERT (m_bInit);
+
+	if (nLines == -1)
+		nLines = static_cast<int>(m_aLines.size() - nStartLine);
+
+	data.assign("\xEF\xBB\xBF");
+	std::string sLineUTF8;
+	WriteLines(true, CRLFSTYLE::AUTOMATIC, nStartLine, nLines,
+		[&](const String& sLine) { ucr::toUTF8(sLine, sLineUTF8); data += sLineUTF8; });
+}
+
 bool CDiffTextBuffer::curUndoGroup()
 {
 	return (m_aUndoBuf.size() != 0 && m_aUndoBuf[0].m_dwFlags&UNDO_BEGINGROUP);
@@ -5,6 +5,8 @@
  */
 #pragma once
 
+#include <functional>
+#include <string>
 #include "GhostTextBuffer.h"
 #include "FileTextEncoding.h"
 
@@ -25,6 +27,9 @@ private :
 	String m_strTempFileName; /**< Temporary file name. */
 	std::vector<int> m_unpackerSubcodes; /**< Plugin information. */
 	bool m_bMixedEOL; /**< EOL style of this buffer is mixed? */
+	uint32_t m_dwRevisionNumberOnRescan; /**< Revision number when the buffer was last compared. */
+	int m_nRealLinesOnRescan; /**< Real line count when the buffer was last compared, -1 if not compared. */
+	bool m_bRevisionsRestored; /**< Undo has restored line revision numbers since last compare? */
 
 	/** 
 	 * @brief Unicode encoding from ucr::UNICODESET.
@@ -38,6 +43,8 @@ private :
 	FileTextEncoding m_encoding;
 
 	bool FlagIsSet(int line, lineflags_t flag) const;
+	void WriteLines(bool bTempFile, CRLFSTYLE nCrlfStyle, int nStartLine, int nLines,
+		const std::function<void(const String&)>& writeLine);
 
 public :
 	CDiffTextBuffer(CMergeDoc * pDoc, int pane);
@@ -48,6 +55,7 @@ public :
 		const CEPoint & ptEndPos, const tchar_t* pszText, size_t cchText,
 		int nActionType = CE_ACTION_UNKNOWN,
 		std::vector<uint32_t> *paSavedRevisionNumbers = nullptr) override;
+	virtual void OnUndoGroupsDiscarded(int nGroups) override;
 	bool curUndoGroup();
 
 	int LoadFromFile(const tchar_t* pszFileName, PackingInfo& infoUnpacker,
@@ -56,6 +64,7 @@ public :
 	int SaveToFile (const String& pszFileName, bool bTempFile, String & sError,
 		PackingInfo& infoUnpacker, CRLFSTYLE nCrlfStyle = CRLFSTYLE::AUTOMATIC,
 		bool bClearModifiedFlag = true, int nStartLine = 0, int nLines = -1);
+	void SaveToMemory(std::string& data, int nStartLine = 0, int nLines = -1);
 	ucr::UNICODESET getUnicoding() const { return m_encoding.m_unicoding; }
 	void setUnicoding(ucr::UNICODESET value) { m_encoding.m_unicoding = value; }
 	int getCodepage() const { return m_encoding.m_codepage; }
@@ -72,7 +81,9 @@ public :
 
 	virtual void SetModified (bool bModified = true) override;
 	void prepareForRescan();
+	bool GetLinesEditedAfterRescan(int &nFirstRealLine, int &nLastRealLine, int &nRealLineCount) const;
 	virtual void OnNotifyLineHasBeenEdited(int nLine) override;
+	virtual void RestoreRevisionNumbers(int nStartLine, std::vector<uint32_t> *paSavedRevisionNumbers) override;
 	bool IsInitialized() const;
 	virtual bool DeleteText2 (CCrystalTextView * pSource, int nStartLine,
 		int nStartPos, int nEndLine, int nEndPos,
@@ -12,6 +12,8 @@
 #include <Poco/Thread.h>
 #include <Poco/Semaphore.h>
 #include "CompareStats.h"
+#include "CompareQueue.h"
+#include "CompareResultCache.h"
 #include "IAbortable.h"
 #include "Plugins.h"
 #include "MergeAppCOMClass.h"
@@ -55,6 +57,7 @@ CDiffThread::CDiffThread()
 CDiffThread::~CDiffThread()
 {
 	delete m_pDiffParm->pSemaphore;
+	delete m_pDiffParm->pCompareQueue;
 }
 
 /**
@@ -85,6 +88,8 @@ unsigned CDiffThread::CompareDirectories()
 
 	delete m_pDiffParm->pSemaphore;
 	m_pDiffParm->pSemaphore = new Semaphore(0, LONG_MAX);
+	delete m_pDiffParm->pCompareQueue;
+	m_pDiffParm->pCompareQueue = new CompareQueue();
 
 	m_pDiffParm->context->m_pCompareStats->SetCompareState(CompareStats::STATE_START);
 
@@ -112,7 +117,9 @@ static void DiffThreadCollect(void *pParam)
 	if (myStruct->m_fncCollect)
 		myStruct->m_fncCollect(myStruct);
 
-	// Release Semaphore() once again to signal that collect phase is ready
+	// Close the compare queue and release Semaphore() to signal that
+	// collect phase is ready
+	myStruct->pCompareQueue->Close();
 	myStruct->pSemaphore->set();
 
 	// Send message to UI to update
@@ -139,9 +146,16 @@ static void DiffThreadCompare(void *pParam)
 
 	myStruct->context->m_pCompareStats->SetCompareState(CompareStats::STATE_COMPARE);
 
+	// Read results of earlier compares before the first item is compared
+	if (myStruct->context->m_pCompareResultCache)
+		myStruct->context->m_pCompareResultCache->Load();
+
 	// Now do all pending file comparisons
 	myStruct->m_fncCompare(myStruct);
 
+	if (myStruct->context->m_pCompareResultCache)
+		myStruct->context->m_pCompareResultCache->Save();
+
 	myStruct->context->m_pCompareStats->SetCompareState(CompareStats::STATE_IDLE);
 
 	// Send message to UI to update
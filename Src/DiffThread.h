@@ -19,6 +19,7 @@ namespace Poco
 class Semaphore;
 }
 class DiffThreadAbortable;
+class CompareQueue;
 
 /**
  * @brief Structure used in sending data to the threads.
@@ -33,6 +34,7 @@ struct DiffFuncStruct
 	int nCollectThreadState; /**< Collect thread state. */
 	DiffThreadAbortable * m_pAbortgate; /**< Interface for aborting compare. */
 	Poco::Semaphore *pSemaphore; /**< Semaphore for synchronizing threads. */
+	CompareQueue *pCompareQueue; /**< Queue of collected items waiting for compare. */
 	std::function<void (DiffFuncStruct*)> m_fncCollect;
 	std::function<void (DiffFuncStruct*)> m_fncCompare;
 	bool bMarkedRescan;	/**< Is the rescan due to "Refresh Selected"? */
@@ -43,6 +45,7 @@ struct DiffFuncStruct
 		, nCollectThreadState(0/*CDiffThread::THREAD_NOTSTARTED*/)
 		, m_pAbortgate(nullptr)
 		, pSemaphore(nullptr)
+		, pCompareQueue(nullptr)
 		, bMarkedRescan(false)
 		{}
 };
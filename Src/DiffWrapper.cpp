@@ -13,7 +13,10 @@
 #include <tuple>
 #include <exception>
 #include <array>
+#include <vector>
+#include <memory>
 #include <Poco/Exception.h>
+#include <Poco/Thread.h>
 #include "coretools.h"
 #include "DiffList.h"
 #include "MovedLines.h"
@@ -48,6 +51,9 @@ extern "C" int is_blank_line(char const* pch, char const* limit);
 static void CopyTextStats(const file_data * inf, FileTextStats * myTextStats);
 static void CopyDiffutilTextStats(file_data *inf, DiffFileData * diffData);
 
+/** @brief Files smaller than this are not worth a thread of their own in DiffFilePairs(). */
+static const int64_t PARALLEL_DIFF_MIN_SIZE = 256 * 1024;
+
 constexpr char* FILTERED_LINE = "!" "c0d5089f" "-" "3d91" "-" "4d69" "-" "b406" "-" "dc5a5b51a4f8";
 
 /**
@@ -721,10 +727,24 @@ void CDiffWrapper::SetPaths(const PathContext &tFiles,
 	m_bPathsAreTemp = tempPaths;
 }
 
+/**
+ * @brief Tells if a prediffer plugin is to be run on the compared files.
+ * Prediffer plugins work on files, so texts given to RunFileDiff() in memory
+ * cannot be prediffed.
+ */
+bool CDiffWrapper::HasPrediffer() const
+{
+	return m_bPluginsEnabled && m_infoPrediffer && !m_infoPrediffer->GetPluginPipeline().empty();
+}
+
 /**
  * @brief Runs diff-engine.
+ * @param [in] buffers Texts of the compared files, in the order of the paths
+ * given with SetPaths(), or nullptr to read the files. The texts must be
+ * encoded as the files would be (see CDiffTextBuffer::SaveToMemory()).
+ * Prediffer plugins are not run on texts in memory.
  */
-bool CDiffWrapper::RunFileDiff()
+bool CDiffWrapper::RunFileDiff(const std::string *buffers /*= nullptr*/)
 {
 	PathContext aFiles = m_files;
 	int file;
@@ -742,7 +762,7 @@ bool CDiffWrapper::RunFileDiff()
 
 	for (file = 0; file < aFiles.GetSize(); file++)
 	{
-		if (m_bPluginsEnabled)
+		if (m_bPluginsEnabled && buffers == nullptr)
 		{
 			// Do the preprocessing now, overwrite the temp files
 			// NOTE: FileTransform_UCS2ToUTF8() may create new temp
@@ -772,11 +792,18 @@ bool CDiffWrapper::RunFileDiff()
 	DiffFileData diffdata, diffdata10, diffdata12, diffdata02;
 	int bin_flag = 0, bin_flag10 = 0, bin_flag12 = 0, bin_flag02 = 0;
 
+	// This opens & fstats both files (if it succeeds)
+	auto openFiles = [&](DiffFileData& data, int file1, int file2)
+	{
+		if (buffers != nullptr)
+			return data.OpenBuffers(buffers[file1], buffers[file2]);
+		return data.OpenFiles(strFileTemp[file1], strFileTemp[file2]);
+	};
+
 	if (aFiles.GetSize() == 2)
 	{
 		diffdata.SetDisplayFilepaths(aFiles[0], aFiles[1]); // store true names for diff utils patch file
-		// This opens & fstats both files (if it succeeds)
-		if (!diffdata.OpenFiles(strFileTemp[0], strFileTemp[1]))
+		if (!openFiles(diffdata, 0, 1))
 		{
 			return false;
 		}
@@ -810,26 +837,25 @@ bool CDiffWrapper::RunFileDiff()
 		diffdata12.SetDisplayFilepaths(aFiles[1], aFiles[2]); // store true names for diff utils patch file
 		diffdata02.SetDisplayFilepaths(aFiles[0], aFiles[2]); // store true names for diff utils patch file
 
-		if (!diffdata10.OpenFiles(strFileTemp[1], strFileTemp[0]))
+		if (!openFiles(diffdata10, 1, 0))
 		{
 			return false;
 		}
 
-		bRet = Diff2Files(&script10, &diffdata10, &bin_flag10, nullptr);
-
-		if (!diffdata12.OpenFiles(strFileTemp[1], strFileTemp[2]))
+		if (!openFiles(diffdata12, 1, 2))
 		{
 			return false;
 		}
 
-		bRet = Diff2Files(&script12, &diffdata12, &bin_flag12, nullptr);
-
-		if (!diffdata02.OpenFiles(strFileTemp[0], strFileTemp[2]))
+		if (!openFiles(diffdata02, 0, 2))
 		{
 			return false;
 		}
 
-		bRet = Diff2Files(&script02, &diffdata02, &bin_flag02, nullptr);
+		struct change ** scripts[] = { &script10, &script12, &script02 };
+		DiffFileData * diffdatas[] = { &diffdata10, &diffdata12, &diffdata02 };
+		int * bin_flags[] = { &bin_flag10, &bin_flag12, &bin_flag02 };
+		bRet = DiffFilePairs(3, scripts, diffdatas, bin_flags);
 	}
 
 	// First determine what happened during comparison
@@ -1164,6 +1190,89 @@ bool CDiffWrapper::Diff2Files(struct change ** diffs, DiffFileData *diffData,
 	return bRet;
 }
 
+namespace
+{
+
+/** @brief One file pair compared by DiffFilePairs(). */
+struct DiffPairTask
+{
+	const CDiffWrapper *pDiffWrapper;
+	DiffutilsOptions options;
+	struct change **diffs;
+	DiffFileData *diffData;
+	int *bin_status;
+	bool bResult;
+};
+
+void DiffPairThreadProc(void *pParam)
+{
+	DiffPairTask *pTask = static_cast<DiffPairTask *>(pParam);
+	// The diffutils globals are per thread
+	pTask->options.SetToDiffUtils();
+	pTask->bResult = pTask->pDiffWrapper->Diff2Files(pTask->diffs, pTask->diffData, pTask->bin_status, nullptr);
+}
+
+}
+
+/**
+ * @brief Compare several file pairs, e.g. the three pairs of a 3-way compare.
+ * If the files are large, the pairs are compared concurrently: pairs get a
+ * thread of their own, in which the diffutils options are set first, and
+ * the calling thread compares the others. Small files are compared one
+ * after another, as starting threads would take longer than comparing them.
+ * @param [in] nPairs Number of file pairs.
+ * @param [out] diffs Change scripts, one for each pair.
+ * @param [in] diffData Opened file pairs.
+ * @param [out] bin_status Binary status of each pair, see Diff2Files().
+ * @param [in] nMaxThreads Max number of threads comparing, including the
+ *  calling thread, 0 for one thread for each pair.
+ * @return true when all compares succeed.
+ */
+bool CDiffWrapper::DiffFilePairs(int nPairs, struct change ** diffs[], DiffFileData * diffData[],
+	int * bin_status[], int nMaxThreads/* = 0*/) const
+{
+	int64_t nMaxSize = 0;
+	for (int i = 0; i < nPairs; ++i)
+		nMaxSize = (std::max)({ nMaxSize, static_cast<int64_t>(diffData[i]->m_inf[0].stat.st_size),
+			static_cast<int64_t>(diffData[i]->m_inf[1].stat.st_size) });
+	const int nThreads = (nMaxThreads > 0) ? (std::min)(nPairs, nMaxThreads) : nPairs;
+	if (nThreads < 2 || nMaxSize < PARALLEL_DIFF_MIN_SIZE)
+	{
+		bool bRet = true;
+		for (int i = 0; i < nPairs; ++i)
+		{
+			if (!Diff2Files(diffs[i], diffData[i], bin_status[i], nullptr))
+				bRet = false;
+		}
+		return bRet;
+	}
+
+	// Pairs 1 to nThreads - 1 get a thread, the calling thread compares the others
+	std::vector<DiffPairTask> tasks(nThreads - 1);
+	std::vector<std::unique_ptr<Poco::Thread>> threads;
+	for (int i = 1; i < nThreads; ++i)
+	{
+		DiffPairTask& task = tasks[i - 1];
+		task = { this, m_options, diffs[i], diffData[i], bin_status[i], false };
+		threads.emplace_back(new Poco::Thread());
+		threads.back()->start(DiffPairThreadProc, &task);
+	}
+	bool bRet = Diff2Files(diffs[0], diffData[0], bin_status[0], nullptr);
+	for (int i = nThreads; i < nPairs; ++i)
+	{
+		if (!Diff2Files(diffs[i], diffData[i], bin_status[i], nullptr))
+			bRet = false;
+	}
+	for (auto& pThread : threads)
+		pThread->join();
+	for (const auto& task : tasks)
+	{
+		if (!task.bResult)
+			bRet = false;
+	}
+	return bRet;
+}
+
 bool CDiffWrapper::IsIdenticalOrIgnorable(struct change* script)
 {
 	bool diff = false;
@@ -1216,14 +1325,14 @@ bool CDiffWrapper::RegExpFilter(std::string& lines) const
 
 	std::string replaced;
 	replaced.reserve(lines.length());
+	std::string line;
 	size_t pos = 0;
 	while (pos < lines.length())
 	{
-		const char* string = lines.c_str() + pos;
+		const size_t begin = pos;
 		while (pos < lines.length() && (lines[pos] != '\r' && lines[pos] != '\n'))
 			pos++;
-		size_t stringlen = lines.c_str() + pos - string;
-		std::string line = std::string(string, stringlen);
+		line.assign(lines, begin, pos - begin);
 		if (!m_pFilterList->Match(line, m_codepage))
 		{
 			linesMatch = false;
@@ -1233,12 +1342,12 @@ bool CDiffWrapper::RegExpFilter(std::string& lines) const
 		{
 			replaced += FILTERED_LINE;
 		}
-		std::string eol;
+		const size_t eol = pos;
 		while (pos < lines.length() && (lines[pos] == '\r' || lines[pos] == '\n'))
-			eol += lines[pos++];
-		replaced += eol;
+			pos++;
+		replaced.append(lines, eol, pos - eol);
 	}
-	lines = replaced;
+	lines = std::move(replaced);
 	return linesMatch;
 }
 
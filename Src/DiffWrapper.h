@@ -9,6 +9,7 @@
 #pragma once
 
 #include <memory>
+#include <string>
 #include "diff.h"
 #include "FileLocation.h"
 #include "PathContext.h"
@@ -174,7 +175,8 @@ public:
 	void SetAppendFiles(bool bAppendFiles);
 	void SetPaths(const PathContext &files, bool tempPaths);
 	void SetAlternativePaths(const PathContext &altPaths);
-	bool RunFileDiff();
+	bool RunFileDiff(const std::string *buffers = nullptr);
+	bool HasPrediffer() const;
 	void GetDiffStatus(DIFFSTATUS *status) const;
 	void AddDiffRange(DiffList *pDiffList, unsigned begin0, unsigned end0, unsigned begin1, unsigned end1, OP_TYPE op);
 	void AddDiffRange(DiffList *pDiffList, DIFFRANGE &dr);
@@ -194,6 +196,8 @@ public:
 	int PostFilter(PostFilterContext& ctxt, change* thisob, const file_data* file_data_ary) const;
 	bool Diff2Files(struct change ** diffs, DiffFileData *diffData,
 		int * bin_status, int * bin_file) const;
+	bool DiffFilePairs(int nPairs, struct change ** diffs[], DiffFileData * diffData[],
+		int * bin_status[], int nMaxThreads = 0) const;
 
 protected:
 	String FormatSwitchString() const;
@@ -19,6 +19,8 @@
 #include "CompareOptions.h"
 #include "UnicodeString.h"
 #include "CompareStats.h"
+#include "CompareResultCache.h"
+#include "Environment.h"
 #include "FilterList.h"
 #include "SubstitutionList.h"
 #include "DirView.h"
@@ -233,6 +235,16 @@ void CDirDoc::InitDiffContext(CDiffContext *pCtxt)
 		pCtxt->m_iGuessEncodingType |= 50001 << 16;
 	pCtxt->m_bIgnoreSmallTimeDiff = GetOptionsMgr()->GetBool(OPT_IGNORE_SMALL_FILETIME);
 	pCtxt->m_bStopAfterFirstDiff = GetOptionsMgr()->GetBool(OPT_CMP_STOP_AFTER_FIRST);
+	pCtxt->m_bFastReject = GetOptionsMgr()->GetBool(OPT_CMP_FAST_REJECT);
+	if (GetOptionsMgr()->GetBool(OPT_CMP_RESULT_CACHE))
+	{
+		// All folder compares of this process share one cache
+		static std::shared_ptr<CompareResultCache> pCompareResultCache(new CompareResultCache(
+			env::ExpandEnvironmentVariables(_T("%LOCALAPPDATA%\\WinMerge\\CompareResultCache.dat"))));
+		pCtxt->m_pCompareResultCache = pCompareResultCache;
+	}
+	else
+		pCtxt->m_pCompareResultCache.reset();
 	pCtxt->m_nQuickCompareLimit = GetOptionsMgr()->GetInt(OPT_CMP_QUICK_LIMIT);
 	pCtxt->m_nBinaryCompareLimit = GetOptionsMgr()->GetInt(OPT_CMP_BINARY_LIMIT);
 	pCtxt->m_bPluginsEnabled = GetOptionsMgr()->GetBool(OPT_PLUGINS_ENABLED);
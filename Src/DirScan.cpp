@@ -7,23 +7,23 @@
 #include "pch.h"
 #include "DirScan.h"
 #include <cassert>
+#include <atomic>
+#include <functional>
 #include <memory>
 #define POCO_NO_UNWINDOWS 1
 #include <Poco/Semaphore.h>
-#include <Poco/Notification.h>
-#include <Poco/NotificationQueue.h>
 #include <Poco/Environment.h>
 #include <Poco/ThreadPool.h>
 #include <Poco/Thread.h>
 #include <Poco/Runnable.h>
 #include <Poco/Mutex.h>
-#include <Poco/AutoPtr.h>
-#include <Poco/Stopwatch.h>
+#include <Poco/Condition.h>
 #include <Poco/Format.h>
 #include "DiffThread.h"
 #include "UnicodeString.h"
 #include "DiffWrapper.h"
 #include "CompareStats.h"
+#include "CompareQueue.h"
 #include "FolderCmp.h"
 #include "FileFilterHelper.h"
 #include "IAbortable.h"
@@ -36,16 +36,13 @@
 #include "OptionsDef.h"
 #include "OptionsMgr.h"
 #include "PathContext.h"
+#include "WorkStealingPool.h"
 #include "DebugNew.h"
 
-using Poco::NotificationQueue;
-using Poco::Notification;
-using Poco::AutoPtr;
 using Poco::Thread;
 using Poco::ThreadPool;
 using Poco::Runnable;
 using Poco::Environment;
-using Poco::Stopwatch;
 
 // Static functions (ie, functions only used locally)
 static void CompareDiffItem(FolderCmp &fc, DIFFITEM &di);
@@ -54,33 +51,13 @@ static DIFFITEM *AddToList(const String &sLeftDir, const String &sRightDir, cons
 static DIFFITEM *AddToList(const String &sDir1, const String &sDir2, const String &sDir3, const DirItem *ent1, const DirItem *ent2, const DirItem *ent3,
 	unsigned code, DiffFuncStruct *myStruct, DIFFITEM *parent, int nItems = 3);
 static void UpdateDiffItem(DIFFITEM &di, bool &bExists, CDiffContext *pCtxt);
-static int CompareItems(NotificationQueue &queue, DiffFuncStruct *myStruct, DIFFITEM *parentdiffpos);
+static int CompareFolderItems(FolderCmp &fc, DIFFITEM *parentdiffpos);
 static unsigned GetDirCompareFlags3Way(const DIFFITEM& di);
 
-class WorkNotification: public Poco::Notification
-{
-public:
-	WorkNotification(DIFFITEM& di, NotificationQueue& queueResult): m_di(di), m_queueResult(queueResult) {}
-	DIFFITEM& data() const { return m_di; }
-	NotificationQueue& queueResult() const { return m_queueResult; }
-private:
-	DIFFITEM& m_di;
-	NotificationQueue& m_queueResult;
-};
-
-class WorkCompletedNotification: public Poco::Notification
-{
-public:
-	explicit WorkCompletedNotification(DIFFITEM& di): m_di(di) {}
-	DIFFITEM& data() const { return m_di; }
-private:
-	DIFFITEM& m_di;
-};
-
 class DiffWorker: public Runnable
 {
 public:
-	DiffWorker(NotificationQueue& queue, CDiffContext *pCtxt, int id):
+	DiffWorker(CompareQueue& queue, CDiffContext *pCtxt, int id):
 	  m_queue(queue), m_pCtxt(pCtxt), m_id(id) {}
 
 	void run()
@@ -90,29 +67,28 @@ public:
 		// when we exit the thread, we delete this and release the scripts
 		CAssureScriptsForThread scriptsForRescan(new MergeAppCOMClass());
 
-		AutoPtr<Notification> pNf(m_queue.waitDequeueNotification());
-		while (pNf.get() != nullptr)
+		DIFFITEM *items[32];
+		size_t nItems;
+		while ((nItems = m_queue.Pop(items, std::size(items))) > 0)
 		{
-			WorkNotification* pWorkNf = dynamic_cast<WorkNotification*>(pNf.get());
-			if (pWorkNf != nullptr) {
-				m_pCtxt->m_pCompareStats->BeginCompare(&pWorkNf->data(), m_id);
+			for (size_t i = 0; i < nItems; ++i)
+			{
+				m_pCtxt->m_pCompareStats->BeginCompare(items[i], m_id);
 				if (!m_pCtxt->ShouldAbort())
-					CompareDiffItem(fc, pWorkNf->data());
-				pWorkNf->queueResult().enqueueNotification(new WorkCompletedNotification(pWorkNf->data()));
+					CompareDiffItem(fc, *items[i]);
 			}
+			m_queue.Done(nItems);
 			if (m_pCtxt->m_pCompareStats->IsIdleCompareThread(m_id))
 			{
 				m_pCtxt->m_pCompareStats->BeginCompare(nullptr, m_id);
-				while (!m_pCtxt->ShouldAbort() && m_pCtxt->m_pCompareStats->IsIdleCompareThread(m_id))
-					Poco::Thread::sleep(10);
+				while (!m_pCtxt->ShouldAbort() && m_pCtxt->m_pCompareStats->WaitWhileIdleCompareThread(m_id, 100))
+					;
 			}
-
-			pNf = m_queue.waitDequeueNotification();
 		}
 	}
 
 private:
-	NotificationQueue& m_queue;
+	CompareQueue& m_queue;
 	CDiffContext *m_pCtxt;
 	int m_id;
 };
@@ -120,54 +96,94 @@ private:
 typedef std::shared_ptr<DiffWorker> DiffWorkerPtr;
 
 /**
- * @brief Collect file- and folder-names to list.
- * This function walks given folders and adds found subfolders and files into
- * lists. There are two modes, determined by the @p depth:
- * - in non-recursive mode we walk only given folders, and add files
- *   contained. Subfolders are added as folder items, not walked into.
- * - in recursive mode we walk all subfolders and add the files they
- *   contain into list.
- *
- * Items are tested against file filters in this function.
- * 
+ * @brief Get full folder paths of a scanned folder.
  * @param [in] paths Root paths of compare
- * @param [in] leftsubdir Left side subdirectory under root path
- * @param [in] bLeftUniq Is left-side folder unique folder?
- * @param [in] rightsubdir Right side subdirectory under root path
- * @param [in] bRightUniq Is right-side folder unique folder?
+ * @param [in] subdir Subdirectories under root paths
+ * @param [out] sDir Full folder paths
+ */
+static void GetFolderPaths(const PathContext &paths, const String subdir[], String sDir[])
+{
+	std::copy(paths.begin(), paths.end(), sDir);
+
+	if (!subdir[0].empty())
+	{
+		for (int nIndex = 0; nIndex < paths.GetSize(); nIndex++)
+			sDir[nIndex] = paths::ConcatPath(sDir[nIndex], subdir[nIndex]);
+	}
+}
+
+/**
+ * @brief Add sizes of child items to folder diff item.
+ * @param [in,out] parent Folder diff item, may be nullptr for root
+ * @param [in] nDirs Number of compared folders
+ */
+static void SumChildSizes(DIFFITEM *parent, int nDirs)
+{
+	if (parent != nullptr)
+	{
+		for (int nIndex = 0; nIndex < nDirs; ++nIndex)
+			if (parent->diffcode.exists(nIndex) && parent->diffFileInfo[nIndex].size == DirItem::FILE_SIZE_NONE)
+				parent->diffFileInfo[nIndex].size = 0;
+	
+		DIFFITEM *dic = parent->GetFirstChild();
+		while (dic)
+		{
+			for (int nIndex = 0; nIndex < nDirs; ++nIndex)
+			{
+				if (dic->diffFileInfo[nIndex].size != DirItem::FILE_SIZE_NONE)
+					parent->diffFileInfo[nIndex].size += dic->diffFileInfo[nIndex].size;
+			}
+			dic = dic->GetFwdSiblingLink();
+		}
+	}
+}
+
+/**
+ * @brief Get number of threads used for parallel collect.
+ * Non-positive option values are relative to the processor count, as with
+ * the compare threads option.
+ */
+static int GetCollectThreadCount()
+{
+	int nthreads = GetOptionsMgr()->GetInt(OPT_CMP_COLLECT_THREADS);
+	if (nthreads <= 0)
+		nthreads += Environment::processorCount();
+	return std::clamp(nthreads, 1, static_cast<int>(Environment::processorCount()));
+}
+
+/**
+ * @brief Add items of one folder to list.
+ * Merges sorted folder listings of all sides and adds one diff item per
+ * found subfolder and file as children of @p parent, in sorted order.
+ * Subfolders to walk into are passed to @p onSubfolder right after their
+ * diff item has been added.
+ *
+ * @param [in] nDirs Number of compared folders
+ * @param [in] subdir Subdirectories under root paths
+ * @param [in] dirs Sorted subfolders of each side
+ * @param [in] aFiles Sorted files of each side
  * @param [in] myStruct Compare-related data, like context etc.
  * @param [in] casesensitive Is filename compare case sensitive?
  * @param [in] depth Levels of subdirectories to scan, -1 scans all
  * @param [in] parent Folder diff item to be scanned
  * @param [in] bUniques If true, walk into unique folders.
- * @return 1 normally, -1 if compare was aborted
+ * @param [in] onSubfolder Called for every subfolder to walk into
+ * @return 1 normally, 0 if all folders are empty, -1 if compare was aborted
  */
-int DirScan_GetItems(const PathContext &paths, const String subdir[],
-		DiffFuncStruct *myStruct,
-		bool casesensitive, int depth, DIFFITEM *parent,
-		bool bUniques)
+static int ScanFolder(int nDirs, const String subdir[], const DirItemArray dirs[], const DirItemArray aFiles[],
+		DiffFuncStruct *myStruct, bool casesensitive, int depth, DIFFITEM *parent, bool bUniques,
+		const std::function<int(DIFFITEM *me, const String newsubdir[])>& onSubfolder)
 {
 	static const tchar_t backslash[] = _T("\\");
-	int nDirs = paths.GetSize();
 	CDiffContext *pCtxt = myStruct->context;
-	String sDir[3];
 	String subprefix[3];
 
-	std::copy(paths.begin(), paths.end(), sDir);
-
 	if (!subdir[0].empty())
 	{
-		for (int nIndex = 0; nIndex < paths.GetSize(); nIndex++)
-		{
-			sDir[nIndex] = paths::ConcatPath(sDir[nIndex], subdir[nIndex]);
+		for (int nIndex = 0; nIndex < nDirs; nIndex++)
 			subprefix[nIndex] = subdir[nIndex] + backslash;
-		}
 	}
 
-	DirItemArray dirs[3], aFiles[3];
-	for (int nIndex = 0; nIndex < nDirs; nIndex++)
-		LoadAndSortFiles(sDir[nIndex], &dirs[nIndex], &aFiles[nIndex], casesensitive);
-
 	// Allow user to abort scanning
 	if (pCtxt->ShouldAbort())
 		return -1;
@@ -311,9 +327,7 @@ int DirScan_GetItems(const PathContext &paths, const String subdir[],
 				{
 					// Scan recursively all subdirectories too, we are not adding folders
 					String newsubdir[3] = {leftnewsub, rightnewsub};
-					int result = DirScan_GetItems(paths, newsubdir, myStruct, casesensitive,
-							depth - 1, me, bUniques);
-					if (result == -1)
+					if (onSubfolder(me, newsubdir) == -1)
 						return -1;
 				}
 			}
@@ -328,9 +342,7 @@ int DirScan_GetItems(const PathContext &paths, const String subdir[],
 				{
 					// Scan recursively all subdirectories too, we are not adding folders
 					String newsubdir[3] = {leftnewsub, middlenewsub, rightnewsub};
-					int result = DirScan_GetItems(paths, newsubdir, myStruct, casesensitive,
-							depth - 1, me, bUniques);
-					if (result == -1)
+					if (onSubfolder(me, newsubdir) == -1)
 						return -1;
 				}
 			}
@@ -453,30 +465,238 @@ int DirScan_GetItems(const PathContext &paths, const String subdir[],
 		break;
 	}
 
-	if (parent != nullptr)
+	return 1;
+}
+
+/**
+ * @brief Collect items of a folder tree on the calling thread.
+ * @sa DirScan_GetItems()
+ */
+static int CollectItems(const PathContext &paths, const String subdir[],
+		DiffFuncStruct *myStruct,
+		bool casesensitive, int depth, DIFFITEM *parent,
+		bool bUniques)
+{
+	int nDirs = paths.GetSize();
+	String sDir[3];
+	GetFolderPaths(paths, subdir, sDir);
+
+	DirItemArray dirs[3], aFiles[3];
+	for (int nIndex = 0; nIndex < nDirs; nIndex++)
+		LoadAndSortFiles(sDir[nIndex], &dirs[nIndex], &aFiles[nIndex], casesensitive);
+
+	int result = ScanFolder(nDirs, subdir, dirs, aFiles, myStruct, casesensitive, depth, parent, bUniques,
+		[&](DIFFITEM *me, const String newsubdir[])
+		{
+			// Scan recursively all subdirectories too, we are not adding folders
+			return CollectItems(paths, newsubdir, myStruct, casesensitive, depth - 1, me, bUniques);
+		});
+	if (result == 1)
+		SumChildSizes(parent, nDirs);
+	return result;
+}
+
+/**
+ * @brief Collects items of a folder tree on a work-stealing thread pool.
+ *
+ * Every folder is a task: the sides of the folder are listed concurrently,
+ * and the last side to finish merges the listings into child diff items and
+ * spawns a task for each subfolder to walk into. As all children of one
+ * parent are added by one task, the sibling order is the same as with the
+ * serial walk.
+ *
+ * The collect thread waits for the folders depth-first in Complete() and
+ * sums up folder sizes once their subtrees are complete.
+ */
+class ParallelCollector
+{
+public:
+	ParallelCollector(const PathContext& paths, DiffFuncStruct *myStruct, bool casesensitive, bool bUniques, int nThreads)
+		: m_paths(paths), m_myStruct(myStruct), m_casesensitive(casesensitive), m_bUniques(bUniques)
+		, m_nDirs(paths.GetSize()), m_pool(nThreads)
 	{
-		for (int nIndex = 0; nIndex < nDirs; ++nIndex)
-			if (parent->diffcode.exists(nIndex) && parent->diffFileInfo[nIndex].size == DirItem::FILE_SIZE_NONE)
-				parent->diffFileInfo[nIndex].size = 0;
-	
-		DIFFITEM *dic = parent->GetFirstChild();
-		while (dic)
+	}
+
+	int Run(const String subdir[], int depth, DIFFITEM *parent)
+	{
+		Folder root(subdir, depth, parent);
+		Schedule(&root);
+		int result = Complete(&root);
+		m_pool.Wait();
+		return result;
+	}
+
+private:
+	struct Folder
+	{
+		Folder(const String subdir_[], int depth_, DIFFITEM *parent_)
+			: depth(depth_), parent(parent_), nPendingSides(0), bFailed(false), result(0), bDone(false)
 		{
-			for (int nIndex = 0; nIndex < nDirs; ++nIndex)
+			std::copy(subdir_, subdir_ + 3, subdir);
+		}
+		String subdir[3];
+		int depth;
+		DIFFITEM *parent;
+		DirItemArray dirs[3], aFiles[3];
+		std::atomic_int nPendingSides;
+		std::atomic_bool bFailed; /**< Has loading a side thrown? */
+		std::vector<std::unique_ptr<Folder>> subfolders; /**< Subfolders to walk into, in sibling order */
+		int result;
+		bool bDone;
+	};
+
+	void Schedule(Folder *pFolder)
+	{
+		pFolder->nPendingSides = m_nDirs;
+		for (int nIndex = 0; nIndex < m_nDirs; nIndex++)
+			m_pool.Submit([this, pFolder, nIndex]() { LoadSide(pFolder, nIndex); });
+	}
+
+	// A folder whose load or scan throws is completed as aborted, so that
+	// Complete() does not wait for it forever. The exception is rethrown by
+	// m_pool.Wait().
+	void LoadSide(Folder *pFolder, int nIndex)
+	{
+		std::exception_ptr pException;
+		if (!m_myStruct->context->ShouldAbort())
+		{
+			try
 			{
-				if (dic->diffFileInfo[nIndex].size != DirItem::FILE_SIZE_NONE)
-					parent->diffFileInfo[nIndex].size += dic->diffFileInfo[nIndex].size;
+				String sDir[3];
+				GetFolderPaths(m_paths, pFolder->subdir, sDir);
+				LoadAndSortFiles(sDir[nIndex], &pFolder->dirs[nIndex], &pFolder->aFiles[nIndex], m_casesensitive);
+			}
+			catch (...)
+			{
+				pException = std::current_exception();
+				pFolder->bFailed = true;
 			}
-			dic = dic->GetFwdSiblingLink();
 		}
+		if (--pFolder->nPendingSides == 0)
+			Scan(pFolder);
+		if (pException)
+			std::rethrow_exception(pException);
 	}
 
-	return 1;
+	void Scan(Folder *pFolder)
+	{
+		std::exception_ptr pException;
+		if (pFolder->bFailed)
+			pFolder->result = -1;
+		else
+		{
+			try
+			{
+				pFolder->result = ScanFolder(m_nDirs, pFolder->subdir, pFolder->dirs, pFolder->aFiles,
+					m_myStruct, m_casesensitive, pFolder->depth, pFolder->parent, m_bUniques,
+					[&](DIFFITEM *me, const String newsubdir[])
+					{
+						pFolder->subfolders.emplace_back(new Folder(newsubdir, pFolder->depth - 1, me));
+						Schedule(pFolder->subfolders.back().get());
+						return 0;
+					});
+			}
+			catch (...)
+			{
+				pException = std::current_exception();
+				pFolder->result = -1;
+			}
+		}
+		for (int nIndex = 0; nIndex < m_nDirs; nIndex++)
+		{
+			DirItemArray().swap(pFolder->dirs[nIndex]);
+			DirItemArray().swap(pFolder->aFiles[nIndex]);
+		}
+		{
+			Poco::FastMutex::ScopedLock lock(m_mutex);
+			pFolder->bDone = true;
+			m_folderDone.broadcast();
+		}
+		if (pException)
+			std::rethrow_exception(pException);
+	}
+
+	int Complete(Folder *pFolder)
+	{
+		{
+			Poco::FastMutex::ScopedLock lock(m_mutex);
+			while (!pFolder->bDone)
+				m_folderDone.wait(m_mutex);
+		}
+		if (pFolder->result == -1)
+			return -1;
+
+		int result = pFolder->result;
+		for (auto& pSubfolder : pFolder->subfolders)
+		{
+			if (Complete(pSubfolder.get()) == -1)
+				result = -1;
+			pSubfolder.reset();
+		}
+		if (result == 1)
+			SumChildSizes(pFolder->parent, m_nDirs);
+		return result;
+	}
+
+	const PathContext& m_paths;
+	DiffFuncStruct *m_myStruct;
+	bool m_casesensitive;
+	bool m_bUniques;
+	int m_nDirs;
+	Poco::FastMutex m_mutex;
+	Poco::Condition m_folderDone;
+	WorkStealingPool m_pool;
+};
+
+/**
+ * @brief Collect file- and folder-names to list.
+ * This function walks given folders and adds found subfolders and files into
+ * lists. There are two modes, determined by the @p depth:
+ * - in non-recursive mode we walk only given folders, and add files
+ *   contained. Subfolders are added as folder items, not walked into.
+ * - in recursive mode we walk all subfolders and add the files they
+ *   contain into list.
+ *
+ * Items are tested against file filters in this function.
+ *
+ * In recursive mode the folder tree is walked by a pool of threads if
+ * more than one collect thread is configured (OPT_CMP_COLLECT_THREADS).
+ * The resulting item tree is identical to the one of the serial walk.
+ * 
+ * @param [in] paths Root paths of compare
+ * @param [in] subdir Subdirectories under root paths
+ * @param [in] myStruct Compare-related data, like context etc.
+ * @param [in] casesensitive Is filename compare case sensitive?
+ * @param [in] depth Levels of subdirectories to scan, -1 scans all
+ * @param [in] parent Folder diff item to be scanned
+ * @param [in] bUniques If true, walk into unique folders.
+ * @return 1 normally, -1 if compare was aborted
+ */
+int DirScan_GetItems(const PathContext &paths, const String subdir[],
+		DiffFuncStruct *myStruct,
+		bool casesensitive, int depth, DIFFITEM *parent,
+		bool bUniques)
+{
+	if (depth != 0)
+	{
+		int nthreads = GetCollectThreadCount();
+		if (nthreads > 1)
+		{
+			ParallelCollector collector(paths, myStruct, casesensitive, bUniques, nthreads);
+			return collector.Run(subdir, depth, parent);
+		}
+	}
+	return CollectItems(paths, subdir, myStruct, casesensitive, depth, parent, bUniques);
 }
 
 /**
  * @brief Compare DiffItems in list and add results to compare context.
  *
+ * File items are compared by a pool of compare threads as soon as the
+ * collect thread hands them over through the compare queue. When the
+ * collect has finished and all files are compared, results of the folder
+ * items are set from the results of their children.
+ *
  * @param myStruct [in] A structure containing compare-related data.
  * @param parentdiffpos [in] Position of parent diff item 
  * @return >= 0 number of diff items, -1 if compare was aborted
@@ -496,7 +716,7 @@ int DirScan_CompareItems(DiffFuncStruct *myStruct, DIFFITEM *parentdiffpos)
 
 	ThreadPool threadPool(nworkers, nworkers);
 	std::vector<DiffWorkerPtr> workers;
-	NotificationQueue queue;
+	CompareQueue& queue = *myStruct->pCompareQueue;
 	myStruct->context->m_pCompareStats->SetCompareThreadCount(nworkers);
 	workers.reserve(nworkers);
 	for (int i = 0; i < nworkers; ++i)
@@ -505,27 +725,33 @@ int DirScan_CompareItems(DiffFuncStruct *myStruct, DIFFITEM *parentdiffpos)
 		threadPool.start(*workers[i]);
 	}
 
-	int res = CompareItems(queue, myStruct, parentdiffpos);
+	// Wait until the collect has finished and all collected items have been
+	// compared
+	while (!queue.WaitUntilDone(2000))
+	{
+		int event = CDiffThread::EVENT_COMPARE_PROGRESSED;
+		myStruct->m_listeners.notify(myStruct, event);
+	}
 
 	myStruct->context->m_pCompareStats->SetIdleCompareThreadCount(0);
-	Thread::sleep(100);
-	queue.wakeUpAll();
 	threadPool.joinAll();
 
-	return res;
+	FolderCmp fc(myStruct->context);
+	return CompareFolderItems(fc, parentdiffpos);
 }
 
-static int CompareItems(NotificationQueue& queue, DiffFuncStruct *myStruct, DIFFITEM *parentdiffpos)
+/**
+ * @brief Set results of folder items from the results of their children.
+ *
+ * @param fc [in] Folder compare object of the calling thread.
+ * @param parentdiffpos [in] Position of parent diff item 
+ * @return >= 0 number of diff items, -1 if compare was aborted
+ */
+static int CompareFolderItems(FolderCmp &fc, DIFFITEM *parentdiffpos)
 {
-	NotificationQueue queueResult;
-	Stopwatch stopwatch;
-	CDiffContext *pCtxt = myStruct->context;
+	CDiffContext *pCtxt = fc.m_pCtxt;
 	int res = 0;
-	int count = 0;
 	bool bCompareFailure = false;
-	if (parentdiffpos == nullptr)
-		myStruct->pSemaphore->wait();
-	stopwatch.start();
 	int nDirs = pCtxt->GetCompareDirs();
 	DIFFITEM *pos = pCtxt->GetFirstChildDiffPosition(parentdiffpos);
 	while (pos != nullptr)
@@ -533,83 +759,63 @@ static int CompareItems(NotificationQueue& queue, DiffFuncStruct *myStruct, DIFF
 		if (pCtxt->ShouldAbort())
 			break;
 
-		if (stopwatch.elapsed() > 2000000)
-		{
-			int event = CDiffThread::EVENT_COMPARE_PROGRESSED;
-			myStruct->m_listeners.notify(myStruct, event);
-			stopwatch.restart();
-		}
-		myStruct->pSemaphore->wait();
 		DIFFITEM *curpos = pos;
 		DIFFITEM &di = pCtxt->GetNextSiblingDiffRefPosition(pos);
 		bool existsalldirs = di.diffcode.existAll();
-		if (di.diffcode.isDirectory() && pCtxt->m_bRecursive)
+		if (di.diffcode.isDirectory())
 		{
-			if ((di.diffcode.diffcode & DIFFCODE::CMPERR) != DIFFCODE::CMPERR)
-			{	// Only clear DIFF|SAME flags if not CMPERR (eg. both flags together)
-				di.diffcode.diffcode &= ~(DIFFCODE::DIFF | DIFFCODE::SAME);
-			}
-			int ndiff = CompareItems(queue, myStruct, curpos);
-			// Propagate sub-directory status to this directory
-			if (ndiff > 0)
-			{	// There were differences in the sub-directories
-				if (existsalldirs || pCtxt->m_bWalkUniques)
-					di.diffcode.diffcode |= DIFFCODE::DIFF;
-				res += ndiff;
-			}
-			else 
-			if (ndiff == 0)
-			{	// Sub-directories were identical
-				if (existsalldirs)
-					di.diffcode.diffcode |= DIFFCODE::SAME;
-				else if (pCtxt->m_bWalkUniques && !di.diffcode.isResultFiltered())
-					di.diffcode.diffcode |= DIFFCODE::DIFF;
-			}
-			else
-			if (ndiff == -1)
-			{	// There were file IO-errors during sub-directory comparison.
-				di.diffcode.diffcode |= DIFFCODE::CMPERR;
-				bCompareFailure = true;
-			}
-
-			if (nDirs == 3 && (di.diffcode.diffcode & DIFFCODE::COMPAREFLAGS) == DIFFCODE::DIFF && !di.diffcode.isResultFiltered())
+			if (pCtxt->m_bRecursive)
 			{
-				di.diffcode.diffcode &= ~DIFFCODE::COMPAREFLAGS3WAY;
-				di.diffcode.diffcode |= GetDirCompareFlags3Way(di);
-			}
-		}
-		if (existsalldirs)
-			queue.enqueueUrgentNotification(new WorkNotification(di, queueResult));
-		else
-			queue.enqueueNotification(new WorkNotification(di, queueResult));
-		++count;
-		pos = curpos;
-		pCtxt->GetNextSiblingDiffRefPosition(pos);
-	}
+				if ((di.diffcode.diffcode & DIFFCODE::CMPERR) != DIFFCODE::CMPERR)
+				{	// Only clear DIFF|SAME flags if not CMPERR (eg. both flags together)
+					di.diffcode.diffcode &= ~(DIFFCODE::DIFF | DIFFCODE::SAME);
+				}
+				int ndiff = CompareFolderItems(fc, curpos);
+				// Propagate sub-directory status to this directory
+				if (ndiff > 0)
+				{	// There were differences in the sub-directories
+					if (existsalldirs || pCtxt->m_bWalkUniques)
+						di.diffcode.diffcode |= DIFFCODE::DIFF;
+					res += ndiff;
+				}
+				else 
+				if (ndiff == 0)
+				{	// Sub-directories were identical
+					if (existsalldirs)
+						di.diffcode.diffcode |= DIFFCODE::SAME;
+					else if (pCtxt->m_bWalkUniques && !di.diffcode.isResultFiltered())
+						di.diffcode.diffcode |= DIFFCODE::DIFF;
+				}
+				else
+				if (ndiff == -1)
+				{	// There were file IO-errors during sub-directory comparison.
+					di.diffcode.diffcode |= DIFFCODE::CMPERR;
+					bCompareFailure = true;
+				}
 
-	while (count > 0)
-	{
-		AutoPtr<Notification> pNf(queueResult.waitDequeueNotification());
-		if (pNf.get() == nullptr)
-			break;
-		WorkCompletedNotification* pWorkCompletedNf = dynamic_cast<WorkCompletedNotification*>(pNf.get());
-		if (pWorkCompletedNf != nullptr) {
-			DIFFITEM &di = pWorkCompletedNf->data();
-			if (di.diffcode.isResultError()) { 
-				DIFFITEM *diParent = di.GetParentLink();
-				assert(diParent != nullptr);
-				if (diParent != nullptr)
+				if (nDirs == 3 && (di.diffcode.diffcode & DIFFCODE::COMPAREFLAGS) == DIFFCODE::DIFF && !di.diffcode.isResultFiltered())
 				{
-					diParent->diffcode.diffcode |= DIFFCODE::CMPERR;
-					bCompareFailure = true;
+					di.diffcode.diffcode &= ~DIFFCODE::COMPAREFLAGS3WAY;
+					di.diffcode.diffcode |= GetDirCompareFlags3Way(di);
 				}
 			}
-				
-			if (di.diffcode.isResultDiff() ||
-				(!di.diffcode.existAll() && !di.diffcode.isResultFiltered()))
-				res++;
+			CompareDiffItem(fc, di);
 		}
-		--count;
+
+		if (di.diffcode.isResultError())
+		{ 
+			DIFFITEM *diParent = di.GetParentLink();
+			assert(diParent != nullptr);
+			if (diParent != nullptr)
+			{
+				diParent->diffcode.diffcode |= DIFFCODE::CMPERR;
+				bCompareFailure = true;
+			}
+		}
+			
+		if (di.diffcode.isResultDiff() ||
+			(!existsalldirs && !di.diffcode.isResultFiltered()))
+			res++;
 	}
 
 	return bCompareFailure || pCtxt->ShouldAbort() ? -1 : res;
@@ -999,7 +1205,10 @@ static DIFFITEM *AddToList(const String& sDir1, const String& sDir2, const Strin
 	if (!myStruct->bMarkedRescan && myStruct->m_fncCollect)
 	{
 		myStruct->context->m_pCompareStats->IncreaseTotalItems();
-		myStruct->pSemaphore->set();
+		// Hand files over to the compare threads right away, folders get
+		// their results after all files have been compared
+		if (!di->diffcode.isDirectory())
+			myStruct->pCompareQueue->Push(di);
 	}
 	return di;
 }
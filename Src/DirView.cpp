@@ -17,6 +17,7 @@
 #include "ClipBoard.h"
 #include "DirActions.h"
 #include "DirViewColItems.h"
+#include "DirViewColSorter.h"
 #include "DirFrame.h"  // StatePane
 #include "DirDoc.h"
 #include "IMergeDoc.h"
@@ -33,6 +34,7 @@
 #include "DirCmpReportDlg.h"
 #include "DirCmpReport.h"
 #include "CompareStatisticsDlg.h"
+#include "CompareStats.h"
 #include "LoadSaveCodepageDlg.h"
 #include "ConfirmFolderCopyDlg.h"
 #include "DirColsDlg.h"
@@ -99,6 +101,7 @@ CDirView::CDirView()
 		, m_hCurrentMenu(nullptr)
 		, m_pSavedTreeState(nullptr)
 		, m_pColItems(nullptr)
+		, m_pColSorter(new DirViewColSorter())
 		, m_nActivePane(-1)
 		, m_nExpandSubdirs(DO_NOT_EXPAND)
 		, m_bUserCancelEdit(false)
@@ -531,6 +534,7 @@ void CDirView::OnLButtonDblClk(UINT nFlags, CPoint point)
  */
 void CDirView::ReloadColumns()
 {
+	m_pColSorter->Clear();
 	LoadColumnHeaderItems();
 
 	UpdateColumnNames();
@@ -1111,6 +1115,7 @@ void CDirView::DoUpdateDirMove(CCmdUI* pCmdUI, eMenuType menuType)
  */
 void CDirView::UpdateResources()
 {
+	m_pColSorter->Clear();
 	UpdateColumnNames();
 	GetParentFrame()->UpdateResources();
 }
@@ -1150,10 +1155,18 @@ void CDirView::SortColumnsAppropriately()
 
 	bool bSortAscending = GetOptionsMgr()->GetBool(OPT_DIRVIEW_SORT_ASCENDING);
 	m_ctlSortHeader.SetSortImage(m_pColItems->ColLogToPhys(sortCol), bSortAscending);
-	//sort using static CompareFunc comparison function
-	CompareState cs(&GetDiffContext(), m_pColItems.get(), sortCol, bSortAscending, m_bTreeMode);
-	std::stable_sort(m_listViewItems.begin(), m_listViewItems.end(), [&cs](const ListViewOwnerDataItem& a, const ListViewOwnerDataItem& b)
-		{ return CompareState::CompareFunc(a.lParam, b.lParam, reinterpret_cast<LPARAM>(&cs)) < 0; });
+	// Sort special items always first in dir view
+	auto itFirstItem = std::stable_partition(m_listViewItems.begin(), m_listViewItems.end(),
+		[](const ListViewOwnerDataItem& item) { return item.lParam == -1; });
+	const CDiffContext& ctxt = GetDiffContext();
+	std::vector<const DIFFITEM *> items;
+	items.reserve(m_listViewItems.end() - itFirstItem);
+	for (auto it = itFirstItem; it != m_listViewItems.end(); ++it)
+		items.push_back(&ctxt.GetDiffAt(reinterpret_cast<DIFFITEM *>(it->lParam)));
+	const std::vector<size_t> order = m_pColSorter->Sort(&ctxt, m_pColItems.get(), sortCol, bSortAscending, m_bTreeMode, items);
+	std::vector<ListViewOwnerDataItem> sortedItems(itFirstItem, m_listViewItems.end());
+	for (size_t i = 0; i < order.size(); ++i)
+		*(itFirstItem + i) = sortedItems[order[i]];
 
 	m_firstDiffItem.reset();
 	m_lastDiffItem.reset();
@@ -1756,6 +1769,7 @@ void CDirView::DeleteItem(int sel, bool removeDIFFITEM)
 	DIFFITEM *diffpos = GetItemKey(sel);
 	if (IsDiffItemSpecial(diffpos))
 		return;
+	m_pColSorter->Clear();
 	if (m_bTreeMode)
 	{
 		CollapseSubdir(sel);
@@ -1800,6 +1814,7 @@ void CDirView::DeleteAllDisplayItems()
 	// that is, they contain no memory needing to be freed
 	m_pList->DeleteAllItems();
 	m_listViewItems.clear();
+	m_pColSorter->Clear();
 
 	m_firstDiffItem.reset();
 	m_lastDiffItem.reset();
@@ -2703,6 +2718,10 @@ void CDirView::OnTimer(UINT_PTR nIDEvent)
 		if (m_elapsed != 0)
 		{
 			msg = strutils::format(_("Elapsed time: %ld ms"), m_elapsed);
+			const CompareStats *pCompareStats = GetDocument()->GetCompareStats();
+			const int nCacheLookups = pCompareStats->GetCacheHits() + pCompareStats->GetCacheMisses();
+			if (nCacheLookups > 0)
+				msg += strutils::format(_(" (cached results: %d of %d files)"), pCompareStats->GetCacheHits(), nCacheLookups);
 			m_elapsed = 0;
 		}
 		else
@@ -4508,35 +4527,6 @@ void CDirView::SetColAlignments()
 	}
 }
 
-CDirView::CompareState::CompareState(const CDiffContext *pCtxt, const DirViewColItems *pColItems, int sortCol, bool bSortAscending, bool bTreeMode)
-: pCtxt(pCtxt)
-, pColItems(pColItems)
-, sortCol(sortCol)
-, bSortAscending(bSortAscending)
-, bTreeMode(bTreeMode)
-{
-}
-
-/// Compare two specified rows during a sort operation (windows callback)
-int CALLBACK CDirView::CompareState::CompareFunc(LPARAM lParam1, LPARAM lParam2, LPARAM lParamSort)
-{
-	CompareState *pThis = reinterpret_cast<CompareState*>(lParamSort);
-	// Sort special items always first in dir view
-	if (lParam1 == -1)
-		return -1;
-	if (lParam2 == -1)
-		return 1;
-
-	DIFFITEM *diffposl = (DIFFITEM *)lParam1;
-	DIFFITEM *diffposr = (DIFFITEM *)lParam2;
-	const DIFFITEM &ldi = pThis->pCtxt->GetDiffAt(diffposl);
-	const DIFFITEM &rdi = pThis->pCtxt->GetDiffAt(diffposr);
-	// compare 'left' and 'right' parameters as appropriate
-	int retVal = pThis->pColItems->ColSort(pThis->pCtxt, pThis->sortCol, ldi, rdi, pThis->bTreeMode);
-	// return compare result, considering sort direction
-	return pThis->bSortAscending ? retVal : -retVal;
-}
-
 /// Add new item to list view
 void CDirView::AddNewItem(int i, DIFFITEM *diffpos, int iImage, int iIndent)
 {
@@ -4556,6 +4546,7 @@ void CDirView::AddNewItem(int i, DIFFITEM *diffpos, int iImage, int iIndent)
  */
 void CDirView::UpdateDiffItemStatus(UINT nIdx)
 {
+	m_pColSorter->Clear();
 	GetListCtrl().RedrawItems(nIdx, nIdx);
 	const DIFFITEM& di = GetDiffItem(nIdx);
 	if (di.diffcode.isDirectory())
@@ -40,6 +40,7 @@ class CLoadSaveCodepageDlg;
 class CShellContextMenu;
 class CDiffContext;
 class DirViewColItems;
+class DirViewColSorter;
 class DirItemEnumerator;
 struct IListCtrl;
 
@@ -148,19 +149,6 @@ private:
 public:
 	void UpdateColumnNames();
 	void SetColAlignments();
-	// class CompareState is used to pass parameters to the PFNLVCOMPARE callback function.
-	class CompareState
-	{
-	private:
-		const DirViewColItems *const pColItems;
-		const CDiffContext *const pCtxt;
-		const int sortCol;
-		const bool bSortAscending;
-		const bool bTreeMode;
-	public:
-		CompareState(const CDiffContext *pCtxt, const DirViewColItems *pColItems, int sortCol, bool bSortAscending, bool bTreeMode);
-		static int CALLBACK CompareFunc(LPARAM lParam1, LPARAM lParam2, LPARAM lParamSort);
-	} friend;
 	void UpdateDiffItemStatus(UINT nIdx);
 private:
 	void InitiateSort();
@@ -222,6 +210,7 @@ protected:
 	HMENU m_hCurrentMenu; /**< Current shell context menu (either left or right) */
 	std::unique_ptr<DirViewTreeState> m_pSavedTreeState;
 	std::unique_ptr<DirViewColItems> m_pColItems;
+	std::unique_ptr<DirViewColSorter> m_pColSorter; /**< Keeps sort keys between sorts */
 	int m_nActivePane;
 
 	// Generated message map functions
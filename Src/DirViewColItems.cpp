@@ -1141,6 +1141,44 @@ static int ColPathSort(const CDiffContext *pCtxt, const void *p, const void *q,
 	return strutils::compare_logical(ColPathGet(pCtxt, p, 0), ColPathGet(pCtxt, q, 0));
 }
 
+/**
+ * @brief Get file name sort key.
+ * Keys give the same order as ColFileNameSort().
+ * @param [in] pCtxt Pointer to compare context.
+ * @param [in] p Pointer to DIFFITEM.
+ * @return Sort key.
+ */
+static DirColSortKey ColFileNameSortKey(const CDiffContext *pCtxt, const void *p, int)
+{
+	const DIFFITEM &di = *static_cast<const DIFFITEM *>(p);
+	return { di.diffcode.isDirectory() ? 0 : 1, ColFileNameGet<String>(pCtxt, p, 0) };
+}
+
+/**
+ * @brief Get file name extension sort key.
+ * Keys give the same order as ColExtSort().
+ * @param [in] pCtxt Pointer to compare context.
+ * @param [in] p Pointer to DIFFITEM.
+ * @return Sort key.
+ */
+static DirColSortKey ColExtSortKey(const CDiffContext *pCtxt, const void *p, int)
+{
+	const DIFFITEM &di = *static_cast<const DIFFITEM *>(p);
+	return { di.diffcode.isDirectory() ? 0 : 1, ColExtGet(pCtxt, p, 0) };
+}
+
+/**
+ * @brief Get folder name sort key.
+ * Keys give the same order as ColPathSort().
+ * @param [in] pCtxt Pointer to compare context.
+ * @param [in] p Pointer to DIFFITEM.
+ * @return Sort key.
+ */
+static DirColSortKey ColPathSortKey(const CDiffContext *pCtxt, const void *p, int)
+{
+	return { 0, ColPathGet(pCtxt, p, 0) };
+}
+
 /**
  * @brief Compare compare results.
  * @param [in] p Pointer to DIFFITEM having first result to compare.
@@ -1419,14 +1457,14 @@ static int ColPropertyMoveSort(const CDiffContext *pCtxt, const void *p, const v
  */
 static DirColInfo f_cols[] =
 {
-	{ _T("Name"), nullptr, COLHDR_FILENAME, COLDESC_FILENAME, &ColFileNameGet<String>, &ColFileNameSort, 0, 0, true, DirColInfo::ALIGN_LEFT },
-	{ _T("Path"), "DirView|ColumnHeader", COLHDR_DIR, COLDESC_DIR, &ColPathGet, &ColPathSort, 0, 1, true, DirColInfo::ALIGN_LEFT },
+	{ _T("Name"), nullptr, COLHDR_FILENAME, COLDESC_FILENAME, &ColFileNameGet<String>, &ColFileNameSort, 0, 0, true, DirColInfo::ALIGN_LEFT, 0, &ColFileNameSortKey },
+	{ _T("Path"), "DirView|ColumnHeader", COLHDR_DIR, COLDESC_DIR, &ColPathGet, &ColPathSort, 0, 1, true, DirColInfo::ALIGN_LEFT, 0, &ColPathSortKey },
 	{ _T("Status"), nullptr, COLHDR_RESULT, COLDESC_RESULT, &ColStatusGet, &ColStatusSort, 0, 2, true, DirColInfo::ALIGN_LEFT },
 	{ _T("Lmtime"), nullptr, COLHDR_LTIMEM, COLDESC_LTIMEM, &ColTimeGet, &ColTimeSort, FIELD_OFFSET(DIFFITEM, diffFileInfo[0].mtime), 3, false, DirColInfo::ALIGN_LEFT, 0 },
 	{ _T("Rmtime"), nullptr, COLHDR_RTIMEM, COLDESC_RTIMEM, &ColTimeGet, &ColTimeSort, FIELD_OFFSET(DIFFITEM, diffFileInfo[1].mtime), 4, false, DirColInfo::ALIGN_LEFT, 1 },
 	{ _T("Lctime"), nullptr, COLHDR_LTIMEC, COLDESC_LTIMEC, &ColTimeGet, &ColTimeSort, FIELD_OFFSET(DIFFITEM, diffFileInfo[0].ctime), -1, false, DirColInfo::ALIGN_LEFT, 0 },
 	{ _T("Rctime"), nullptr, COLHDR_RTIMEC, COLDESC_RTIMEC, &ColTimeGet, &ColTimeSort, FIELD_OFFSET(DIFFITEM, diffFileInfo[1].ctime), -1, false, DirColInfo::ALIGN_LEFT, 1 },
-	{ _T("Ext"), nullptr, COLHDR_EXTENSION, COLDESC_EXTENSION, &ColExtGet, &ColExtSort, 0, 5, true, DirColInfo::ALIGN_LEFT },
+	{ _T("Ext"), nullptr, COLHDR_EXTENSION, COLDESC_EXTENSION, &ColExtGet, &ColExtSort, 0, 5, true, DirColInfo::ALIGN_LEFT, 0, &ColExtSortKey },
 	{ _T("Lsize"), nullptr, COLHDR_LSIZE, COLDESC_LSIZE, &ColSizeGet, &ColSizeSort, FIELD_OFFSET(DIFFITEM, diffFileInfo[0].size), -1, false, DirColInfo::ALIGN_RIGHT, 0 },
 	{ _T("Rsize"), nullptr, COLHDR_RSIZE, COLDESC_RSIZE, &ColSizeGet, &ColSizeSort, FIELD_OFFSET(DIFFITEM, diffFileInfo[1].size), -1, false, DirColInfo::ALIGN_RIGHT, 1 },
 	{ _T("LsizeShort"), nullptr, COLHDR_LSIZE_SHORT, COLDESC_LSIZE_SHORT, &ColSizeShortGet, &ColSizeSort, FIELD_OFFSET(DIFFITEM, diffFileInfo[0].size), -1, false, DirColInfo::ALIGN_RIGHT, 0 },
@@ -1458,8 +1496,8 @@ static DirColInfo f_cols[] =
 };
 static DirColInfo f_cols3[] =
 {
-	{ _T("Name"), nullptr, COLHDR_FILENAME, COLDESC_FILENAME, &ColFileNameGet<String>, &ColFileNameSort, 0, 0, true, DirColInfo::ALIGN_LEFT },
-	{ _T("Path"), "DirView|ColumnHeader", COLHDR_DIR, COLDESC_DIR, &ColPathGet, &ColPathSort, 0, 1, true, DirColInfo::ALIGN_LEFT },
+	{ _T("Name"), nullptr, COLHDR_FILENAME, COLDESC_FILENAME, &ColFileNameGet<String>, &ColFileNameSort, 0, 0, true, DirColInfo::ALIGN_LEFT, 0, &ColFileNameSortKey },
+	{ _T("Path"), "DirView|ColumnHeader", COLHDR_DIR, COLDESC_DIR, &ColPathGet, &ColPathSort, 0, 1, true, DirColInfo::ALIGN_LEFT, 0, &ColPathSortKey },
 	{ _T("Status"), nullptr, COLHDR_RESULT, COLDESC_RESULT, &ColStatusGet, &ColStatusSort, 0, 2, true, DirColInfo::ALIGN_LEFT },
 	{ _T("Lmtime"), nullptr, COLHDR_LTIMEM, COLDESC_LTIMEM, &ColTimeGet, &ColTimeSort, FIELD_OFFSET(DIFFITEM, diffFileInfo[0].mtime), 3, false, DirColInfo::ALIGN_LEFT, 0 },
 	{ _T("Mmtime"), nullptr, COLHDR_MTIMEM, COLDESC_MTIMEM, &ColTimeGet, &ColTimeSort, FIELD_OFFSET(DIFFITEM, diffFileInfo[1].mtime), 4, false, DirColInfo::ALIGN_LEFT, 1 },
@@ -1467,7 +1505,7 @@ static DirColInfo f_cols3[] =
 	{ _T("Lctime"), nullptr, COLHDR_LTIMEC, COLDESC_LTIMEC, &ColTimeGet, &ColTimeSort, FIELD_OFFSET(DIFFITEM, diffFileInfo[0].ctime), -1, false, DirColInfo::ALIGN_LEFT, 0 },
 	{ _T("Mctime"), nullptr, COLHDR_MTIMEC, COLDESC_MTIMEC, &ColTimeGet, &ColTimeSort, FIELD_OFFSET(DIFFITEM, diffFileInfo[1].ctime), -1, false, DirColInfo::ALIGN_LEFT, 1 },
 	{ _T("Rctime"), nullptr, COLHDR_RTIMEC, COLDESC_RTIMEC, &ColTimeGet, &ColTimeSort, FIELD_OFFSET(DIFFITEM, diffFileInfo[2].ctime), -1, false, DirColInfo::ALIGN_LEFT, 2 },
-	{ _T("Ext"), nullptr, COLHDR_EXTENSION, COLDESC_EXTENSION, &ColExtGet, &ColExtSort, 0, 6, true, DirColInfo::ALIGN_LEFT },
+	{ _T("Ext"), nullptr, COLHDR_EXTENSION, COLDESC_EXTENSION, &ColExtGet, &ColExtSort, 0, 6, true, DirColInfo::ALIGN_LEFT, 0, &ColExtSortKey },
 	{ _T("Lsize"), nullptr, COLHDR_LSIZE, COLDESC_LSIZE, &ColSizeGet, &ColSizeSort, FIELD_OFFSET(DIFFITEM, diffFileInfo[0].size), -1, false, DirColInfo::ALIGN_RIGHT, 0 },
 	{ _T("Msize"), nullptr, COLHDR_MSIZE, COLDESC_MSIZE, &ColSizeGet, &ColSizeSort, FIELD_OFFSET(DIFFITEM, diffFileInfo[1].size), -1, false, DirColInfo::ALIGN_RIGHT, 1 },
 	{ _T("Rsize"), nullptr, COLHDR_RSIZE, COLDESC_RSIZE, &ColSizeGet, &ColSizeSort, FIELD_OFFSET(DIFFITEM, diffFileInfo[2].size), -1, false, DirColInfo::ALIGN_RIGHT, 2 },
@@ -1979,6 +2017,58 @@ DirViewColItems::ColSort(const CDiffContext *pCtxt, int col, const DIFFITEM &ldi
 	return 0;
 }
 
+/**
+ * @brief Can items be sorted on specified column by sort keys?
+ * Columns whose sort function compares formatted strings give sort keys,
+ * columns with other sort functions must be sorted with ColSort().
+ * @param [in] col Column number to sort.
+ * @return true if ColSortKey() can be used.
+ */
+bool DirViewColItems::HasColSortKey(int col) const
+{
+	const DirColInfo * pColInfo = GetDirColInfo(col);
+	if (pColInfo == nullptr)
+		return false;
+	return pColInfo->sortkeyfnc != nullptr || (pColInfo->sortfnc == nullptr && pColInfo->getfnc != nullptr);
+}
+
+/**
+ * @brief Get sort key of an item on specified column.
+ * Comparing the keys of two items with CompareSortKeys() gives the same
+ * order as ColSort() in list mode.
+ * @param [in] pCtxt Compare context.
+ * @param [in] col Column number to sort, HasColSortKey() must be true.
+ * @param [in] di Difference item data.
+ * @return Sort key.
+ */
+DirColSortKey
+DirViewColItems::ColSortKey(const CDiffContext *pCtxt, int col, const DIFFITEM &di) const
+{
+	const DirColInfo * pColInfo = GetDirColInfo(col);
+	if (pColInfo == nullptr)
+	{
+		assert(false); // fix caller, should not ask for nonexistent columns
+		return {};
+	}
+	const void * arg = reinterpret_cast<const char *>(&di) + pColInfo->offset;
+	if (ColSortKeyFncPtrType fnc = pColInfo->sortkeyfnc)
+		return (*fnc)(pCtxt, arg, pColInfo->opt);
+	if (ColGetFncPtrType fnc = pColInfo->getfnc)
+		return { 0, (*fnc)(pCtxt, arg, pColInfo->opt) };
+	return {};
+}
+
+/**
+ * @brief Compare two sort keys.
+ * @return Order of keys, -1, 0, or 1.
+ */
+int DirViewColItems::CompareSortKeys(const DirColSortKey& key1, const DirColSortKey& key2)
+{
+	if (key1.group != key2.group)
+		return key1.group < key2.group ? -1 : 1;
+	return strutils::compare_logical(key1.text, key2.text);
+}
+
 void DirViewColItems::SetColumnOrdering(const int colorder[])
 {
 	m_dispcols = 0;
@@ -14,9 +14,21 @@
 class DIFFITEM;
 class CDiffContext;
 
+/**
+ * @brief Sort key of one item in one column.
+ * Keys are compared by group first, then by text with
+ * strutils::compare_logical().
+ */
+struct DirColSortKey
+{
+	int group = 0; /**< e.g. folders before files */
+	String text;
+};
+
 // DirViewColItems typedefs
 typedef String (*ColGetFncPtrType)(const CDiffContext *, const void *, int);
 typedef int (*ColSortFncPtrType)(const CDiffContext *, const void *, const void *, int);
+typedef DirColSortKey (*ColSortKeyFncPtrType)(const CDiffContext *, const void *, int);
 
 
 /**
@@ -42,6 +54,7 @@ struct DirColInfo
 	bool defSortUp; /**< Does column start with ascending sort (most do) */
 	int alignment; /**< Column alignment */
 	int opt;
+	ColSortKeyFncPtrType sortkeyfnc; /**< Handler giving the sort key, for columns whose sort handler formats strings */
 	String GetDisplayName() const;
 	String GetDescription() const;
 };
@@ -70,6 +83,9 @@ public:
 	int GetDispColCount() const { return m_dispcols; }
 	String ColGetTextToDisplay(const CDiffContext *pCtxt, int col, const DIFFITEM &di) const;
 	int ColSort(const CDiffContext *pCtxt, int col, const DIFFITEM &ldi, const DIFFITEM &rdi, bool bTreeMode) const;
+	bool HasColSortKey(int col) const;
+	DirColSortKey ColSortKey(const CDiffContext *pCtxt, int col, const DIFFITEM &di) const;
+	static int CompareSortKeys(const DirColSortKey& key1, const DirColSortKey& key2);
 
 	int ColPhysToLog(int i) const { return m_invcolorder[i]; }
 	int ColLogToPhys(int i) const { return m_colorder[i]; } /**< -1 if not displayed */
@@ -0,0 +1,223 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  DirViewColSorter.cpp
+ *
+ * @brief Implementation file for DirViewColSorter
+ */
+
+#include "StdAfx.h"
+#include "DirViewColSorter.h"
+#include <algorithm>
+#include <numeric>
+#include <Poco/Environment.h>
+#include "DiffItem.h"
+#include "WorkStealingPool.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+/** @brief Sibling groups with fewer items are sorted in the calling thread. */
+static const size_t PARALLEL_SORT_MIN_ITEMS = 10000;
+
+/**
+ * @brief Stable sort which sorts large ranges in several threads.
+ * The range is split into one chunk per thread, the chunks are sorted
+ * concurrently and then merged pairwise, also concurrently.
+ * @param [in,out] v Values to sort.
+ * @param [in] comp Comparison, must be safe to call concurrently.
+ */
+template<class Compare>
+static void ParallelStableSort(std::vector<int>& v, Compare comp)
+{
+	const int nThreads = (std::min)(static_cast<int>(Poco::Environment::processorCount()),
+		static_cast<int>(v.size() / (PARALLEL_SORT_MIN_ITEMS / 4) + 1));
+	if (v.size() < PARALLEL_SORT_MIN_ITEMS || nThreads < 2)
+	{
+		std::stable_sort(v.begin(), v.end(), comp);
+		return;
+	}
+
+	std::vector<size_t> bounds(nThreads + 1);
+	for (int i = 0; i <= nThreads; ++i)
+		bounds[i] = v.size() * i / nThreads;
+
+	WorkStealingPool pool(nThreads);
+	for (int i = 0; i < nThreads; ++i)
+	{
+		pool.Submit([&, i]() {
+			std::stable_sort(v.begin() + bounds[i], v.begin() + bounds[i + 1], comp);
+		});
+	}
+	pool.Wait();
+	// Merging adjacent chunks only keeps the sort stable
+	for (int width = 1; width < nThreads; width *= 2)
+	{
+		for (int i = 0; i + width < nThreads; i += 2 * width)
+		{
+			const size_t first = bounds[i];
+			const size_t middle = bounds[i + width];
+			const size_t last = bounds[(std::min)(i + 2 * width, nThreads)];
+			pool.Submit([&, first, middle, last]() {
+				std::inplace_merge(v.begin() + first, v.begin() + middle, v.begin() + last, comp);
+			});
+		}
+		pool.Wait();
+	}
+}
+
+DirViewColSorter::DirViewColSorter()
+: m_pColItems(nullptr)
+, m_col(-1)
+{
+}
+
+DirViewColSorter::~DirViewColSorter() = default;
+
+/**
+ * @brief Forget the sort keys.
+ * Must be called when items are changed or deleted, or when the language
+ * used in the columns changes.
+ */
+void DirViewColSorter::Clear()
+{
+	m_keys.clear();
+	m_pColItems = nullptr;
+	m_col = -1;
+}
+
+/**
+ * @brief Rank sibling nodes on the sort column.
+ * Sort keys are made in the calling thread since the column handlers are
+ * not known to be thread-safe. Only comparing the keys is done concurrently.
+ * Columns without sort keys are sorted with their sort function.
+ * @param [in] pCtxt Compare context.
+ * @param [in] pColItems Column items.
+ * @param [in] col Column number to sort.
+ * @param [in] nodes All nodes to sort.
+ * @param [in,out] siblings Indexes of sibling nodes in @p nodes, in their current order.
+ * @param [out] ranks Rank of each node, set for the nodes in @p siblings.
+ * @param [in] bAscending Sort direction.
+ */
+void DirViewColSorter::RankSiblings(const CDiffContext *pCtxt, const DirViewColItems *pColItems, int col,
+	const std::vector<const DIFFITEM *>& nodes, std::vector<int>& siblings, std::vector<int>& ranks, bool bAscending)
+{
+	if (pColItems->HasColSortKey(col))
+	{
+		std::vector<const DirColSortKey *> keys(siblings.size());
+		for (size_t i = 0; i < siblings.size(); ++i)
+		{
+			const DIFFITEM *pdi = nodes[siblings[i]];
+			auto it = m_keys.find(pdi);
+			if (it == m_keys.end())
+				it = m_keys.emplace(pdi, pColItems->ColSortKey(pCtxt, col, *pdi)).first;
+			keys[i] = &it->second;
+		}
+		std::vector<int> order(siblings.size());
+		std::iota(order.begin(), order.end(), 0);
+		ParallelStableSort(order, [&keys, bAscending](int a, int b)
+			{
+				const int result = DirViewColItems::CompareSortKeys(*keys[a], *keys[b]);
+				return bAscending ? result < 0 : result > 0;
+			});
+		for (size_t i = 0; i < order.size(); ++i)
+			order[i] = siblings[order[i]];
+		siblings.swap(order);
+	}
+	else
+	{
+		std::stable_sort(siblings.begin(), siblings.end(), [&](int a, int b)
+			{
+				const int result = pColItems->ColSort(pCtxt, col, *nodes[a], *nodes[b], false);
+				return bAscending ? result < 0 : result > 0;
+			});
+	}
+	// Equal items keep their current order, so every rank is different
+	for (size_t i = 0; i < siblings.size(); ++i)
+		ranks[siblings[i]] = static_cast<int>(i);
+}
+
+/**
+ * @brief Sort items on specified column.
+ * Gives the same order as a stable sort of the items with
+ * DirViewColItems::ColSort(). In tree mode every item is placed after its
+ * ancestors, and the subfolders of a folder stay together.
+ * @param [in] pCtxt Compare context.
+ * @param [in] pColItems Column items.
+ * @param [in] col Column number to sort.
+ * @param [in] bAscending Sort direction.
+ * @param [in] bTreeMode Are items shown as a tree?
+ * @param [in] items Items to sort, in their current order.
+ * @return Indexes of @p items in sorted order.
+ */
+std::vector<size_t> DirViewColSorter::Sort(const CDiffContext *pCtxt, const DirViewColItems *pColItems,
+	int col, bool bAscending, bool bTreeMode, const std::vector<const DIFFITEM *>& items)
+{
+	if (pColItems != m_pColItems || col != m_col)
+	{
+		m_keys.clear();
+		m_pColItems = pColItems;
+		m_col = col;
+	}
+
+	// Path of each item from its top-level folder, as node indexes. In
+	// list mode every item is a top-level node of its own.
+	std::vector<const DIFFITEM *> nodes;
+	std::unordered_map<const DIFFITEM *, int> nodeIndexes;
+	std::vector<std::vector<int>> paths(items.size());
+	nodeIndexes.reserve(items.size());
+	for (size_t i = 0; i < items.size(); ++i)
+	{
+		std::vector<int>& path = paths[i];
+		const DIFFITEM *cur = items[i];
+		do
+		{
+			auto result = nodeIndexes.emplace(cur, static_cast<int>(nodes.size()));
+			if (result.second)
+				nodes.push_back(cur);
+			path.push_back(result.first->second);
+			cur = cur->GetParentLink();
+		} while (bTreeMode && cur != nullptr && cur->HasParent());
+		std::reverse(path.begin(), path.end());
+	}
+
+	// Rank nodes among their siblings
+	std::vector<int> ranks(nodes.size());
+	if (bTreeMode)
+	{
+		std::vector<const DIFFITEM *> parents;
+		std::unordered_map<const DIFFITEM *, std::vector<int>> siblings;
+		for (int node = 0; node < static_cast<int>(nodes.size()); ++node)
+		{
+			auto result = siblings.emplace(nodes[node]->GetParentLink(), std::vector<int>());
+			if (result.second)
+				parents.push_back(nodes[node]->GetParentLink());
+			result.first->second.push_back(node);
+		}
+		for (const DIFFITEM *parent : parents)
+			RankSiblings(pCtxt, pColItems, col, nodes, siblings[parent], ranks, bAscending);
+	}
+	else
+	{
+		std::vector<int> siblings(nodes.size());
+		std::iota(siblings.begin(), siblings.end(), 0);
+		RankSiblings(pCtxt, pColItems, col, nodes, siblings, ranks, bAscending);
+	}
+
+	// Order items by the ranks along their paths, ancestors first
+	std::vector<size_t> order(items.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&paths, &ranks](size_t a, size_t b)
+		{
+			const std::vector<int>& pathA = paths[a];
+			const std::vector<int>& pathB = paths[b];
+			const size_t len = (std::min)(pathA.size(), pathB.size());
+			for (size_t level = 0; level < len; ++level)
+			{
+				if (pathA[level] != pathB[level])
+					return ranks[pathA[level]] < ranks[pathB[level]];
+			}
+			return pathA.size() < pathB.size();
+		});
+	return order;
+}
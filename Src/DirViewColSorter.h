@@ -0,0 +1,42 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  DirViewColSorter.h
+ *
+ * @brief Declaration file for DirViewColSorter
+ */
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+#include "DirViewColItems.h"
+
+class CDiffContext;
+class DIFFITEM;
+
+/**
+ * @brief Sorts folder compare items on a column.
+ *
+ * Items are not compared pairwise with DirViewColItems::ColSort() for the
+ * whole sort. Siblings are ranked once, by sort keys when the column has
+ * them, and items are then ordered by the ranks along their tree paths.
+ * Sort keys are kept for later sorts on the same column until Clear() is
+ * called, which must be done whenever items are changed or deleted.
+ */
+class DirViewColSorter
+{
+public:
+	DirViewColSorter();
+	~DirViewColSorter();
+
+	void Clear();
+	std::vector<size_t> Sort(const CDiffContext *pCtxt, const DirViewColItems *pColItems,
+		int col, bool bAscending, bool bTreeMode, const std::vector<const DIFFITEM *>& items);
+
+private:
+	void RankSiblings(const CDiffContext *pCtxt, const DirViewColItems *pColItems, int col,
+		const std::vector<const DIFFITEM *>& nodes, std::vector<int>& siblings, std::vector<int>& ranks, bool bAscending);
+
+	const DirViewColItems *m_pColItems; /**< Column items the keys were made for */
+	int m_col; /**< Column the keys were made for */
+	std::unordered_map<const DIFFITEM *, DirColSortKey> m_keys;
+};
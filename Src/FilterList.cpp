@@ -29,100 +29,60 @@ FilterList::~FilterList()
 /** 
  * @brief Add new regular expression to the list.
  * This function adds new regular expression to the list of expressions.
- * The regular expression is compiled and studied for better performance.
+ * The expressions are compiled together when first matched, and invalid
+ * ones are left out then.
  * @param [in] regularExpression Regular expression string.
- * @param [in] encoding Expression encoding.
- * @param [in] excluded 
+ * @param [in] exclude Does a match exclude the string?
+ * @param [in] throwIfInvalid Compile the expression now, and throw if it is invalid.
  */
 void FilterList::AddRegExp(const std::string& regularExpression, bool exclude, bool throwIfInvalid)
 {
-	try
+	if (throwIfInvalid)
 	{
-		auto& list = exclude ? m_listExclude : m_list;
-		list.push_back(filter_item_ptr(new filter_item(regularExpression, RegularExpression::RE_UTF8)));
-	}
-	catch (Poco::RegularExpressionException& e)
-	{
-		if (throwIfInvalid)
+		try
+		{
+			RegularExpression regexp(regularExpression, RegularExpression::RE_UTF8);
+		}
+		catch (Poco::RegularExpressionException& e)
+		{
 			throw std::runtime_error(e.message().c_str());
+		}
 	}
+	auto& list = exclude ? m_listExclude : m_list;
+	list.push_back(filter_item_ptr(new filter_item(regularExpression, RegularExpression::RE_UTF8)));
+	(exclude ? m_setExclude : m_set).Add(regularExpression, RegularExpression::RE_UTF8);
 }
 
 /** 
  * @brief Match string against list of expressions.
  * This function matches given @p string against the list of regular
  * expressions. The matching ends when first match is found, so all
- * expressions may not be matched against.
+ * expressions may not be matched against. The string is converted to
+ * UTF-8 only once for both include and exclude expressions.
  * @param [in] string string to match.
  * @param [in] codepage codepage of string.
  * @return true if any of the expressions did match the string.
  */
 bool FilterList::Match(const std::string& string, int codepage/*=CP_UTF8*/)
 {
-	const size_t count = m_list.size();
-	bool retval = m_list.size() == 0;
-
-	// convert string into UTF-8
-	ucr::buffer buf(string.length() * 2);
-
+	const std::string *pSubject = &string;
+	std::string converted;
 	if (codepage != ucr::CP_UTF_8)
-			ucr::convert(ucr::NONE, codepage, reinterpret_cast<const unsigned char *>(string.c_str()), 
-					string.length(), ucr::UTF8, ucr::CP_UTF_8, &buf);
-
-	unsigned i = 0;
-	while (i < count && !retval)
-	{
-		const filter_item_ptr& item = m_list[i];
-		int result = 0;
-		RegularExpression::Match match;
-		try
-		{
-			if (buf.size > 0)
-				result = item->regexp.match(std::string(reinterpret_cast<const char *>(buf.ptr), buf.size), 0, match);
-			else
-				result = item->regexp.match(string, 0, match);
-		}
-		catch (...)
-		{
-			// TODO:
-		}
-		if (result > 0)
-		{
-			retval = true;
-		}
-		else
-			++i;
-	}
-
-	if (!retval)
-		return retval;
-
-	i = 0;
-	const size_t countExclude = m_listExclude.size();
-	while (i < countExclude && retval)
 	{
-		const filter_item_ptr& item = m_listExclude[i];
-		int result = 0;
-		RegularExpression::Match match;
-		try
-		{
-			if (buf.size > 0)
-				result = item->regexp.match(std::string(reinterpret_cast<const char *>(buf.ptr), buf.size), 0, match);
-			else
-				result = item->regexp.match(string, 0, match);
-		}
-		catch (...)
-		{
-			// TODO:
-		}
-		if (result > 0)
+		// convert string into UTF-8
+		ucr::buffer buf(string.length() * 2);
+		ucr::convert(ucr::NONE, codepage, reinterpret_cast<const unsigned char *>(string.c_str()), 
+				string.length(), ucr::UTF8, ucr::CP_UTF_8, &buf);
+		if (buf.size > 0)
 		{
-			retval = false;
+			converted.assign(reinterpret_cast<const char *>(buf.ptr), buf.size);
+			pSubject = &converted;
 		}
-		else
-			++i;
 	}
 
+	bool retval = m_set.IsEmpty() || m_set.MatchAny(*pSubject);
+	if (retval && !m_setExclude.IsEmpty())
+		retval = !m_setExclude.MatchAny(*pSubject);
 	return retval;
 }
 
@@ -138,20 +98,24 @@ void FilterList::CloneFrom(const FilterList* filterList)
 		return;
 
 	m_list.clear();
+	m_set.Clear();
 
 	size_t count = filterList->m_list.size();
 	m_list.reserve(count);
 	for (size_t i = 0; i < count; i++)
 	{
 		m_list.emplace_back(std::make_shared<filter_item>(filterList->m_list[i].get()));
+		m_set.Add(m_list.back()->filterAsString, m_list.back()->_reOpts);
 	}
 
 	m_listExclude.clear();
+	m_setExclude.Clear();
 
 	count = filterList->m_listExclude.size();
 	m_listExclude.reserve(count);
 	for (size_t i = 0; i < count; i++)
 	{
 		m_listExclude.emplace_back(std::make_shared<filter_item>(filterList->m_listExclude[i].get()));
+		m_setExclude.Add(m_listExclude.back()->filterAsString, m_listExclude.back()->_reOpts);
 	}
 }
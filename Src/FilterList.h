@@ -9,20 +9,20 @@
 #include <memory>
 #include <Poco/RegularExpression.h>
 #include "unicoder.h"
+#include "RegularExpressionSet.h"
 
 /**
- * @brief Container for one filtering rule / compiled expression.
- * This structure holds compiled regular expression and a original expression
- * as a string. We need the original expression string in case we want to
- * know which regular expression did match.
+ * @brief Container for one filtering rule.
+ * This structure holds the original expression as a string. The
+ * expressions are compiled together by RegularExpressionSet when first
+ * matched.
  */
 struct filter_item
 {
 	std::string filterAsString; /** Original regular expression string */
-	Poco::RegularExpression regexp; /**< Compiled regular expression */
 	int _reOpts; /**< Options to set to Poco::RegularExpression */
-	filter_item(const std::string &filter, int reOpts) : filterAsString(filter), regexp(filter, reOpts), _reOpts(reOpts) {}
-	filter_item(const filter_item* item) : filterAsString(item->filterAsString), regexp(item->filterAsString, item->_reOpts), _reOpts(item->_reOpts) {}
+	filter_item(const std::string &filter, int reOpts) : filterAsString(filter), _reOpts(reOpts) {}
+	filter_item(const filter_item* item) : filterAsString(item->filterAsString), _reOpts(item->_reOpts) {}
 };
 
 typedef std::shared_ptr<filter_item> filter_item_ptr;
@@ -31,7 +31,8 @@ typedef std::shared_ptr<filter_item> filter_item_ptr;
  * @brief Regular expression list.
  * This class holds a list of regular expressions for matching strings.
  * The class also provides simple function for matching and remembers the
- * last matched expression.
+ * last matched expression. The expressions are matched through
+ * RegularExpressionSet, which scans the string once for all of them.
  */
 class FilterList
 {
@@ -48,7 +49,8 @@ public:
 private:
 	std::vector <filter_item_ptr> m_list;
 	std::vector <filter_item_ptr> m_listExclude;
-
+	RegularExpressionSet m_set; /**< Expressions of m_list, matched as one */
+	RegularExpressionSet m_setExclude; /**< Expressions of m_listExclude, matched as one */
 };
 
 /** 
@@ -58,13 +60,15 @@ inline void FilterList::RemoveAllFilters()
 {
 	m_list.clear();
 	m_listExclude.clear();
+	m_set.Clear();
+	m_setExclude.Clear();
 }
 
 /** 
- * @brief Returns if list has any expressions.
- * @return true if list contains one or more expressions.
+ * @brief Returns if list has any valid expressions.
+ * @return true if list contains one or more valid expressions.
  */
 inline bool FilterList::HasRegExps() const
 {
-	return !m_list.empty() || !m_listExclude.empty();
+	return !m_set.IsEmpty() || !m_setExclude.IsEmpty();
 }
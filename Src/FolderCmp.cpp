@@ -5,6 +5,8 @@
  */
 
 #include "pch.h"
+#include <cstring>
+#include <Poco/Environment.h>
 #include "diff.h"
 #include "FolderCmp.h"
 #include "Wrap_DiffUtils.h"
@@ -21,7 +23,10 @@
 #include "TFile.h"
 #include "FileFilterHelper.h"
 #include "PropertySystem.h"
+#include "CompareStats.h"
+#include "CompareResultCache.h"
 #include "MergeApp.h"
+#include "cio.h"
 #include "DebugNew.h"
 
 using CompareEngines::ByteCompare;
@@ -29,6 +34,80 @@ using CompareEngines::BinaryCompare;
 using CompareEngines::TimeSizeCompare;
 using CompareEngines::ImageCompare;
 
+/** @brief Size of the blocks read from both ends of a file for fast reject. */
+static const int FASTREJECT_BLOCKSIZE = 4 * 1024;
+
+namespace
+{
+
+/**
+ * @brief First and last block of a file.
+ */
+struct FileEnds
+{
+	char head[FASTREJECT_BLOCKSIZE];
+	char tail[FASTREJECT_BLOCKSIZE];
+	int cbHead = 0;
+	int cbTail = 0;
+};
+
+/**
+ * @brief Read the first and optionally the last block of a file.
+ * @param [in] filepath Path of the file.
+ * @param [in] size Size of the file.
+ * @param [in] bTail Read also the last block?
+ * @param [out] ends Blocks read.
+ * @return true if the blocks were read.
+ */
+bool ReadFileEnds(const String& filepath, int64_t size, bool bTail, FileEnds& ends)
+{
+	int fd = -1;
+	cio::tsopen_s(&fd, filepath, O_RDONLY | O_BINARY, _SH_DENYNO, _S_IREAD);
+	if (fd < 0)
+		return false;
+	bool bResult = true;
+	ends.cbHead = cio::read_i(fd, ends.head, FASTREJECT_BLOCKSIZE);
+	if (ends.cbHead < 0 || ends.cbHead != (std::min)(size, static_cast<int64_t>(FASTREJECT_BLOCKSIZE)))
+		bResult = false; // file has changed after collect
+	else if (bTail && size > FASTREJECT_BLOCKSIZE)
+	{
+		const int64_t offset = (std::max)(size - FASTREJECT_BLOCKSIZE, static_cast<int64_t>(FASTREJECT_BLOCKSIZE));
+		if (cio::lseek(fd, offset, SEEK_SET) != offset)
+			bResult = false;
+		else
+		{
+			ends.cbTail = cio::read_i(fd, ends.tail, static_cast<unsigned>(size - offset));
+			bResult = (ends.cbTail == size - offset);
+		}
+	}
+	cio::close(fd);
+	return bResult;
+}
+
+/**
+ * @brief Check if a block has a NUL character in its encoding, which is
+ * what makes diffutils take transcoded text as binary.
+ */
+bool HasNulChar(const char *p, int cb, ucr::UNICODESET unicoding)
+{
+	int nCharSize = 1;
+	if (unicoding == ucr::UCS2LE || unicoding == ucr::UCS2BE)
+		nCharSize = 2;
+	else if (unicoding == ucr::UCS4LE || unicoding == ucr::UCS4BE)
+		nCharSize = 4;
+	if (nCharSize == 1)
+		return memchr(p, 0, cb) != nullptr;
+	static const char zeros[4] = {};
+	for (int i = 0; i + nCharSize <= cb; i += nCharSize)
+	{
+		if (memcmp(p + i, zeros, nCharSize) == 0)
+			return true;
+	}
+	return false;
+}
+
+}
+
 FolderCmp::FolderCmp(CDiffContext *pCtxt)
 : m_pCtxt(pCtxt)
 , m_pDiffUtilsEngine(nullptr)
@@ -108,6 +187,8 @@ int FolderCmp::prepAndCompareFiles(DIFFITEM &di)
 		DiffFileData diffdata10, diffdata12, diffdata02;
 		String filepathUnpacked[3];
 		String filepathTransformed[3];
+		String sCacheKey;
+		bool bCacheHit = false;
 		int codepage = 0;
 
 		// For user chosen plugins, define bAutomaticUnpacker as false and use the chosen infoHandler
@@ -129,6 +210,37 @@ int FolderCmp::prepAndCompareFiles(DIFFITEM &di)
 		FileTextEncoding encoding[3];
 		bool bForceUTF8 = m_pCtxt->GetCompareOptions(nCompMethod)->m_bIgnoreCase;
 
+		// Without plugins the collected files are compared as they are, and the
+		// fast reject needs the encodings only when codepage differences are
+		// ignored, so try it before the encoding detection opens the files
+		const bool bNoPlugins =
+			(infoUnpacker == nullptr || infoUnpacker->GetPluginPipeline().empty()) &&
+			(infoPrediffer == nullptr || infoPrediffer->GetPluginPipeline().empty());
+		const bool bEarlyFastReject = bNoPlugins && !m_pCtxt->m_bIgnoreCodepage &&
+			m_pCtxt->m_bFastReject && nDirs == 2 && CanFastReject(nCompMethod);
+		if (bEarlyFastReject)
+		{
+			sCacheKey = GetResultCacheKey(di, nCompMethod);
+			if (!sCacheKey.empty() && LookupResult(sCacheKey, code))
+			{
+				bCacheHit = true;
+				for (nIndex = 0; nIndex < nDirs; nIndex++)
+					encoding[nIndex] = m_diffFileData.m_FileLocation[nIndex].encoding;
+				goto exitPrepAndCompare;
+			}
+			const String filepath[2] = { tFiles[0], tFiles[1] };
+			if (FastReject(di, filepath, encoding, true, code))
+			{
+				// The Encoding column shows the encodings guessed from the first blocks
+				for (nIndex = 0; nIndex < nDirs; nIndex++)
+					m_diffFileData.m_FileLocation[nIndex].encoding = encoding[nIndex];
+				// Fast reject doesn't know about diff counts
+				m_ndiffs = CDiffContext::DIFFS_UNKNOWN_QUICKCOMPARE;
+				m_ntrivialdiffs = CDiffContext::DIFFS_UNKNOWN_QUICKCOMPARE;
+				goto exitPrepAndCompare;
+			}
+		}
+
 		for (nIndex = 0; nIndex < nDirs; nIndex++)
 		{
 		// plugin may alter filepaths to temp copies (which we delete before returning in all cases)
@@ -160,10 +272,28 @@ int FolderCmp::prepAndCompareFiles(DIFFITEM &di)
 				goto exitPrepAndCompare;
 		}
 
-		// If options are binary equivalent, we could check for filesize
-		// difference here, and bail out if files are clearly different
-		// But, then we don't know if file is ascii or binary, and this
-		// affects behavior (also, we don't have an icon for unknown type)
+		// Reuse the result of an earlier compare of the same files
+		if (!bEarlyFastReject && filepathTransformed[0] == tFiles[0] && filepathTransformed[1] == tFiles[1] &&
+			(nDirs < 3 || filepathTransformed[2] == tFiles[2]))
+		{
+			sCacheKey = GetResultCacheKey(di, nCompMethod);
+			bCacheHit = !sCacheKey.empty() && LookupResult(sCacheKey, code);
+			if (bCacheHit)
+				goto exitPrepAndCompare;
+		}
+
+		// If options are binary equivalent, file sizes and the ends of the
+		// files may already tell that the files are different
+		// (unpacked or prediffed files don't have the collected sizes)
+		if (!bEarlyFastReject && m_pCtxt->m_bFastReject && nDirs == 2 && CanFastReject(nCompMethod) &&
+			filepathTransformed[0] == tFiles[0] && filepathTransformed[1] == tFiles[1] &&
+			FastReject(di, filepathTransformed, encoding, false, code))
+		{
+			// Fast reject doesn't know about diff counts
+			m_ndiffs = CDiffContext::DIFFS_UNKNOWN_QUICKCOMPARE;
+			m_ntrivialdiffs = CDiffContext::DIFFS_UNKNOWN_QUICKCOMPARE;
+			goto exitPrepAndCompare;
+		}
 
 		// Actually compare the files
 		// `diffutils_compare_files()` is a fairly thin front-end to GNU diffutils
@@ -235,9 +365,15 @@ int FolderCmp::prepAndCompareFiles(DIFFITEM &di)
 				bool bRet;
 				int bin_flag10 = 0, bin_flag12 = 0, bin_flag02 = 0;
 
-				bRet = m_pDiffUtilsEngine->Diff2Files(&script10, &diffdata10, &bin_flag10, nullptr);
-				bRet = m_pDiffUtilsEngine->Diff2Files(&script12, &diffdata12, &bin_flag12, nullptr);
-				bRet = m_pDiffUtilsEngine->Diff2Files(&script02, &diffdata02, &bin_flag02, nullptr);
+				struct change ** scripts[] = { &script10, &script12, &script02 };
+				DiffFileData * diffdatas[] = { &diffdata10, &diffdata12, &diffdata02 };
+				int * bin_flags[] = { &bin_flag10, &bin_flag12, &bin_flag02 };
+				// The compare threads already keep the cores busy, so the
+				// pairs only get threads for the cores left over
+				const int nCompareThreads = m_pCtxt->m_pCompareStats->GetCompareThreadCount() -
+					static_cast<int>(m_pCtxt->m_pCompareStats->GetIdleCompareThreadCount());
+				const int nMaxThreads = (std::max)(static_cast<int>(Poco::Environment::processorCount()) / (std::max)(nCompareThreads, 1), 1);
+				bRet = m_pDiffUtilsEngine->DiffFilePairs(3, scripts, diffdatas, bin_flags, nMaxThreads);
 				m_diffFileData.m_textStats[0] = diffdata10.m_textStats[1];
 				m_diffFileData.m_textStats[1] = diffdata12.m_textStats[0];
 				m_diffFileData.m_textStats[2] = diffdata02.m_textStats[1];
@@ -404,6 +540,10 @@ exitPrepAndCompare:
 		// Also when disabling ignore codepage option and the encodings of files are not equal, change the flag to `DIFFCODE::DIFF even if  `DIFFCODE::SAME` flag is set to the variable `code`
 		if (!di.diffcode.existAll() || (!m_pCtxt->m_bIgnoreCodepage && !std::equal(encoding + 1, encoding + nDirs, encoding)))
 			code = (code & ~DIFFCODE::COMPAREFLAGS) | DIFFCODE::DIFF;
+
+		// Cache the final code, so that a cache hit gives the same result
+		if (!sCacheKey.empty() && !bCacheHit)
+			StoreResult(sCacheKey, code);
 	}
 	else if (nCompMethod == CMP_BINARY_CONTENT)
 	{
@@ -412,7 +552,13 @@ exitPrepAndCompare:
 		m_pBinaryCompare->SetAbortable(m_pCtxt->GetAbortable());
 		PathContext tFiles;
 		m_pCtxt->GetComparePaths(di, tFiles);
-		code = m_pBinaryCompare->CompareFiles(tFiles, di);
+		const String sCacheKey = GetResultCacheKey(di, nCompMethod);
+		if (sCacheKey.empty() || !LookupResult(sCacheKey, code))
+		{
+			code = m_pBinaryCompare->CompareFiles(tFiles, di);
+			if (!sCacheKey.empty())
+				StoreResult(sCacheKey, code);
+		}
 	}
 	else if (nCompMethod == CMP_DATE || nCompMethod == CMP_DATE_SIZE || nCompMethod == CMP_SIZE)
 	{
@@ -445,13 +591,20 @@ exitPrepAndCompare:
 		size_t numprops = m_pCtxt->m_pPropertySystem->GetCanonicalNames().size();
 		PathContext tFiles;
 		m_pCtxt->GetComparePaths(di, tFiles);
+		// Files found byte for byte identical have the same hash values,
+		// so only the first one is read again
+		const bool bSameContent = (nCompMethod == CMP_BINARY_CONTENT &&
+			(code & DIFFCODE::COMPAREFLAGS) == DIFFCODE::SAME && di.diffcode.existAll());
+		const PropertyValues* pSameContentValues = nullptr;
 		for (int i = 0; i < nDirs; ++i)
 		{
 			auto& properties = di.diffFileInfo[i].m_pAdditionalProperties;
 			if (di.diffcode.exists(i))
 			{
 				properties.reset(new PropertyValues());
-				m_pCtxt->m_pPropertySystem->GetPropertyValues(tFiles[i], *properties);
+				m_pCtxt->m_pPropertySystem->GetPropertyValues(tFiles[i], *properties, pSameContentValues);
+				if (bSameContent && pSameContentValues == nullptr)
+					pSameContentValues = properties.get();
 			}
 			else
 			{
@@ -464,3 +617,187 @@ exitPrepAndCompare:
 	return code;
 }
 
+/**
+ * @brief Check if compare options make a byte difference always a difference.
+ * @param [in] nCompMethod Compare method (content or quick contents).
+ * @return true if a fast reject gives the same result as the full compare.
+ */
+bool FolderCmp::CanFastReject(int nCompMethod) const
+{
+	const CompareOptions *pOptions = m_pCtxt->GetCompareOptions(nCompMethod);
+	if (pOptions == nullptr ||
+		pOptions->m_ignoreWhitespace != WHITESPACE_COMPARE_ALL ||
+		pOptions->m_bIgnoreBlankLines ||
+		pOptions->m_bIgnoreCase ||
+		pOptions->m_bIgnoreNumbers ||
+		pOptions->m_bIgnoreEOLDifference ||
+		pOptions->m_bIgnoreMissingTrailingEol)
+		return false;
+	if (nCompMethod == CMP_CONTENT)
+	{
+		// Line filters, substitution filters and comment filters may hide
+		// differences, and diffutils may be switched to quick contents
+		if (static_cast<const DiffutilsOptions *>(pOptions)->m_filterCommentsLines ||
+			(m_pCtxt->m_pFilterList != nullptr && m_pCtxt->m_pFilterList->HasRegExps()) ||
+			(m_pCtxt->m_pSubstitutionList != nullptr && m_pCtxt->m_pSubstitutionList->HasRegExps()))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Try to decide the result of a two-way content compare from the file
+ * sizes and the first and last blocks of the files.
+ * Only differences are decided here (plus the trivial case of two empty
+ * files), identical ends still need the full compare. Text or binary type is
+ * guessed from the first block as diffutils does, NUL characters of
+ * Unicode files with a BOM are counted after transcoding.
+ * @param [in] di Compared files.
+ * @param [in] filepath Paths of the files to read (after plugins).
+ * @param [in,out] encoding Guessed encodings of the files, guessed from the
+ * first blocks if @p bGuessEncodings is set and the result is decided.
+ * @param [in] bGuessEncodings Have the encodings not been guessed yet?
+ * @param [out] code Compare result code, if decided.
+ * @return true if the result was decided.
+ */
+bool FolderCmp::FastReject(const DIFFITEM &di, const String filepath[], FileTextEncoding encoding[], bool bGuessEncodings, unsigned &code)
+{
+	if (!di.diffcode.existAll())
+		return false;
+	// Different encodings may still give identical texts
+	if (m_pCtxt->m_bIgnoreCodepage && (bGuessEncodings || encoding[0] != encoding[1]))
+		return false;
+	const int64_t size0 = di.diffFileInfo[0].size;
+	const int64_t size1 = di.diffFileInfo[1].size;
+	if (size0 == DirItem::FILE_SIZE_NONE || size1 == DirItem::FILE_SIZE_NONE)
+		return false;
+	if (size0 == 0 && size1 == 0)
+	{
+		if (bGuessEncodings)
+		{
+			for (int i = 0; i < 2; ++i)
+				encoding[i] = codepage_detect::Guess(paths::FindExtension(filepath[i]), nullptr, 0, m_pCtxt->m_iGuessEncodingType);
+		}
+		code = DIFFCODE::FILE | DIFFCODE::TEXT | DIFFCODE::SAME;
+		return true;
+	}
+
+	const bool bSameSize = (size0 == size1);
+	std::unique_ptr<FileEnds> ends[2] = { std::make_unique<FileEnds>(), std::make_unique<FileEnds>() };
+	if (!ReadFileEnds(filepath[0], size0, bSameSize, *ends[0]) ||
+		!ReadFileEnds(filepath[1], size1, bSameSize, *ends[1]))
+		return false;
+	if (bSameSize &&
+		memcmp(ends[0]->head, ends[1]->head, ends[0]->cbHead) == 0 &&
+		memcmp(ends[0]->tail, ends[1]->tail, ends[0]->cbTail) == 0)
+		return false;
+
+	if (bGuessEncodings)
+	{
+		for (int i = 0; i < 2; ++i)
+			encoding[i] = codepage_detect::Guess(paths::FindExtension(filepath[i]), ends[i]->head, ends[i]->cbHead, m_pCtxt->m_iGuessEncodingType);
+	}
+	code = DIFFCODE::FILE | DIFFCODE::DIFF;
+	const bool bBin0 = HasNulChar(ends[0]->head, ends[0]->cbHead, encoding[0].m_unicoding);
+	const bool bBin1 = HasNulChar(ends[1]->head, ends[1]->cbHead, encoding[1].m_unicoding);
+	if (bBin0 || bBin1)
+	{
+		code |= DIFFCODE::BIN;
+		if (bBin0)
+			code |= DIFFCODE::BINSIDE1;
+		if (bBin1)
+			code |= DIFFCODE::BINSIDE2;
+	}
+	else
+		code |= DIFFCODE::TEXT;
+	return true;
+}
+
+/**
+ * @brief Make the key of an item in the compare result cache.
+ * The key identifies the compared files by path, size and modification time,
+ * and the compare by the options affecting its result.
+ * @param [in] di Compared files.
+ * @param [in] nCompMethod Compare method used for the files.
+ * @return Cache key, or empty string if the result must not be cached.
+ */
+String FolderCmp::GetResultCacheKey(const DIFFITEM &di, int nCompMethod) const
+{
+	if (!m_pCtxt->m_pCompareResultCache || !di.diffcode.existAll())
+		return _T("");
+	// Filter lists are not part of the key
+	if ((m_pCtxt->m_pFilterList != nullptr && m_pCtxt->m_pFilterList->HasRegExps()) ||
+		(m_pCtxt->m_pSubstitutionList != nullptr && m_pCtxt->m_pSubstitutionList->HasRegExps()))
+		return _T("");
+
+	// A file modified within the timestamp resolution of the file system may
+	// be modified again without changing its timestamp
+	const Poco::Timestamp::TimeVal recent = Poco::Timestamp().epochMicroseconds() - 2 * Poco::Timestamp::resolution();
+
+	String key = strutils::format(_T("%d %d %d %I64d %d %d"), nCompMethod,
+		m_pCtxt->m_bIgnoreCodepage, m_pCtxt->m_iGuessEncodingType,
+		static_cast<int64_t>(m_pCtxt->m_nQuickCompareLimit), m_pCtxt->m_bStopAfterFirstDiff, m_pCtxt->m_bFastReject);
+	if (const DIFFOPTIONS *pOptions = m_pCtxt->GetOptions())
+	{
+		key += strutils::format(_T(" %d %d %d %d %d %d %d %d %d %d"),
+			pOptions->nIgnoreWhitespace, pOptions->nDiffAlgorithm, pOptions->bIgnoreCase,
+			pOptions->bIgnoreNumbers, pOptions->bIgnoreBlankLines, pOptions->bIgnoreEol,
+			pOptions->bFilterCommentsLines, pOptions->bIndentHeuristic,
+			pOptions->bCompletelyBlankOutIgnoredChanges, pOptions->bIgnoreMissingTrailingEol);
+	}
+	for (int i = 0; i < m_pCtxt->GetCompareDirs(); ++i)
+	{
+		const DiffFileInfo& dfi = di.diffFileInfo[i];
+		if (dfi.size == DirItem::FILE_SIZE_NONE || dfi.mtime.epochMicroseconds() > recent)
+			return _T("");
+		key += strutils::format(_T("\n%s\t%I64d\t%I64d"),
+			paths::ConcatPath(dfi.path, dfi.filename), static_cast<int64_t>(dfi.size), dfi.mtime.epochMicroseconds());
+	}
+	return key;
+}
+
+/**
+ * @brief Take the result of an earlier compare from the compare result cache.
+ * @param [in] key Cache key from GetResultCacheKey().
+ * @param [out] code Compare result code, if found.
+ * @return true if the result was found.
+ */
+bool FolderCmp::LookupResult(const String &key, unsigned &code)
+{
+	CompareResultCache::Result result;
+	const bool bFound = m_pCtxt->m_pCompareResultCache->Lookup(key, result);
+	m_pCtxt->m_pCompareStats->AddCacheLookup(bFound);
+	if (!bFound)
+		return false;
+	code = result.code;
+	m_ndiffs = result.ndiffs;
+	m_ntrivialdiffs = result.ntrivialdiffs;
+	for (int i = 0; i < m_pCtxt->GetCompareDirs(); ++i)
+	{
+		m_diffFileData.m_textStats[i] = result.textStats[i];
+		m_diffFileData.m_FileLocation[i].encoding = result.encoding[i];
+	}
+	return true;
+}
+
+/**
+ * @brief Put the result of a compare into the compare result cache.
+ * Failed and aborted compares are not cached.
+ * @param [in] key Cache key from GetResultCacheKey().
+ * @param [in] code Compare result code.
+ */
+void FolderCmp::StoreResult(const String &key, unsigned code)
+{
+	if (DIFFCODE::isResultError(code) || DIFFCODE::isResultAbort(code))
+		return;
+	CompareResultCache::Result result;
+	result.code = code;
+	result.ndiffs = m_ndiffs;
+	result.ntrivialdiffs = m_ntrivialdiffs;
+	for (int i = 0; i < m_pCtxt->GetCompareDirs(); ++i)
+	{
+		result.textStats[i] = m_diffFileData.m_textStats[i];
+		result.encoding[i] = m_diffFileData.m_FileLocation[i].encoding;
+	}
+	m_pCtxt->m_pCompareResultCache->Store(key, result);
+}
@@ -15,6 +15,7 @@
 #include "PathContext.h"
 
 class CDiffContext;
+class FileTextEncoding;
 class PackingInfo;
 class PrediffingInfo;
 
@@ -52,6 +53,12 @@ public:
 	CDiffContext *const m_pCtxt;
 
 private:
+	bool CanFastReject(int nCompMethod) const;
+	bool FastReject(const DIFFITEM &di, const String filepath[], FileTextEncoding encoding[], bool bGuessEncodings, unsigned &code);
+	String GetResultCacheKey(const DIFFITEM &di, int nCompMethod) const;
+	bool LookupResult(const String &key, unsigned &code);
+	void StoreResult(const String &key, unsigned code);
+
 	std::unique_ptr<CompareEngines::DiffUtils> m_pDiffUtilsEngine;
 	std::unique_ptr<CompareEngines::ByteCompare> m_pByteCompare;
 	std::unique_ptr<CompareEngines::BinaryCompare> m_pBinaryCompare;
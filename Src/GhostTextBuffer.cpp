@@ -469,12 +469,13 @@ void CGhostTextBuffer::RemoveAllGhostLines()
 	if (nFirstGhost >= 0)
 	{
 		// Compact non-ghost lines, starting at the first ghost.
-		// (we copy the buffer address, so the buffer doesn't move and we don't free it)
+		// (we move the lines, so their buffers don't move and lines loaded
+		// into the line arena stay there)
 		int newnl = nFirstGhost;
 		for (int ct = nFirstGhost; ct < nlines; ct++)
 		{
 			if ((GetLineFlags(ct) & LF_GHOST) == 0)
-				m_aLines[newnl++] = m_aLines[ct];
+				m_aLines[newnl++] = std::move(m_aLines[ct]);
 		}
 
 		// Discard unused entries in one shot
@@ -842,7 +843,7 @@ AddUndoRecord(bool bInsert, const CEPoint & ptStartPos,
 UndoRecord CGhostTextBuffer::			/* virtual override */
 GetUndoRecord(int nUndoPos) const
 {
-	UndoRecord ur = m_aUndoBuf[nUndoPos];
+	UndoRecord ur = CCrystalTextBuffer::GetUndoRecord(nUndoPos);
 	ur.m_ptStartPos.y = ComputeApparentLine(ur.m_ptStartPos.y, 0);
 	ur.m_ptEndPos.y = ComputeApparentLine(ur.m_ptEndPos.y, 0);
 	return ur;
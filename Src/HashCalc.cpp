@@ -1,4 +1,4 @@
-/** 
+/**
  * @file  HashCalc.cpp
  *
  * @brief Implementation file for HashCalc
@@ -8,62 +8,155 @@
 
 #ifdef _WIN64
 
+#include <algorithm>
+#include <Poco/Environment.h>
+#include "WorkStealingPool.h"
+
 #pragma comment(lib, "bcrypt.lib")
- 
-static NTSTATUS CalculateHashValue(HANDLE hFile, BCRYPT_HASH_HANDLE hHash, ULONG hashSize, std::vector<uint8_t>& hash)
+
+/** @brief Size of a read from the file. */
+static const DWORD BUFFER_SIZE = 1024 * 1024;
+/** @brief Smaller files are hashed in the calling thread. */
+static const LONGLONG PARALLEL_HASH_MIN_SIZE = 4 * BUFFER_SIZE;
+
+/** @brief Hash object of one algorithm. */
+struct HashObject
+{
+	BCRYPT_ALG_HANDLE hAlg = nullptr;
+	BCRYPT_HASH_HANDLE hHash = nullptr;
+	std::vector<uint8_t> object;
+	ULONG hashSize = 0;
+	NTSTATUS status = 0;
+};
+
+static NTSTATUS CreateHashObject(const wchar_t *pAlgoId, HashObject& hashObject)
+{
+	NTSTATUS status = BCryptOpenAlgorithmProvider(&hashObject.hAlg, pAlgoId, nullptr, 0);
+	if (status == 0)
+	{
+		ULONG bytesWritten = 0;
+		ULONG objectSize = 0;
+		status = BCryptGetProperty(hashObject.hAlg, BCRYPT_OBJECT_LENGTH, reinterpret_cast<PUCHAR>(&objectSize), sizeof(DWORD), &bytesWritten, 0);
+		if (status == 0)
+		{
+			hashObject.object.resize(objectSize);
+			status = BCryptCreateHash(hashObject.hAlg, &hashObject.hHash, hashObject.object.data(), static_cast<ULONG>(hashObject.object.size()), nullptr, 0, 0);
+			if (status == 0)
+				status = BCryptGetProperty(hashObject.hAlg, BCRYPT_HASH_LENGTH, reinterpret_cast<PUCHAR>(&hashObject.hashSize), sizeof(DWORD), &bytesWritten, 0);
+		}
+	}
+	return status;
+}
+
+static void DestroyHashObject(HashObject& hashObject)
+{
+	if (hashObject.hHash != nullptr)
+		BCryptDestroyHash(hashObject.hHash);
+	if (hashObject.hAlg != nullptr)
+		BCryptCloseAlgorithmProvider(hashObject.hAlg, 0);
+}
+
+/**
+ * @brief Feed a block of data to all hash objects.
+ * The hash objects are independent, so a pool hashes them concurrently.
+ */
+static void HashData(std::vector<HashObject>& hashObjects, const uint8_t *data, DWORD size, WorkStealingPool *pPool)
+{
+	for (auto& hashObject : hashObjects)
+	{
+		auto hash = [&hashObject, data, size]() {
+			if (hashObject.status == 0)
+				hashObject.status = BCryptHashData(hashObject.hHash, const_cast<PUCHAR>(data), size, 0);
+		};
+		if (pPool != nullptr)
+			pPool->Submit(hash);
+		else
+			hash();
+	}
+}
+
+/**
+ * @brief Read the file once and feed its contents to all hash objects.
+ * Large files are read into two buffers in turn: the next block is read
+ * while the previous one is hashed.
+ */
+static NTSTATUS HashFile(HANDLE hFile, std::vector<HashObject>& hashObjects)
 {
-	hash.resize(hashSize);
-	std::vector<uint8_t> buffer(64 * 1024);
+	LARGE_INTEGER fileSize{};
+	const int nThreads = (std::min)(static_cast<int>(Poco::Environment::processorCount()),
+		static_cast<int>(hashObjects.size()) + 1);
+	std::unique_ptr<WorkStealingPool> pPool;
+	if (GetFileSizeEx(hFile, &fileSize) && fileSize.QuadPart >= PARALLEL_HASH_MIN_SIZE && nThreads >= 2)
+		pPool.reset(new WorkStealingPool(nThreads));
+
+	std::vector<uint8_t> buffers[2] = { std::vector<uint8_t>(BUFFER_SIZE), std::vector<uint8_t>(pPool ? BUFFER_SIZE : 0) };
+	int current = 0;
 	NTSTATUS status = 0;
-	while (status == 0)
+	for (;;)
 	{
 		DWORD dwRead = 0;
-		if (!ReadFile(hFile, buffer.data(), static_cast<DWORD>(buffer.size()), &dwRead, nullptr))
+		const BOOL bRead = ReadFile(hFile, buffers[current].data(), BUFFER_SIZE, &dwRead, nullptr);
+		if (pPool)
+			pPool->Wait();
+		if (!bRead)
 		{
 			status = 1; // STATUS_UNSUCCESSFUL
-			hash.clear();
 			break;
 		}
-		status = BCryptHashData(hHash, buffer.data(), dwRead, 0);
-		if (buffer.size() != dwRead)
+		HashData(hashObjects, buffers[current].data(), dwRead, pPool.get());
+		if (dwRead != BUFFER_SIZE)
 			break;
+		if (pPool)
+			current = 1 - current;
 	}
-	if (status == 0)
+	if (pPool)
+		pPool->Wait();
+	for (const auto& hashObject : hashObjects)
 	{
-		status = BCryptFinishHash(hHash, hash.data(), static_cast<ULONG>(hash.size()), 0);
+		if (status == 0)
+			status = hashObject.status;
 	}
 	return status;
 }
 
 NTSTATUS CalculateHashValue(HANDLE hFile, const wchar_t *pAlgoId, std::vector<uint8_t>& hash)
 {
-	hash.clear();
-	BCRYPT_ALG_HANDLE hAlg = nullptr;
-	NTSTATUS status = BCryptOpenAlgorithmProvider(&hAlg, pAlgoId, nullptr, 0);
+	std::vector<std::vector<uint8_t>> hashes;
+	NTSTATUS status = CalculateHashValues(hFile, { pAlgoId }, hashes);
+	hash = std::move(hashes[0]);
+	return status;
+}
+
+/**
+ * @brief Calculate several hash values of a file in one pass.
+ * @param [in] hFile File to read from its current position.
+ * @param [in] algoIds Identifiers of the hash algorithms, e.g. BCRYPT_SHA1_ALGORITHM.
+ * @param [out] hashes Hash value of each algorithm, all empty on error.
+ * @return 0 on success, NTSTATUS error code otherwise.
+ */
+NTSTATUS CalculateHashValues(HANDLE hFile, const std::vector<const wchar_t*>& algoIds, std::vector<std::vector<uint8_t>>& hashes)
+{
+	hashes.clear();
+	hashes.resize(algoIds.size());
+	std::vector<HashObject> hashObjects(algoIds.size());
+	NTSTATUS status = 0;
+	for (size_t i = 0; i < algoIds.size() && status == 0; ++i)
+		status = CreateHashObject(algoIds[i], hashObjects[i]);
 	if (status == 0)
+		status = HashFile(hFile, hashObjects);
+	for (size_t i = 0; i < algoIds.size() && status == 0; ++i)
 	{
-		ULONG bytesWritten = 0;
-		ULONG objectSize = 0;
-		status = BCryptGetProperty(hAlg, BCRYPT_OBJECT_LENGTH, reinterpret_cast<PUCHAR>(&objectSize), sizeof(DWORD), &bytesWritten, 0);
-		if (status == 0)
-		{
-			std::vector<uint8_t> hashObject(objectSize);
-			BCRYPT_HASH_HANDLE hHash = nullptr;
-			status = BCryptCreateHash(hAlg, &hHash, hashObject.data(), static_cast<ULONG>(hashObject.size()), nullptr, 0, 0);
-			if (status == 0)
-			{
-				ULONG hashSize = 0;
-				status = BCryptGetProperty(hAlg, BCRYPT_HASH_LENGTH, reinterpret_cast<PUCHAR>(&hashSize), sizeof(DWORD), &bytesWritten, 0);
-				if (status == 0)
-				{
-					status = CalculateHashValue(hFile, hHash, hashSize, hash);
-				}
-				BCryptDestroyHash(hHash);
-			}
-		}
-		BCryptCloseAlgorithmProvider(hAlg, 0);
+		hashes[i].resize(hashObjects[i].hashSize);
+		status = BCryptFinishHash(hashObjects[i].hHash, hashes[i].data(), static_cast<ULONG>(hashes[i].size()), 0);
+	}
+	for (auto& hashObject : hashObjects)
+		DestroyHashObject(hashObject);
+	if (status != 0)
+	{
+		for (auto& hash : hashes)
+			hash.clear();
 	}
 	return status;
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -9,3 +9,4 @@
 #include <vector>
 
 NTSTATUS CalculateHashValue(HANDLE hFile, const wchar_t* pAlgoId, std::vector<uint8_t>& hash);
+NTSTATUS CalculateHashValues(HANDLE hFile, const std::vector<const wchar_t*>& algoIds, std::vector<std::vector<uint8_t>>& hashes);
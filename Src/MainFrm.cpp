@@ -1227,6 +1227,9 @@ void CMainFrame::OnOptions()
 
 		theApp.UpdateCodepageModule();
 
+		// Background word diffs read the break characters, so stop them first
+		for (auto pMergeDoc : GetAllMergeDocs())
+			pMergeDoc->CancelWordDiffPrecompute();
 		strdiff::SetBreakChars(GetOptionsMgr()->GetString(OPT_BREAK_SEPARATORS).c_str());
 
 		// make an attempt at rescanning any open diff sessions
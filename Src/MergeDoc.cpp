@@ -51,6 +51,7 @@
 #include "charsets.h"
 #include "markdown.h"
 #include "stringdiffs.h"
+#include "WorkStealingPool.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -148,6 +149,7 @@ CMergeDoc::CMergeDoc()
 , m_nGroups(0)
 , m_pView{nullptr}
 , m_bAutomaticRescan(false)
+, m_bDiffListCurrent(false)
 , m_CurrentPredifferID(0)
 , m_CurrentEditorScriptID(ID_SCRIPT_FOR_COPYING_NONE)
 , m_bChangedSchemeManually(false)
@@ -169,6 +171,9 @@ CMergeDoc::CMergeDoc()
 
 	m_bEnableRescan = true;
 	m_bAutomaticRescan = GetOptionsMgr()->GetBool(OPT_AUTOMATIC_RESCAN);
+	const size_t nMaxUndoMemory = static_cast<size_t>(GetOptionsMgr()->GetInt(OPT_UNDO_MEMORY_LIMIT)) * 1024 * 1024;
+	for (int nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
+		m_ptBuf[nBuffer]->SetMaxUndoMemory(nMaxUndoMemory);
 
 	// COleDateTime m_LastRescan
 	curUndo = undoTgt.begin();
@@ -189,6 +194,7 @@ CMergeDoc::CMergeDoc()
  */
 CMergeDoc::~CMergeDoc()
 {	
+	CancelWordDiffPrecompute();
 	GetMainFrame()->UnwatchDocuments(this);
 
 	if (m_pDirDoc != nullptr)
@@ -311,16 +317,19 @@ static int SaveBuffForDiff(CDiffTextBuffer & buf, const String& filepath, int nS
  * @param bIdentical [out] If true files were identical
  * @param bForced [in] If true, suppressing is ignored and rescan
  * is done always
+ * @param bEditedLinesOnly [in] If true, only the lines edited since last
+ * rescan are compared again when possible. Must be false if anything else
+ * than the text of the buffers has changed.
  * @return Tells if rescan was successfully, was suppressed, or
  * error happened
  * If this code is OK, Rescan has detached the views temporarily
  * (positions of cursors have been lost)
- * @note Rescan() ALWAYS compares temp files. Actual user files are not
- * touched by Rescan().
+ * @note Rescan() compares the buffers' texts, in memory or through temp files
+ * when a prediffer has to be run. Actual user files are not touched by Rescan().
  * @sa CDiffWrapper::RunFileDiff()
  */
 int CMergeDoc::Rescan(bool &bBinary, IDENTLEVEL &identical,
-		bool bForced /* =false */)
+		bool bForced /* =false */, bool bEditedLinesOnly /* =false */)
 {
 	DIFFOPTIONS diffOptions = {0};
 	DiffFileInfo fileInfo;
@@ -335,7 +344,9 @@ int CMergeDoc::Rescan(bool &bBinary, IDENTLEVEL &identical,
 			return RESCAN_SUPPRESSED;
 	}
 
-	ClearWordDiffCache();
+	// Word diffs of the diffs which are not compared again are kept
+	WordDiffCache oldWordDiffs = TakeWordDiffCache();
+	const int nOldDiffs = m_diffList.GetSize();
 
 	m_diffWrapper.SetFilterList(
 		GetOptionsMgr()->GetBool(OPT_LINEFILTER_ENABLED) ?
@@ -390,17 +401,6 @@ int CMergeDoc::Rescan(bool &bBinary, IDENTLEVEL &identical,
 	// Set up DiffWrapper
 	m_diffWrapper.GetOptions(&diffOptions);
 
-	// Clear diff list
-	m_diffList.Clear();
-	m_nCurDiff = -1;
-	m_CurWordDiff = { -1, static_cast<size_t>(-1), -1 };
-	// Clear moved lines lists
-	if (m_diffWrapper.GetDetectMovedBlocks())
-	{
-		for (nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
-			m_diffWrapper.GetMovedLines(nBuffer)->Clear();
-	}
-
 	// Set paths for diffing and run diff
 	m_diffWrapper.EnablePlugins(GetOptionsMgr()->GetBool(OPT_PLUGINS_ENABLED));
 	if (m_nBuffers < 3)
@@ -410,18 +410,56 @@ int CMergeDoc::Rescan(bool &bBinary, IDENTLEVEL &identical,
 	m_diffWrapper.SetCompareFiles(m_filePaths);
 
 	DIFFSTATUS status;
+	int nFirstNewDiff = 0, nLastNewDiff = -1;
 
-	if (!HasSyncPoints())
+	// Edited lines can be compared alone only if their result does not
+	// depend on other lines (moved blocks, multiline comments, prediffers)
+	bEditedLinesOnly = bEditedLinesOnly && m_bDiffListCurrent &&
+		std::count(Changed, Changed + m_nBuffers, FileChange::NoChange) == m_nBuffers &&
+		!HasSyncPoints() && !m_diffWrapper.GetDetectMovedBlocks() &&
+		!m_diffWrapper.HasPrediffer() && !diffOptions.bFilterCommentsLines &&
+		DiffEditedLines(status, nFirstNewDiff, nLastNewDiff);
+	m_bDiffListCurrent = false;
+
+	m_nCurDiff = -1;
+	m_CurWordDiff = { -1, static_cast<size_t>(-1), -1 };
+	if (!bEditedLinesOnly)
+	{
+		// Clear diff list
+		m_diffList.Clear();
+		// Clear moved lines lists
+		if (m_diffWrapper.GetDetectMovedBlocks())
+		{
+			for (nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
+				m_diffWrapper.GetMovedLines(nBuffer)->Clear();
+		}
+	}
+
+	// Without a prediffer the diff engine can compare the buffers' texts
+	// directly, instead of writing them to temp files and reading them back
+	const bool bInMemory = !m_diffWrapper.HasPrediffer();
+	std::string buffers[3];
+
+	if (bEditedLinesOnly)
+	{
+		diffSuccess = true;
+	}
+	else if (!HasSyncPoints())
 	{
 		// Save text buffer to file
 		for (nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
 		{
-			m_ptBuf[nBuffer]->SetTempPath(tempPath);
-			SaveBuffForDiff(*m_ptBuf[nBuffer], m_tempFiles[nBuffer].GetPath());
+			if (bInMemory)
+				m_ptBuf[nBuffer]->SaveToMemory(buffers[nBuffer]);
+			else
+			{
+				m_ptBuf[nBuffer]->SetTempPath(tempPath);
+				SaveBuffForDiff(*m_ptBuf[nBuffer], m_tempFiles[nBuffer].GetPath());
+			}
 		}
 
 		m_diffWrapper.SetCreateDiffList(&m_diffList);
-		diffSuccess = m_diffWrapper.RunFileDiff();
+		diffSuccess = m_diffWrapper.RunFileDiff(bInMemory ? buffers : nullptr);
 
 		// Read diff-status
 		m_diffWrapper.GetDiffStatus(&status);
@@ -439,14 +477,19 @@ int CMergeDoc::Rescan(bool &bBinary, IDENTLEVEL &identical,
 			for (nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
 			{
 				nLines[nBuffer] = (i >= syncpoints.size()) ? -1 : syncpoints[i][nBuffer] - nStartLine[nBuffer];
-				m_ptBuf[nBuffer]->SetTempPath(tempPath);
-				SaveBuffForDiff(*m_ptBuf[nBuffer], m_tempFiles[nBuffer].GetPath(), 
-					nStartLine[nBuffer], nLines[nBuffer]);
+				if (bInMemory)
+					m_ptBuf[nBuffer]->SaveToMemory(buffers[nBuffer], nStartLine[nBuffer], nLines[nBuffer]);
+				else
+				{
+					m_ptBuf[nBuffer]->SetTempPath(tempPath);
+					SaveBuffForDiff(*m_ptBuf[nBuffer], m_tempFiles[nBuffer].GetPath(), 
+						nStartLine[nBuffer], nLines[nBuffer]);
+				}
 			}
 			DiffList templist;
 			templist.Clear();
 			m_diffWrapper.SetCreateDiffList(&templist);
-			diffSuccess = m_diffWrapper.RunFileDiff();
+			diffSuccess = m_diffWrapper.RunFileDiff(bInMemory ? buffers : nullptr);
 			for (nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
 				nRealLine[nBuffer] = m_ptBuf[nBuffer]->ComputeRealLine(nStartLine[nBuffer]);
 
@@ -493,7 +536,6 @@ int CMergeDoc::Rescan(bool &bBinary, IDENTLEVEL &identical,
 		}
 		m_diffWrapper.SetCreateDiffList(&m_diffList);
 	}
-
 	// If one file has EOL before EOF and other not...
 	if (std::count(status.bMissingNL, status.bMissingNL + m_nBuffers, status.bMissingNL[0]) < m_nBuffers)
 	{
@@ -504,6 +546,9 @@ int CMergeDoc::Rescan(bool &bBinary, IDENTLEVEL &identical,
 			lineCount[nBuffer] = m_ptBuf[nBuffer]->GetLineCount();
 		m_diffWrapper.FixLastDiffRange(m_nBuffers, lineCount, status.bMissingNL, diffOptions.bIgnoreBlankLines);
 	}
+	if (!bEditedLinesOnly)
+		nLastNewDiff = m_diffList.GetSize() - 1;
+	const int nUnchangedTailDiffs = m_diffList.GetSize() - 1 - nLastNewDiff;
 
 	// set identical/diff result as recorded by diffutils
 	identical = status.Identical;
@@ -534,15 +579,18 @@ int CMergeDoc::Rescan(bool &bBinary, IDENTLEVEL &identical,
 		if (GetOptionsMgr()->GetBool(OPT_CMP_ALIGN_SIMILAR_LINES))
 		{
 			if (m_nBuffers < 3)
-				AdjustDiffBlocks();
+				AdjustDiffBlocks(nFirstNewDiff, nLastNewDiff);
 			else
-				AdjustDiffBlocks3way();
+				AdjustDiffBlocks3way(nFirstNewDiff, nLastNewDiff);
 		}
 
 		// Analyse diff-list (updating real line-numbers)
 		// this operation does not change the modified flag
 		PrimeTextBuffers();
 
+		if (bEditedLinesOnly)
+			RestoreWordDiffCache(std::move(oldWordDiffs), nOldDiffs, nFirstNewDiff, nUnchangedTailDiffs);
+
 		// Hide identical lines if diff-context is not 'All'
 		HideLines();
 
@@ -573,6 +621,10 @@ int CMergeDoc::Rescan(bool &bBinary, IDENTLEVEL &identical,
 		{
 			m_bEditAfterRescan[nBuffer] = false;
 		}
+		m_bDiffListCurrent = true;
+
+		// Word diffs are computed in the background for the views
+		PrecomputeWordDiffs();
 	}
 
 	if (!GetOptionsMgr()->GetBool(OPT_CMP_IGNORE_CODEPAGE) &&
@@ -586,6 +638,200 @@ int CMergeDoc::Rescan(bool &bBinary, IDENTLEVEL &identical,
 	return nResult;
 }
 
+/**
+ * @brief Compare again only the lines edited since last rescan.
+ * The edited lines are found from the line revision numbers. They are
+ * compared together with the diffs they touch, from and to lines which were
+ * aligned by last rescan, and the result replaces those diffs in m_diffList.
+ * Diffs after the edited lines are moved by the count of added lines.
+ * @param [out] status Status of the compare.
+ * @param [out] nFirstNewDiff Index of the first diff found in edited lines.
+ * @param [out] nLastNewDiff Index of the last diff found in edited lines.
+ * @return false if the edited lines cannot be compared alone, the whole
+ * files must be compared then. m_diffList is not changed in that case.
+ */
+bool CMergeDoc::DiffEditedLines(DIFFSTATUS &status, int &nFirstNewDiff, int &nLastNewDiff)
+{
+	int nBuffer;
+	int nEditBegin[3], nEditEnd[3]; // edited lines [begin, end) in lines of last rescan
+	int nLineCount[3], nAddedLines[3];
+	bool bEdited = false;
+	for (nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
+	{
+		int nFirstLine, nLastLine;
+		if (!m_ptBuf[nBuffer]->GetLinesEditedAfterRescan(nFirstLine, nLastLine, nLineCount[nBuffer]))
+			return false;
+		nAddedLines[nBuffer] = nLineCount[nBuffer] - m_ptBuf[nBuffer]->m_nRealLinesOnRescan;
+		nEditBegin[nBuffer] = nEditEnd[nBuffer] = -1;
+		if (nFirstLine < 0)
+		{
+			// Lines cannot be added or removed without editing one
+			if (nAddedLines[nBuffer] != 0)
+				return false;
+			continue;
+		}
+		nEditBegin[nBuffer] = nFirstLine;
+		nEditEnd[nBuffer] = nLastLine + 1 - nAddedLines[nBuffer];
+		if (nEditEnd[nBuffer] < nEditBegin[nBuffer])
+			return false;
+		bEdited = true;
+	}
+	nFirstNewDiff = 0;
+	nLastNewDiff = -1;
+	if (!bEdited)
+		return true;
+
+	// Lines outside of diffs are aligned in all files, so find such lines
+	// before and after the edited lines, or diff boundaries which are
+	// aligned too. Aligned positions are ordered the same in all files,
+	// so they can be compared with the sum of their lines.
+	const int nDiffs = m_diffList.GetSize();
+	auto sum = [this](const int lines[3]) {
+		int nSum = 0;
+		for (int i = 0; i < m_nBuffers; i++)
+			nSum += lines[i];
+		return nSum;
+	};
+	// Diffs divided by AdjustDiffBlocks() touch each other, they are
+	// compared again together
+	auto touchesNext = [&](int nDiff) {
+		if (nDiff < 0 || nDiff + 1 >= nDiffs)
+			return false;
+		for (int i = 0; i < m_nBuffers; i++)
+			if (m_diffList.DiffRangeAt(nDiff)->end[i] + 1 != m_diffList.DiffRangeAt(nDiff + 1)->begin[i])
+				return false;
+		return true;
+	};
+	int nStart[3]{}, nEnd[3]{};
+	bool bFound = false;
+	for (nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
+	{
+		if (nEditBegin[nBuffer] < 0)
+			continue;
+		int start[3], end[3];
+		// Start at the first diff touching the edited lines, or in the
+		// aligned lines before them
+		int nDiff = 0;
+		while (nDiff < nDiffs && m_diffList.DiffRangeAt(nDiff)->end[nBuffer] + 1 < nEditBegin[nBuffer])
+			++nDiff;
+		if (nDiff < nDiffs && m_diffList.DiffRangeAt(nDiff)->begin[nBuffer] <= nEditBegin[nBuffer])
+		{
+			while (touchesNext(nDiff - 1))
+				--nDiff;
+			std::copy_n(m_diffList.DiffRangeAt(nDiff)->begin, 3, start);
+		}
+		else
+		{
+			const DIFFRANGE *pPrev = nDiff > 0 ? m_diffList.DiffRangeAt(nDiff - 1) : nullptr;
+			const int nOffset = nEditBegin[nBuffer] - (pPrev ? pPrev->end[nBuffer] + 1 : 0);
+			for (int i = 0; i < m_nBuffers; i++)
+				start[i] = (pPrev ? pPrev->end[i] + 1 : 0) + nOffset;
+		}
+		// End after the last diff touching the edited lines, or in the
+		// aligned lines after them
+		nDiff = nDiffs - 1;
+		while (nDiff >= 0 && m_diffList.DiffRangeAt(nDiff)->begin[nBuffer] > nEditEnd[nBuffer])
+			--nDiff;
+		if (nDiff >= 0 && m_diffList.DiffRangeAt(nDiff)->end[nBuffer] + 1 >= nEditEnd[nBuffer])
+		{
+			while (touchesNext(nDiff))
+				++nDiff;
+			for (int i = 0; i < m_nBuffers; i++)
+				end[i] = m_diffList.DiffRangeAt(nDiff)->end[i] + 1;
+		}
+		else
+		{
+			const DIFFRANGE *pPrev = nDiff >= 0 ? m_diffList.DiffRangeAt(nDiff) : nullptr;
+			const int nOffset = nEditEnd[nBuffer] - (pPrev ? pPrev->end[nBuffer] + 1 : 0);
+			for (int i = 0; i < m_nBuffers; i++)
+				end[i] = (pPrev ? pPrev->end[i] + 1 : 0) + nOffset;
+		}
+		if (!bFound || sum(start) < sum(nStart))
+			std::copy_n(start, 3, nStart);
+		if (!bFound || sum(end) > sum(nEnd))
+			std::copy_n(end, 3, nEnd);
+		bFound = true;
+	}
+
+	// The last line decides the missing EOL handling of the whole file
+	int nApparentStart[3], nApparentLines[3];
+	for (nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
+	{
+		const int nNewEnd = nEnd[nBuffer] + nAddedLines[nBuffer];
+		if (nNewEnd >= nLineCount[nBuffer] || nNewEnd < nStart[nBuffer])
+			return false;
+		nApparentStart[nBuffer] = m_ptBuf[nBuffer]->ComputeApparentLine(nStart[nBuffer]);
+		nApparentLines[nBuffer] = m_ptBuf[nBuffer]->ComputeApparentLine(nNewEnd) - nApparentStart[nBuffer];
+	}
+
+	std::string buffers[3];
+	for (nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
+		m_ptBuf[nBuffer]->SaveToMemory(buffers[nBuffer], nApparentStart[nBuffer], nApparentLines[nBuffer]);
+	DiffList templist;
+	templist.Clear();
+	m_diffWrapper.SetCreateDiffList(&templist);
+	const bool bSuccess = m_diffWrapper.RunFileDiff(buffers);
+	m_diffWrapper.SetCreateDiffList(&m_diffList);
+	DIFFSTATUS status_part;
+	m_diffWrapper.GetDiffStatus(&status_part);
+	if (!bSuccess || status_part.bBinaries)
+		return false;
+
+	// Replace the diffs between start and end
+	DiffList newDiffList;
+	newDiffList.Clear();
+	int nDiff = 0;
+	for (; nDiff < nDiffs; nDiff++)
+	{
+		const DIFFRANGE *pdr = m_diffList.DiffRangeAt(nDiff);
+		int end[3];
+		for (int i = 0; i < m_nBuffers; i++)
+			end[i] = pdr->end[i] + 1;
+		if (sum(end) > sum(nStart))
+			break;
+		newDiffList.AddDiff(*pdr);
+	}
+	nFirstNewDiff = newDiffList.GetSize();
+	newDiffList.AppendDiffList(templist, nStart);
+	nLastNewDiff = newDiffList.GetSize() - 1;
+	for (; nDiff < nDiffs; nDiff++)
+	{
+		DIFFRANGE dr = *m_diffList.DiffRangeAt(nDiff);
+		if (sum(dr.begin) < sum(nEnd))
+			continue;
+		for (int i = 0; i < m_nBuffers; i++)
+		{
+			dr.begin[i] += nAddedLines[i];
+			dr.end[i] += nAddedLines[i];
+		}
+		newDiffList.AddDiff(dr);
+	}
+	m_diffList.Clear();
+	for (nDiff = 0; nDiff < newDiffList.GetSize(); nDiff++)
+		m_diffList.AddDiff(*newDiffList.DiffRangeAt(nDiff));
+
+	// Same identical levels as the whole files compare
+	status = DIFFSTATUS();
+	std::vector<OP_TYPE> ops;
+	for (nDiff = 0; nDiff < m_diffList.GetSize(); nDiff++)
+	{
+		const OP_TYPE op = m_diffList.DiffRangeAt(nDiff)->op;
+		if (op != OP_TRIVIAL && std::find(ops.begin(), ops.end(), op) == ops.end())
+			ops.push_back(op);
+	}
+	if (ops.empty())
+		status.Identical = IDENTLEVEL::ALL;
+	else if (m_nBuffers == 3 && ops.size() == 1 && ops[0] == OP_1STONLY)
+		status.Identical = IDENTLEVEL::EXCEPTLEFT;
+	else if (m_nBuffers == 3 && ops.size() == 1 && ops[0] == OP_2NDONLY)
+		status.Identical = IDENTLEVEL::EXCEPTMIDDLE;
+	else if (m_nBuffers == 3 && ops.size() == 1 && ops[0] == OP_3RDONLY)
+		status.Identical = IDENTLEVEL::EXCEPTRIGHT;
+	else
+		status.Identical = IDENTLEVEL::NONE;
+	return true;
+}
+
 void CMergeDoc::CheckFileChanged(void)
 {
 	for (int nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
@@ -1168,8 +1414,10 @@ void CMergeDoc::SetCurrentDiff(int nDiff)
  * Update view and restore cursor and scroll position after
  * rescanning document.
  * @param [in] bForced If true rescan cannot be suppressed
+ * @param [in] bEditedLinesOnly If true only the edited lines are compared
+ * again when possible
  */
-void CMergeDoc::FlushAndRescan(bool bForced /* =false */)
+void CMergeDoc::FlushAndRescan(bool bForced /* =false */, bool bEditedLinesOnly /* =false */)
 {
 	// Ignore suppressing when forced rescan
 	if (!bForced)
@@ -1185,7 +1433,7 @@ void CMergeDoc::FlushAndRescan(bool bForced /* =false */)
 
 	bool bBinary = false;
 	IDENTLEVEL identical = IDENTLEVEL::NONE;
-	int nRescanResult = Rescan(bBinary, identical, bForced);
+	int nRescanResult = Rescan(bBinary, identical, bForced, bEditedLinesOnly);
 
 	// restore cursors and caret
 	ForEachView([](auto& pView) { pView->PopCursors(); });
@@ -1961,7 +2209,7 @@ void CMergeDoc::RescanIfNeeded(float timeOutInSecond)
 	COleDateTimeSpan elapsed = COleDateTime::GetCurrentTime() - m_LastRescan;
 	if (elapsed.GetTotalSeconds() >= timeOutInSecond)
 		// (laoran 08-01-2003) maybe should be FlushAndRescan(true) ??
-		FlushAndRescan();
+		FlushAndRescan(false, true);
 }
 
 /**
@@ -2621,6 +2869,9 @@ void CMergeDoc::RefreshOptions()
 	DIFFOPTIONS options = {0};
 	
 	m_bAutomaticRescan = GetOptionsMgr()->GetBool(OPT_AUTOMATIC_RESCAN);
+	const size_t nMaxUndoMemory = static_cast<size_t>(GetOptionsMgr()->GetInt(OPT_UNDO_MEMORY_LIMIT)) * 1024 * 1024;
+	for (int nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
+		m_ptBuf[nBuffer]->SetMaxUndoMemory(nMaxUndoMemory);
 
 	m_diffWrapper.SetDetectMovedBlocks(GetOptionsMgr()->GetBool(OPT_CMP_MOVED_BLOCKS));
 	Options::DiffOptions::Load(GetOptionsMgr(), options);
@@ -20,8 +20,13 @@
 #include "FileTransform.h"
 #include <vector>
 #include <map>
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <unordered_map>
+
+class LineMatchIndex;
 
 /**
  * @brief Additional action codes for WinMerge.
@@ -160,7 +165,7 @@ public:
 	void MoveOnLoad(int nPane = -1, int nLinIndex = -1, bool bRealLine = false, int nCharIndex = -1);
 	void ChangeFile(int nBuffer, const String& path, int nLineIndex = -1);
 	void RescanIfNeeded(float timeOutInSecond);
-	int Rescan(bool &bBinary, IDENTLEVEL &identical, bool bForced = false);
+	int Rescan(bool &bBinary, IDENTLEVEL &identical, bool bForced = false, bool bEditedLinesOnly = false);
 	void CheckFileChanged(void) override;
 	int ShowMessageBox(const String& sText, unsigned nType = MB_OK, unsigned nIDHelp = 0);
 	void ShowRescanError(int nRescanResult, IDENTLEVEL identical);
@@ -289,9 +294,31 @@ public:
 	std::vector<WordDiff> GetWordDiffArray(int nLineIndex, bool ignoreDiffOptions = false);
 	std::vector<WordDiff> GetWordDiffArrayInRange(const int begin[3], const int end[3], bool ignoreDiffOptions = false, int pane1 = -1, int pane2 = -1);
 	void ClearWordDiffCache(int nDiff = -1);
+	void CancelWordDiffPrecompute();
 private:
+	struct WordDiffInput;
+	struct WordDiffPrecompute;
+	/** @brief Word diffs of one diff block, see GetWordDiffArray() */
+	struct WordDiffCacheEntry
+	{
+		int dbegin; /**< First line of the block when computed */
+		int dend; /**< Last line of the block when computed */
+		std::array<int, 3> lines; /**< Real line count of the block in each pane */
+		std::array<uint32_t, 3> revision; /**< Highest line revision number of the block in each pane */
+		std::vector<WordDiff> worddiffs; /**< Word diffs of the whole block */
+		std::vector<int> lineStarts; /**< Index of first word diff of each line (and end), empty unless diffed per line */
+	};
+	typedef std::unordered_map<int, WordDiffCacheEntry> WordDiffCache;
 	void Computelinediff(CMergeEditView *pView, std::pair<CEPoint, CEPoint> rc[], bool bReversed);
-	std::map<int, std::vector<WordDiff> > m_cacheWordDiffs;
+	bool GetWordDiffInput(const int begin[3], const int end[3], bool ignoreDiffOptions, int pane1, int pane2, WordDiffInput& input);
+	static std::vector<WordDiff> ComputeWordDiffArray(const WordDiffInput& input, const std::atomic_bool *pCanceled = nullptr);
+	WordDiffCacheEntry MakeWordDiffCacheEntry(const DIFFRANGE& cd) const;
+	WordDiffCache TakeWordDiffCache();
+	void RestoreWordDiffCache(WordDiffCache&& oldCache, int nOldDiffs, int nFirstNewDiff, int nUnchangedTailDiffs);
+	void PrecomputeWordDiffs();
+	WordDiffCache m_cacheWordDiffs; /**< Word diffs by diff index, without ignoreDiffOptions */
+	std::mutex m_mutexWordDiffs; /**< Guards m_cacheWordDiffs, which precompute threads fill too */
+	std::shared_ptr<WordDiffPrecompute> m_pWordDiffPrecompute;
 // End MergeDocLineDiffs.cpp
 
 // Implementation in MergeDocEncoding.cpp
@@ -306,7 +333,7 @@ public:
 	bool PromptAndSaveIfNeeded(bool bAllowCancel);
 	std::vector<int> undoTgt;
 	std::vector<int>::iterator curUndo;
-	void FlushAndRescan(bool bForced = false);
+	void FlushAndRescan(bool bForced = false, bool bEditedLinesOnly = false);
 	void SetCurrentDiff(int nDiff);
 	int GetCurrentDiff() const { return m_nCurDiff; }
 	const CurrentWordDiff& GetCurrentWordDiff() const { return m_CurWordDiff; }
@@ -375,6 +402,7 @@ protected:
 	String m_strDesc[3]; /**< Left/Middle/Right side description text */
 	BUFFERTYPE m_nBufferType[3];
 	bool m_bEditAfterRescan[3]; /**< Left/middle/right doc edited after rescanning */
+	bool m_bDiffListCurrent; /**< Does m_diffList hold the result of the last rescan? */
 	TempFile m_tempFiles[3]; /**< Temp files for compared files */
 	String m_strSaveAsPath; /**< "3rd path" where output saved if given */
 	int m_nDiffContext;
@@ -455,14 +483,16 @@ protected:
 	//}}AFX_MSG
 	DECLARE_MESSAGE_MAP()
 private:
+	bool DiffEditedLines(DIFFSTATUS &status, int &nFirstNewDiff, int &nLastNewDiff);
 	void PrimeTextBuffers();
 	void HideLines();
-	void AdjustDiffBlocks();
-	void AdjustDiffBlocks3way();
+	void AdjustDiffBlocks(int nFirstDiff, int nLastDiff);
+	void AdjustDiffBlocks3way(int nFirstDiff, int nLastDiff);
+	std::vector<DIFFRANGE> DivideDiffBlock(const DIFFRANGE & diffrange);
+	std::vector<DIFFRANGE> DivideDiffBlock3way(const DIFFRANGE & diffrange, const DIFFOPTIONS & diffOptions);
 	void AdjustDiffBlock(DiffMap & diffmap, const DIFFRANGE & diffrange,
-		const std::vector<WordDiff>& worddiffs,
+		const LineMatchIndex& matches,
 		int i0, int i1, int lo0, int hi0, int lo1, int hi1);
-	int GetMatchCost(const DIFFRANGE& dr, int i0, int i1, int line0, int line1, const std::vector<WordDiff>& worddiffs);
 	OP_TYPE ComputeOpType3way(const std::vector<std::array<int, 3>>& vlines, size_t index,
 		const DIFFRANGE& diffrange, const DIFFOPTIONS& diffOptions);
 	void FlagTrivialLines();
@@ -7,11 +7,14 @@
 
 #include "StdAfx.h"
 #include <vector>
+#include <climits>
+#include <Poco/Environment.h>
 #include "MergeDoc.h"
 
 #include "Merge.h"
 #include "DiffList.h"
 #include "stringdiffs.h"
+#include "WorkStealingPool.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -19,6 +22,181 @@
 
 using std::vector;
 
+/** @brief Diff blocks with fewer lines in all are divided in the calling thread. */
+static const int PARALLEL_ADJUST_MIN_LINES = 1000;
+
+/**
+ * @brief Matching characters of the line pairs of a diff block, by line.
+ *
+ * The text between two word diffs is equal in both panes, so it matches
+ * lines at a constant distance (diagonal) from each other. The matching
+ * characters of each line are summed per diagonal once, instead of walking
+ * the whole word diff list for every pair of lines.
+ */
+class LineMatchIndex
+{
+public:
+	/** @brief Characters of a line matching the line on one diagonal. */
+	struct Match
+	{
+		int nDiagonal; /**< Other line minus this line */
+		int nLength; /**< Matching characters */
+	};
+
+	LineMatchIndex(const CDiffTextBuffer& buf, const DIFFRANGE& dr, int i0, int i1,
+		const std::vector<WordDiff>& worddiffs);
+	/** @brief Matches of a line of the block, sorted by diagonal. */
+	const std::vector<Match>& GetMatches(int line) const { return m_matches[line]; }
+
+private:
+	void AddEqualText(int nBeginLine, int nBeginChar, int nEndLine, int nEndChar,
+		int nLastLine, int nDiagonal);
+
+	const CDiffTextBuffer& m_buf; /**< Buffer of the indexed pane */
+	int m_nOffset; /**< First line of the block */
+	std::vector<std::vector<Match>> m_matches;
+};
+
+/**
+ * @brief Index the equal text between the word diffs of a diff block.
+ * @param [in] buf Buffer of pane @p i0.
+ * @param [in] dr Diff block.
+ * @param [in] i0 Pane whose lines are indexed.
+ * @param [in] i1 Other pane.
+ * @param [in] worddiffs Word diffs between the panes.
+ */
+LineMatchIndex::LineMatchIndex(const CDiffTextBuffer& buf, const DIFFRANGE& dr, int i0, int i1,
+	const std::vector<WordDiff>& worddiffs)
+: m_buf(buf)
+, m_nOffset(dr.begin[i0])
+, m_matches((std::max)(dr.end[i0] - dr.begin[i0] + 1, 0))
+{
+	if (worddiffs.empty())
+	{
+		AddEqualText(dr.begin[i0], 0, INT_MAX, 0, INT_MAX, dr.begin[i1] - dr.begin[i0]);
+		return;
+	}
+	WordDiff prevWordDiff(0, 0, dr.begin[0], dr.begin[0], 0, 0, dr.begin[1], dr.begin[1]);
+	for (const auto& worddiff : worddiffs)
+	{
+		// The equal text ends where both panes reach the word diff
+		const int nDiagonal = prevWordDiff.endline[1] - prevWordDiff.endline[0];
+		AddEqualText(prevWordDiff.endline[0], prevWordDiff.end[0], worddiff.beginline[0], worddiff.begin[0],
+			(std::min)(worddiff.beginline[0], worddiff.beginline[1] - nDiagonal), nDiagonal);
+		prevWordDiff = worddiff;
+	}
+	AddEqualText(prevWordDiff.endline[0], prevWordDiff.end[0], INT_MAX, 0, INT_MAX,
+		prevWordDiff.endline[1] - prevWordDiff.endline[0]);
+
+	// Equal texts of a line on the same diagonal match together
+	for (auto& matches : m_matches)
+	{
+		if (matches.size() < 2)
+			continue;
+		std::sort(matches.begin(), matches.end(),
+			[](const Match& a, const Match& b) { return a.nDiagonal < b.nDiagonal; });
+		size_t j = 0;
+		for (size_t i = 1; i < matches.size(); ++i)
+		{
+			if (matches[i].nDiagonal == matches[j].nDiagonal)
+				matches[j].nLength += matches[i].nLength;
+			else
+				matches[++j] = matches[i];
+		}
+		matches.resize(j + 1);
+	}
+}
+
+/**
+ * @brief Add equal text to the lines it covers.
+ * @param [in] nBeginLine, nBeginChar Start of the equal text.
+ * @param [in] nEndLine, nEndChar End of the equal text.
+ * @param [in] nLastLine Last line matching a line of the other pane.
+ * @param [in] nDiagonal Line of the other pane minus line of this pane.
+ */
+void LineMatchIndex::AddEqualText(int nBeginLine, int nBeginChar, int nEndLine, int nEndChar,
+	int nLastLine, int nDiagonal)
+{
+	const int nFirst = (std::max)(nBeginLine - m_nOffset, 0);
+	const int nLast = (std::min)(nLastLine - m_nOffset, static_cast<int>(m_matches.size()) - 1);
+	for (int i = nFirst; i <= nLast; ++i)
+	{
+		const int nLine = m_nOffset + i;
+		int nLength = (nLine == nEndLine) ? nEndChar : m_buf.GetFullLineLength(nLine);
+		if (nLine == nBeginLine)
+			nLength -= nBeginChar;
+		m_matches[i].push_back({ nDiagonal, nLength });
+	}
+}
+
+/**
+ * @brief Divide the diff blocks in a range of a diff list.
+ * Diff blocks are independent of each other, so they are divided by all
+ * processors if there are enough lines.
+ * @param [in,out] diffList Diff list whose blocks are replaced.
+ * @param [in] nBuffers Number of files compared.
+ * @param [in] nFirstDiff First diff to divide.
+ * @param [in] nLastDiff Last diff to divide.
+ * @param [in] divide Function dividing one diff block, called concurrently.
+ */
+template <class Divide>
+static void
+DivideDiffBlocks(DiffList& diffList, int nBuffers, int nFirstDiff, int nLastDiff, Divide divide)
+{
+	int nDiff;
+	int nDiffCount = diffList.GetSize();
+	nFirstDiff = (std::max)(nFirstDiff, 0);
+	nLastDiff = (std::min)(nLastDiff, nDiffCount - 1);
+	std::vector<std::vector<DIFFRANGE>> dividedDiffs((std::max)(nLastDiff - nFirstDiff + 1, 0));
+
+	int nLines = 0;
+	for (nDiff = nFirstDiff; nDiff <= nLastDiff && nLines < PARALLEL_ADJUST_MIN_LINES; nDiff++)
+	{
+		const DIFFRANGE & diffrange = *diffList.DiffRangeAt(nDiff);
+		for (int file = 0; file < nBuffers; file++)
+			nLines += (std::max)(diffrange.end[file] - diffrange.begin[file] + 1, 0);
+	}
+	const int nThreads = (std::min)(static_cast<int>(Poco::Environment::processorCount()),
+		static_cast<int>(dividedDiffs.size()));
+	if (nLines < PARALLEL_ADJUST_MIN_LINES || nThreads < 2)
+	{
+		for (nDiff = nFirstDiff; nDiff <= nLastDiff; nDiff++)
+			dividedDiffs[nDiff - nFirstDiff] = divide(*diffList.DiffRangeAt(nDiff));
+	}
+	else
+	{
+		WorkStealingPool pool(nThreads);
+		for (nDiff = nFirstDiff; nDiff <= nLastDiff; nDiff++)
+		{
+			pool.Submit([&, nDiff]() {
+				dividedDiffs[nDiff - nFirstDiff] = divide(*diffList.DiffRangeAt(nDiff));
+			});
+		}
+		pool.Wait();
+	}
+
+	DiffList newDiffList;
+	newDiffList.Clear();
+	for (nDiff = 0; nDiff < nDiffCount; nDiff++)
+	{
+		if (nDiff >= nFirstDiff && nDiff <= nLastDiff)
+		{
+			for (const auto& dr : dividedDiffs[nDiff - nFirstDiff])
+				newDiffList.AddDiff(dr);
+		}
+		else
+		{
+			newDiffList.AddDiff(*diffList.DiffRangeAt(nDiff));
+		}
+	}
+
+	// recreate diffList
+	diffList.Clear();
+	nDiffCount = newDiffList.GetSize();
+	for (nDiff = 0; nDiff < nDiffCount; nDiff++)
+		diffList.AddDiff(*newDiffList.DiffRangeAt(nDiff));
+}
+
 static void
 ValidateDiffMap(const DiffMap& diffmap)
 {
@@ -327,404 +505,354 @@ OP_TYPE CMergeDoc::ComputeOpType3way(
 
 /**
  * @brief Divide diff blocks to align similar lines in diff blocks.
+ * @param [in] nFirstDiff First diff to divide.
+ * @param [in] nLastDiff Last diff to divide, other diffs are kept as they are.
  */
-void CMergeDoc::AdjustDiffBlocks()
+void CMergeDoc::AdjustDiffBlocks(int nFirstDiff, int nLastDiff)
 {
-	int nDiff;
-	int nDiffCount = m_diffList.GetSize();
-
 	// Go through and do our best to line up lines within each diff block
 	// between left side and right side
-	DiffList newDiffList;
-	newDiffList.Clear();
-	for (nDiff = 0; nDiff < nDiffCount; nDiff++)
+	DivideDiffBlocks(m_diffList, m_nBuffers, nFirstDiff, nLastDiff,
+		[this](const DIFFRANGE& diffrange) { return DivideDiffBlock(diffrange); });
+}
+
+/**
+ * @brief Divide a diff block to align similar lines.
+ * @param [in] diffrange Diff block to divide.
+ * @return Divided diff blocks, or the diff block itself.
+ */
+std::vector<DIFFRANGE> CMergeDoc::DivideDiffBlock(const DIFFRANGE & diffrange)
+{
+	std::vector<DIFFRANGE> diffs;
+	// size map correctly (it will hold one entry for each left-side line
+	int nlines0 = diffrange.end[0] - diffrange.begin[0] + 1;
+	int nlines1 = diffrange.end[1] - diffrange.begin[1] + 1;
+	if (nlines0 <= 0 || nlines1 <= 0)
 	{
-		const DIFFRANGE & diffrange = *m_diffList.DiffRangeAt(nDiff);
-		// size map correctly (it will hold one entry for each left-side line
-		int nlines0 = diffrange.end[0] - diffrange.begin[0] + 1;
-		int nlines1 = diffrange.end[1] - diffrange.begin[1] + 1;
-		if (nlines0>0 && nlines1>0)
-		{
-			// Call worker to do all lines in block
-			int lo0 = 0, hi0 = nlines0-1;
-			int lo1 = 0, hi1 = nlines1-1;
-			const std::vector<WordDiff> worddiffs = GetWordDiffArrayInRange(diffrange.begin, diffrange.end);
+		diffs.push_back(diffrange);
+		return diffs;
+	}
+
+	// Call worker to do all lines in block
+	int lo0 = 0, hi0 = nlines0-1;
+	int lo1 = 0, hi1 = nlines1-1;
+	const std::vector<WordDiff> worddiffs = GetWordDiffArrayInRange(diffrange.begin, diffrange.end);
 #ifdef _DEBUG
-			PrintWordDiffList(2, worddiffs);
+	PrintWordDiffList(2, worddiffs);
 #endif
-			DiffMap diffmap;
-			diffmap.InitDiffMap(nlines0);
-			AdjustDiffBlock(diffmap, diffrange, worddiffs, 0, 1, lo0, hi0, lo1, hi1);
-			ValidateDiffMap(diffmap);
-			std::vector<std::array<int, 2>> vlines = CreateVirtualLineToRealLineMap(diffmap, nlines0, nlines1);
-
-			// divide diff blocks
-			int line0 = 0, line1 = 0;
-			for (size_t i = 0; i < vlines.size();)
+	DiffMap diffmap;
+	diffmap.InitDiffMap(nlines0);
+	AdjustDiffBlock(diffmap, diffrange, LineMatchIndex(*m_ptBuf[0], diffrange, 0, 1, worddiffs), 0, 1, lo0, hi0, lo1, hi1);
+	ValidateDiffMap(diffmap);
+	std::vector<std::array<int, 2>> vlines = CreateVirtualLineToRealLineMap(diffmap, nlines0, nlines1);
+
+	// divide diff blocks
+	int line0 = 0, line1 = 0;
+	for (size_t i = 0; i < vlines.size();)
+	{
+		DIFFRANGE dr;
+		size_t ib = i;
+		if ((vlines[i][0] != DiffMap::GHOST_MAP_ENTRY) &&
+			(vlines[i][1] != DiffMap::GHOST_MAP_ENTRY))
+		{
+			while (i < vlines.size() &&
+				(vlines[i][0] != DiffMap::GHOST_MAP_ENTRY) &&
+				(vlines[i][1] != DiffMap::GHOST_MAP_ENTRY))
 			{
-				DIFFRANGE dr;
-				size_t ib = i;
-				if ((vlines[i][0] != DiffMap::GHOST_MAP_ENTRY) &&
-					(vlines[i][1] != DiffMap::GHOST_MAP_ENTRY))
-				{
-					while (i < vlines.size() &&
-						(vlines[i][0] != DiffMap::GHOST_MAP_ENTRY) &&
-						(vlines[i][1] != DiffMap::GHOST_MAP_ENTRY))
-					{
-						line0++;
-						line1++;
-						i++;
-					}
-					dr.begin[0]  = diffrange.begin[0] + vlines[ib][0];
-					dr.begin[1]  = diffrange.begin[1] + vlines[ib][1];
-					dr.end[0]    = diffrange.begin[0] + vlines[i - 1][0];
-					dr.end[1]    = diffrange.begin[1] + vlines[i - 1][1];
-					dr.blank[0]  = dr.blank[1] = -1;
-					dr.op        = diffrange.op;
-					newDiffList.AddDiff(dr);
-				}
-				else if ((vlines[i][0] == DiffMap::GHOST_MAP_ENTRY) &&
-				         (vlines[i][1] != DiffMap::GHOST_MAP_ENTRY))
-				{
-					while (i < vlines.size() &&
-					     (vlines[i][0] == DiffMap::GHOST_MAP_ENTRY) &&
-					     (vlines[i][1] != DiffMap::GHOST_MAP_ENTRY))
-					{
-						line1++;
-						i++;
-					}
-					dr.begin[0]  = diffrange.begin[0] + line0;
-					dr.begin[1]  = diffrange.begin[1] + vlines[ib][1];
-					dr.end[0]    = diffrange.begin[0] + line0 - 1;
-					dr.end[1]    = diffrange.begin[1] + vlines[i - 1][1];
-					dr.blank[0]  = dr.blank[1] = -1;
-					dr.op        = diffrange.op;
-					newDiffList.AddDiff(dr);
-				}
-				else if ((vlines[i][0] != DiffMap::GHOST_MAP_ENTRY) &&
-				         (vlines[i][1] == DiffMap::GHOST_MAP_ENTRY))
-				{
-					while (i < vlines.size() &&
-					     (vlines[i][0] != DiffMap::GHOST_MAP_ENTRY) &&
-					     (vlines[i][1] == DiffMap::GHOST_MAP_ENTRY))
-					{
-						line0++;
-						i++;
-					}
-					dr.begin[0]  = diffrange.begin[0] + vlines[ib][0];
-					dr.begin[1]  = diffrange.begin[1] + line1;
-					dr.end[0]    = diffrange.begin[0] + vlines[i - 1][0];
-					dr.end[1]    = diffrange.begin[1] + line1 - 1;
-					dr.blank[0]  = dr.blank[1] = -1;
-					dr.op        = diffrange.op;
-					newDiffList.AddDiff(dr);
-				}
-				else
-				{
-					assert(0);
-				}
+				line0++;
+				line1++;
+				i++;
+			}
+			dr.begin[0]  = diffrange.begin[0] + vlines[ib][0];
+			dr.begin[1]  = diffrange.begin[1] + vlines[ib][1];
+			dr.end[0]    = diffrange.begin[0] + vlines[i - 1][0];
+			dr.end[1]    = diffrange.begin[1] + vlines[i - 1][1];
+			dr.blank[0]  = dr.blank[1] = -1;
+			dr.op        = diffrange.op;
+			diffs.push_back(dr);
+		}
+		else if ((vlines[i][0] == DiffMap::GHOST_MAP_ENTRY) &&
+		         (vlines[i][1] != DiffMap::GHOST_MAP_ENTRY))
+		{
+			while (i < vlines.size() &&
+			     (vlines[i][0] == DiffMap::GHOST_MAP_ENTRY) &&
+			     (vlines[i][1] != DiffMap::GHOST_MAP_ENTRY))
+			{
+				line1++;
+				i++;
+			}
+			dr.begin[0]  = diffrange.begin[0] + line0;
+			dr.begin[1]  = diffrange.begin[1] + vlines[ib][1];
+			dr.end[0]    = diffrange.begin[0] + line0 - 1;
+			dr.end[1]    = diffrange.begin[1] + vlines[i - 1][1];
+			dr.blank[0]  = dr.blank[1] = -1;
+			dr.op        = diffrange.op;
+			diffs.push_back(dr);
+		}
+		else if ((vlines[i][0] != DiffMap::GHOST_MAP_ENTRY) &&
+		         (vlines[i][1] == DiffMap::GHOST_MAP_ENTRY))
+		{
+			while (i < vlines.size() &&
+			     (vlines[i][0] != DiffMap::GHOST_MAP_ENTRY) &&
+			     (vlines[i][1] == DiffMap::GHOST_MAP_ENTRY))
+			{
+				line0++;
+				i++;
 			}
+			dr.begin[0]  = diffrange.begin[0] + vlines[ib][0];
+			dr.begin[1]  = diffrange.begin[1] + line1;
+			dr.end[0]    = diffrange.begin[0] + vlines[i - 1][0];
+			dr.end[1]    = diffrange.begin[1] + line1 - 1;
+			dr.blank[0]  = dr.blank[1] = -1;
+			dr.op        = diffrange.op;
+			diffs.push_back(dr);
 		}
 		else
 		{
-			newDiffList.AddDiff(diffrange);
+			assert(0);
 		}
 	}
-
-	// recreate m_diffList
-	m_diffList.Clear();
-	nDiffCount = newDiffList.GetSize();
-	for (nDiff = 0; nDiff < nDiffCount; nDiff++)
-		m_diffList.AddDiff(*newDiffList.DiffRangeAt(nDiff));
+	return diffs;
 }
 
 /**
  * @brief Divide diff blocks to align similar lines in diff blocks. (3-way)
+ * @param [in] nFirstDiff First diff to divide.
+ * @param [in] nLastDiff Last diff to divide, other diffs are kept as they are.
  */
-void CMergeDoc::AdjustDiffBlocks3way()
+void CMergeDoc::AdjustDiffBlocks3way(int nFirstDiff, int nLastDiff)
 {
-	int nDiff;
-	int nDiffCount = m_diffList.GetSize();
+	DIFFOPTIONS diffOptions = {0};
+	m_diffWrapper.GetOptions(&diffOptions);
 
 	// Go through and do our best to line up lines within each diff block
 	// between left side and right side
-	DiffList newDiffList;
-	newDiffList.Clear();
-	for (nDiff = 0; nDiff < nDiffCount; nDiff++)
-	{
-		const DIFFRANGE & diffrange = *m_diffList.DiffRangeAt(nDiff);
-		// size map correctly (it will hold one entry for each left-side line
-		int nlines0 = diffrange.end[0] - diffrange.begin[0] + 1;
-		int nlines1 = diffrange.end[1] - diffrange.begin[1] + 1;
-		int nlines2 = diffrange.end[2] - diffrange.begin[2] + 1;
-		if ((nlines0 > 0) + (nlines1 > 0) + (nlines2 > 0) > 1)
-		{
-			// Call worker to do all lines in block
-			int lo0 = 0, hi0 = nlines0 - 1;
-			int lo1 = 0, hi1 = nlines1 - 1;
-			int lo2 = 0, hi2 = nlines2 - 1;
-			const std::vector<WordDiff> worddiffs01 = GetWordDiffArrayInRange(diffrange.begin, diffrange.end, false, 0, 1);
-			const std::vector<WordDiff> worddiffs12 = GetWordDiffArrayInRange(diffrange.begin, diffrange.end, false, 1, 2);
-			const std::vector<WordDiff> worddiffs20 = GetWordDiffArrayInRange(diffrange.begin, diffrange.end, false, 2, 0);
-			DiffMap diffmap01, diffmap12, diffmap20;
-			diffmap01.InitDiffMap(nlines0);
-			diffmap12.InitDiffMap(nlines1);
-			diffmap20.InitDiffMap(nlines2);
-			AdjustDiffBlock(diffmap01, diffrange, worddiffs01, 0, 1, lo0, hi0, lo1, hi1);
-			AdjustDiffBlock(diffmap12, diffrange, worddiffs12, 1, 2, lo1, hi1, lo2, hi2);
-			AdjustDiffBlock(diffmap20, diffrange, worddiffs20, 2, 0, lo2, hi2, lo0, hi0);
-			ValidateDiffMap(diffmap01);
-			ValidateDiffMap(diffmap12);
-			ValidateDiffMap(diffmap20);
-			std::vector<std::array<int, 3>> vlines = CreateVirtualLineToRealLineMap3way(diffmap01, diffmap12, diffmap20, nlines0, nlines1, nlines2);
-
-			DIFFOPTIONS diffOptions = {0};
-			m_diffWrapper.GetOptions(&diffOptions);
-			std::vector<OP_TYPE> opary(vlines.size());
-			for (size_t i = 0; i < vlines.size(); ++i)
-				opary[i] = (diffrange.op == OP_TRIVIAL) ?
-					OP_TRIVIAL :
-					ComputeOpType3way(vlines, i, diffrange, diffOptions);
-			// divide diff blocks
-			int line0 = 0, line1 = 0, line2 = 0;
-			for (size_t i = 0; i < vlines.size();)
-			{
-				DIFFRANGE dr;
-				size_t ib = i;
-				OP_TYPE op = opary[i];
-				if ((vlines[i][0] != DiffMap::GHOST_MAP_ENTRY) &&
-					(vlines[i][1] != DiffMap::GHOST_MAP_ENTRY) &&
-					(vlines[i][2] != DiffMap::GHOST_MAP_ENTRY))
-				{
-					while (i < vlines.size() &&
-						(vlines[i][0] != DiffMap::GHOST_MAP_ENTRY) &&
-						(vlines[i][1] != DiffMap::GHOST_MAP_ENTRY) &&
-						(vlines[i][2] != DiffMap::GHOST_MAP_ENTRY) &&
-						op == opary[i])
-					{
-						line0++;
-						line1++;
-						line2++;
-						i++;
-					}
-					dr.begin[0]  = diffrange.begin[0] + vlines[ib][0];
-					dr.begin[1]  = diffrange.begin[1] + vlines[ib][1];
-					dr.begin[2]  = diffrange.begin[2] + vlines[ib][2];
-					dr.end[0]    = diffrange.begin[0] + vlines[i - 1][0];
-					dr.end[1]    = diffrange.begin[1] + vlines[i - 1][1];
-					dr.end[2]    = diffrange.begin[2] + vlines[i - 1][2];
-					dr.blank[0]  = dr.blank[1] = dr.blank[2] = -1;
-					dr.op        = op;
-					newDiffList.AddDiff(dr);
-				}
-				else if ((vlines[i][0] == DiffMap::GHOST_MAP_ENTRY) &&
-				         (vlines[i][1] != DiffMap::GHOST_MAP_ENTRY) &&
-				         (vlines[i][2] != DiffMap::GHOST_MAP_ENTRY))
-				{
-					while (i < vlines.size() &&
-					     (vlines[i][0] == DiffMap::GHOST_MAP_ENTRY) &&
-					     (vlines[i][1] != DiffMap::GHOST_MAP_ENTRY) &&
-					     (vlines[i][2] != DiffMap::GHOST_MAP_ENTRY) &&
-						 op == opary[i])
-					{
-						line1++;
-						line2++;
-						i++;
-					}
-					dr.begin[0]  = diffrange.begin[0] + line0;
-					dr.begin[1]  = diffrange.begin[1] + vlines[ib][1];
-					dr.begin[2]  = diffrange.begin[2] + vlines[ib][2];
-					dr.end[0]    = diffrange.begin[0] + line0 - 1;
-					dr.end[1]    = diffrange.begin[1] + vlines[i - 1][1];
-					dr.end[2]    = diffrange.begin[2] + vlines[i - 1][2];
-					dr.blank[0]  = dr.blank[1] = dr.blank[2] = -1;
-					dr.op        = op;
-					newDiffList.AddDiff(dr);
-				}
-				else if ((vlines[i][0] != DiffMap::GHOST_MAP_ENTRY) &&
-				         (vlines[i][1] == DiffMap::GHOST_MAP_ENTRY) &&
-				         (vlines[i][2] != DiffMap::GHOST_MAP_ENTRY))
-				{
-					while (i < vlines.size() &&
-					     (vlines[i][0] != DiffMap::GHOST_MAP_ENTRY) &&
-					     (vlines[i][1] == DiffMap::GHOST_MAP_ENTRY) &&
-					     (vlines[i][2] != DiffMap::GHOST_MAP_ENTRY) &&
-						 op == opary[i])
-					{
-						line0++;
-						line2++;
-						i++;
-					}
-					dr.begin[0]  = diffrange.begin[0] + vlines[ib][0];
-					dr.begin[1]  = diffrange.begin[1] + line1;
-					dr.begin[2]  = diffrange.begin[2] + vlines[ib][2];
-					dr.end[0]    = diffrange.begin[0] + vlines[i - 1][0];
-					dr.end[1]    = diffrange.begin[1] + line1 - 1;
-					dr.end[2]    = diffrange.begin[2] + vlines[i - 1][2];
-					dr.blank[0]  = dr.blank[1] = dr.blank[2] = -1;
-					dr.op        = op;
-					newDiffList.AddDiff(dr);
-				}
-				else if ((vlines[i][0] != DiffMap::GHOST_MAP_ENTRY) &&
-				         (vlines[i][1] != DiffMap::GHOST_MAP_ENTRY) &&
-				         (vlines[i][2] == DiffMap::GHOST_MAP_ENTRY))
-				{
-					while (i < vlines.size() &&
-					     (vlines[i][0] != DiffMap::GHOST_MAP_ENTRY) &&
-					     (vlines[i][1] != DiffMap::GHOST_MAP_ENTRY) &&
-					     (vlines[i][2] == DiffMap::GHOST_MAP_ENTRY) &&
-						 op == opary[i])
-					{
-						line0++;
-						line1++;
-						i++;
-					}
-					dr.begin[0]  = diffrange.begin[0] + vlines[ib][0];
-					dr.begin[1]  = diffrange.begin[1] + vlines[ib][1];
-					dr.begin[2]  = diffrange.begin[2] + line2;
-					dr.end[0]    = diffrange.begin[0] + vlines[i - 1][0];
-					dr.end[1]    = diffrange.begin[1] + vlines[i - 1][1];
-					dr.end[2]    = diffrange.begin[2] + line2 - 1;
-					dr.blank[0]  = dr.blank[1] = dr.blank[2] = -1;
-					dr.op        = op;
-					newDiffList.AddDiff(dr);
-				}
-				else if ((vlines[i][0] != DiffMap::GHOST_MAP_ENTRY) &&
-				         (vlines[i][1] == DiffMap::GHOST_MAP_ENTRY) &&
-				         (vlines[i][2] == DiffMap::GHOST_MAP_ENTRY))
-				{
-					while (i < vlines.size() &&
-					     (vlines[i][0] != DiffMap::GHOST_MAP_ENTRY) &&
-					     (vlines[i][1] == DiffMap::GHOST_MAP_ENTRY) &&
-				         (vlines[i][2] == DiffMap::GHOST_MAP_ENTRY) &&
-						 op == opary[i])
-					{
-						line0++;
-						i++;
-					}
-					dr.begin[0]  = diffrange.begin[0] + vlines[ib][0];
-					dr.begin[1]  = diffrange.begin[1] + line1;
-					dr.begin[2]  = diffrange.begin[2] + line2;
-					dr.end[0]    = diffrange.begin[0] + vlines[i - 1][0];
-					dr.end[1]    = diffrange.begin[1] + line1 - 1;
-					dr.end[2]    = diffrange.begin[2] + line2 - 1;
-					dr.blank[0]  = dr.blank[1] = dr.blank[2] = -1;
-					dr.op        = op;
-					newDiffList.AddDiff(dr);
-				}
-				else if ((vlines[i][0] == DiffMap::GHOST_MAP_ENTRY) &&
-				         (vlines[i][1] != DiffMap::GHOST_MAP_ENTRY) &&
-				         (vlines[i][2] == DiffMap::GHOST_MAP_ENTRY))
-				{
-					while (i < vlines.size() &&
-					     (vlines[i][0] == DiffMap::GHOST_MAP_ENTRY) &&
-					     (vlines[i][1] != DiffMap::GHOST_MAP_ENTRY) &&
-					     (vlines[i][2] == DiffMap::GHOST_MAP_ENTRY) &&
-						 op == opary[i])
-					{
-						line1++;
-						i++;
-					}
-					dr.begin[0]  = diffrange.begin[0] + line0;
-					dr.begin[1]  = diffrange.begin[1] + vlines[ib][1];
-					dr.begin[2]  = diffrange.begin[2] + line2;
-					dr.end[0]    = diffrange.begin[0] + line0 - 1;
-					dr.end[1]    = diffrange.begin[1] + vlines[i - 1][1];
-					dr.end[2]    = diffrange.begin[2] + line2 - 1;
-					dr.blank[0]  = dr.blank[1] = dr.blank[2] = -1;
-					dr.op        = op;
-					newDiffList.AddDiff(dr);
-				}
-				else if ((vlines[i][0] == DiffMap::GHOST_MAP_ENTRY) &&
-				         (vlines[i][1] == DiffMap::GHOST_MAP_ENTRY) &&
-				         (vlines[i][2] != DiffMap::GHOST_MAP_ENTRY))
-				{
-					while (i < vlines.size() &&
-					     (vlines[i][0] == DiffMap::GHOST_MAP_ENTRY) &&
-					     (vlines[i][1] == DiffMap::GHOST_MAP_ENTRY) &&
-					     (vlines[i][2] != DiffMap::GHOST_MAP_ENTRY) &&
-						 op == opary[i])
-					{
-						line2++;
-						i++;
-					}
-					dr.begin[0]  = diffrange.begin[0] + line0;
-					dr.begin[1]  = diffrange.begin[1] + line1;
-					dr.begin[2]  = diffrange.begin[2] + vlines[ib][2];
-					dr.end[0]    = diffrange.begin[0] + line0 - 1;
-					dr.end[1]    = diffrange.begin[1] + line1 - 1;
-					dr.end[2]    = diffrange.begin[2] + vlines[i - 1][2];
-					dr.blank[0]  = dr.blank[1] = dr.blank[2] = -1;
-					dr.op        = op;
-					newDiffList.AddDiff(dr);
-				}
-				else
-				{
-					assert(0);
-				}
-			}
-		}
-		else
-		{
-			newDiffList.AddDiff(diffrange);
-		}
-	}
-
-	// recreate m_diffList
-	m_diffList.Clear();
-	nDiffCount = newDiffList.GetSize();
-	for (nDiff = 0; nDiff < nDiffCount; nDiff++)
-		m_diffList.AddDiff(*newDiffList.DiffRangeAt(nDiff));
+	DivideDiffBlocks(m_diffList, m_nBuffers, nFirstDiff, nLastDiff,
+		[&](const DIFFRANGE& diffrange) { return DivideDiffBlock3way(diffrange, diffOptions); });
 }
 
 /**
- * @brief Return cost of making strings equal
- *
- * The cost of making them equal is the measure of their dissimilarity
- * which is their Levenshtein distance.
+ * @brief Divide a diff block to align similar lines. (3-way)
+ * @param [in] diffrange Diff block to divide.
+ * @param [in] diffOptions Options for comparing the aligned lines.
+ * @return Divided diff blocks, or the diff block itself.
  */
-int CMergeDoc::GetMatchCost(const DIFFRANGE& dr, int i0, int i1, int line0, int line1, const std::vector<WordDiff>& worddiffs)
+std::vector<DIFFRANGE> CMergeDoc::DivideDiffBlock3way(const DIFFRANGE & diffrange, const DIFFOPTIONS & diffOptions)
 {
-	int matchlen = 0;
-	WordDiff dummyWordDiff(0, 0, dr.begin[0], dr.begin[0], 0, 0, dr.begin[1], dr.begin[1]);
-	WordDiff& prevWordDiff = dummyWordDiff;
-	for (size_t i = 0; i < worddiffs.size(); ++i)
+	std::vector<DIFFRANGE> diffs;
+	// size map correctly (it will hold one entry for each left-side line
+	int nlines0 = diffrange.end[0] - diffrange.begin[0] + 1;
+	int nlines1 = diffrange.end[1] - diffrange.begin[1] + 1;
+	int nlines2 = diffrange.end[2] - diffrange.begin[2] + 1;
+	if ((nlines0 > 0) + (nlines1 > 0) + (nlines2 > 0) <= 1)
+	{
+		diffs.push_back(diffrange);
+		return diffs;
+	}
+
+	// Call worker to do all lines in block
+	int lo0 = 0, hi0 = nlines0 - 1;
+	int lo1 = 0, hi1 = nlines1 - 1;
+	int lo2 = 0, hi2 = nlines2 - 1;
+	const std::vector<WordDiff> worddiffs01 = GetWordDiffArrayInRange(diffrange.begin, diffrange.end, false, 0, 1);
+	const std::vector<WordDiff> worddiffs12 = GetWordDiffArrayInRange(diffrange.begin, diffrange.end, false, 1, 2);
+	const std::vector<WordDiff> worddiffs20 = GetWordDiffArrayInRange(diffrange.begin, diffrange.end, false, 2, 0);
+	DiffMap diffmap01, diffmap12, diffmap20;
+	diffmap01.InitDiffMap(nlines0);
+	diffmap12.InitDiffMap(nlines1);
+	diffmap20.InitDiffMap(nlines2);
+	AdjustDiffBlock(diffmap01, diffrange, LineMatchIndex(*m_ptBuf[0], diffrange, 0, 1, worddiffs01), 0, 1, lo0, hi0, lo1, hi1);
+	AdjustDiffBlock(diffmap12, diffrange, LineMatchIndex(*m_ptBuf[1], diffrange, 1, 2, worddiffs12), 1, 2, lo1, hi1, lo2, hi2);
+	AdjustDiffBlock(diffmap20, diffrange, LineMatchIndex(*m_ptBuf[2], diffrange, 2, 0, worddiffs20), 2, 0, lo2, hi2, lo0, hi0);
+	ValidateDiffMap(diffmap01);
+	ValidateDiffMap(diffmap12);
+	ValidateDiffMap(diffmap20);
+	std::vector<std::array<int, 3>> vlines = CreateVirtualLineToRealLineMap3way(diffmap01, diffmap12, diffmap20, nlines0, nlines1, nlines2);
+
+	std::vector<OP_TYPE> opary(vlines.size());
+	for (size_t i = 0; i < vlines.size(); ++i)
+		opary[i] = (diffrange.op == OP_TRIVIAL) ?
+			OP_TRIVIAL :
+			ComputeOpType3way(vlines, i, diffrange, diffOptions);
+	// divide diff blocks
+	int line0 = 0, line1 = 0, line2 = 0;
+	for (size_t i = 0; i < vlines.size();)
 	{
-		if ((prevWordDiff.endline[0] <= line0 && line0 <= worddiffs[i].beginline[0]) &&
-		    (prevWordDiff.endline[1] <= line1 && line1 <= worddiffs[i].beginline[1]) &&
-			(line0 - prevWordDiff.endline[0] == line1 - prevWordDiff.endline[1]))
+		DIFFRANGE dr;
+		size_t ib = i;
+		OP_TYPE op = opary[i];
+		if ((vlines[i][0] != DiffMap::GHOST_MAP_ENTRY) &&
+			(vlines[i][1] != DiffMap::GHOST_MAP_ENTRY) &&
+			(vlines[i][2] != DiffMap::GHOST_MAP_ENTRY))
 		{
-			if (line0 == worddiffs[i].beginline[0])
+			while (i < vlines.size() &&
+				(vlines[i][0] != DiffMap::GHOST_MAP_ENTRY) &&
+				(vlines[i][1] != DiffMap::GHOST_MAP_ENTRY) &&
+				(vlines[i][2] != DiffMap::GHOST_MAP_ENTRY) &&
+				op == opary[i])
 			{
-				matchlen += worddiffs[i].begin[0] - ((prevWordDiff.endline[0] == line0) ? prevWordDiff.end[0] : 0);
+				line0++;
+				line1++;
+				line2++;
+				i++;
 			}
-			else /* line0 < worddiffs[i].beginline[0] */
+			dr.begin[0]  = diffrange.begin[0] + vlines[ib][0];
+			dr.begin[1]  = diffrange.begin[1] + vlines[ib][1];
+			dr.begin[2]  = diffrange.begin[2] + vlines[ib][2];
+			dr.end[0]    = diffrange.begin[0] + vlines[i - 1][0];
+			dr.end[1]    = diffrange.begin[1] + vlines[i - 1][1];
+			dr.end[2]    = diffrange.begin[2] + vlines[i - 1][2];
+			dr.blank[0]  = dr.blank[1] = dr.blank[2] = -1;
+			dr.op        = op;
+			diffs.push_back(dr);
+		}
+		else if ((vlines[i][0] == DiffMap::GHOST_MAP_ENTRY) &&
+		         (vlines[i][1] != DiffMap::GHOST_MAP_ENTRY) &&
+		         (vlines[i][2] != DiffMap::GHOST_MAP_ENTRY))
+		{
+			while (i < vlines.size() &&
+			     (vlines[i][0] == DiffMap::GHOST_MAP_ENTRY) &&
+			     (vlines[i][1] != DiffMap::GHOST_MAP_ENTRY) &&
+			     (vlines[i][2] != DiffMap::GHOST_MAP_ENTRY) &&
+				 op == opary[i])
 			{
-				matchlen += m_ptBuf[i0]->GetFullLineLength(line0) - ((prevWordDiff.endline[0] == line0) ? prevWordDiff.end[0] : 0);
+				line1++;
+				line2++;
+				i++;
 			}
+			dr.begin[0]  = diffrange.begin[0] + line0;
+			dr.begin[1]  = diffrange.begin[1] + vlines[ib][1];
+			dr.begin[2]  = diffrange.begin[2] + vlines[ib][2];
+			dr.end[0]    = diffrange.begin[0] + line0 - 1;
+			dr.end[1]    = diffrange.begin[1] + vlines[i - 1][1];
+			dr.end[2]    = diffrange.begin[2] + vlines[i - 1][2];
+			dr.blank[0]  = dr.blank[1] = dr.blank[2] = -1;
+			dr.op        = op;
+			diffs.push_back(dr);
 		}
-		prevWordDiff = worddiffs[i];
-	}
-	if (worddiffs.empty())
-	{
-		if (line0 - dr.begin[i0] == line1 - dr.begin[i1])
-			matchlen += m_ptBuf[i0]->GetFullLineLength(line0);
-	}
-	else
-	{
-		if (prevWordDiff.endline[0] <= line0 && prevWordDiff.endline[1] <= line1 &&
-		    (line0 - prevWordDiff.endline[0] == line1 - prevWordDiff.endline[1]))
+		else if ((vlines[i][0] != DiffMap::GHOST_MAP_ENTRY) &&
+		         (vlines[i][1] == DiffMap::GHOST_MAP_ENTRY) &&
+		         (vlines[i][2] != DiffMap::GHOST_MAP_ENTRY))
 		{
-			matchlen += m_ptBuf[i0]->GetFullLineLength(line0) - ((prevWordDiff.endline[0] == line0) ? prevWordDiff.end[0] : 0);
+			while (i < vlines.size() &&
+			     (vlines[i][0] != DiffMap::GHOST_MAP_ENTRY) &&
+			     (vlines[i][1] == DiffMap::GHOST_MAP_ENTRY) &&
+			     (vlines[i][2] != DiffMap::GHOST_MAP_ENTRY) &&
+				 op == opary[i])
+			{
+				line0++;
+				line2++;
+				i++;
+			}
+			dr.begin[0]  = diffrange.begin[0] + vlines[ib][0];
+			dr.begin[1]  = diffrange.begin[1] + line1;
+			dr.begin[2]  = diffrange.begin[2] + vlines[ib][2];
+			dr.end[0]    = diffrange.begin[0] + vlines[i - 1][0];
+			dr.end[1]    = diffrange.begin[1] + line1 - 1;
+			dr.end[2]    = diffrange.begin[2] + vlines[i - 1][2];
+			dr.blank[0]  = dr.blank[1] = dr.blank[2] = -1;
+			dr.op        = op;
+			diffs.push_back(dr);
+		}
+		else if ((vlines[i][0] != DiffMap::GHOST_MAP_ENTRY) &&
+		         (vlines[i][1] != DiffMap::GHOST_MAP_ENTRY) &&
+		         (vlines[i][2] == DiffMap::GHOST_MAP_ENTRY))
+		{
+			while (i < vlines.size() &&
+			     (vlines[i][0] != DiffMap::GHOST_MAP_ENTRY) &&
+			     (vlines[i][1] != DiffMap::GHOST_MAP_ENTRY) &&
+			     (vlines[i][2] == DiffMap::GHOST_MAP_ENTRY) &&
+				 op == opary[i])
+			{
+				line0++;
+				line1++;
+				i++;
+			}
+			dr.begin[0]  = diffrange.begin[0] + vlines[ib][0];
+			dr.begin[1]  = diffrange.begin[1] + vlines[ib][1];
+			dr.begin[2]  = diffrange.begin[2] + line2;
+			dr.end[0]    = diffrange.begin[0] + vlines[i - 1][0];
+			dr.end[1]    = diffrange.begin[1] + vlines[i - 1][1];
+			dr.end[2]    = diffrange.begin[2] + line2 - 1;
+			dr.blank[0]  = dr.blank[1] = dr.blank[2] = -1;
+			dr.op        = op;
+			diffs.push_back(dr);
+		}
+		else if ((vlines[i][0] != DiffMap::GHOST_MAP_ENTRY) &&
+		         (vlines[i][1] == DiffMap::GHOST_MAP_ENTRY) &&
+		         (vlines[i][2] == DiffMap::GHOST_MAP_ENTRY))
+		{
+			while (i < vlines.size() &&
+			     (vlines[i][0] != DiffMap::GHOST_MAP_ENTRY) &&
+			     (vlines[i][1] == DiffMap::GHOST_MAP_ENTRY) &&
+		         (vlines[i][2] == DiffMap::GHOST_MAP_ENTRY) &&
+				 op == opary[i])
+			{
+				line0++;
+				i++;
+			}
+			dr.begin[0]  = diffrange.begin[0] + vlines[ib][0];
+			dr.begin[1]  = diffrange.begin[1] + line1;
+			dr.begin[2]  = diffrange.begin[2] + line2;
+			dr.end[0]    = diffrange.begin[0] + vlines[i - 1][0];
+			dr.end[1]    = diffrange.begin[1] + line1 - 1;
+			dr.end[2]    = diffrange.begin[2] + line2 - 1;
+			dr.blank[0]  = dr.blank[1] = dr.blank[2] = -1;
+			dr.op        = op;
+			diffs.push_back(dr);
+		}
+		else if ((vlines[i][0] == DiffMap::GHOST_MAP_ENTRY) &&
+		         (vlines[i][1] != DiffMap::GHOST_MAP_ENTRY) &&
+		         (vlines[i][2] == DiffMap::GHOST_MAP_ENTRY))
+		{
+			while (i < vlines.size() &&
+			     (vlines[i][0] == DiffMap::GHOST_MAP_ENTRY) &&
+			     (vlines[i][1] != DiffMap::GHOST_MAP_ENTRY) &&
+			     (vlines[i][2] == DiffMap::GHOST_MAP_ENTRY) &&
+				 op == opary[i])
+			{
+				line1++;
+				i++;
+			}
+			dr.begin[0]  = diffrange.begin[0] + line0;
+			dr.begin[1]  = diffrange.begin[1] + vlines[ib][1];
+			dr.begin[2]  = diffrange.begin[2] + line2;
+			dr.end[0]    = diffrange.begin[0] + line0 - 1;
+			dr.end[1]    = diffrange.begin[1] + vlines[i - 1][1];
+			dr.end[2]    = diffrange.begin[2] + line2 - 1;
+			dr.blank[0]  = dr.blank[1] = dr.blank[2] = -1;
+			dr.op        = op;
+			diffs.push_back(dr);
+		}
+		else if ((vlines[i][0] == DiffMap::GHOST_MAP_ENTRY) &&
+		         (vlines[i][1] == DiffMap::GHOST_MAP_ENTRY) &&
+		         (vlines[i][2] != DiffMap::GHOST_MAP_ENTRY))
+		{
+			while (i < vlines.size() &&
+			     (vlines[i][0] == DiffMap::GHOST_MAP_ENTRY) &&
+			     (vlines[i][1] == DiffMap::GHOST_MAP_ENTRY) &&
+			     (vlines[i][2] != DiffMap::GHOST_MAP_ENTRY) &&
+				 op == opary[i])
+			{
+				line2++;
+				i++;
+			}
+			dr.begin[0]  = diffrange.begin[0] + line0;
+			dr.begin[1]  = diffrange.begin[1] + line1;
+			dr.begin[2]  = diffrange.begin[2] + vlines[ib][2];
+			dr.end[0]    = diffrange.begin[0] + line0 - 1;
+			dr.end[1]    = diffrange.begin[1] + line1 - 1;
+			dr.end[2]    = diffrange.begin[2] + vlines[i - 1][2];
+			dr.blank[0]  = dr.blank[1] = dr.blank[2] = -1;
+			dr.op        = op;
+			diffs.push_back(dr);
+		}
+		else
+		{
+			assert(0);
 		}
 	}
-/*
-#ifdef _DEBUG
-	String str = strutils::format(_T("pane%d,%d line%5d,%5d match len: %d\n"), i0, i1, line0, line1, matchlen);
-	OutputDebugString(str.c_str());
-#endif
-*/
-	return -matchlen;
+	return diffs;
 }
 
 /**
@@ -736,7 +864,7 @@ int CMergeDoc::GetMatchCost(const DIFFRANGE& dr, int i0, int i1, int line0, int
  * Find best match, and use that to split problem into two parts (above & below match)
  * and call ourselves recursively to solve each smaller problem
  */
-void CMergeDoc::AdjustDiffBlock(DiffMap & diffMap, const DIFFRANGE & diffrange, const std::vector<WordDiff>& worddiffs, int i0, int i1, int lo0, int hi0, int lo1, int hi1)
+void CMergeDoc::AdjustDiffBlock(DiffMap & diffMap, const DIFFRANGE & diffrange, const LineMatchIndex& matches, int i0, int i1, int lo0, int hi0, int lo1, int hi1)
 {
 	// Map & lo & hi numbers are all relative to this block
 	// We need to know offsets to find actual line strings from buffer
@@ -807,28 +935,30 @@ void CMergeDoc::AdjustDiffBlock(DiffMap & diffMap, const DIFFRANGE & diffrange,
 		return;
 	}
 
-	// Find best fit
-	int ibest=-1, isavings=0x7fffffff, itarget=-1;
+	// Find best fit, the pair of lines with most matching characters
+	// Only the pairs listed by the index match anything, if none of them
+	// does the first pair is taken
+	int ibest=lo0, imatchlen=0, itarget=lo1;
 	for (int i=lo0; i<=hi0; ++i)
 	{
-		for (int j=lo1; j<=hi1; ++j)
+		for (const auto& match : matches.GetMatches(i))
 		{
-			int savings = GetMatchCost(diffrange, i0, i1, offset0 + i, offset1 + j, worddiffs);
+			int j = i + offset0 + match.nDiagonal - offset1;
+			if (j < lo1)
+				continue;
+			if (j > hi1)
+				break;
 			// TODO
 			// Need to penalize assignments that push us outside the box
 			// further than is required
-			if (savings < isavings)
+			if (match.nLength > imatchlen)
 			{
 				ibest = i;
 				itarget = j;
-				isavings = savings;
+				imatchlen = match.nLength;
 			}
 		}
 	}
-	// I think we have to find at least one
-	// because cost (Levenshtein distance) is less than or equal to maxlen
-	// so cost is always nonnegative
-	ASSERT(ibest >= 0);
 
 	ASSERT(diffMap.m_map[ibest] == DiffMap::BAD_MAP_ENTRY);
 
@@ -839,7 +969,7 @@ void CMergeDoc::AdjustDiffBlock(DiffMap & diffMap, const DIFFRANGE & diffrange,
 	{
 		if (lo1 < itarget)
 		{
-			AdjustDiffBlock(diffMap, diffrange, worddiffs, i0, i1, lo0, ibest-1, lo1, itarget-1);
+			AdjustDiffBlock(diffMap, diffrange, matches, i0, i1, lo0, ibest-1, lo1, itarget-1);
 		}
 		else
 		{
@@ -856,7 +986,7 @@ void CMergeDoc::AdjustDiffBlock(DiffMap & diffMap, const DIFFRANGE & diffrange,
 	{
 		if (itarget < hi1)
 		{
-			AdjustDiffBlock(diffMap, diffrange, worddiffs, i0, i1, ibest + 1, hi0,
+			AdjustDiffBlock(diffMap, diffrange, matches, i0, i1, ibest + 1, hi0,
 					itarget + 1, hi1);
 		}
 		else
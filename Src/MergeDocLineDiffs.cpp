@@ -9,11 +9,18 @@
 #include "MergeDoc.h"
 #include <vector>
 #include <memory>
+#include <atomic>
+#include <condition_variable>
+#include <algorithm>
+#include <Poco/Environment.h>
 #include "MergeEditView.h"
 #include "stringdiffs.h"
 #include "UnicodeString.h"
 #include "SubstitutionFiltersList.h"
 #include "Merge.h"
+#include "OptionsDef.h"
+#include "OptionsMgr.h"
+#include "WorkStealingPool.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -298,17 +305,280 @@ void CMergeDoc::Computelinediff(CMergeEditView *pView, std::pair<CEPoint, CEPoin
 	m_CurWordDiff.nWordDiff = nWordDiff;
 }
 
+/**
+ * @brief Texts of a line range and the options to compare them with.
+ * They are copied from the buffers, so the word diffs can be computed in
+ * another thread while the buffers are used.
+ */
+struct CMergeDoc::WordDiffInput
+{
+	int nPanes = 0; /**< Number of texts, 0 if the range is beyond the end of a buffer */
+	String str[3]; /**< Text of the lines in each pane */
+	std::vector<int> offsets[3]; /**< Offset of each line in str */
+	std::vector<int> lengths[3]; /**< Length of each line without EOL */
+	int begin[3] = {}; /**< First line */
+	int end[3] = {}; /**< Last line */
+	int lineCount[3] = {}; /**< Line count of the buffer */
+	bool casitive = true;
+	bool eolSensitive = true;
+	int xwhite = 0;
+	bool ignoreNumbers = false;
+	int breakType = 0;
+	bool byteColoring = false;
+};
+
+/**
+ * @brief Word diffs of diff blocks being computed in background threads.
+ * Jobs are taken in order by the first free thread, so the blocks nearest
+ * to the view are computed first.
+ */
+struct CMergeDoc::WordDiffPrecompute
+{
+	struct Job
+	{
+		int nDiff;
+		bool bPerLine; /**< Are the lines diffed one by one? */
+		WordDiffCacheEntry entry; /**< Entry to fill and add to the cache */
+		std::vector<WordDiffInput> inputs; /**< Whole block, or one for each line */
+	};
+	std::vector<Job> jobs;
+	std::atomic_size_t nNextJob{ 0 };
+	std::atomic_bool bCanceled{ false };
+	int nRunning = 0; /**< Number of tasks submitted and not finished */
+	std::mutex mutexRunning; /**< Guards nRunning */
+	std::condition_variable cvFinished; /**< Signaled when nRunning drops to zero */
+};
+
+/**
+ * @brief Threads computing the word diffs of all documents in the background.
+ * One pool is shared, so opening several documents does not start more
+ * threads than there are processors.
+ */
+static WorkStealingPool& GetWordDiffPool()
+{
+	static WorkStealingPool pool((std::max)(static_cast<int>(Poco::Environment::processorCount()) - 1, 1));
+	return pool;
+}
+
+/** @brief Max number of characters copied for background word diffs after a rescan. */
+static const size_t PRECOMPUTE_MAX_CHARS = 16 * 1024 * 1024;
+
 void CMergeDoc::ClearWordDiffCache(int nDiff/* = -1 */)
 {
 	if (nDiff == -1)
 	{
+		CancelWordDiffPrecompute();
+		std::lock_guard<std::mutex> lock(m_mutexWordDiffs);
 		m_cacheWordDiffs.clear();
 	}
 	else
 	{
-		std::map<int, std::vector<WordDiff> >::iterator it = m_cacheWordDiffs.find(nDiff);
-		if (it != m_cacheWordDiffs.end())
-			m_cacheWordDiffs.erase(it);
+		std::lock_guard<std::mutex> lock(m_mutexWordDiffs);
+		m_cacheWordDiffs.erase(nDiff);
+	}
+}
+
+/**
+ * @brief Stop computing word diffs in the background.
+ * Returns when the threads no longer touch the cache. The jobs check the
+ * cancel flag while diffing, so this only waits for a short time.
+ */
+void CMergeDoc::CancelWordDiffPrecompute()
+{
+	if (!m_pWordDiffPrecompute)
+		return;
+	WordDiffPrecompute& precompute = *m_pWordDiffPrecompute;
+	precompute.bCanceled = true;
+	{
+		std::unique_lock<std::mutex> lock(precompute.mutexRunning);
+		precompute.cvFinished.wait(lock, [&precompute]() { return precompute.nRunning == 0; });
+	}
+	m_pWordDiffPrecompute.reset();
+}
+
+/**
+ * @brief Make a cache entry for a diff block, without word diffs.
+ * The real line counts and line revision numbers tell whether the
+ * block's text has changed since.
+ */
+CMergeDoc::WordDiffCacheEntry CMergeDoc::MakeWordDiffCacheEntry(const DIFFRANGE& cd) const
+{
+	WordDiffCacheEntry entry;
+	entry.dbegin = cd.dbegin;
+	entry.dend = cd.dend;
+	entry.lines = {};
+	entry.revision = {};
+	for (int file = 0; file < m_nBuffers; file++)
+	{
+		entry.lines[file] = cd.end[file] - cd.begin[file];
+		const int nLineCount = m_ptBuf[file]->GetLineCount();
+		for (int nLine = cd.dbegin; nLine <= cd.dend && nLine < nLineCount; nLine++)
+			entry.revision[file] = (std::max)(entry.revision[file], m_ptBuf[file]->GetLineRevisionNumber(nLine));
+	}
+	return entry;
+}
+
+/**
+ * @brief Take the cache out of the document before a rescan.
+ * @sa RestoreWordDiffCache()
+ */
+CMergeDoc::WordDiffCache CMergeDoc::TakeWordDiffCache()
+{
+	CancelWordDiffPrecompute();
+	std::lock_guard<std::mutex> lock(m_mutexWordDiffs);
+	WordDiffCache cache;
+	cache.swap(m_cacheWordDiffs);
+	return cache;
+}
+
+/**
+ * @brief Put back the word diffs of diffs a rescan did not compare again.
+ * The diffs before the compared ones keep their index, the diffs after
+ * them keep their index from the end of the list. Their word diffs are
+ * moved with the blocks, unless the text of a block has changed.
+ * @param [in] oldCache Cache taken by TakeWordDiffCache().
+ * @param [in] nOldDiffs Diff count before the rescan.
+ * @param [in] nFirstNewDiff Index of the first diff compared again.
+ * @param [in] nUnchangedTailDiffs Count of diffs after the ones compared again.
+ */
+void CMergeDoc::RestoreWordDiffCache(WordDiffCache&& oldCache, int nOldDiffs, int nFirstNewDiff, int nUnchangedTailDiffs)
+{
+	const int nDiffs = m_diffList.GetSize();
+	const int nLastLine = m_ptBuf[0]->GetLineCount() - 1;
+	WordDiffCache cache;
+	for (auto& [nOldDiff, oldEntry] : oldCache)
+	{
+		int nDiff;
+		if (nOldDiff < nFirstNewDiff)
+			nDiff = nOldDiff;
+		else if (nOldDiff >= nOldDiffs - nUnchangedTailDiffs)
+			nDiff = nOldDiff - nOldDiffs + nDiffs;
+		else
+			continue;
+		if (nDiff < 0 || nDiff >= nDiffs)
+			continue;
+		const DIFFRANGE *pdr = m_diffList.DiffRangeAt(nDiff);
+		// Word diffs at the end of the last line depend on the line count
+		if (pdr->dend >= nLastLine || pdr->dend - pdr->dbegin != oldEntry.dend - oldEntry.dbegin)
+			continue;
+		WordDiffCacheEntry entry = MakeWordDiffCacheEntry(*pdr);
+		if (entry.lines != oldEntry.lines || entry.revision != oldEntry.revision)
+			continue;
+		const int nOffset = pdr->dbegin - oldEntry.dbegin;
+		entry.worddiffs = std::move(oldEntry.worddiffs);
+		entry.lineStarts = std::move(oldEntry.lineStarts);
+		for (auto& wd : entry.worddiffs)
+		{
+			for (int i = 0; i < 3; i++)
+			{
+				wd.beginline[i] += nOffset;
+				wd.endline[i] += nOffset;
+			}
+		}
+		cache.emplace(nDiff, std::move(entry));
+	}
+	std::lock_guard<std::mutex> lock(m_mutexWordDiffs);
+	m_cacheWordDiffs.swap(cache);
+}
+
+/**
+ * @brief Start computing the word diffs of all diff blocks in background
+ * threads, after a rescan.
+ * The texts of the blocks are copied first, starting from the block
+ * nearest to the middle of the active view, and the threads compute them
+ * in the same order. Blocks far from the view are left to be computed on
+ * demand if there is too much text.
+ */
+void CMergeDoc::PrecomputeWordDiffs()
+{
+	CancelWordDiffPrecompute();
+
+	const int nDiffs = m_diffList.GetSize();
+	if (nDiffs == 0 || !GetOptionsMgr()->GetBool(OPT_WORDDIFF_HIGHLIGHT))
+		return;
+	CMergeEditView *pView = GetActiveMergeView();
+	const int nCenter = pView->GetTopLine() + pView->GetScreenLines() / 2;
+	std::vector<std::pair<int, int>> order; // distance from the center, diff
+	{
+		std::lock_guard<std::mutex> lock(m_mutexWordDiffs);
+		for (int nDiff = 0; nDiff < nDiffs; nDiff++)
+		{
+			if (m_cacheWordDiffs.find(nDiff) != m_cacheWordDiffs.end())
+				continue;
+			const DIFFRANGE *pdr = m_diffList.DiffRangeAt(nDiff);
+			const int nDistance = (pdr->dend < nCenter) ? nCenter - pdr->dend : (std::max)(pdr->dbegin - nCenter, 0);
+			order.emplace_back(nDistance, nDiff);
+		}
+	}
+	std::sort(order.begin(), order.end());
+
+	const bool bTableEditing = m_ptBuf[0]->GetTableEditing();
+	auto pPrecompute = std::make_shared<WordDiffPrecompute>();
+	size_t nChars = 0;
+	for (const auto& [nDistance, nDiff] : order)
+	{
+		if (nChars >= PRECOMPUTE_MAX_CHARS)
+			break;
+		const DIFFRANGE& cd = *m_diffList.DiffRangeAt(nDiff);
+		const bool diffPerLine = IsDiffPerLine(bTableEditing, cd);
+		WordDiffPrecompute::Job job{ nDiff, diffPerLine, MakeWordDiffCacheEntry(cd) };
+		for (int nLine = cd.dbegin; nLine <= (diffPerLine ? cd.dend : cd.dbegin); nLine++)
+		{
+			int nLineBegin[3]{}, nLineEnd[3]{};
+			for (int pane = 0; pane < m_nBuffers; ++pane)
+			{
+				nLineBegin[pane] = nLine;
+				nLineEnd[pane] = diffPerLine ? nLine : cd.dend;
+			}
+			job.inputs.emplace_back();
+			GetWordDiffInput(nLineBegin, nLineEnd, false, -1, -1, job.inputs.back());
+			for (int i = 0; i < job.inputs.back().nPanes; i++)
+				nChars += job.inputs.back().str[i].length();
+		}
+		pPrecompute->jobs.push_back(std::move(job));
+	}
+
+	WorkStealingPool& pool = GetWordDiffPool();
+	m_pWordDiffPrecompute = pPrecompute;
+	const int nThreads = (std::min)(pool.GetThreadCount(), static_cast<int>(pPrecompute->jobs.size()));
+	pPrecompute->nRunning = nThreads;
+	for (int i = 0; i < nThreads; i++)
+	{
+		pool.Submit([this, pPrecompute]() {
+			try
+			{
+				for (;;)
+				{
+					const size_t nJob = pPrecompute->nNextJob++;
+					if (nJob >= pPrecompute->jobs.size())
+						break;
+					WordDiffPrecompute::Job& job = pPrecompute->jobs[nJob];
+					for (const auto& input : job.inputs)
+					{
+						if (pPrecompute->bCanceled)
+							break;
+						std::vector<WordDiff> worddiffs = ComputeWordDiffArray(input, &pPrecompute->bCanceled);
+						if (job.bPerLine)
+							job.entry.lineStarts.push_back(static_cast<int>(job.entry.worddiffs.size()));
+						job.entry.worddiffs.insert(job.entry.worddiffs.end(), worddiffs.begin(), worddiffs.end());
+					}
+					if (job.bPerLine)
+						job.entry.lineStarts.push_back(static_cast<int>(job.entry.worddiffs.size()));
+					job.inputs.clear();
+					std::lock_guard<std::mutex> lock(m_mutexWordDiffs);
+					if (pPrecompute->bCanceled)
+						break;
+					m_cacheWordDiffs.emplace(job.nDiff, std::move(job.entry));
+				}
+			}
+			catch (...)
+			{
+				// Word diffs not precomputed are computed when shown
+			}
+			std::lock_guard<std::mutex> lock(pPrecompute->mutexRunning);
+			if (--pPrecompute->nRunning == 0)
+				pPrecompute->cvFinished.notify_all();
+		});
 	}
 }
 
@@ -321,79 +591,124 @@ std::vector<WordDiff> CMergeDoc::GetWordDiffArrayInDiffBlock(int nDiff, bool ign
 	if (!diffPerLine)
 		return GetWordDiffArray(cd.dbegin, ignoreDiffOptions);
 
-	std::vector<WordDiff> worddiffs;
+	if (!ignoreDiffOptions)
+	{
+		std::lock_guard<std::mutex> lock(m_mutexWordDiffs);
+		auto it = m_cacheWordDiffs.find(nDiff);
+		if (it != m_cacheWordDiffs.end() && it->second.dbegin == cd.dbegin && it->second.dend == cd.dend)
+			return it->second.worddiffs;
+	}
+
+	WordDiffCacheEntry entry = MakeWordDiffCacheEntry(cd);
 	for (int nLine = cd.dbegin; nLine <= cd.dend; ++nLine)
 	{
-		std::vector<WordDiff> worddiffsPerLine = GetWordDiffArray(nLine, ignoreDiffOptions);
-		worddiffs.insert(worddiffs.end(), worddiffsPerLine.begin(), worddiffsPerLine.end());
+		int nLineBegin[3]{}, nLineEnd[3]{};
+		for (int pane = 0; pane < m_nBuffers; ++pane)
+			nLineBegin[pane] = nLineEnd[pane] = nLine;
+		std::vector<WordDiff> worddiffsPerLine = GetWordDiffArrayInRange(nLineBegin, nLineEnd, ignoreDiffOptions);
+		entry.lineStarts.push_back(static_cast<int>(entry.worddiffs.size()));
+		entry.worddiffs.insert(entry.worddiffs.end(), worddiffsPerLine.begin(), worddiffsPerLine.end());
+	}
+	entry.lineStarts.push_back(static_cast<int>(entry.worddiffs.size()));
+	std::vector<WordDiff> worddiffs = entry.worddiffs;
+
+	if (!ignoreDiffOptions)
+	{
+		std::lock_guard<std::mutex> lock(m_mutexWordDiffs);
+		m_cacheWordDiffs[nDiff] = std::move(entry);
 	}
 	return worddiffs;
 }
 
-std::vector<WordDiff>
-CMergeDoc::GetWordDiffArrayInRange(const int begin[3], const int end[3], bool ignoreDiffOptions/*=false*/, int pane1/*=-1*/, int pane2/*=-1*/)
+/**
+ * @brief Copy the texts of a line range and the compare options.
+ * @return false if the range is beyond the end of a buffer, the input has
+ * no texts then.
+ */
+bool CMergeDoc::GetWordDiffInput(const int begin[3], const int end[3], bool ignoreDiffOptions, int pane1, int pane2, WordDiffInput& input)
 {
 	DIFFOPTIONS diffOptions = {0};
 	m_diffWrapper.GetOptions(&diffOptions);
-	String str[3];
-	std::unique_ptr<int[]> nOffsets[3];
-	std::vector<WordDiff> worddiffs;
 	std::vector<int> panes;
 	if (pane1 == -1 && pane2 == -1)
 		panes = (m_nBuffers == 2) ? std::vector<int>{0, 1} : std::vector<int>{ 0, 1, 2 };
 	else
 		panes = std::vector<int>{ pane1, pane2 };
+	input.nPanes = 0;
 	for (size_t i = 0; i < panes.size(); ++i)
 	{
 		int file = panes[i];
 		int nLineBegin = begin[file];
 		int nLineEnd = end[file];
-		if (nLineEnd >= m_ptBuf[file]->GetLineCount())
-			return worddiffs;
-		nOffsets[file].reset(new int[nLineEnd - nLineBegin + 1]);
+		const int nLineCount = m_ptBuf[file]->GetLineCount();
+		if (nLineEnd >= nLineCount)
+			return false;
+		std::vector<int>& offsets = input.offsets[i];
+		std::vector<int>& lengths = input.lengths[i];
+		offsets.assign((std::max)(nLineEnd - nLineBegin + 1, 1), 0);
+		lengths.assign(offsets.size(), 0);
 		String strText;
 		if (nLineBegin <= nLineEnd)
 		{
 			if (nLineBegin != nLineEnd || m_ptBuf[file]->GetLineLength(nLineEnd) > 0)
 				m_ptBuf[file]->GetTextWithoutEmptys(nLineBegin, 0, nLineEnd, m_ptBuf[file]->GetLineLength(nLineEnd), strText);
 			strText += m_ptBuf[file]->GetLineEol(nLineEnd);
-			nOffsets[file][0] = 0;
 		}
-		str[i] = std::move(strText);
+		input.str[i] = std::move(strText);
 		for (int nLine = nLineBegin; nLine < nLineEnd; nLine++)
-			nOffsets[file][nLine-nLineBegin+1] = nOffsets[file][nLine-nLineBegin] + m_ptBuf[file]->GetFullLineLength(nLine);
+			offsets[nLine-nLineBegin+1] = offsets[nLine-nLineBegin] + m_ptBuf[file]->GetFullLineLength(nLine);
+		for (int nLine = nLineBegin; nLine < nLineBegin + static_cast<int>(lengths.size()); nLine++)
+			lengths[nLine-nLineBegin] = nLine < nLineCount ? m_ptBuf[file]->GetLineLength(nLine) : 0;
+		input.begin[i] = nLineBegin;
+		input.end[i] = nLineEnd;
+		input.lineCount[i] = nLineCount;
 	}
+	input.nPanes = static_cast<int>(panes.size());
 
 	// Options that affect comparison
-	bool casitive = ignoreDiffOptions ? false : !diffOptions.bIgnoreCase;
-	bool eolSensitive = ignoreDiffOptions ? true : !diffOptions.bIgnoreEol;
-	int xwhite = ignoreDiffOptions ? 0 : diffOptions.nIgnoreWhitespace;
-	int breakType = GetBreakType(); // whitespace only or include punctuation
-	bool byteColoring = GetByteColoringOption();
+	input.casitive = ignoreDiffOptions ? false : !diffOptions.bIgnoreCase;
+	input.eolSensitive = ignoreDiffOptions ? true : !diffOptions.bIgnoreEol;
+	input.xwhite = ignoreDiffOptions ? 0 : diffOptions.nIgnoreWhitespace;
+	input.ignoreNumbers = diffOptions.bIgnoreNumbers;
+	input.breakType = GetBreakType(); // whitespace only or include punctuation
+	input.byteColoring = GetByteColoringOption();
+	return true;
+}
+
+/**
+ * @brief Compute the word diffs of copied texts.
+ * Uses only @p input, so it can be called from any thread.
+ */
+std::vector<WordDiff> CMergeDoc::ComputeWordDiffArray(const WordDiffInput& input, const std::atomic_bool *pCanceled/* = nullptr*/)
+{
+	std::vector<WordDiff> worddiffs;
+	if (input.nPanes == 0)
+		return worddiffs;
 
 	// Make the call to stringdiffs, which does all the hard & tedious computations
 	std::vector<strdiff::wdiff> wdiffs =
-		strdiff::ComputeWordDiffs(static_cast<int>(panes.size()), str, casitive, eolSensitive, xwhite, diffOptions.bIgnoreNumbers, breakType, byteColoring);
+		strdiff::ComputeWordDiffs(input.nPanes, input.str, input.casitive, input.eolSensitive, input.xwhite, input.ignoreNumbers, input.breakType, input.byteColoring, pCanceled);
 
 	std::vector<strdiff::wdiff>::iterator it;
 	for (it = wdiffs.begin(); it != wdiffs.end(); ++it)
 	{
 		WordDiff wd;
-		for (size_t i = 0; i < panes.size(); ++i)
+		for (int i = 0; i < input.nPanes; ++i)
 		{
-			int file = panes[i];
-			int nLineBegin = begin[file];
-			int nLineEnd = end[file];
+			const std::vector<int>& offsets = input.offsets[i];
+			const std::vector<int>& lengths = input.lengths[i];
+			int nLineBegin = input.begin[i];
+			int nLineEnd = input.end[i];
 			int nLine;
 			for (nLine = nLineBegin; nLine < nLineEnd; nLine++)
 			{
-				if (it->begin[i] == nOffsets[file][nLine-nLineBegin] || it->begin[i] < nOffsets[file][nLine-nLineBegin+1])
+				if (it->begin[i] == offsets[nLine-nLineBegin] || it->begin[i] < offsets[nLine-nLineBegin+1])
 					break;
 			}
 			wd.beginline[i] = nLine;
-			wd.begin[i] = it->begin[i] - nOffsets[file][nLine-nLineBegin];
-			const int nLineCount = m_ptBuf[file]->GetLineCount();
-			const int nLineLength1 = nLine < nLineCount ? m_ptBuf[file]->GetLineLength(nLine) : 0;
+			wd.begin[i] = it->begin[i] - offsets[nLine-nLineBegin];
+			const int nLineCount = input.lineCount[i];
+			const int nLineLength1 = lengths[nLine-nLineBegin];
 			if (nLineLength1 < wd.begin[i])
 			{
 				if (wd.beginline[i] < nLineCount - 1)
@@ -409,12 +724,12 @@ CMergeDoc::GetWordDiffArrayInRange(const int begin[3], const int end[3], bool ig
 
 			for (; nLine < nLineEnd; nLine++)
 			{
-				if (it->end[i] + 1 == nOffsets[file][nLine-nLineBegin] || it->end[i] + 1 < nOffsets[file][nLine-nLineBegin+1])
+				if (it->end[i] + 1 == offsets[nLine-nLineBegin] || it->end[i] + 1 < offsets[nLine-nLineBegin+1])
 					break;
 			}
 			wd.endline[i] = nLine;
-			wd.end[i] = it->end[i]  + 1 - nOffsets[file][nLine-nLineBegin];
-			const int nLineLength2 = nLine < nLineCount ? m_ptBuf[file]->GetLineLength(nLine) : 0;
+			wd.end[i] = it->end[i]  + 1 - offsets[nLine-nLineBegin];
+			const int nLineLength2 = lengths[nLine-nLineBegin];
 			if (nLineLength2 < wd.end[i])
 			{
 				if (wd.endline[i] < nLineCount - 1)
@@ -435,6 +750,15 @@ CMergeDoc::GetWordDiffArrayInRange(const int begin[3], const int end[3], bool ig
 	return worddiffs;
 }
 
+std::vector<WordDiff>
+CMergeDoc::GetWordDiffArrayInRange(const int begin[3], const int end[3], bool ignoreDiffOptions/*=false*/, int pane1/*=-1*/, int pane2/*=-1*/)
+{
+	WordDiffInput input;
+	if (!GetWordDiffInput(begin, end, ignoreDiffOptions, pane1, pane2, input))
+		return std::vector<WordDiff>();
+	return ComputeWordDiffArray(input);
+}
+
 /**
  * @brief Return array of differences in specified line
  * This is used by algorithm for line diff coloring
@@ -455,19 +779,23 @@ std::vector<WordDiff> CMergeDoc::GetWordDiffArray(int nLineIndex, bool ignoreDif
 	int nDiff = m_diffList.LineToDiff(nLineIndex);
 	if (nDiff == -1)
 		return worddiffs;
+
+	m_diffList.GetDiff(nDiff, cd);
+
 	if (!ignoreDiffOptions)
 	{
-		std::map<int, std::vector<WordDiff> >::iterator itmap = m_cacheWordDiffs.find(nDiff);
-		if (itmap != m_cacheWordDiffs.end())
+		std::lock_guard<std::mutex> lock(m_mutexWordDiffs);
+		auto itmap = m_cacheWordDiffs.find(nDiff);
+		if (itmap != m_cacheWordDiffs.end() && itmap->second.dbegin == cd.dbegin && itmap->second.dend == cd.dend)
 		{
-			worddiffs.resize((*itmap).second.size());
-			std::copy((*itmap).second.begin(), (*itmap).second.end(), worddiffs.begin());
-			return worddiffs;
+			const WordDiffCacheEntry& entry = itmap->second;
+			if (entry.lineStarts.empty())
+				return entry.worddiffs;
+			const int nLine = nLineIndex - cd.dbegin;
+			return std::vector<WordDiff>(entry.worddiffs.begin() + entry.lineStarts[nLine], entry.worddiffs.begin() + entry.lineStarts[nLine + 1]);
 		}
 	}
 
-	m_diffList.GetDiff(nDiff, cd);
-
 	bool diffPerLine = IsDiffPerLine(m_ptBuf[0]->GetTableEditing(), cd);
 
 	int nLineBegin[3]{}, nLineEnd[3]{};
@@ -491,10 +819,11 @@ std::vector<WordDiff> CMergeDoc::GetWordDiffArray(int nLineIndex, bool ignoreDif
 
 	if (!diffPerLine && !ignoreDiffOptions)
 	{
-		m_cacheWordDiffs[nDiff].resize(worddiffs.size());
-		std::copy(worddiffs.begin(), worddiffs.end(), m_cacheWordDiffs[nDiff].begin());
+		WordDiffCacheEntry entry = MakeWordDiffCacheEntry(cd);
+		entry.worddiffs = worddiffs;
+		std::lock_guard<std::mutex> lock(m_mutexWordDiffs);
+		m_cacheWordDiffs[nDiff] = std::move(entry);
 	}
 
 	return worddiffs;
 }
-
@@ -2439,7 +2439,7 @@ void CMergeEditView::OnEditOperation(int nAction, const tchar_t* pszText, size_t
 			nAction == CE_ACTION_CUT)
 		{
 			if (!SetTimer(IDT_RESCAN, RESCAN_TIMEOUT, nullptr))
-				pDoc->FlushAndRescan();
+				pDoc->FlushAndRescan(false, true);
 		}
 		else
 			pDoc->FlushAndRescan();
@@ -3990,10 +3990,11 @@ int CMergeEditView::GetEmptySubLines( int nLineIndex )
 }
 
 /**
- * @brief Invalidate sub line index cache from the specified index to the end of file.
- * @param [in] nLineIndex Index of the first line to invalidate 
+ * @brief Invalidate the sub line counts of the specified lines in the sub line index cache.
+ * @param [in] nLineIndex1 Index of the first line to invalidate
+ * @param [in] nLineIndex2 Index of the last line to invalidate, -1 for the end of file
  */
-void CMergeEditView::InvalidateSubLineIndexCache( int nLineIndex )
+void CMergeEditView::InvalidateSubLineIndexCache( int nLineIndex1, int nLineIndex2 )
 {
 	CMergeDoc * pDoc = GetDocument();
 	ASSERT(pDoc != nullptr);
@@ -4003,7 +4004,31 @@ void CMergeEditView::InvalidateSubLineIndexCache( int nLineIndex )
 	{
 		CMergeEditView *pView = GetGroupView(nPane);
 		if (pView != nullptr)
-			pView->CCrystalTextView::InvalidateSubLineIndexCache( nLineIndex );
+			pView->CCrystalTextView::InvalidateSubLineIndexCache( nLineIndex1, nLineIndex2 );
+	}
+}
+
+/**
+ * @brief Move the cached sub line counts of the lines below an insert or delete.
+ * The empty sub lines of all panes are aligned by line index, so the sub line
+ * index of every pane, this one included, changes from the moved lines to the
+ * end of file. The wrapped line counts are kept, so no lines are wrapped again.
+ * @param [in] nLineIndex Index of the line the lines are inserted or deleted at
+ * @param [in] nLineDelta # of lines inserted, negative for deleted lines
+ */
+void CMergeEditView::MoveLineCache( int nLineIndex, int nLineDelta )
+{
+	CCrystalTextView::MoveLineCache( nLineIndex, nLineDelta );
+	if (nLineDelta == 0)
+		return;
+
+	CMergeDoc * pDoc = GetDocument();
+	ASSERT(pDoc != nullptr);
+	for (int nPane = 0; nPane < pDoc->m_nBuffers; nPane++) 
+	{
+		CMergeEditView *pView = GetGroupView(nPane);
+		if (pView != nullptr)
+			pView->CCrystalTextView::InvalidateSubLineIndexCache( nLineIndex, -1 );
 	}
 }
 
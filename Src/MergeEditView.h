@@ -135,7 +135,8 @@ public:
 	using CCrystalTextView::GetSubLineIndex;
 	using CCrystalTextView::GetLineBySubLine;
 	virtual int GetEmptySubLines( int nLineIndex ) override;
-	virtual void InvalidateSubLineIndexCache( int nLineIndex ) override;
+	virtual void InvalidateSubLineIndexCache( int nLineIndex1, int nLineIndex2 ) override;
+	virtual void MoveLineCache( int nLineIndex, int nLineDelta ) override;
 	void RepaintLocationPane();
 	void DocumentsLoaded();
 	void UpdateLocationViewPosition(int nTopLine = -1, int nBottomLine = -1);
@@ -6,89 +6,92 @@
  */
 
 #include "pch.h"
-#include <map>
+#include <vector>
+#include <algorithm>
 #include <cassert>
 #include "diff.h"
 
-class IntSet
-{
-public:
-	void Add(int val) { m_map[val] = 1; }
-	void Remove(int val) { m_map.erase(val); }
-	size_t count() const { return m_map.size(); }
-	bool isPresent(int val) const { return m_map.find(val) != m_map.end(); }
-	int getSingle() const { return m_map.begin()->first; }
-private:
-	std::map<int, int> m_map;
-};
-
 /** 
  * @brief  Set of equivalent lines
- * This uses diffutils line numbers, which are counted from the prefix
+ * This uses diffutils line numbers, which are counted from the prefix.
+ * Lines are never removed from a group, so only the number of lines on
+ * each side and the first of them are needed to find perfect matches.
  */
 struct EqGroup
 {
-	IntSet m_lines0; // equivalent lines on side#0
-	IntSet m_lines1; // equivalent lines on side#1
+	int m_count[2] = {}; // number of equivalent lines on side#0 and side#1
+	int m_line[2] = {}; // first equivalent line on side#0 and side#1
 
-	bool isPerfectMatch() const { return m_lines0.count()==1 && m_lines1.count()==1; }
+	bool isPerfectMatch() const { return m_count[0]==1 && m_count[1]==1; }
+	int getSingle(int nside) const { return m_line[nside]; }
 };
 
 
-/** @brief  Maps equivalency code to equivalency group */
+/**
+ * @brief  Maps equivalency code to equivalency group
+ * Equivalency codes are indexes below file_data::equiv_max, so the groups
+ * are stored in a vector indexed by code.
+ */
 class CodeToGroupMap
 {
 public:
-	std::map<int, EqGroup *> m_map;
+	explicit CodeToGroupMap(int equivMax)
+	{
+		m_groups.reserve(equivMax > 0 ? equivMax : 0);
+	}
+
 	/** @brief Add a line to the appropriate equivalency group */
 	void Add(int lineno, int eqcode, int nside)
 	{
-		EqGroup *pgroup = find(eqcode);
-		if (pgroup == nullptr)
-		{
-			pgroup = new EqGroup;
-			m_map[eqcode] = pgroup;
-		}
-		if (nside)
-			pgroup->m_lines1.Add(lineno);
-		else
-			pgroup->m_lines0.Add(lineno);
+		assert(eqcode >= 0);
+		if (eqcode >= static_cast<int>(m_groups.size()))
+			m_groups.resize(eqcode + 1);
+		EqGroup& group = m_groups[eqcode];
+		if (group.m_count[nside]++ == 0)
+			group.m_line[nside] = lineno;
 	}
 
 	/** @brief Return the appropriate equivalency group */
-	EqGroup * find(int eqcode)
+	const EqGroup& find(int eqcode) const
 	{
-		std::map<int, EqGroup *>::const_iterator it = m_map.find(eqcode);
-		return it != m_map.end() ? it->second : nullptr;
+		return m_groups[eqcode];
 	}
 
-	~CodeToGroupMap()
-	{
-		std::map<int, EqGroup *>::const_iterator pos = m_map.begin();
-		while (pos != m_map.end())
-			delete pos++->second;
-	}
+private:
+	std::vector<EqGroup> m_groups;
 };
 
-static bool isLineInDiffBlock(int nside, int lineno, change *script)
+/**
+ * @brief  Index of the lines of one side which are in diff blocks
+ * Splitting diff blocks into moved and non-moved parts does not change
+ * which lines are in a diff block, so the index is built once.
+ */
+class DiffBlockIndex
 {
-	change *p = nullptr;
-	for (change *e = script; e; e = p)
+public:
+	DiffBlockIndex(const change *script, int nside)
 	{
-		p = e->link;
-		if (nside == 0)
+		for (const change *e = script; e; e = e->link)
 		{
-			if (e->line0 <= lineno && lineno < e->line0 + e->deleted)
-				return true;
-		}
-		else
-		{
-			if (e->line1 <= lineno && lineno < e->line1 + e->inserted)
-				return true;
+			int line = nside ? e->line1 : e->line0;
+			int count = nside ? e->inserted : e->deleted;
+			if (count > 0)
+				m_ranges.emplace_back(line, line + count);
 		}
+		std::sort(m_ranges.begin(), m_ranges.end());
 	}
-	return false;
-}
+
+	/** @brief Return true if the line is in a diff block */
+	bool isLineInDiffBlock(int lineno) const
+	{
+		auto it = std::upper_bound(m_ranges.begin(), m_ranges.end(), lineno,
+			[](int line, const std::pair<int, int>& range) { return line < range.second; });
+		return it != m_ranges.end() && it->first <= lineno;
+	}
+
+private:
+	std::vector<std::pair<int, int>> m_ranges; // sorted, non-overlapping [begin, end) line ranges
+};
 
 /*
  WinMerge moved block code
@@ -103,7 +106,7 @@ static bool isLineInDiffBlock(int nside, int lineno, change *script)
 extern "C" void moved_block_analysis(struct change ** pscript, struct file_data fd[])
 {
 	// Hash all altered lines
-	CodeToGroupMap map;
+	CodeToGroupMap map((std::max)(fd[0].equiv_max, fd[1].equiv_max));
 
 	struct change * script = *pscript;
 	struct change *p,*e;
@@ -116,6 +119,8 @@ extern "C" void moved_block_analysis(struct change ** pscript, struct file_data
 		for (i = e->line1; i - (e->line1) < (e->inserted); ++i)
 			map.Add(i, fd[1].equivs[i], 1);
 	}
+	const DiffBlockIndex blocks0(script, 0);
+	const DiffBlockIndex blocks1(script, 1);
 
 
 	// Scan through diff blocks, finding moved sections from left side
@@ -125,14 +130,14 @@ extern "C" void moved_block_analysis(struct change ** pscript, struct file_data
 	{
 		// scan down block for a match
 		p = e->link;
-		EqGroup * pgroup = nullptr;
+		const EqGroup * pgroup = nullptr;
 		int i=0;
 		for (i=e->line0; i-(e->line0) < (e->deleted); ++i)
 		{
-			EqGroup * tempgroup = map.find(fd[0].equivs[i]);
-			if (tempgroup->isPerfectMatch())
+			const EqGroup & tempgroup = map.find(fd[0].equivs[i]);
+			if (tempgroup.isPerfectMatch())
 			{
-				pgroup = tempgroup;
+				pgroup = &tempgroup;
 				break;
 			}
 		}
@@ -142,7 +147,7 @@ extern "C" void moved_block_analysis(struct change ** pscript, struct file_data
 			continue;
 
 		// found a match
-		int j = pgroup->m_lines1.getSingle();
+		int j = pgroup->getSingle(1);
 		// Ok, now our moved block is the single line i,j
 
 		// extend moved block upward as far as possible
@@ -150,12 +155,8 @@ extern "C" void moved_block_analysis(struct change ** pscript, struct file_data
 		int j1 = j-1;
 		for ( ; i1>=e->line0; --i1, --j1)
 		{
-			EqGroup * pgroup0 = map.find(fd[0].equivs[i1]);
-			EqGroup * pgroup1 = map.find(fd[1].equivs[j1]);
-			if (pgroup0 != pgroup1 || !isLineInDiffBlock(1, j1, script))
+			if (!blocks1.isLineInDiffBlock(j1) || fd[0].equivs[i1] != fd[1].equivs[j1])
 				break;
-//			pgroup0->m_lines0.Remove(i1); // commented out this line although I'm not sure what this line means because this line causes the bug sf.net#2174
-//			pgroup1->m_lines1.Remove(j1);
 		}
 		++i1;
 		++j1;
@@ -166,12 +167,8 @@ extern "C" void moved_block_analysis(struct change ** pscript, struct file_data
 		int j2 = j+1;
 		for ( ; i2-(e->line0) < (e->deleted); ++i2,++j2)
 		{
-			EqGroup * pgroup0 = map.find(fd[0].equivs[i2]);
-			EqGroup * pgroup1 = map.find(fd[1].equivs[j2]);
-			if (pgroup0 != pgroup1 || !isLineInDiffBlock(1, j2, script))
+			if (!blocks1.isLineInDiffBlock(j2) || fd[0].equivs[i2] != fd[1].equivs[j2])
 				break;
-//			pgroup0->m_lines0.Remove(i2); // commented out this line although I'm not sure what this line means because this line causes the bug sf.net#2174
-//			pgroup1->m_lines1.Remove(j2);
 		}
 		--i2;
 		--j2;
@@ -243,14 +240,14 @@ extern "C" void moved_block_analysis(struct change ** pscript, struct file_data
 	{
 		// scan down block for a match
 		p = e->link;
-		EqGroup * pgroup = nullptr;
+		const EqGroup * pgroup = nullptr;
 		int j=0;
 		for (j=e->line1; j-(e->line1) < (e->inserted); ++j)
 		{
-			EqGroup * tempgroup = map.find(fd[1].equivs[j]);
-			if (tempgroup->isPerfectMatch())
+			const EqGroup & tempgroup = map.find(fd[1].equivs[j]);
+			if (tempgroup.isPerfectMatch())
 			{
-				pgroup = tempgroup;
+				pgroup = &tempgroup;
 				break;
 			}
 		}
@@ -260,7 +257,7 @@ extern "C" void moved_block_analysis(struct change ** pscript, struct file_data
 			continue;
 
 		// found a match
-		int i = pgroup->m_lines0.getSingle();
+		int i = pgroup->getSingle(0);
 		// Ok, now our moved block is the single line i,j
 
 		// extend moved block upward as far as possible
@@ -268,12 +265,8 @@ extern "C" void moved_block_analysis(struct change ** pscript, struct file_data
 		int j1 = j-1;
 		for ( ; j1>=e->line1; --i1, --j1)
 		{
-			EqGroup * pgroup0 = map.find(fd[0].equivs[i1]);
-			EqGroup * pgroup1 = map.find(fd[1].equivs[j1]);
-			if (pgroup0 != pgroup1 || !isLineInDiffBlock(0, i1, script))
+			if (!blocks0.isLineInDiffBlock(i1) || fd[0].equivs[i1] != fd[1].equivs[j1])
 				break;
-//			pgroup0->m_lines0.Remove(i1); // commented out this line although I'm not sure what this line means because this line causes the bug sf.net#2174
-//			pgroup1->m_lines1.Remove(j1);
 		}
 		++i1;
 		++j1;
@@ -284,12 +277,8 @@ extern "C" void moved_block_analysis(struct change ** pscript, struct file_data
 		int j2 = j+1;
 		for ( ; j2-(e->line1) < (e->inserted); ++i2,++j2)
 		{
-			EqGroup * pgroup0 = map.find(fd[0].equivs[i2]);
-			EqGroup * pgroup1 = map.find(fd[1].equivs[j2]);
-			if (pgroup0 != pgroup1 || !isLineInDiffBlock(0, i2, script))
+			if (!blocks0.isLineInDiffBlock(i2) || fd[0].equivs[i2] != fd[1].equivs[j2])
 				break;
-//			pgroup0->m_lines0.Remove(i2); // commented out this line although I'm not sure what this line means because this line causes the bug sf.net#2174
-//			pgroup1->m_lines1.Remove(j2);
 		}
 		--i2;
 		--j2;
@@ -5,7 +5,7 @@
  */
 #pragma once
 
-#include <map>
+#include <unordered_map>
 
 /**
  * @brief Container class for moved lines/blocks.
@@ -31,7 +31,7 @@ protected:
 	int SecondSideInMovedBlock(unsigned firstSideLine) const;
 
 private:
-	typedef std::map<int, int> MovedLinesMap;
+	typedef std::unordered_map<int, int> MovedLinesMap;
 	MovedLinesMap m_moved0; /**< Moved lines map for first side */
 	MovedLinesMap m_moved1; /**< Moved lines map for second side */
 };
@@ -79,6 +79,7 @@ inline const String OPT_REPORTFILES_INCLUDEFILECMPREPORT {_T("ReportFiles/Includ
 // File compare
 inline const String OPT_AUTOMATIC_RESCAN {_T("Settings/AutomaticRescan"s)};
 inline const String OPT_ALLOW_MIXED_EOL {_T("Settings/AllowMixedEOL"s)};
+inline const String OPT_UNDO_MEMORY_LIMIT {_T("Settings/UndoMemoryLimit"s)};
 inline const String OPT_COPY_GRANULARITY {_T("Settings/CopyGranularity"s)};
 inline const String OPT_TAB_SIZE {_T("Settings/TabSize"s)};
 inline const String OPT_TAB_TYPE {_T("Settings/TabType"s)};
@@ -218,8 +219,11 @@ inline const String OPT_CMP_MOVED_BLOCKS {_T("Settings/MovedBlocks"s)};
 inline const String OPT_CMP_ALIGN_SIMILAR_LINES {_T("Settings/MatchSimilarLines"s)};
 inline const String OPT_CMP_STOP_AFTER_FIRST {_T("Settings/StopAfterFirst"s)};
 inline const String OPT_CMP_QUICK_LIMIT {_T("Settings/QuickMethodLimit"s)};
+inline const String OPT_CMP_FAST_REJECT {_T("Settings/FastReject"s)};
+inline const String OPT_CMP_RESULT_CACHE {_T("Settings/CompareResultCache"s)};
 inline const String OPT_CMP_BINARY_LIMIT {_T("Settings/BinaryMethodLimit"s)};
 inline const String OPT_CMP_COMPARE_THREADS {_T("Settings/CompareThreads"s)};
+inline const String OPT_CMP_COLLECT_THREADS {_T("Settings/CollectThreads"s)};
 inline const String OPT_CMP_WALK_UNIQUE_DIRS {_T("Settings/ScanUnpairedDir"s)};
 inline const String OPT_CMP_IGNORE_REPARSE_POINTS {_T("Settings/IgnoreReparsePoints"s)};
 inline const String OPT_CMP_INCLUDE_SUBDIRS {_T("Settings/Recurse"s)};
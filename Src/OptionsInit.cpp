@@ -119,6 +119,7 @@ void Init(COptionsMgr *pOptions)
 
 	pOptions->InitOption(OPT_AUTOMATIC_RESCAN, false);
 	pOptions->InitOption(OPT_ALLOW_MIXED_EOL, false);
+	pOptions->InitOption(OPT_UNDO_MEMORY_LIMIT, 0, 0, 2048); // Megs, 0 means no limit
 	pOptions->InitOption(OPT_COPY_GRANULARITY, 3/*Character*/);
 	pOptions->InitOption(OPT_TAB_SIZE, (int)4, 0, 64);
 	pOptions->InitOption(OPT_TAB_TYPE, (int)0, 0, 1);	// 0 means tabs inserted
@@ -143,8 +144,11 @@ void Init(COptionsMgr *pOptions)
 	pOptions->InitOption(OPT_CMP_ALIGN_SIMILAR_LINES, false);
 	pOptions->InitOption(OPT_CMP_STOP_AFTER_FIRST, false);
 	pOptions->InitOption(OPT_CMP_QUICK_LIMIT, 4 * 1024 * 1024); // 4 Megs
+	pOptions->InitOption(OPT_CMP_FAST_REJECT, false);
+	pOptions->InitOption(OPT_CMP_RESULT_CACHE, false);
 	pOptions->InitOption(OPT_CMP_BINARY_LIMIT, 64 * 1024 * 1024); // 64 Megs
 	pOptions->InitOption(OPT_CMP_COMPARE_THREADS, -1, -128, 128);
+	pOptions->InitOption(OPT_CMP_COLLECT_THREADS, -1, -128, 128);
 	pOptions->InitOption(OPT_CMP_WALK_UNIQUE_DIRS, true);
 	pOptions->InitOption(OPT_CMP_IGNORE_REPARSE_POINTS, false);
 	pOptions->InitOption(OPT_CMP_IGNORE_CODEPAGE, false);
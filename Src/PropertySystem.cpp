@@ -56,22 +56,54 @@ static const PROPERTYKEY *GetPropertyKeyFromName(const String& canonicalName)
 	return nullptr;
 }
 
-static bool CalculateHashValue(const String& path, const PROPERTYKEY& key, PROPVARIANT& value)
+/**
+ * @brief Calculate the values of all hash properties of a file.
+ * The file is read once however many hash properties there are.
+ * @param [in] path Path of the file.
+ * @param [in] keys Keys of the properties.
+ * @return Hash value for each key, empty for other properties or on error.
+ */
+static std::vector<std::vector<uint8_t>> CalculateHashValues(const String& path, const std::vector<PROPERTYKEY>& keys)
 {
-	int i = GetPropertyIndexFromKey(key);
-	if (i >= 0)
+	std::vector<std::vector<uint8_t>> hashes(keys.size());
+	std::vector<const wchar_t *> algoIds;
+	std::vector<size_t> indexes;
+	for (size_t i = 0; i < keys.size(); ++i)
 	{
-		std::vector<uint8_t> hash;
-		HANDLE hFile = CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_WRITE, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
-		if (hFile != INVALID_HANDLE_VALUE)
+		int j = GetPropertyIndexFromKey(keys[i]);
+		if (j >= 0)
 		{
-			CalculateHashValue(hFile, g_HashProperties[i].pszDisplayName, hash);
-			CloseHandle(hFile);
+			algoIds.push_back(g_HashProperties[j].pszDisplayName);
+			indexes.push_back(i);
 		}
-		InitPropVariantFromBuffer(hash.data(), static_cast<unsigned>(hash.size()), &value);
-		return true;
 	}
-	return false;
+	if (algoIds.empty())
+		return hashes;
+	HANDLE hFile = CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_WRITE, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL|FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if (hFile != INVALID_HANDLE_VALUE)
+	{
+		std::vector<std::vector<uint8_t>> values;
+		CalculateHashValues(hFile, algoIds, values);
+		CloseHandle(hFile);
+		for (size_t k = 0; k < indexes.size(); ++k)
+			hashes[indexes[k]] = std::move(values[k]);
+	}
+	return hashes;
+}
+
+/**
+ * @brief Get the value of a hash property.
+ * @param [in] hashes Hash values calculated by CalculateHashValues().
+ * @param [in] pSameContentValue Value of a file with the same contents, or nullptr.
+ * @param [in] index Index of the property.
+ * @param [out] value Hash value.
+ */
+static void GetHashValue(const std::vector<std::vector<uint8_t>>& hashes, const PROPVARIANT *pSameContentValue, size_t index, PROPVARIANT& value)
+{
+	if (pSameContentValue != nullptr)
+		PropVariantCopy(&value, pSameContentValue);
+	else
+		InitPropVariantFromBuffer(hashes[index].data(), static_cast<unsigned>(hashes[index].size()), &value);
 }
 
 PropertyValues::PropertyValues() = default;
@@ -208,18 +240,35 @@ void PropertySystem::AddProperties(const std::vector<String>& canonicalNames)
 	}
 }
 
-bool PropertySystem::GetPropertyValues(const String& path, PropertyValues& values)
+/**
+ * @brief Get the values of the properties of a file.
+ * @param [in] path Path of the file.
+ * @param [out] values Property values.
+ * @param [in] pSameContentValues Values of a file known to have the same
+ *  contents, whose hash values are copied instead of reading the file.
+ * @return true if the property store of the file was opened.
+ */
+bool PropertySystem::GetPropertyValues(const String& path, PropertyValues& values, const PropertyValues* pSameContentValues)
 {
 	IPropertyStore* pps = nullptr;
 	values.m_values.clear();
+	if (pSameContentValues != nullptr && pSameContentValues->m_values.size() != m_keys.size())
+		pSameContentValues = nullptr;
+	std::vector<std::vector<uint8_t>> hashes;
+	if (pSameContentValues == nullptr)
+		hashes = CalculateHashValues(path, m_keys);
+	auto sameContentValue = [pSameContentValues](size_t i) {
+		return pSameContentValues ? &pSameContentValues->m_values[i] : nullptr;
+	};
 	if (!m_onlyHashProperties && SUCCEEDED(SHGetPropertyStoreFromParsingName(path.c_str(), nullptr, GPS_DEFAULT, IID_PPV_ARGS(&pps))))
 	{
 		values.m_values.reserve(m_keys.size());
-		for (const auto& key : m_keys)
+		for (size_t i = 0; i < m_keys.size(); ++i)
 		{
+			const auto& key = m_keys[i];
 			PROPVARIANT value{};
 			if (GetPropertyIndexFromKey(key) >= 0)
-				CalculateHashValue(path, key, value);
+				GetHashValue(hashes, sameContentValue(i), i, value);
 			else
 				pps->GetValue(key, &value);
 			values.m_values.push_back(value);
@@ -229,12 +278,13 @@ bool PropertySystem::GetPropertyValues(const String& path, PropertyValues& value
 	}
 	else
 	{
-		for (const auto& key : m_keys)
+		for (size_t i = 0; i < m_keys.size(); ++i)
 		{
+			const auto& key = m_keys[i];
 			PROPVARIANT value2{};
 			if (GetPropertyIndexFromKey(key) >= 0)
 			{
-				CalculateHashValue(path, key, value2);
+				GetHashValue(hashes, sameContentValue(i), i, value2);
 			}
 			else
 			{
@@ -362,7 +412,7 @@ PropertySystem::PropertySystem(const std::vector<String>& canonicalNames)
 {
 }
 
-bool PropertySystem::GetPropertyValues(const String& path, PropertyValues& values)
+bool PropertySystem::GetPropertyValues(const String& path, PropertyValues& values, const PropertyValues* pSameContentValues)
 {
 	return false;
 }
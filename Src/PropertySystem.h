@@ -47,7 +47,7 @@ public:
 	};
 	explicit PropertySystem(ENUMFILTER filter);
 	explicit PropertySystem(const std::vector<String>& canonicalNames);
-	bool GetPropertyValues(const String& path, PropertyValues& values);
+	bool GetPropertyValues(const String& path, PropertyValues& values, const PropertyValues* pSameContentValues = nullptr);
 	String FormatPropertyValue(const PropertyValues& values, unsigned index);
 	bool GetDisplayNames(std::vector<String>& names);
 	bool HasHashProperties() const;
@@ -0,0 +1,208 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  RegularExpressionSet.cpp
+ *
+ * @brief Implementation file for RegularExpressionSet
+ */
+
+#include "pch.h"
+#include "RegularExpressionSet.h"
+#include <algorithm>
+#include <mutex>
+#include <Poco/RegularExpression.h>
+#include <Poco/Exception.h>
+#include "DebugNew.h"
+
+using Poco::RegularExpression;
+
+/** @brief Compiled expressions, shared by copies of the set. */
+struct RegularExpressionSet::Compiled
+{
+	std::once_flag once;
+	std::vector<std::unique_ptr<RegularExpression>> merged; /**< One for each set of options */
+	std::vector<std::unique_ptr<RegularExpression>> separate; /**< Expressions not merged */
+};
+
+/**
+ * @brief Can the pattern be one branch of an alternation?
+ * Group numbers change when patterns are merged, so patterns referring to
+ * groups by number are matched alone. So are patterns using constructs
+ * which are only valid at the start of a pattern or which quote the rest
+ * of it.
+ */
+static bool IsMergeable(const std::string& pattern)
+{
+	for (size_t i = 0; i + 1 < pattern.length(); ++i)
+	{
+		const char c = pattern[i];
+		const char next = pattern[i + 1];
+		if (c == '\\')
+		{
+			// \1..\9, \g{1}, \k<name> back references and \Q..\E quoting
+			if ((next >= '1' && next <= '9') || next == 'g' || next == 'k' || next == 'Q')
+				return false;
+			++i;
+		}
+		else if (c == '(')
+		{
+			// (*VERB), (?1) (?R) (?+1) (?&name) (?P>name) recursion,
+			// (?| branch reset, (?( conditionals testing a group and
+			// named groups, whose names may clash
+			if (next == '*')
+				return false;
+			if (next == '?' && i + 2 < pattern.length())
+			{
+				const char opt = pattern[i + 2];
+				if ((opt >= '0' && opt <= '9') || opt == 'R' || opt == '+' || opt == '-' ||
+					opt == '&' || opt == 'P' || opt == '|' || opt == '(' || opt == '<' || opt == '\'')
+				{
+					// (?<= and (?<! are lookbehinds, not names
+					if (opt == '<' && i + 3 < pattern.length() && (pattern[i + 3] == '=' || pattern[i + 3] == '!'))
+						continue;
+					// (?-i) turns an option off
+					if (opt == '-' && i + 3 < pattern.length() && !(pattern[i + 3] >= '0' && pattern[i + 3] <= '9'))
+						continue;
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Compile an expression matched alone.
+ * Invalid expressions are left out of the set.
+ */
+static void AddSeparate(std::vector<std::unique_ptr<RegularExpression>>& separate, const std::string& pattern, int options)
+{
+	try
+	{
+		separate.emplace_back(new RegularExpression(pattern, options));
+	}
+	catch (Poco::RegularExpressionException&)
+	{
+	}
+}
+
+RegularExpressionSet::RegularExpressionSet()
+: m_pCompiled(std::make_shared<Compiled>())
+{
+}
+
+RegularExpressionSet::~RegularExpressionSet() = default;
+
+/**
+ * @brief Add an expression to the set.
+ * The expression is compiled later, and left out if it is invalid.
+ * @param [in] pattern Regular expression.
+ * @param [in] options Poco::RegularExpression compile options.
+ */
+void RegularExpressionSet::Add(const std::string& pattern, int options)
+{
+	m_patterns.emplace_back(pattern, options);
+	m_pCompiled = std::make_shared<Compiled>();
+}
+
+/**
+ * @brief Remove all expressions from the set.
+ */
+void RegularExpressionSet::Clear()
+{
+	m_patterns.clear();
+	m_pCompiled = std::make_shared<Compiled>();
+}
+
+/**
+ * @brief Compile the expressions if not done yet.
+ * Merged expressions that fail to compile (e.g. their group names clash
+ * or one of them is invalid) are compiled one by one instead.
+ */
+const RegularExpressionSet::Compiled& RegularExpressionSet::GetCompiled() const
+{
+	Compiled& compiled = *m_pCompiled;
+	std::call_once(compiled.once, [this, &compiled]()
+	{
+		std::vector<int> optionsList;
+		for (const auto& pattern : m_patterns)
+		{
+			if (std::find(optionsList.begin(), optionsList.end(), pattern.second) == optionsList.end())
+				optionsList.push_back(pattern.second);
+		}
+		for (int options : optionsList)
+		{
+			std::string merged;
+			std::vector<const std::string *> branches;
+			for (const auto& pattern : m_patterns)
+			{
+				if (pattern.second != options)
+					continue;
+				if (!IsMergeable(pattern.first))
+				{
+					AddSeparate(compiled.separate, pattern.first, options);
+					continue;
+				}
+				merged += merged.empty() ? "(?:" : ")|(?:";
+				merged += pattern.first;
+				branches.push_back(&pattern.first);
+			}
+			if (branches.size() == 1)
+				AddSeparate(compiled.separate, *branches[0], options);
+			else if (!branches.empty())
+			{
+				merged += ")";
+				try
+				{
+					compiled.merged.emplace_back(new RegularExpression(merged, options));
+				}
+				catch (Poco::RegularExpressionException&)
+				{
+					for (const auto *pPattern : branches)
+						AddSeparate(compiled.separate, *pPattern, options);
+				}
+			}
+		}
+	});
+	return compiled;
+}
+
+/**
+ * @brief Does any expression of the set match the subject?
+ * @param [in] subject String to match.
+ * @return true if at least one expression matches.
+ */
+bool RegularExpressionSet::MatchAny(const std::string& subject) const
+{
+	if (m_patterns.empty())
+		return false;
+	const Compiled& compiled = GetCompiled();
+	for (const auto* pList : { &compiled.merged, &compiled.separate })
+	{
+		for (const auto& pRegexp : *pList)
+		{
+			RegularExpression::Match match;
+			try
+			{
+				if (pRegexp->match(subject, 0, match) > 0)
+					return true;
+			}
+			catch (Poco::RegularExpressionException&)
+			{
+				// A match error, e.g. the match limit being exceeded, is no match
+			}
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Is there no valid expression in the set?
+ * Compiles the set if not done yet, to leave out invalid expressions.
+ */
+bool RegularExpressionSet::IsEmpty() const
+{
+	if (m_patterns.empty())
+		return true;
+	const Compiled& compiled = GetCompiled();
+	return compiled.merged.empty() && compiled.separate.empty();
+}
@@ -0,0 +1,43 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  RegularExpressionSet.h
+ *
+ * @brief Declaration file for RegularExpressionSet
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+
+namespace Poco { class RegularExpression; }
+
+/**
+ * @brief Set of regular expressions matched as one.
+ *
+ * Expressions compiled with the same options are merged into one
+ * alternation, so a subject is scanned once however many expressions
+ * there are. Expressions which cannot be merged without changing their
+ * meaning (back references, recursion, verbs, ...) are matched alone.
+ * The set is compiled on first use, which may happen concurrently.
+ * Invalid expressions are left out then.
+ */
+class RegularExpressionSet
+{
+public:
+	RegularExpressionSet();
+	~RegularExpressionSet();
+
+	void Add(const std::string& pattern, int options);
+	void Clear();
+	bool IsEmpty() const;
+	bool MatchAny(const std::string& subject) const;
+
+private:
+	struct Compiled;
+
+	const Compiled& GetCompiled() const;
+
+	std::vector<std::pair<std::string, int>> m_patterns; /**< Patterns and their compile options */
+	std::shared_ptr<Compiled> m_pCompiled; /**< Shared by copies, replaced when the patterns change */
+};
@@ -99,6 +99,7 @@ SubstitutionItem::SubstitutionItem(const SubstitutionItem& other)
 void SubstitutionList::Add(const std::string& pattern, const std::string& replacement, int regexpCompileOptions)
 {
 	m_list.emplace_back(pattern, replacement, regexpCompileOptions);
+	m_set.Add(pattern, regexpCompileOptions);
 }
 
 void SubstitutionList::Add(
@@ -125,6 +126,7 @@ void SubstitutionList::Add(
 	if (matchWholeWordOnly)
 		rePattern = "\\b" + rePattern + "\\b";
 	m_list.emplace_back(rePattern, replacement, regexpCompileOptions);
+	m_set.Add(rePattern, regexpCompileOptions);
 }
 
 std::string SubstitutionList::Subst(const std::string& subject, int codepage/*=CP_UTF8*/) const
@@ -146,6 +148,11 @@ std::string SubstitutionList::Subst(const std::string& subject, int codepage/*=C
 		replaced = subject;
 	}
 
+	// A pattern can only match after an earlier substitution changed the
+	// subject, so a subject none of the patterns matches stays as it is.
+	if (!m_set.MatchAny(replaced))
+		return replaced;
+
 	for (const auto& item : m_list)
 	{
 		try
@@ -164,5 +171,6 @@ std::string SubstitutionList::Subst(const std::string& subject, int codepage/*=C
 void SubstitutionList::RemoveAllFilters()
 {
 	m_list.clear();
+	m_set.Clear();
 }
 
@@ -9,6 +9,7 @@
 #include <memory>
 #include <Poco/RegularExpression.h>
 #include "unicoder.h"
+#include "RegularExpressionSet.h"
 
 
 struct SubstitutionItem
@@ -38,5 +39,6 @@ public:
 
 private:
 	std::vector<SubstitutionItem> m_list;
+	RegularExpressionSet m_set; /**< Patterns of m_list, to skip subjects none of them matches */
 };
 
@@ -0,0 +1,161 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  WorkStealingPool.cpp
+ *
+ * @brief Implementation file for WorkStealingPool
+ */
+
+#include "pch.h"
+#include "WorkStealingPool.h"
+#include <cassert>
+#include <climits>
+#include "DebugNew.h"
+
+/** @brief Pool and worker index of the calling thread, if it is a pool worker. */
+static thread_local WorkStealingPool *t_pPool = nullptr;
+static thread_local int t_nWorker = -1;
+
+/**
+ * @brief Create the pool and start its worker threads.
+ * @param [in] nThreads Number of worker threads.
+ */
+WorkStealingPool::WorkStealingPool(int nThreads)
+: m_available(0, INT_MAX)
+, m_nPending(0)
+, m_nNextWorker(0)
+, m_bStop(false)
+{
+	assert(nThreads > 0);
+	m_workers.reserve(nThreads);
+	for (int i = 0; i < nThreads; ++i)
+	{
+		m_workers.emplace_back(new Worker);
+		m_workers[i]->m_pPool = this;
+		m_workers[i]->m_id = i;
+	}
+	for (auto& pWorker : m_workers)
+		pWorker->m_thread.start(ThreadProc, pWorker.get());
+}
+
+/**
+ * @brief Wait for pending tasks and stop the worker threads.
+ */
+WorkStealingPool::~WorkStealingPool()
+{
+	WaitIdle();
+	m_bStop = true;
+	for (size_t i = 0; i < m_workers.size(); ++i)
+		m_available.set();
+	for (auto& pWorker : m_workers)
+		pWorker->m_thread.join();
+}
+
+/**
+ * @brief Queue a task.
+ * Tasks submitted by a worker of this pool go to that worker's own deque.
+ * @param [in] task Task to run.
+ */
+void WorkStealingPool::Submit(Task task)
+{
+	const int id = (t_pPool == this) ? t_nWorker :
+		static_cast<int>(m_nNextWorker++ % m_workers.size());
+	++m_nPending;
+	{
+		Poco::FastMutex::ScopedLock lock(m_workers[id]->m_mutex);
+		m_workers[id]->m_tasks.push_back(std::move(task));
+	}
+	m_available.set();
+}
+
+/**
+ * @brief Wait until all submitted tasks, including the tasks they spawned,
+ * have been run.
+ * @note Must not be called from a worker of this pool.
+ * @throw The first exception thrown by a task since the last call.
+ */
+void WorkStealingPool::Wait()
+{
+	WaitIdle();
+	std::exception_ptr pException;
+	{
+		Poco::FastMutex::ScopedLock lock(m_exceptionMutex);
+		std::swap(pException, m_pException);
+	}
+	if (pException)
+		std::rethrow_exception(pException);
+}
+
+void WorkStealingPool::WaitIdle()
+{
+	assert(t_pPool != this);
+	while (m_nPending > 0)
+		m_idle.wait();
+}
+
+void WorkStealingPool::ThreadProc(void *pParam)
+{
+	Worker *pWorker = static_cast<Worker *>(pParam);
+	t_pPool = pWorker->m_pPool;
+	t_nWorker = pWorker->m_id;
+	pWorker->m_pPool->Run(pWorker->m_id);
+}
+
+void WorkStealingPool::Run(int id)
+{
+	for (;;)
+	{
+		m_available.wait();
+		// Every task is announced by exactly one set() of the semaphore, so
+		// a task is guaranteed to be queued somewhere unless we are stopping.
+		Task task;
+		while (!TakeTask(id, task))
+		{
+			if (m_bStop)
+				return;
+			Poco::Thread::yield();
+		}
+		try
+		{
+			task();
+		}
+		catch (...)
+		{
+			Poco::FastMutex::ScopedLock lock(m_exceptionMutex);
+			if (!m_pException)
+				m_pException = std::current_exception();
+		}
+		if (--m_nPending == 0)
+			m_idle.set();
+	}
+}
+
+/**
+ * @brief Pop a task from the back of our own deque, or steal one from the
+ * front of another worker's deque.
+ */
+bool WorkStealingPool::TakeTask(int id, Task& task)
+{
+	{
+		Worker& worker = *m_workers[id];
+		Poco::FastMutex::ScopedLock lock(worker.m_mutex);
+		if (!worker.m_tasks.empty())
+		{
+			task = std::move(worker.m_tasks.back());
+			worker.m_tasks.pop_back();
+			return true;
+		}
+	}
+	const size_t nWorkers = m_workers.size();
+	for (size_t i = 1; i < nWorkers; ++i)
+	{
+		Worker& victim = *m_workers[(id + i) % nWorkers];
+		Poco::FastMutex::ScopedLock lock(victim.m_mutex);
+		if (!victim.m_tasks.empty())
+		{
+			task = std::move(victim.m_tasks.front());
+			victim.m_tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
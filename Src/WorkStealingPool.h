@@ -0,0 +1,68 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  WorkStealingPool.h
+ *
+ * @brief Declaration file for WorkStealingPool
+ */
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <vector>
+#define POCO_NO_UNWINDOWS 1
+#include <Poco/Event.h>
+#include <Poco/Mutex.h>
+#include <Poco/Semaphore.h>
+#include <Poco/Thread.h>
+
+/**
+ * @brief Thread pool for recursively spawned tasks.
+ *
+ * Every worker owns a task deque. A task submitted from inside a worker is
+ * pushed to the back of that worker's deque and popped again LIFO, so a
+ * worker keeps descending into the subtree it is working on. Idle workers
+ * steal from the front of other deques, taking the oldest (and usually the
+ * biggest) pending pieces of work first. Tasks submitted from outside the
+ * pool are distributed round-robin.
+ *
+ * An exception thrown by a task does not stop its worker. The first one is
+ * kept and rethrown by Wait().
+ */
+class WorkStealingPool
+{
+public:
+	typedef std::function<void()> Task;
+
+	explicit WorkStealingPool(int nThreads);
+	~WorkStealingPool();
+	void Submit(Task task);
+	void Wait();
+	int GetThreadCount() const { return static_cast<int>(m_workers.size()); }
+
+private:
+	struct Worker
+	{
+		WorkStealingPool *m_pPool;
+		int m_id;
+		Poco::Thread m_thread;
+		Poco::FastMutex m_mutex;
+		std::deque<Task> m_tasks;
+	};
+
+	static void ThreadProc(void *pParam);
+	void WaitIdle();
+	void Run(int id);
+	bool TakeTask(int id, Task& task);
+
+	std::vector<std::unique_ptr<Worker>> m_workers;
+	Poco::Semaphore m_available; /**< Signaled once per submitted task */
+	Poco::Event m_idle; /**< Signaled when the pending task count drops to zero */
+	std::atomic_int m_nPending;
+	std::atomic_uint m_nNextWorker;
+	std::atomic_bool m_bStop;
+	Poco::FastMutex m_exceptionMutex;
+	std::exception_ptr m_pException; /**< First exception thrown by a task since the last Wait() */
+};
@@ -874,8 +874,9 @@ struct change * diff_2_files (struct file_data filevec[], int depth, int * bin_s
 			for (;;)
 			{
 				//  Read a buffer's worth from both files.  
+				//  Preloaded buffers already hold the whole files.
 				for (i = 0; i < 2; i++)
-					while (filevec[i].buffered_chars < buffer_size)
+					while (!filevec[i].preloaded && filevec[i].buffered_chars < buffer_size)
 					  {
 						int r = _read (filevec[i].desc,
 									   filevec[i].buffer	+ filevec[i].buffered_chars,
@@ -1133,6 +1134,6 @@ void cleanup_file_buffers(struct file_data fd[])
 		free ((void *)(fd[i].linbuf + fd[i].linbuf_base));
 
 	if (fd[0].buffer != fd[1].buffer)
-		free (fd[0].buffer);
-	free (fd[1].buffer);
+		free_file_buffer (&fd[0]);
+	free_file_buffer (&fd[1]);
 }
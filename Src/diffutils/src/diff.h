@@ -304,6 +304,14 @@ struct file_data {
 
     /* text stats for WinMerge */
     int count_crlfs, count_crs, count_lfs, count_zeros;
+
+    /* WinMerge: nonzero if BUFFER already holds the whole file,
+       so DESC must not be read. */
+    int preloaded;
+
+    /* WinMerge: nonzero if BUFFER is a copy-on-write view of the file,
+       which must be released with myunmapfile instead of free. */
+    int mapped;
 };
 
 /* Describe the two files currently being compared.  */
@@ -343,6 +351,7 @@ void print_ifdef_script (struct change *);
 int read_files (struct file_data[], int, int *);
 int sip (struct file_data *, int);
 void slurp (struct file_data *);
+void free_file_buffer (struct file_data *);
 
 /* normal.c */
 void print_normal_script (struct change *);
@@ -389,8 +398,13 @@ extern char const version_string[];
 /* mystat.cpp */
 int myfstat(int fd, struct _stat64 *buf);
 int mywstat(const wchar_t *filename, struct _stat64 *buf);
+/* mymmap.cpp */
+char *mymapfile(int fd, size_t reserve, size_t *size);
+void myunmapfile(char *view);
 #else
 #define myfstat fstat
+#define mymapfile(fd, reserve, size) ((char *) NULL)
+#define myunmapfile(view) ((void) 0)
 #endif
 
 #ifdef __cplusplus
@@ -20,6 +20,14 @@ the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.  */
 #include "diff.h"
 #include <io.h>
 #include <assert.h>
+#include <stdint.h>
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 /* Rotate a value n bits to the left. */
 #define UINT_BIT (sizeof (unsigned) * CHAR_BIT)
@@ -28,6 +36,9 @@ the Free Software Foundation, 675 Mass Ave, Cambridge, MA 02139, USA.  */
 /* Given a hash value and a new character, return a new hash value. */
 #define HASH(h, c) ((c) + ROL (h, 7))
 
+/* Smaller files are read into memory instead of being mapped. */
+#define MAP_MIN_SIZE (16 * 1024 * 1024)
+
 /* Guess remaining number of lines from number N of lines so far,
    size S so far, and total size T.  */
 #define GUESS_LINES(n,s,t) (((t) - (s)) / ((n) < 10 ? 32 : (s) / ((n)-1)) + 5)
@@ -75,7 +86,7 @@ static DECL_TLS int equivs_index;
 /* Number of elements allocated in the array `equivs'.  */
 static DECL_TLS int equivs_alloc;
 
-static void find_and_hash_each_line (struct file_data *);
+static void find_and_hash_each_line (struct file_data *, int);
 static void find_identical_ends (struct file_data[]);
 static char *prepare_text_end (struct file_data *, short);
 static enum UNICODESET get_unicode_signature(struct file_data *, int *pBomsize);
@@ -140,8 +151,16 @@ int
 sip (struct file_data *current, int skip_test)
 {
   int isbinary = 0;
+  if (current->preloaded)
+    {
+      /* The text is already in memory; test the same amount of it
+         as would have been read from a file.  */
+      if (!skip_test && !get_unicode_signature(current, NULL))
+        isbinary = binary_file_p(current->buffer,
+          min (current->buffered_chars, (FSIZE) STAT_BLOCKSIZE (current->stat)));
+    }
   /* If we have a nonexistent file (or NUL: device) at this stage, treat it as empty.  */
-  if (current->desc < 0 || !(S_ISREG (current->stat.st_mode)))
+  else if (current->desc < 0 || !(S_ISREG (current->stat.st_mode)))
     {
       /* Leave room for a sentinel.  */
       current->buffer = xmalloc (sizeof (word));
@@ -177,6 +196,50 @@ sip (struct file_data *current, int skip_test)
   return isbinary;
 }
 
+/* Replace the buffer of the current file with a copy-on-write view of the
+   whole file, leaving room for the appended newline and sentinel.
+   Files which must be transcoded grow, so they are not mapped.
+   Return nonzero if the file was mapped.  */
+static int
+map_file (struct file_data *current)
+{
+  struct file_data view = { 0 };
+  size_t size;
+
+  view.buffer = mymapfile (current->desc, sizeof (word) + 1, &size);
+  if (view.buffer == NULL)
+    return 0;
+  view.buffered_chars = size;
+  switch (get_unicode_signature (&view, NULL))
+    {
+    case NONE:
+    case UTF8:
+      break;
+    default:
+      myunmapfile (view.buffer);
+      return 0;
+    }
+
+  free_file_buffer (current);
+  current->buffer = view.buffer;
+  current->bufsize = size + sizeof (word) + 1;
+  current->buffered_chars = size;
+  current->mapped = 1;
+  return 1;
+}
+
+/* Release the buffer of the current file, however it was allocated.  */
+void
+free_file_buffer (struct file_data *current)
+{
+  if (current->mapped)
+    myunmapfile (current->buffer);
+  else
+    free (current->buffer);
+  current->buffer = NULL;
+  current->mapped = 0;
+}
+
 /* Slurp the rest of the current file completely into memory.  */
 
 void
@@ -184,10 +247,10 @@ slurp (struct file_data *current)
 {
   size_t cc;
 
-  if (current->desc < 0)
+  if (current->desc < 0 && !current->preloaded)
     /* The file is nonexistent.  */
     ;
-  else if (always_text_flag || current->buffered_chars != 0)
+  else if (always_text_flag || current->buffered_chars != 0 || current->preloaded)
     {
       enum UNICODESET sig = get_unicode_signature(current, NULL);
       size_t alloc_extra
@@ -196,7 +259,15 @@ slurp (struct file_data *current)
           ? ~0U	// yes, allocate extra room for transcoding
           : 0U;	// no, allocate no extra room for transcoding
 
-      for (;;)
+      /* Huge files which need no transcoding are used from the page cache.
+         Writes to the view (EOL mapping, sentinels, the appended newline)
+         only change private copies of its pages.  */
+      if (!current->preloaded && !alloc_extra && S_ISREG (current->stat.st_mode)
+          && current->stat.st_size >= MAP_MIN_SIZE && map_file (current))
+        return;
+
+      /* A preloaded buffer only needs room for the newline and sentinel.  */
+      while (!current->preloaded)
         {
           if (current->buffered_chars == current->bufsize)
             {
@@ -256,10 +327,111 @@ ISWSPACE (char ch)
   return ch==' ' || ch=='\t';
 }
 
+#ifdef USE_SSE2
+/* Return the index of the lowest set bit of MASK, which must not be 0. */
+static int
+lowest_bit (unsigned mask)
+{
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward (&index, mask);
+  return (int) index;
+#else
+  return __builtin_ctz (mask);
+#endif
+}
+#endif
+
+/* Return the first \n or \r at or after P.
+   There must be one before END; 16 bytes are tested at a time up to END. */
+static unsigned char const HUGE *
+find_eol (unsigned char const HUGE *p, unsigned char const HUGE *end)
+{
+#ifdef USE_SSE2
+  __m128i const lf = _mm_set1_epi8 ('\n');
+  __m128i const cr = _mm_set1_epi8 ('\r');
+  for (; end - p >= 16; p += 16)
+    {
+      __m128i v = _mm_loadu_si128 ((__m128i const *) p);
+      int mask = _mm_movemask_epi8 (_mm_or_si128 (_mm_cmpeq_epi8 (v, lf), _mm_cmpeq_epi8 (v, cr)));
+      if (mask)
+        return p + lowest_bit (mask);
+    }
+#endif
+  while (*p != '\n' && *p != '\r')
+    p++;
+  return p;
+}
+
+/* Count the line ends in [P, END): every \n and every \r not followed by \n.
+   END[0] is read to tell a \r\n from a lone \r. */
+static size_t
+count_lines (unsigned char const HUGE *p, unsigned char const HUGE *end)
+{
+  size_t count = 0;
+#ifdef USE_SSE2
+  __m128i const lf = _mm_set1_epi8 ('\n');
+  __m128i const cr = _mm_set1_epi8 ('\r');
+  __m128i const zero = _mm_setzero_si128 ();
+  while (end - p > 16)
+    {
+      /* Sum the per-byte counters before they can overflow. */
+      __m128i counts = zero;
+      int n;
+      for (n = 0; n < 255 && end - p > 16; n++, p += 16)
+        {
+          __m128i v = _mm_loadu_si128 ((__m128i const *) p);
+          __m128i next = _mm_loadu_si128 ((__m128i const *) (p + 1));
+          __m128i eol = _mm_or_si128 (_mm_cmpeq_epi8 (v, lf),
+            _mm_andnot_si128 (_mm_cmpeq_epi8 (next, lf), _mm_cmpeq_epi8 (v, cr)));
+          counts = _mm_sub_epi8 (counts, eol);
+        }
+      counts = _mm_sad_epu8 (counts, zero);
+      count += _mm_cvtsi128_si32 (counts) + _mm_cvtsi128_si32 (_mm_srli_si128 (counts, 8));
+    }
+#endif
+  for (; p < end; p++)
+    count += *p == '\n' || (*p == '\r' && p[1] != '\n');
+  return count;
+}
+
+/* Hash the LEN bytes at P eight at a time.
+   Only used when no option makes different lines match,
+   so any hash of the exact bytes will do. */
+static unsigned
+hash_line (unsigned char const HUGE *p, size_t len)
+{
+  uint64_t const k = 0x9E3779B97F4A7C15ULL;
+  uint64_t h = len * k;
+  uint64_t w;
+  uint32_t lo, hi;
+
+  for (; len > 8; len -= 8, p += 8)
+    {
+      memcpy (&w, p, sizeof (w));
+      h = (h ^ w) * k;
+      h ^= h >> 32;
+    }
+  /* The last 1 to 8 bytes, read as two overlapping halves if possible. */
+  if (len >= 4)
+    {
+      memcpy (&lo, p, sizeof (lo));
+      memcpy (&hi, p + len - 4, sizeof (hi));
+      w = lo | (uint64_t) hi << 32;
+    }
+  else if (len > 0)
+    w = p[0] | p[len / 2] << 8 | p[len - 1] << 16;
+  else
+    w = 0;
+  h = (h ^ w) * k;
+  return (unsigned) (h ^ h >> 32);
+}
+
 /* Split the file into lines, simultaneously computing the equivalence class for
-   each line. */
+   each line.  LINES is the number of lines from the prefix end to the suffix
+   begin, as counted by count_lines. */
 static void
-find_and_hash_each_line (struct file_data *current)
+find_and_hash_each_line (struct file_data *current, int lines)
 {
   unsigned h;
   unsigned char const HUGE *p = (unsigned char const HUGE *) current->prefix_end;
@@ -272,7 +444,7 @@ find_and_hash_each_line (struct file_data *current)
   int alloc_lines = current->alloc_lines;
   int line = 0;
   int linbuf_base = current->linbuf_base;
-  int *cureqs = (int *) xmalloc (alloc_lines * sizeof (int));
+  int *cureqs;
   struct equivclass HUGE *eqs = equivs;
   int eqs_index = equivs_index;
   int eqs_alloc = equivs_alloc;
@@ -282,6 +454,22 @@ find_and_hash_each_line (struct file_data *current)
     = current->missing_newline && ROBUST_OUTPUT_STYLE (output_style)
       ? bufend : (char const HUGE *) NULL;
   int varies = length_varies;
+  int exact = !(ignore_case_flag | ignore_all_space_flag | ignore_space_change_flag | ignore_numbers_flag);
+  int suffix_lines = no_diff_means_no_output
+    ? context + 2
+    : (int) count_lines ((unsigned char const HUGE *) suffix_begin, (unsigned char const HUGE *) bufend);
+
+  /* Size the line table for all lines at once,
+     including the end of the last line. */
+  if (alloc_lines < lines + suffix_lines + 1)
+    {
+      alloc_lines = lines + suffix_lines + 1;
+      linbuf = (char const HUGE **) xrealloc ((void *)(linbuf + linbuf_base),
+                 (alloc_lines - linbuf_base)
+                 * sizeof (*linbuf))
+         - linbuf_base;
+    }
+  cureqs = (int *) xmalloc (alloc_lines * sizeof (int));
 
   /* prepare_text_end put a zero word at the end of the buffer, 
   so we're not in danger of overrunning the end of the file */
@@ -299,7 +487,16 @@ find_and_hash_each_line (struct file_data *current)
          respecting UNIX (\r), MS-DOS/Windows (\r\n), and MAC (\r) eols */
 
       /* Hash this line until we find a newline. */
-      if (ignore_case_flag)
+      if (exact)
+        {
+          unsigned char const HUGE *eol = find_eol (p, (unsigned char const HUGE *) bufend);
+          /* A \r before \n is hashed as part of the line, as below. */
+          if (*eol == '\r' && eol[1] == '\n')
+            eol++;
+          h = hash_line (p, eol - p);
+          p = eol + 1;
+        }
+      else if (ignore_case_flag)
         {
           if (ignore_all_space_flag)
             while ((c = *p++) != '\n' && (c != '\r' || *p == '\n'))
@@ -472,8 +669,9 @@ hashing_done:;
 
       line++;
 
-      while (p[0] != '\n' && (p[0] != '\r' || p[1] == '\n'))
-         p++;
+      p = find_eol (p, (unsigned char const HUGE *) bufend);
+      if (p[0] == '\r' && p[1] == '\n')
+        p++;
       p++;
     }
 
@@ -686,11 +884,16 @@ prepare_text_end (struct file_data *current, short side)
 
 	current->buffered_chars = buffered_chars;
 
-	/* Count line endings and map them to '\n' if ignore_eol_diff is set. */
+	/* Count line endings and map them to '\n' if ignore_eol_diff is set.
+	   Bytes are only stored once a CR LF has been compacted (t != q0), so
+	   a mapped file gets private copies of the changed pages only. */
 	t = q0 = p + buffered_chars;
 	while (q0 > r)
 	{
-		switch (*--t = *--q0)
+		char c = *--q0;
+		if (--t != q0)
+			*t = c;
+		switch (c)
 		{
 		case '\r':
 			++current->count_crs;
@@ -716,8 +919,10 @@ prepare_text_end (struct file_data *current, short side)
 		}
 	}
 
-  /* Don't use uninitialized storage when planting or using sentinels.  */
-  bzero (p + buffered_chars, sizeof (word));
+  /* Don't use uninitialized storage when planting or using sentinels.
+     The rest of a mapped view's last page is already zero.  */
+  if (!current->mapped)
+    bzero (p + buffered_chars, sizeof (word));
   return t;
 }
 # pragma warning(pop)           // Restores the warning state.
@@ -751,6 +956,7 @@ find_identical_ends (struct file_data filevec[])
       slurp (&filevec[0]);
       buffer0 = prepare_text_end (&filevec[0], -1);
       filevec[1].buffer = filevec[0].buffer;
+      filevec[1].mapped = filevec[0].mapped;
       filevec[1].bufsize = filevec[0].bufsize;
       filevec[1].buffered_chars = filevec[0].buffered_chars;
       buffer1 = buffer0;
@@ -1015,6 +1221,7 @@ read_files (struct file_data filevec[], int pretend_binary, int *bin_file)
   int i;
   int skip_test = always_text_flag | pretend_binary;
   int appears_binary = 0;
+  int lines[2];
 
   if (bin_file != NULL)
     *bin_file = 0;
@@ -1106,7 +1313,18 @@ read_files (struct file_data filevec[], int pretend_binary, int *bin_file)
       return 0;
     }
 
-  equivs_alloc = filevec[0].alloc_lines + filevec[1].alloc_lines + 1;
+  /* Count the lines to hash, so that no table has to grow while hashing.
+     Each line needs at most one equivalence class.  */
+  for (i = 0; i < 2; ++i)
+    {
+      size_t count = count_lines ((unsigned char const HUGE *) filevec[i].prefix_end,
+                                  (unsigned char const HUGE *) filevec[i].suffix_begin);
+      if (count >= INT_MAX / 2)
+        fatal ("too many lines");
+      lines[i] = (int) count;
+    }
+
+  equivs_alloc = lines[0] + lines[1] + 1;
 #ifdef __MSDOS__
   if ((equivs = (struct equivclass HUGE *) farmalloc ((long) equivs_alloc * sizeof(struct equivclass))) == NULL)
     fatal ("far memory exhausted");
@@ -1126,7 +1344,7 @@ read_files (struct file_data filevec[], int pretend_binary, int *bin_file)
   bzero (buckets, nbuckets * sizeof (*buckets));
 
   for (i = 0; i < 2; ++i)
-    find_and_hash_each_line (&filevec[i]);
+    find_and_hash_each_line (&filevec[i], lines[i]);
 
   filevec[0].equiv_max = filevec[1].equiv_max = equivs_index;
 
@@ -0,0 +1,47 @@
+// Copy-on-write file views for slurp(), so huge files are compared in the page cache
+#include "pch.h"
+#include <io.h>
+#include <cstdint>
+#include <Windows.h>
+
+/**
+ * @brief Map a whole file into memory as a private, copy-on-write view.
+ * The view ends at a page boundary. The rest of its last page is zeroed
+ * memory which can be written without changing the file.
+ * @param [in] fd Descriptor of the file.
+ * @param [in] reserve Number of bytes which must be writable after the file contents.
+ * @param [out] size Size of the file.
+ * @return Address of the view, nullptr if the file is empty, too large or
+ * has less than @p reserve bytes left in its last page.
+ */
+extern "C" char *mymapfile(int fd, size_t reserve, size_t *size)
+{
+	HANDLE hFile = reinterpret_cast<HANDLE>(_get_osfhandle(fd));
+	LARGE_INTEGER fileSize;
+	if (hFile == INVALID_HANDLE_VALUE || !GetFileSizeEx(hFile, &fileSize) ||
+		fileSize.QuadPart == 0 || static_cast<ULONGLONG>(fileSize.QuadPart) > SIZE_MAX - reserve)
+		return nullptr;
+
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	const ULONGLONG tail = (si.dwPageSize - fileSize.QuadPart % si.dwPageSize) % si.dwPageSize;
+	if (tail < reserve)
+		return nullptr;
+
+	HANDLE hMapping = CreateFileMapping(hFile, nullptr, PAGE_WRITECOPY, fileSize.HighPart, fileSize.LowPart, nullptr);
+	if (hMapping == nullptr)
+		return nullptr;
+	void *view = MapViewOfFile(hMapping, FILE_MAP_COPY, 0, 0, static_cast<SIZE_T>(fileSize.QuadPart));
+	// The view keeps the mapping alive
+	CloseHandle(hMapping);
+	if (view == nullptr)
+		return nullptr;
+	*size = static_cast<size_t>(fileSize.QuadPart);
+	return static_cast<char *>(view);
+}
+
+/** @brief Release a view returned by mymapfile(). */
+extern "C" void myunmapfile(char *view)
+{
+	UnmapViewOfFile(view);
+}
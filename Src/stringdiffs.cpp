@@ -11,10 +11,16 @@
 #include <Windows.h>
 #include <cassert>
 #include <chrono>
+#include <unordered_map>
 #include "CompareOptions.h"
 #include "stringdiffsi.h"
 #include "Diff3.h"
 
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
+
 using std::vector;
 
 namespace strdiff
@@ -23,6 +29,31 @@ namespace strdiff
 static tchar_t *BreakChars = nullptr;
 static tchar_t BreakCharDefaults[] = _T(",.;:");
 static const int TimeoutMilliSeconds = 500;
+/** @brief Max number of edit script elements onp() makes for a whole line. */
+static const size_t MaxEditCost = 2 * 1024 * 1024;
+/** @brief Max edit script elements per word of a range between anchors. */
+static const size_t GapEditCostPerWord = 16;
+/** @brief Max nesting of ranges between anchors. */
+static const int MaxAnchorDepth = 8;
+/** @brief Larger onp() buffers are freed after use. */
+static const size_t MaxKeptEditCost = 256 * 1024;
+
+/** @brief Step of the O(NP) algorithm, linked to the previous step of its path. */
+struct EditScriptElem
+{
+	int neq; /**< Number of equal words after the edit */
+	int pi; /**< Index of the previous element, -1 at the start */
+	char op; /**< '+' or '-' */
+};
+
+/** @brief Buffers of onp(), kept for the next calls in the same thread. */
+struct OnpScratch
+{
+	std::vector<int> fp;
+	std::vector<int> last; /**< Index of the last element of each diagonal */
+	std::vector<EditScriptElem> es;
+};
+static thread_local OnpScratch onpScratch;
 
 static bool isSafeWhitespace(tchar_t ch);
 static bool isWordBreak(int breakType, const tchar_t *str, int index);
@@ -92,12 +123,13 @@ struct Comp02Functor
  */
 std::vector<wdiff>
 ComputeWordDiffs(int nFiles, const String *str,
-	bool case_sensitive, bool eol_sensitive, int whitespace, bool ignore_numbers, int breakType, bool byte_level)
+	bool case_sensitive, bool eol_sensitive, int whitespace, bool ignore_numbers, int breakType, bool byte_level,
+	const std::atomic_bool *pCanceled/* = nullptr*/)
 {
 	std::vector<wdiff> diffs;
 	if (nFiles == 2)
 	{
-		stringdiffs sdiffs(str[0], str[1], case_sensitive, eol_sensitive, whitespace, ignore_numbers, breakType, &diffs);
+		stringdiffs sdiffs(str[0], str[1], case_sensitive, eol_sensitive, whitespace, ignore_numbers, breakType, &diffs, pCanceled);
 		// Hash all words in both lines and then compare them word by word
 		// storing differences into m_wdiffs
 		sdiffs.BuildWordDiffList();
@@ -113,7 +145,7 @@ ComputeWordDiffs(int nFiles, const String *str,
 	{
 		if (str[0].empty())
 		{
-			stringdiffs sdiffs(str[1], str[2], case_sensitive, eol_sensitive, whitespace, ignore_numbers, breakType, &diffs);
+			stringdiffs sdiffs(str[1], str[2], case_sensitive, eol_sensitive, whitespace, ignore_numbers, breakType, &diffs, pCanceled);
 			sdiffs.BuildWordDiffList();
 			if (byte_level)
 				sdiffs.wordLevelToByteLevel();
@@ -131,7 +163,7 @@ ComputeWordDiffs(int nFiles, const String *str,
 		}
 		else if (str[1].empty())
 		{
-			stringdiffs sdiffs(str[0], str[2], case_sensitive, eol_sensitive, whitespace, ignore_numbers, breakType, &diffs);
+			stringdiffs sdiffs(str[0], str[2], case_sensitive, eol_sensitive, whitespace, ignore_numbers, breakType, &diffs, pCanceled);
 			sdiffs.BuildWordDiffList();
 			if (byte_level)
 				sdiffs.wordLevelToByteLevel();
@@ -149,7 +181,7 @@ ComputeWordDiffs(int nFiles, const String *str,
 		}
 		else if (str[2].empty())
 		{
-			stringdiffs sdiffs(str[0], str[1], case_sensitive, eol_sensitive, whitespace, ignore_numbers, breakType, &diffs);
+			stringdiffs sdiffs(str[0], str[1], case_sensitive, eol_sensitive, whitespace, ignore_numbers, breakType, &diffs, pCanceled);
 			sdiffs.BuildWordDiffList();
 			if (byte_level)
 				sdiffs.wordLevelToByteLevel();
@@ -168,8 +200,8 @@ ComputeWordDiffs(int nFiles, const String *str,
 		else
 		{
 			std::vector<wdiff> diffs10, diffs12;
-			stringdiffs sdiffs10(str[1], str[0], case_sensitive, eol_sensitive, 0, ignore_numbers, breakType, &diffs10);
-			stringdiffs sdiffs12(str[1], str[2], case_sensitive, eol_sensitive, 0, ignore_numbers, breakType, &diffs12);
+			stringdiffs sdiffs10(str[1], str[0], case_sensitive, eol_sensitive, 0, ignore_numbers, breakType, &diffs10, pCanceled);
+			stringdiffs sdiffs12(str[1], str[2], case_sensitive, eol_sensitive, 0, ignore_numbers, breakType, &diffs12, pCanceled);
 			// Hash all words in both lines and then compare them word by word
 			// storing differences into m_wdiffs
 			sdiffs10.BuildWordDiffList();
@@ -229,7 +261,7 @@ int Compare(const String& str1, const String& str2,
  */
 stringdiffs::stringdiffs(const String & str1, const String & str2,
 	bool case_sensitive, bool eol_sensitive, int whitespace, bool ignore_numbers, int breakType,
-	std::vector<wdiff> * pDiffs)
+	std::vector<wdiff> * pDiffs, const std::atomic_bool *pCanceled/* = nullptr*/)
 : m_str1(str1)
 , m_str2(str2)
 , m_whitespace(whitespace)
@@ -239,6 +271,7 @@ stringdiffs::stringdiffs(const String & str1, const String & str2,
 , m_ignore_numbers(ignore_numbers)
 , m_pDiffs(pDiffs)
 , m_matchblock(true) // Change to false to get word to word compare
+, m_pCanceled(pCanceled)
 {
 }
 
@@ -282,15 +315,31 @@ stringdiffs::debugoutput()
 }
 #endif
 
-bool
+void
 stringdiffs::BuildWordDiffList_DP()
 {
-	std::vector<char> edscript;
+	const int M = static_cast<int>(m_words1.size() - 1);
+	const int N = static_cast<int>(m_words2.size() - 1);
+	std::vector<char> ses;
+	if (onp(0, M, 0, N, ses, MaxEditCost) < 0)
+	{
+		// Too many differences to find the shortest edit script in time
+		ses.clear();
+		anchorDiff(0, M, 0, N, ses, 0);
+	}
 
-	//if (dp(edscript) <= 0)
-	//	return false;
-	if (onp(edscript) < 0)
-		return false;
+	// A deleted word next to an inserted word is a changed word
+	std::vector<char> edscript;
+	for (size_t n = 0; n < ses.size(); n++)
+	{
+		char c = ses[n];
+		if ((c == '+' || c == '-') && n + 1 < ses.size() && ses[n + 1] == "+-"[c == '+'])
+		{
+			c = '!';
+			n++;
+		}
+		edscript.push_back(c);
+	}
 
 	int i = 1, j = 1;
 	for (size_t k = 0; k < edscript.size(); k++)
@@ -374,7 +423,6 @@ stringdiffs::BuildWordDiffList_DP()
 #ifdef STRINGDIFF_LOGGING
 	debugoutput();
 #endif
-	return true;
 }
 
 /**
@@ -385,26 +433,8 @@ stringdiffs::BuildWordDiffList()
 {
 	m_words1 = BuildWordsArray(m_str1);
 	m_words2 = BuildWordsArray(m_str2);
-
-	bool succeeded = false;
-#ifdef _WIN64
-	if (m_words1.size() < 20480 && m_words2.size() < 20480)
-#else
-	if (m_words1.size() < 2048 && m_words2.size() < 2048)
-#endif
-	{
-		succeeded = BuildWordDiffList_DP();
-	}
-	if (!succeeded)
-	{
-		int s1 = m_words1[0].start;
-		int e1 = m_words1[m_words1.size() - 1].end;
-		int s2 = m_words2[0].start;
-		int e2 = m_words2[m_words2.size() - 1].end;
-		m_wdiffs.emplace_back(s1, e1, s2, e2);
-		return;
-	}
-
+	m_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(TimeoutMilliSeconds);
+	BuildWordDiffList_DP();
 }
 
 /**
@@ -578,140 +608,245 @@ stringdiffs::AreWordsSame(const word& word1, const word& word2) const
 
 /**
  * @ brief An O(NP) Sequence Comparison Algorithm. Sun Wu, Udi Manber, Gene Myers
+ * Compares words [offset1 + 1, offset1 + M] of the first string with words
+ * [offset2 + 1, offset2 + N] of the second one, and appends the edit script
+ * to @p ses: '=' for an equal word, '-' for a word of the first string
+ * only, '+' for a word of the second string only.
+ * @param [in] maxCost Max number of edit script elements to make.
+ * @return Number of deleted and inserted words, -1 if @p maxCost or the
+ * time limit is exceeded, @p ses is not changed then.
  */
 int
-stringdiffs::onp(std::vector<char> &edscript)
+stringdiffs::onp(int offset1, int M, int offset2, int N, std::vector<char> &ses, size_t maxCost)
 {
-	auto start = std::chrono::system_clock::now();
-
-	int M = static_cast<int>(m_words1.size() - 1);
-	int N = static_cast<int>(m_words2.size() - 1);
 	const bool exchanged = (M > N);
 	if (exchanged)
 		std::swap(M, N);
 
-	int *fp = (new int[(M+1) + 1 + (N+1)]) + (M+1);
-	struct EditScriptElem { int op; int neq; int pk; int pi; };
-	std::vector<EditScriptElem> *es = (new std::vector<EditScriptElem>[(M+1) + 1 + (N+1)]) + (M+1);
+	OnpScratch& scratch = onpScratch;
+	scratch.fp.assign((M+1) + 1 + (N+1), -1);
+	scratch.last.assign((M+1) + 1 + (N+1), -1);
+	scratch.es.clear();
+	int *fp = scratch.fp.data() + (M+1);
+	int *last = scratch.last.data() + (M+1);
+	std::vector<EditScriptElem>& es = scratch.es;
 	int DELTA = N - M;
 	
-	auto addEditScriptElem = [&es, &fp](int k) {
+	auto addEditScriptElem = [&es, fp, last](int k) {
 		EditScriptElem ese;
+		int pk;
 		if (fp[k - 1] + 1 > fp[k + 1])
 		{
 			ese.op = '+';
 			ese.neq = fp[k] - (fp[k - 1] + 1);
-			ese.pk = k - 1;
+			pk = k - 1;
 		}
 		else
 		{
 			ese.op = '-';
 			ese.neq = fp[k] - fp[k + 1];
-			ese.pk = k + 1;
+			pk = k + 1;
 		}
-		ese.pi = static_cast<int>(es[ese.pk].size() - 1);
-		es[k].push_back(ese);
+		ese.pi = last[pk];
+		last[k] = static_cast<int>(es.size());
+		es.push_back(ese);
 	};
 
 	const int COUNTMAX = 100000;
 	int count = 0;
 	int k;
-	for (k = -(M+1); k <= (N+1); k++)
-		fp[k] = -1; 
 	int p = -1;
 	do
 	{
 		p++;
 		for (k = -p; k <= DELTA-1; k++)
 		{
-			fp[k] = snake(k, std::max(fp[k-1] + 1, fp[k+1]), M, N, exchanged);
+			fp[k] = snake(k, std::max(fp[k-1] + 1, fp[k+1]), M, N, exchanged, offset1, offset2);
 			addEditScriptElem(k);
 			count++;
 		}
 		for (k = DELTA + p; k >= DELTA+1; k--)
 		{
-			fp[k] = snake(k, std::max(fp[k-1] + 1, fp[k+1]), M, N, exchanged);
+			fp[k] = snake(k, std::max(fp[k-1] + 1, fp[k+1]), M, N, exchanged, offset1, offset2);
 			addEditScriptElem(k);
 			count++;
 		}
 		k = DELTA;
-		fp[k] = snake(k, std::max(fp[k-1] + 1, fp[k+1]), M, N, exchanged);
+		fp[k] = snake(k, std::max(fp[k-1] + 1, fp[k+1]), M, N, exchanged, offset1, offset2);
 		addEditScriptElem(k);
 		count++;
 
+		bool bGiveUp = (es.size() > maxCost);
 		if (count > COUNTMAX)
 		{
 			count = 0;
-			auto end = std::chrono::system_clock::now();
-			auto msec = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
-			if (msec > TimeoutMilliSeconds)
-			{
-				delete [] (es - (M+1));
-				delete [] (fp - (M+1));
-				return -1;
-			}
+			if (IsTimedOut())
+				bGiveUp = true;
+		}
+		if (bGiveUp)
+		{
+			if (es.capacity() > MaxKeptEditCost)
+				std::vector<EditScriptElem>().swap(es);
+			return -1;
 		}
 	} while (fp[k] != N);
 
-	edscript.clear();
-
-	std::vector<char> ses;
-	int i;
-	for (k = DELTA, i = static_cast<int>(es[DELTA].size() - 1); i >= 0;)
-	{
-		EditScriptElem& esi = es[k][i];
-		for (int j = 0; j < esi.neq; ++j)
-			ses.push_back('=');
-		ses.push_back(static_cast<char>(esi.op));
-		i = esi.pi;
-		k = esi.pk;
-	}
-	std::reverse(ses.begin(), ses.end());
-
+	// The first element enters the start point and is not an edit
+	const size_t start = ses.size();
 	int D = 0;
-	for (size_t n = 1, cnt = ses.size(); n < cnt; n++)
+	for (int i = last[DELTA]; i >= 0; i = es[i].pi)
 	{
-		char c = '!';
-		int ch = ses[n];
-		bool is_plus = (ch == '+');
-		if (is_plus || ch == '-')
+		const EditScriptElem& esi = es[i];
+		ses.insert(ses.end(), esi.neq, '=');
+		if (es[i].pi >= 0)
 		{
-			if (n != (cnt - 1) && ses[n + 1] == "+-"[is_plus])
-				n++;
-			else
-				c = "+-"[exchanged == is_plus]; //('+' : exchanged ? '-' : '+'); ('-' : exchanged ? '+' : '-')
+			ses.push_back(exchanged ? "+-"[esi.op == '+'] : esi.op);
 			D++;
 		}
-		else
-			c = '=';
-		edscript.push_back(c);
 	}
-		
-	delete [] (es - (M+1));
-	delete [] (fp - (M+1));
+	std::reverse(ses.begin() + start, ses.end());
+
+	if (es.capacity() > MaxKeptEditCost)
+		std::vector<EditScriptElem>().swap(es);
 
 	return D;
 }
 
 int
-stringdiffs::snake(int k, int y, int M, int N, bool exchanged) const
+stringdiffs::snake(int k, int y, int M, int N, bool exchanged, int offset1, int offset2) const
 {
 	int x = y - k;
 	if (exchanged)
 	{
-		while (x < M && y < N && AreWordsSame(m_words1[y + 1], m_words2[x + 1])) {
+		while (x < M && y < N && AreWordsSame(m_words1[offset1 + y + 1], m_words2[offset2 + x + 1])) {
 			x++; y++;
 		}
 	}
 	else
 	{
-		while (x < M && y < N && AreWordsSame(m_words1[x + 1], m_words2[y + 1])) {
+		while (x < M && y < N && AreWordsSame(m_words1[offset1 + x + 1], m_words2[offset2 + y + 1])) {
 			x++; y++;
 		}
 	}
 	return y;
 }
 
+/**
+ * @brief Compare words without the shortest edit script, for lines too
+ * different to find it in time.
+ * Words which occur once in both ranges are matched in the longest
+ * increasing sequence (as in patience diff), and the words between such
+ * anchors are compared again. Ranges still too different are replaced as
+ * a whole. Appends the edit script to @p ses, see onp().
+ */
+void
+stringdiffs::anchorDiff(int offset1, int M, int offset2, int N, std::vector<char> &ses, int depth)
+{
+	// Equal words at both ends
+	int prefix = 0;
+	while (prefix < M && prefix < N && AreWordsSame(m_words1[offset1 + prefix + 1], m_words2[offset2 + prefix + 1]))
+		prefix++;
+	int suffix = 0;
+	while (suffix < M - prefix && suffix < N - prefix && AreWordsSame(m_words1[offset1 + M - suffix], m_words2[offset2 + N - suffix]))
+		suffix++;
+	ses.insert(ses.end(), prefix, '=');
+	offset1 += prefix;
+	offset2 += prefix;
+	M -= prefix + suffix;
+	N -= prefix + suffix;
+
+	if (M == 0 || N == 0)
+	{
+		ses.insert(ses.end(), M, '-');
+		ses.insert(ses.end(), N, '+');
+	}
+	else if (depth == 0 || onp(offset1, M, offset2, N, ses, (std::min)((M + N) * GapEditCostPerWord, MaxEditCost)) < 0)
+	{
+		std::vector<std::pair<int, int>> anchors;
+		if (depth < MaxAnchorDepth && !IsTimedOut())
+		{
+			// Count the words by hash, a collision only makes a word not unique
+			struct Occurrence { int count1 = 0, count2 = 0, i1 = 0, i2 = 0; };
+			std::unordered_map<unsigned, Occurrence> occurrences;
+			occurrences.reserve(M + N);
+			for (int i = 1; i <= M; i++)
+			{
+				const word& w = m_words1[offset1 + i];
+				if (!IsAnchor(w))
+					continue;
+				Occurrence& o = occurrences[static_cast<unsigned>(w.hash)];
+				o.count1++;
+				o.i1 = i;
+			}
+			for (int j = 1; j <= N; j++)
+			{
+				const word& w = m_words2[offset2 + j];
+				if (!IsAnchor(w))
+					continue;
+				auto it = occurrences.find(static_cast<unsigned>(w.hash));
+				if (it != occurrences.end())
+				{
+					it->second.count2++;
+					it->second.i2 = j;
+				}
+			}
+			std::vector<std::pair<int, int>> pairs;
+			for (int i = 1; i <= M; i++)
+			{
+				const word& w = m_words1[offset1 + i];
+				if (!IsAnchor(w))
+					continue;
+				const Occurrence& o = occurrences[static_cast<unsigned>(w.hash)];
+				if (o.count1 == 1 && o.count2 == 1 && AreWordsSame(w, m_words2[offset2 + o.i2]))
+					pairs.emplace_back(i, o.i2);
+			}
+
+			// Longest increasing sequence of the second indexes
+			std::vector<int> tails; // index in pairs of the last pair of each sequence length
+			std::vector<int> prev(pairs.size(), -1);
+			for (int n = 0; n < static_cast<int>(pairs.size()); n++)
+			{
+				auto it = std::lower_bound(tails.begin(), tails.end(), pairs[n].second,
+					[&pairs](int t, int j) { return pairs[t].second < j; });
+				if (it != tails.begin())
+					prev[n] = *(it - 1);
+				if (it == tails.end())
+					tails.push_back(n);
+				else
+					*it = n;
+			}
+			for (int n = tails.empty() ? -1 : tails.back(); n >= 0; n = prev[n])
+				anchors.push_back(pairs[n]);
+			std::reverse(anchors.begin(), anchors.end());
+		}
+
+		if (anchors.empty())
+		{
+			// Changed words, then the deleted or inserted ones
+			for (int n = (std::min)(M, N); n > 0; n--)
+			{
+				ses.push_back('-');
+				ses.push_back('+');
+			}
+			ses.insert(ses.end(), M - (std::min)(M, N), '-');
+			ses.insert(ses.end(), N - (std::min)(M, N), '+');
+		}
+		else
+		{
+			int i = 0, j = 0;
+			for (const auto& [i1, j1] : anchors)
+			{
+				anchorDiff(offset1 + i, i1 - i - 1, offset2 + j, j1 - j - 1, ses, depth + 1);
+				ses.push_back('=');
+				i = i1;
+				j = j1;
+			}
+			anchorDiff(offset1 + i, M - i, offset2 + j, N - j, ses, depth + 1);
+		}
+	}
+	ses.insert(ses.end(), suffix, '=');
+}
+
 /**
  * @brief Return true if chars match
  *
@@ -790,6 +925,67 @@ isWordBreak(int breakType, const tchar_t *str, int index)
 }
 
 
+/**
+ * @brief Count the equal characters at the start of two strings.
+ * @param [in] len Max number of characters to compare.
+ */
+static size_t
+CommonPrefixLength(const tchar_t *str1, const tchar_t *str2, size_t len)
+{
+	size_t i = 0;
+#ifdef USE_SSE2
+	if constexpr (sizeof(tchar_t) == 2)
+	{
+		for (; i + 8 <= len; i += 8)
+		{
+			const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(str1 + i));
+			const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(str2 + i));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi16(a, b)) != 0xffff)
+				break;
+		}
+	}
+#endif
+	while (i < len && str1[i] == str2[i])
+		++i;
+	return i;
+}
+
+/**
+ * @brief Count the equal characters at the end of two strings.
+ * @param [in] end1, end2 End of the strings.
+ * @param [in] len Max number of characters to compare.
+ */
+static size_t
+CommonSuffixLength(const tchar_t *end1, const tchar_t *end2, size_t len)
+{
+	size_t i = 0;
+#ifdef USE_SSE2
+	if constexpr (sizeof(tchar_t) == 2)
+	{
+		for (; i + 8 <= len; i += 8)
+		{
+			const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(end1 - i - 8));
+			const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(end2 - i - 8));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi16(a, b)) != 0xffff)
+				break;
+		}
+	}
+#endif
+	while (i < len && end1[-1 - static_cast<ptrdiff_t>(i)] == end2[-1 - static_cast<ptrdiff_t>(i)])
+		++i;
+	return i;
+}
+
+/**
+ * @brief Is there a glyph boundary before str[index] whatever the text around?
+ * True between two ASCII characters, except in CR LF.
+ */
+static inline bool
+isAsciiBoundary(const tchar_t *str, size_t index)
+{
+	return str[index - 1] < 0x80 && str[index] < 0x80 && !(str[index - 1] == '\r' && str[index] == '\n');
+}
+
 /**
  * @brief advance current pointer over whitespace, until not whitespace or beyond end
  * @param pcurrent [in,out] current location (to be advanced)
@@ -891,6 +1087,22 @@ stringdiffs::ComputeByteDiff(const String & str1, const String & str2,
 		end[1] = len2 - 1;
 		return;
 	}
+	// Skip equal characters at once, up to a glyph boundary in both strings
+	// which the loop below would also reach
+	if (xwhite == WHITESPACE_COMPARE_ALL)
+	{
+		size_t n = CommonPrefixLength(py1, py2, (std::min)(pen1 - py1, pen2 - py2));
+		while (n > 0 && !(isAsciiBoundary(py1, n) && isAsciiBoundary(py2, n)))
+			--n;
+		if (n > 0)
+		{
+			py1 += n;
+			py2 += n;
+			pIterCharBegin1->following(static_cast<int32_t>(py1 - pbeg1 - 1));
+			pIterCharBegin2->following(static_cast<int32_t>(py2 - pbeg2 - 1));
+		}
+	}
+
 	// Advance over matching beginnings of lines
 	// Advance py1 & py2 from beginning until find difference or end
 	while (true)
@@ -959,6 +1171,23 @@ stringdiffs::ComputeByteDiff(const String & str1, const String & str2,
 	const tchar_t *pz1 = pen1;
 	const tchar_t *pz2 = pen2;
 
+	// Skip equal characters at the ends at once, like above
+	if (xwhite == WHITESPACE_COMPARE_ALL && py1 <= pen1 && py2 <= pen2)
+	{
+		size_t n = CommonSuffixLength(pbeg1 + len1, pbeg2 + len2, (std::min)(pbeg1 + len1 - py1, pbeg2 + len2 - py2));
+		// The character before the boundary must be equal too
+		n = (n > 0) ? n - 1 : 0;
+		while (n > 0 && !(isAsciiBoundary(pbeg1, len1 - n) && isAsciiBoundary(pbeg2, len2 - n)))
+			--n;
+		if (n > 0)
+		{
+			pz1 = pbeg1 + pIterCharEnd1->preceding(static_cast<int32_t>(len1 - n));
+			pz2 = pbeg2 + pIterCharEnd2->preceding(static_cast<int32_t>(len2 - n));
+			glyphlenz1 = pbeg1 + len1 - n - pz1;
+			glyphlenz2 = pbeg2 + len2 - n - pz2;
+		}
+	}
+
 	// Retreat over matching ends of lines
 	// Retreat pz1 & pz2 from end until find difference or beginning
 	while (true)
@@ -8,6 +8,7 @@
 
 #include "UnicodeString.h"
 #include <vector>
+#include <atomic>
 
 namespace strdiff
 {
@@ -38,7 +39,8 @@ void SetBreakChars(const tchar_t *breakChars);
 std::vector<wdiff> ComputeWordDiffs(const String& str1, const String& str2,
 	bool case_sensitive, bool eol_sensitive, int whitespace, bool ignore_numbers, int breakType, bool byte_level);
 std::vector<wdiff> ComputeWordDiffs(int nStrings, const String *str, 
-                   bool case_sensitive, bool eol_sensitive, int whitespace, bool ignore_numbers, int breakType, bool byte_level);
+                   bool case_sensitive, bool eol_sensitive, int whitespace, bool ignore_numbers, int breakType, bool byte_level,
+                   const std::atomic_bool *pCanceled = nullptr);
 int Compare(const String& str1, const String& str2,
 	bool case_sensitive, bool eol_sensitive, int whitespace, bool ignore_numbers);
 
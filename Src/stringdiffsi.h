@@ -7,6 +7,8 @@
 #pragma once
 
 #include <vector>
+#include <chrono>
+#include <atomic>
 #include "utils/icu.hpp"
 
 // Uncomment this to see stringdiff log messages
@@ -48,7 +50,7 @@ class stringdiffs
 public:
 	stringdiffs(const String & str1, const String & str2,
 		bool case_sensitive, bool eol_sensitive, int whitespace, bool ignore_numbers, int breakType,
-		std::vector<wdiff> * pDiffs);
+		std::vector<wdiff> * pDiffs, const std::atomic_bool *pCanceled = nullptr);
 
 	~stringdiffs();
 
@@ -98,10 +100,25 @@ private:
 	{
 		return (word1.bBreak == dleol);
 	}
-	bool BuildWordDiffList_DP();
+	/**
+	 * @brief Can this block be matched as a unique word by anchorDiff()?
+	 */
+	inline bool IsAnchor(const word & word1) const
+	{
+		return !IsSpace(word1) && !IsEOL(word1) && !IsNumber(word1);
+	}
+	void BuildWordDiffList_DP();
 	int dp(std::vector<char> & edscript);
-	int onp(std::vector<char> & edscript);
-	int snake(int k, int y, int M, int N, bool exchanged) const;
+	int onp(int offset1, int M, int offset2, int N, std::vector<char> & ses, size_t maxCost);
+	int snake(int k, int y, int M, int N, bool exchanged, int offset1, int offset2) const;
+	void anchorDiff(int offset1, int M, int offset2, int N, std::vector<char> & ses, int depth);
+	/**
+	 * @brief Is the shortest edit script no longer worth looking for?
+	 */
+	inline bool IsTimedOut() const
+	{
+		return (m_pCanceled != nullptr && *m_pCanceled) || std::chrono::steady_clock::now() > m_deadline;
+	}
 #ifdef STRINGDIFF_LOGGING
 	void debugoutput();
 #endif
@@ -120,6 +137,8 @@ private:
 	std::vector<word> m_words1;
 	std::vector<word> m_words2;
 	std::vector<wdiff> m_wdiffs;
+	std::chrono::steady_clock::time_point m_deadline; /**< Time to give up looking for the shortest edit script */
+	const std::atomic_bool *m_pCanceled; /**< Set by another thread when the result is no longer needed, may be nullptr */
 };
 
 }
@@ -134,8 +134,9 @@ struct change * diff_2_files_xdiff (struct file_data filevec[], int* bin_status,
 			for (;;)
 			{
 				//  Read a buffer's worth from both files.  
+				//  Preloaded buffers already hold the whole files.
 				for (i = 0; i < 2; i++)
-					while (filevec[i].buffered_chars < buffer_size)
+					while (!filevec[i].preloaded && filevec[i].buffered_chars < buffer_size)
 					  {
 						cio::ssize_t r = cio::read (filevec[i].desc,
 									   filevec[i].buffer	+ filevec[i].buffered_chars,
@@ -4,6 +4,7 @@
 #include "PathContext.h"
 #include "CompareEngines/BinaryCompare.h"
 #include <fstream>
+#include <vector>
 
 namespace
 {
@@ -264,6 +265,34 @@ namespace
 
 	}
 
+	TEST_F(BinaryCompareTest, LargeFile)
+	{
+		CompareEngines::BinaryCompare bc;
+		DIFFITEM di;
+		PathContext files;
+		// Large enough to be memory-mapped
+		std::vector<char> buf_left(1024 * 1024 * 9 + 1, 'A');
+		std::vector<char> buf_right(buf_left);
+
+		files.SetLeft(_T("A"));
+		files.SetRight(_T("B"));
+		di.diffFileInfo[0].size = buf_left.size();
+		di.diffFileInfo[1].size = buf_right.size();
+
+		{
+			TempFile l1("A", buf_left.data(), buf_left.size());
+			TempFile r1("B", buf_right.data(), buf_right.size());
+			EXPECT_EQ(DIFFCODE::SAME, bc.CompareFiles(files, di));
+		}
+
+		{
+			buf_right[buf_right.size() - 1] = 'B';
+			TempFile l1("A", buf_left.data(), buf_left.size());
+			TempFile r1("B", buf_right.data(), buf_right.size());
+			EXPECT_EQ(DIFFCODE::DIFF, bc.CompareFiles(files, di));
+		}
+	}
+
 	TEST_F(BinaryCompareTest, Error)
 	{
 		CompareEngines::BinaryCompare bc;
@@ -133,6 +133,110 @@ namespace
 
 	}
 
+	TEST_F(ByteCompareTest, CompareBytesAcrossBlocks)
+	{
+		CompareEngines::ByteCompare bc;
+		QuickCompareOptions option;
+		std::string filename_left  = "_tmp_.txt";
+		std::string filename_right = "_tmp_2.txt";
+
+		bc.SetCompareOptions(option);
+
+		for (size_t i = 0; i < 80; ++i)
+		{
+			std::vector<char> buf_left(WMCMPBUFF + 100);
+			memset(buf_left.data(), 'A', buf_left.size());
+			// CR/LF pairs split at every block position
+			buf_left[i] = '\r';
+			buf_left[i + 1] = '\n';
+			buf_left[WMCMPBUFF - 1] = '\r';
+			buf_left[WMCMPBUFF] = '\n';
+			buf_left[i + 200] = '\r';
+			buf_left[i + 300] = '\n';
+			std::vector<char> buf_right(buf_left);
+
+			{// same
+				TempFile file_left (filename_left,  buf_left.data(),  buf_left.size());
+				TempFile file_right(filename_right, buf_right.data(), buf_right.size());
+
+				FilePair pair(filename_left, filename_right);
+
+				EXPECT_EQ(DIFFCODE::TEXT|DIFFCODE::SAME, bc.CompareFiles(&pair.diffData));
+				EXPECT_EQ(2, pair.diffData.m_textStats[0].ncrlfs);
+				EXPECT_EQ(1, pair.diffData.m_textStats[0].ncrs);
+				EXPECT_EQ(1, pair.diffData.m_textStats[0].nlfs);
+				EXPECT_EQ(2, pair.diffData.m_textStats[1].ncrlfs);
+			}
+
+			{// diff
+				buf_right[i + 400] = 'B';
+
+				TempFile file_left (filename_left,  buf_left.data(),  buf_left.size());
+				TempFile file_right(filename_right, buf_right.data(), buf_right.size());
+
+				FilePair pair(filename_left, filename_right);
+
+				EXPECT_EQ(DIFFCODE::TEXT|DIFFCODE::DIFF, bc.CompareFiles(&pair.diffData));
+			}
+		}
+	}
+
+	TEST_F(ByteCompareTest, LargeFile)
+	{
+		CompareEngines::ByteCompare bc;
+		QuickCompareOptions option;
+		std::string filename_left  = "_tmp_.txt";
+		std::string filename_right = "_tmp_2.txt";
+		// Large enough to be memory-mapped and compared in several windows
+		std::vector<char> buf_left(1024 * 1024 * 9 + 1, 'A');
+
+		bc.SetCompareOptions(option);
+
+		buf_left[100] = '\r';
+		buf_left[101] = '\n';
+		buf_left[1024 * 1024 * 8 - 1] = '\r';
+		buf_left[1024 * 1024 * 8] = '\n';
+		buf_left[buf_left.size() - 1] = '\n';
+		std::vector<char> buf_right(buf_left);
+
+		{// same
+			TempFile file_left (filename_left,  buf_left.data(),  buf_left.size());
+			TempFile file_right(filename_right, buf_right.data(), buf_right.size());
+
+			FilePair pair(filename_left, filename_right);
+
+			EXPECT_EQ(DIFFCODE::TEXT|DIFFCODE::SAME, bc.CompareFiles(&pair.diffData));
+			EXPECT_EQ(2, pair.diffData.m_textStats[0].ncrlfs);
+			EXPECT_EQ(1, pair.diffData.m_textStats[0].nlfs);
+			EXPECT_EQ(0, pair.diffData.m_textStats[0].ncrs);
+			EXPECT_EQ(2, pair.diffData.m_textStats[1].ncrlfs);
+		}
+
+		{// diff
+			buf_right[1024 * 1024 * 8 + 10] = 'B';
+
+			TempFile file_left (filename_left,  buf_left.data(),  buf_left.size());
+			TempFile file_right(filename_right, buf_right.data(), buf_right.size());
+
+			FilePair pair(filename_left, filename_right);
+
+			EXPECT_EQ(DIFFCODE::TEXT|DIFFCODE::DIFF, bc.CompareFiles(&pair.diffData));
+		}
+
+		{// missing trailing EOL
+			option.m_bIgnoreMissingTrailingEol = true;
+			bc.SetCompareOptions(option);
+			buf_right[1024 * 1024 * 8 + 10] = 'A';
+
+			TempFile file_left (filename_left,  buf_left.data(),  buf_left.size());
+			TempFile file_right(filename_right, buf_right.data(), buf_right.size() - 1);
+
+			FilePair pair(filename_left, filename_right);
+
+			EXPECT_EQ(DIFFCODE::TEXT|DIFFCODE::SAME, bc.CompareFiles(&pair.diffData));
+		}
+	}
+
 	TEST_F(ByteCompareTest, IgnoreAllSpace)
 	{
 		CompareEngines::ByteCompare bc;
@@ -0,0 +1,97 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include <fstream>
+#include "CompareResultCache.h"
+#include "DiffItem.h"
+#include "Environment.h"
+#include "paths.h"
+#include "TFile.h"
+
+namespace
+{
+	// The fixture for testing the compare result cache.
+	class CompareResultCacheTest : public testing::Test
+	{
+	protected:
+		CompareResultCacheTest()
+			: m_filepath(paths::ConcatPath(env::GetTemporaryPath(), _T("CompareResultCache_test.dat")))
+		{
+		}
+
+		virtual void SetUp()
+		{
+			RemoveCacheFile();
+		}
+
+		virtual void TearDown()
+		{
+			RemoveCacheFile();
+		}
+
+		void RemoveCacheFile()
+		{
+			try { TFile(m_filepath).remove(); } catch (...) {}
+		}
+
+		String m_filepath;
+	};
+
+	TEST_F(CompareResultCacheTest, LookupStored)
+	{
+		CompareResultCache cache(m_filepath);
+		EXPECT_FALSE(cache.Load());
+
+		CompareResultCache::Result result{};
+		EXPECT_FALSE(cache.Lookup(_T("key"), result));
+
+		result.code = DIFFCODE::FILE | DIFFCODE::TEXT | DIFFCODE::DIFF;
+		result.ndiffs = 3;
+		result.ntrivialdiffs = 1;
+		result.textStats[1].ncrlfs = 10;
+		cache.Store(_T("key"), result);
+
+		CompareResultCache::Result found{};
+		EXPECT_TRUE(cache.Lookup(_T("key"), found));
+		EXPECT_EQ(result.code, found.code);
+		EXPECT_EQ(3, found.ndiffs);
+		EXPECT_EQ(1, found.ntrivialdiffs);
+		EXPECT_EQ(10, found.textStats[1].ncrlfs);
+		EXPECT_FALSE(cache.Lookup(_T("other key"), found));
+	}
+
+	TEST_F(CompareResultCacheTest, SaveAndLoad)
+	{
+		CompareResultCache::Result result{};
+		result.code = DIFFCODE::FILE | DIFFCODE::BIN | DIFFCODE::SAME;
+		result.ndiffs = 0;
+		result.ntrivialdiffs = 0;
+		result.textStats[0].nzeros = 5;
+		{
+			CompareResultCache cache(m_filepath);
+			cache.Load();
+			cache.Store(_T("0 1\nC:\\left\\a.txt\t10\t20\nC:\\right\\a.txt\t10\t30"), result);
+			EXPECT_TRUE(cache.Save());
+		}
+
+		CompareResultCache cache(m_filepath);
+		EXPECT_TRUE(cache.Load());
+		CompareResultCache::Result found{};
+		EXPECT_TRUE(cache.Lookup(_T("0 1\nC:\\left\\a.txt\t10\t20\nC:\\right\\a.txt\t10\t30"), found));
+		EXPECT_EQ(result.code, found.code);
+		EXPECT_EQ(5, found.textStats[0].nzeros);
+		EXPECT_FALSE(cache.Lookup(_T("0 1\nC:\\left\\a.txt\t10\t21\nC:\\right\\a.txt\t10\t30"), found));
+	}
+
+	TEST_F(CompareResultCacheTest, DamagedFile)
+	{
+		{
+			std::ofstream ostr(ucr::toUTF8(m_filepath).c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+			ostr << "not a cache file";
+		}
+		CompareResultCache cache(m_filepath);
+		EXPECT_FALSE(cache.Load());
+		CompareResultCache::Result found{};
+		EXPECT_FALSE(cache.Lookup(_T("key"), found));
+	}
+
+}	// namespace
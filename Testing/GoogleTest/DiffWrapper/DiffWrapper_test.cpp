@@ -1,5 +1,8 @@
 #include "pch.h"
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include "DiffWrapper.h"
 #include "PathContext.h"
 #include "paths.h"
@@ -7,6 +10,7 @@
 #include "UniFile.h"
 #include "LineFiltersList.h"
 #include "SubstitutionFiltersList.h"
+#include "MovedLines.h"
 
 const TempFile WriteToTempFile(const String& text)
 {
@@ -415,3 +419,183 @@ TEST(DiffWrapper, RunFileDiff_SubstitutionFilters)
 		}
 	}
 }
+
+TEST(DiffWrapper, RunFileDiff_ThreeWayLargeFiles)
+{
+	CDiffWrapper dw;
+	DIFFOPTIONS options{};
+	DIFFRANGE dr;
+
+	// Large enough to compare the file pairs concurrently
+	String base;
+	for (int i = 0; i < 30000; ++i)
+		base += strutils::format(_T("line %d\n"), i);
+	String left = base;
+	left.replace(left.find(_T("line 100\n")), 8, _T("changed1"));
+	String right = base;
+	right.replace(right.find(_T("line 20000\n")), 10, _T("changed3"));
+
+	for (auto algo : { DIFF_ALGORITHM_DEFAULT, DIFF_ALGORITHM_HISTOGRAM })
+	{
+		options.nDiffAlgorithm = algo;
+
+		DiffList diffList;
+		TempFile leftFile = WriteToTempFile(left);
+		TempFile middleFile = WriteToTempFile(base);
+		TempFile rightFile = WriteToTempFile(right);
+		dw.SetCreateDiffList(&diffList);
+		dw.SetPaths({ leftFile.GetPath(), middleFile.GetPath(), rightFile.GetPath() }, false);
+		dw.SetOptions(&options);
+		EXPECT_TRUE(dw.RunFileDiff());
+		ASSERT_EQ(2, diffList.GetSize());
+		diffList.GetDiff(0, dr);
+		EXPECT_EQ(OP_1STONLY, dr.op);
+		EXPECT_EQ(100, dr.begin[0]);
+		EXPECT_EQ(100, dr.begin[1]);
+		EXPECT_EQ(100, dr.begin[2]);
+		diffList.GetDiff(1, dr);
+		EXPECT_EQ(OP_3RDONLY, dr.op);
+		EXPECT_EQ(20000, dr.begin[0]);
+		EXPECT_EQ(20000, dr.begin[1]);
+		EXPECT_EQ(20000, dr.begin[2]);
+	}
+}
+
+TEST(DiffWrapper, RunFileDiff_Buffers)
+{
+	CDiffWrapper dw;
+	DIFFOPTIONS options{};
+	DIFFRANGE dr;
+	DIFFSTATUS status;
+
+	for (auto algo : { DIFF_ALGORITHM_DEFAULT, DIFF_ALGORITHM_MINIMAL, DIFF_ALGORITHM_PATIENCE, DIFF_ALGORITHM_HISTOGRAM, DIFF_ALGORITHM_NONE })
+	{
+		options.nDiffAlgorithm = algo;
+
+		{
+			DiffList diffList;
+			const std::string buffers[] = { "\xEF\xBB\xBF" "a\nb\nc1", "\xEF\xBB\xBF" "a\nb\nc2\n" };
+			dw.SetCreateDiffList(&diffList);
+			dw.SetPaths({ _T("left.txt"), _T("right.txt") }, true);
+			dw.SetOptions(&options);
+			EXPECT_TRUE(dw.RunFileDiff(buffers));
+			EXPECT_EQ(1, diffList.GetSize());
+			diffList.GetDiff(0, dr);
+			EXPECT_EQ(2, dr.begin[0]);
+			EXPECT_EQ(2, dr.begin[1]);
+			EXPECT_EQ(2, dr.end[0]);
+			EXPECT_EQ(2, dr.end[1]);
+			dw.GetDiffStatus(&status);
+			EXPECT_FALSE(status.bBinaries);
+			EXPECT_TRUE(status.bMissingNL[0]);
+			EXPECT_FALSE(status.bMissingNL[1]);
+		}
+	}
+
+	{
+		CDiffWrapper dwBinary;
+		DiffList diffList;
+		const std::string buffers[] = { std::string("a\0b", 3), std::string("a\0c", 3) };
+		dwBinary.SetCreateDiffList(&diffList);
+		dwBinary.SetPaths({ _T("left.bin"), _T("right.bin") }, true);
+		dwBinary.SetOptions(&options);
+		EXPECT_TRUE(dwBinary.RunFileDiff(buffers));
+		dwBinary.GetDiffStatus(&status);
+		EXPECT_TRUE(status.bBinaries);
+		EXPECT_EQ(IDENTLEVEL::NONE, status.Identical);
+	}
+}
+
+TEST(DiffWrapper, RunFileDiff_MovedBlocks)
+{
+	CDiffWrapper dw;
+	DIFFOPTIONS options{};
+	DiffList diffList;
+	TempFile left = WriteToTempFile(_T("a\nb\nc\nd\nx1\nx2\n"));
+	TempFile right = WriteToTempFile(_T("x1\nx2\na\nb\nc\nd\n"));
+	dw.SetCreateDiffList(&diffList);
+	dw.SetPaths({ left.GetPath(), right.GetPath() }, false);
+	dw.SetOptions(&options);
+	dw.SetDetectMovedBlocks(true);
+	dw.RunFileDiff();
+	EXPECT_EQ(2, diffList.GetSize());
+	EXPECT_EQ(0, dw.GetMovedLines(0)->LineInBlock(4, MovedLines::SIDE::RIGHT));
+	EXPECT_EQ(1, dw.GetMovedLines(0)->LineInBlock(5, MovedLines::SIDE::RIGHT));
+	EXPECT_EQ(4, dw.GetMovedLines(1)->LineInBlock(0, MovedLines::SIDE::LEFT));
+	EXPECT_EQ(5, dw.GetMovedLines(1)->LineInBlock(1, MovedLines::SIDE::LEFT));
+	EXPECT_EQ(-1, dw.GetMovedLines(0)->LineInBlock(0, MovedLines::SIDE::RIGHT));
+	EXPECT_EQ(-1, dw.GetMovedLines(1)->LineInBlock(2, MovedLines::SIDE::LEFT));
+}
+
+/**
+ * @brief Make two texts of lines with mixed EOLs, every 1000th line changed.
+ */
+static void MakeMixedEolTexts(int nLines, std::string buffers[2])
+{
+	for (int i = 0; i < nLines; ++i)
+	{
+		const char *eol = (i % 3 == 0) ? "\r\n" : "\n";
+		const std::string line = "\tint value" + std::to_string(i) + " = Calculate(value, " + std::to_string(i * 7) + ");";
+		buffers[0] += line + eol;
+		buffers[1] += (i % 1000 == 500 ? line + " // changed" : line) + eol;
+	}
+}
+
+TEST(DiffWrapper, RunFileDiff_MixedEolIgnoreOptions)
+{
+	std::string buffers[2];
+	MakeMixedEolTexts(20000, buffers);
+
+	for (int whitespace : { WHITESPACE_COMPARE_ALL, WHITESPACE_IGNORE_CHANGE, WHITESPACE_IGNORE_ALL })
+	{
+		for (bool ignoreCase : { false, true })
+		{
+			CDiffWrapper dw;
+			DIFFOPTIONS options{};
+			DiffList diffList;
+			DIFFRANGE dr;
+			options.nIgnoreWhitespace = whitespace;
+			options.bIgnoreCase = ignoreCase;
+			dw.SetCreateDiffList(&diffList);
+			dw.SetPaths({ _T("left.txt"), _T("right.txt") }, true);
+			dw.SetOptions(&options);
+			EXPECT_TRUE(dw.RunFileDiff(buffers));
+			ASSERT_EQ(20, diffList.GetSize());
+			diffList.GetDiff(0, dr);
+			EXPECT_EQ(500, dr.begin[0]);
+			EXPECT_EQ(500, dr.end[1]);
+		}
+	}
+}
+
+// Benchmark, run with --gtest_also_run_disabled_tests. The throughput of
+// each option set is printed and recorded as a property in the XML report.
+TEST(DiffWrapper, DISABLED_RunFileDiff_Throughput)
+{
+	std::string buffers[2];
+	MakeMixedEolTexts(200000, buffers);
+
+	for (int whitespace : { WHITESPACE_COMPARE_ALL, WHITESPACE_IGNORE_CHANGE, WHITESPACE_IGNORE_ALL })
+	{
+		for (bool ignoreCase : { false, true })
+		{
+			CDiffWrapper dw;
+			DIFFOPTIONS options{};
+			DiffList diffList;
+			options.nIgnoreWhitespace = whitespace;
+			options.bIgnoreCase = ignoreCase;
+			dw.SetCreateDiffList(&diffList);
+			dw.SetPaths({ _T("left.txt"), _T("right.txt") }, true);
+			dw.SetOptions(&options);
+			const auto start = std::chrono::steady_clock::now();
+			EXPECT_TRUE(dw.RunFileDiff(buffers));
+			const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			EXPECT_EQ(200, diffList.GetSize());
+
+			const double mbPerSec = (buffers[0].size() + buffers[1].size()) / 1e6 / (std::max)(elapsed.count(), 1e-6);
+			const std::string name = "MBps_whitespace" + std::to_string(whitespace) + (ignoreCase ? "_ignorecase" : "");
+			RecordProperty(name, static_cast<int>(mbPerSec));
+			std::printf("%s: %.1f MB/s\n", name.c_str(), mbPerSec);
+		}
+	}
+}
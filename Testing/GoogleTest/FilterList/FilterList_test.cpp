@@ -0,0 +1,95 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include "FilterList.h"
+
+namespace
+{
+	// The fixture for testing the regular expression list.
+	class FilterListTest : public testing::Test
+	{
+	protected:
+		FilterList m_filterList;
+	};
+
+	TEST_F(FilterListTest, Empty)
+	{
+		EXPECT_FALSE(m_filterList.HasRegExps());
+		EXPECT_TRUE(m_filterList.Match("abc"));
+	}
+
+	TEST_F(FilterListTest, Include)
+	{
+		m_filterList.AddRegExp("^abc");
+		m_filterList.AddRegExp("def$");
+		m_filterList.AddRegExp("g+h");
+		EXPECT_TRUE(m_filterList.HasRegExps());
+		EXPECT_TRUE(m_filterList.Match("abcxyz"));
+		EXPECT_TRUE(m_filterList.Match("xyzdef"));
+		EXPECT_TRUE(m_filterList.Match("xgggh"));
+		EXPECT_FALSE(m_filterList.Match("xabc"));
+		EXPECT_FALSE(m_filterList.Match("defx"));
+		EXPECT_FALSE(m_filterList.Match("h"));
+	}
+
+	TEST_F(FilterListTest, Exclude)
+	{
+		m_filterList.AddRegExp("\\.cpp$");
+		m_filterList.AddRegExp("^test_", true);
+		m_filterList.AddRegExp("_old\\.", true);
+		EXPECT_TRUE(m_filterList.Match("main.cpp"));
+		EXPECT_FALSE(m_filterList.Match("main.h"));
+		EXPECT_FALSE(m_filterList.Match("test_main.cpp"));
+		EXPECT_FALSE(m_filterList.Match("main_old.cpp"));
+
+		FilterList excludeOnly;
+		excludeOnly.AddRegExp("^#", true);
+		EXPECT_TRUE(excludeOnly.Match("int i;"));
+		EXPECT_FALSE(excludeOnly.Match("#include"));
+	}
+
+	TEST_F(FilterListTest, PatternsMatchedAlone)
+	{
+		// Back references, conditionals, named groups and anchors with options
+		// must keep their meaning when the list holds other expressions
+		m_filterList.AddRegExp("(a)b\\1");
+		m_filterList.AddRegExp("(x)y");
+		m_filterList.AddRegExp("(?<name>[0-9])-\\k<name>");
+		m_filterList.AddRegExp("(?<name>z)!");
+		m_filterList.AddRegExp("(?i)^begin");
+		m_filterList.AddRegExp("(p)?(?(1)q|r)");
+		EXPECT_TRUE(m_filterList.Match("aba"));
+		EXPECT_FALSE(m_filterList.Match("abx"));
+		EXPECT_TRUE(m_filterList.Match("xy"));
+		EXPECT_TRUE(m_filterList.Match("1-1"));
+		EXPECT_FALSE(m_filterList.Match("1-2"));
+		EXPECT_TRUE(m_filterList.Match("z!"));
+		EXPECT_TRUE(m_filterList.Match("BEGIN"));
+		EXPECT_FALSE(m_filterList.Match("xBEGIN"));
+		EXPECT_TRUE(m_filterList.Match("pq"));
+	}
+
+	TEST_F(FilterListTest, InvalidExpression)
+	{
+		m_filterList.AddRegExp("(abc");
+		EXPECT_FALSE(m_filterList.HasRegExps());
+		EXPECT_THROW(m_filterList.AddRegExp("(abc", false, true), std::runtime_error);
+		m_filterList.AddRegExp("abc");
+		EXPECT_TRUE(m_filterList.Match("abc"));
+	}
+
+	TEST_F(FilterListTest, CloneFrom)
+	{
+		m_filterList.AddRegExp("abc");
+		m_filterList.AddRegExp("abcd", true);
+		FilterList clone;
+		clone.AddRegExp("xyz");
+		clone.CloneFrom(&m_filterList);
+		EXPECT_TRUE(clone.Match("abc"));
+		EXPECT_FALSE(clone.Match("abcd"));
+		EXPECT_FALSE(clone.Match("xyz"));
+		m_filterList.RemoveAllFilters();
+		EXPECT_TRUE(m_filterList.Match("xyz"));
+		EXPECT_TRUE(clone.Match("abc"));
+	}
+
+}  // namespace
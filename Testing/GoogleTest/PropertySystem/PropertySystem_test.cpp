@@ -84,6 +84,25 @@ namespace
 		ASSERT_STREQ(_T("304596906e45fb5c90e4a5147350d513a091f2263ebb27247f0f968467008ac1"), ps.FormatPropertyValue(values, 4).c_str());;
 	}
 
+	TEST_F(PropertySystemTest, GetSameContentValues)
+	{
+		PropertySystem ps({ _T("Hash.MD5"), _T("Hash.SHA1"), _T("Hash.SHA256") });
+		PropertyValues values;
+		String path = paths::GetLongPath(paths::ConcatPath(env::GetProgPath(), _T("..\\..\\..\\Src\\res\\splash.jpg")));
+		ps.GetPropertyValues(path, values);
+		// Hash values are copied, the file is not read
+		PropertyValues values2;
+		ps.GetPropertyValues(path + _T(".nonexistent"), values2, &values);
+		for (unsigned i = 0; i < 3; ++i)
+		{
+			ASSERT_TRUE(values2.IsHashValue(i));
+			ASSERT_EQ(values.GetHashValue(i), values2.GetHashValue(i));
+		}
+		PropertyValues values3;
+		ps.GetPropertyValues(path + _T(".nonexistent"), values3);
+		ASSERT_TRUE(values3.GetHashValue(0).empty());
+	}
+
 }
 
 #endif
@@ -749,6 +749,28 @@ namespace
 
 	}
 
+	// Long lines with many differences
+	TEST_F(StringDiffsTest, LongLine)
+	{
+		String str1, str2;
+		for (int i = 0; i < 30000; ++i)
+		{
+			String word = _T("w") + strutils::to_str(i);
+			str1 += word + _T(" ");
+			str2 += (i % 10 == 0 ? String(_T("x")) : word) + _T(" ");
+		}
+		std::vector<strdiff::wdiff> diffs = strdiff::ComputeWordDiffs(str1, str2, true, true, 0, false, 0, false);
+		EXPECT_EQ(3000, diffs.size());
+		if (diffs.size() == 3000)
+		{
+			strdiff::wdiff* pDiff = &diffs[1];
+			EXPECT_EQ(30, pDiff->begin[0]);
+			EXPECT_EQ(32, pDiff->end[0]);
+			EXPECT_EQ(29, pDiff->begin[1]);
+			EXPECT_EQ(29, pDiff->end[1]);
+		}
+	}
+
 	TEST_F(StringDiffsTest, CompareCase)
 	{
 		int result;
@@ -59,6 +59,21 @@ namespace
 		EXPECT_EQ(0, list.GetCount());
 	}
 
+	TEST_F(SubstitutionListTest, Chained)
+	{
+		SubstitutionList list;
+		list.Add("a", "b", 0);
+		list.Add("b", "c", 0);
+		list.Add("c+", "d", 0);
+		EXPECT_EQ("d", list.Subst("abc"));
+		EXPECT_EQ("xyz", list.Subst("xyz"));
+		list.RemoveAllFilters();
+		list.Add("a", "b", false, false);
+		list.Add("(b)", "\\1\\1", Poco::RegularExpression::RE_CASELESS);
+		EXPECT_EQ("bbbb", list.Subst("Ab"));
+		EXPECT_EQ("xyz", list.Subst("xyz"));
+	}
+
 
 
 }  // namespace
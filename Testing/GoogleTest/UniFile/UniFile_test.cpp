@@ -0,0 +1,219 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include <fstream>
+#include <random>
+#include "UniFile.h"
+#include "unicoder.h"
+#include "Environment.h"
+#include "paths.h"
+#include "TFile.h"
+
+namespace
+{
+	/** @brief Block size of UniMemFile::ReadLines(), see READLINES_BLOCK_SIZE. */
+	const size_t BlockSize = 256 * 1024;
+	/** @brief Files from this size are read on several threads, see PARALLEL_READLINES_MIN_SIZE. */
+	const size_t ParallelMinSize = 4 * 1024 * 1024;
+
+	/** @brief Lines and text stats read from a file. */
+	struct ReadResult
+	{
+		std::vector<String> lines;
+		UniFile::txtstats stats;
+	};
+
+	// The fixture for testing that UniMemFile::ReadLines() reads the same
+	// lines and stats as UniMemFile::ReadString().
+	class UniFileTest : public testing::Test
+	{
+	protected:
+		UniFileTest()
+			: m_filepath(paths::ConcatPath(env::GetTemporaryPath(), _T("UniFile_test.txt")))
+			, m_random(12345)
+		{
+		}
+
+		virtual void TearDown()
+		{
+			try { TFile(m_filepath).remove(); } catch (...) {}
+		}
+
+		void WriteFile(const std::string& data)
+		{
+			std::ofstream ostr(ucr::toUTF8(m_filepath).c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+			ostr.write(data.data(), data.size());
+		}
+
+		/**
+		 * @brief Make random lines with all kinds of EOLs.
+		 * @param [in] size Approximate size of the text in bytes.
+		 * @param [in] chars Characters the lines are made of.
+		 */
+		std::string MakeLines(size_t size, const std::vector<std::string>& chars)
+		{
+			static const char *eols[] = { "\r\n", "\n", "\r" };
+			std::string text;
+			while (text.size() < size)
+			{
+				const int len = std::uniform_int_distribution<int>(0, 200)(m_random);
+				for (int i = 0; i < len; ++i)
+					text += chars[std::uniform_int_distribution<size_t>(0, chars.size() - 1)(m_random)];
+				text += eols[std::uniform_int_distribution<int>(0, 2)(m_random)];
+			}
+			return text;
+		}
+
+		/**
+		 * @brief Make text with EOLs around the place where each block is cut.
+		 * ReadLines() cuts a block at the first EOL from BlockSize bytes after
+		 * its start.
+		 * @param [in] charsize Size of a character in bytes.
+		 */
+		static std::string MakeBlockEdges(size_t charsize)
+		{
+			// Edge text placed just before the cut, and its length up to the block end
+			static const std::pair<const char *, size_t> edges[] = {
+				{ "\r\n", 2 }, // CR before the cut, LF after it
+				{ "x\r\n", 3 }, // CR LF after the cut
+				{ "x\rx\n", 2 }, // CR without LF after the cut
+				{ "x\nx", 2 }, // LF after the cut
+			};
+			std::string text;
+			size_t blockStart = 0;
+			for (const auto& [edge, cchToEnd] : edges)
+			{
+				text += std::string(blockStart + BlockSize / charsize - 1 - text.size(), 'a');
+				blockStart = text.size() + cchToEnd;
+				text += edge;
+				text += "\n";
+			}
+			return text;
+		}
+
+		/** @brief Make UCS-2LE text of 8-bit text. */
+		static std::string ToUCS2LE(const std::string& text)
+		{
+			std::string ucs2;
+			for (char ch : text)
+			{
+				ucs2 += ch;
+				ucs2 += '\0';
+			}
+			return ucs2;
+		}
+
+		bool Read(bool bReadLines, ReadResult& result)
+		{
+			UniMemFile file;
+			if (!file.OpenReadOnly(m_filepath))
+				return false;
+			if (!file.IsUnicode())
+				file.SetCodepage(1252);
+			if (bReadLines)
+			{
+				if (!file.ReadLines([&result](const tchar_t *pchLine, size_t cchLine)
+					{
+						result.lines.emplace_back(pchLine, cchLine);
+					}))
+					return false;
+			}
+			else
+			{
+				String line, eol;
+				for (;;)
+				{
+					const int64_t position = file.GetPosition();
+					bool lossy = false;
+					const bool more = file.ReadString(line, eol, &lossy);
+					line += eol;
+					if (!line.empty())
+						result.lines.push_back(line);
+					if (!more || file.GetPosition() == position)
+						break;
+				}
+			}
+			result.stats = file.GetTxtStats();
+			return true;
+		}
+
+		void ExpectSameAsReadString(const std::string& data)
+		{
+			WriteFile(data);
+			ReadResult expected, actual;
+			ASSERT_TRUE(Read(false, expected));
+			ASSERT_TRUE(Read(true, actual));
+			ASSERT_EQ(expected.lines.size(), actual.lines.size());
+			for (size_t i = 0; i < expected.lines.size(); ++i)
+				ASSERT_EQ(expected.lines[i], actual.lines[i]) << "line " << i;
+			EXPECT_EQ(expected.stats.ncrs, actual.stats.ncrs);
+			EXPECT_EQ(expected.stats.nlfs, actual.stats.nlfs);
+			EXPECT_EQ(expected.stats.ncrlfs, actual.stats.ncrlfs);
+			EXPECT_EQ(expected.stats.nzeros, actual.stats.nzeros);
+			EXPECT_EQ(expected.stats.nlosses, actual.stats.nlosses);
+		}
+
+		String m_filepath;
+		std::mt19937 m_random;
+	};
+
+	const std::string BOM_UTF8 = "\xEF\xBB\xBF";
+	const std::string BOM_UCS2LE = "\xFF\xFE";
+	const std::vector<std::string> AsciiChars = { "a", "b", " ", "\t", "1" };
+	const std::vector<std::string> Utf8Chars = { "a", " ", "\xC3\xA9", "\xE3\x81\x82", "\xF0\x9F\x98\x80" };
+	const std::vector<std::string> ZeroChars = { "a", " ", std::string(1, '\0') };
+	const std::vector<std::string> BadUtf8Chars = { "a", " ", "\xC3\xA9", "\xFF", "\xE3\x81" };
+
+	TEST_F(UniFileTest, ReadLines_BlockEdges)
+	{
+		ExpectSameAsReadString(MakeBlockEdges(1));
+		ExpectSameAsReadString(BOM_UTF8 + MakeBlockEdges(1));
+		ExpectSameAsReadString(BOM_UCS2LE + ToUCS2LE(MakeBlockEdges(2)));
+	}
+
+	TEST_F(UniFileTest, ReadLines_LastLineWithoutEol)
+	{
+		ExpectSameAsReadString(MakeLines(BlockSize * 3, AsciiChars) + "last");
+		ExpectSameAsReadString(BOM_UTF8 + MakeLines(BlockSize * 3, Utf8Chars) + "last");
+		ExpectSameAsReadString(MakeBlockEdges(1) + "last");
+		ExpectSameAsReadString("no eol");
+		ExpectSameAsReadString("");
+	}
+
+	TEST_F(UniFileTest, ReadLines_Zeros)
+	{
+		ExpectSameAsReadString(MakeLines(BlockSize * 3, ZeroChars));
+		ExpectSameAsReadString(BOM_UCS2LE + ToUCS2LE(MakeLines(BlockSize * 3, ZeroChars)));
+	}
+
+	TEST_F(UniFileTest, ReadLines_BadUtf8)
+	{
+		ExpectSameAsReadString(BOM_UTF8 + MakeLines(BlockSize * 3, BadUtf8Chars));
+		// Only the second block is lossy
+		ExpectSameAsReadString(BOM_UTF8 + MakeLines(BlockSize, Utf8Chars) + "\xFF\n" + MakeLines(BlockSize * 2, Utf8Chars));
+	}
+
+	TEST_F(UniFileTest, ReadLines_BadUtf8SwallowsBlockEnd)
+	{
+		// The incomplete sequence before the EOL ending the first block makes
+		// ReadString() read past the block, the rest is read with ReadString()
+		const std::string text = BOM_UTF8 + std::string(BlockSize - 1, 'a') + "\xE3\nabc\n";
+		ExpectSameAsReadString(text + MakeLines(BlockSize * 2, Utf8Chars));
+	}
+
+	TEST_F(UniFileTest, ReadLines_UCS2LEOddSize)
+	{
+		ExpectSameAsReadString(BOM_UCS2LE + ToUCS2LE(MakeLines(BlockSize * 3, AsciiChars)) + "x");
+		ExpectSameAsReadString(BOM_UCS2LE + ToUCS2LE(MakeBlockEdges(2)) + "x");
+		ExpectSameAsReadString(BOM_UCS2LE + "x");
+	}
+
+	TEST_F(UniFileTest, ReadLines_ParallelThreshold)
+	{
+		ExpectSameAsReadString(MakeLines(ParallelMinSize - BlockSize, AsciiChars));
+		ExpectSameAsReadString(MakeLines(ParallelMinSize + BlockSize, AsciiChars));
+		ExpectSameAsReadString(BOM_UTF8 + MakeLines(ParallelMinSize + BlockSize, Utf8Chars));
+		ExpectSameAsReadString(BOM_UTF8 + MakeLines(ParallelMinSize + BlockSize, BadUtf8Chars));
+		ExpectSameAsReadString(BOM_UCS2LE + ToUCS2LE(MakeLines(ParallelMinSize + BlockSize, ZeroChars)) + "x");
+	}
+
+}	// namespace